@@ -5,7 +5,7 @@
  * MariaDB Query Profiler - CLI Tool
  *
  * Usage:
- *   php mariadb_profiler.php job start <key>
+ *   php mariadb_profiler.php job start <key> [--sample-rate=<0..1>] [--filter-<name>=<value>] [--trigger[=<token>]]
  *   php mariadb_profiler.php job end <key>
  *   php mariadb_profiler.php job list
  *   php mariadb_profiler.php job show <key> [--tag=<tag>]  # Show parsed queries (with table/column extraction)
@@ -13,7 +13,12 @@
  *   php mariadb_profiler.php job export <key>               # Export parsed JSON to file
  *   php mariadb_profiler.php job tags <key>                 # Show tag summary
  *   php mariadb_profiler.php job callers <key>              # Show caller summary
+ *   php mariadb_profiler.php job agg <key>                  # Show per-query-shape summaries
+ *   php mariadb_profiler.php job tx <key>                   # Show transaction spans, slowest first
+ *   php mariadb_profiler.php job conns <key>                # Show connects/closes and queries per host
+ *   php mariadb_profiler.php job convert <key>              # Print all records (incl. binary log) as JSONL
  *   php mariadb_profiler.php job purge                      # Remove all completed job data
+ *   php mariadb_profiler.php collector run [--socket=<path>] # Receive logs from mariadb_profiler.collector_socket
  */
 
 // Find autoloader
@@ -37,6 +42,7 @@ if (!$autoloaded) {
     exit(1);
 }
 
+use MariadbProfiler\Collector;
 use MariadbProfiler\JobManager;
 use MariadbProfiler\SqlAnalyzer;
 
@@ -51,6 +57,11 @@ if (empty($args)) {
 // Check for --log-dir and --tag options
 $logDir = null;
 $tagFilter = null;
+$sampleRate = null;
+$socketPath = null;
+$jobFilter = [];
+$trigger = null;
+$filterNames = ['tag', 'verb', 'table', 'min-us', 'uri', 'status'];
 $filteredArgs = [];
 for ($i = 0; $i < count($args); $i++) {
     if ($args[$i] === '--log-dir' && isset($args[$i + 1])) {
@@ -63,6 +74,34 @@ for ($i = 0; $i < count($args); $i++) {
         $i++;
     } elseif (strpos($args[$i], '--tag=') === 0) {
         $tagFilter = substr($args[$i], strlen('--tag='));
+    } elseif ($args[$i] === '--sample-rate' && isset($args[$i + 1])) {
+        $sampleRate = $args[$i + 1];
+        $i++;
+    } elseif (strpos($args[$i], '--sample-rate=') === 0) {
+        $sampleRate = substr($args[$i], strlen('--sample-rate='));
+    } elseif ($args[$i] === '--socket' && isset($args[$i + 1])) {
+        $socketPath = $args[$i + 1];
+        $i++;
+    } elseif (strpos($args[$i], '--socket=') === 0) {
+        $socketPath = substr($args[$i], strlen('--socket='));
+    } elseif ($args[$i] === '--trigger') {
+        $trigger = generateTriggerToken();
+    } elseif (strpos($args[$i], '--trigger=') === 0) {
+        $trigger = substr($args[$i], strlen('--trigger='));
+    } elseif (strpos($args[$i], '--filter-') === 0) {
+        $option = substr($args[$i], strlen('--filter-'));
+        $eq = strpos($option, '=');
+        $name = $eq === false ? $option : substr($option, 0, $eq);
+        if (!in_array($name, $filterNames, true)) {
+            fwrite(STDERR, "[ERROR] Unknown filter: --filter-{$name}\n");
+            exit(1);
+        }
+        if ($eq !== false) {
+            $jobFilter[str_replace('-', '_', $name)] = substr($option, $eq + 1);
+        } elseif (isset($args[$i + 1])) {
+            $jobFilter[str_replace('-', '_', $name)] = $args[$i + 1];
+            $i++;
+        }
     } else {
         $filteredArgs[] = $args[$i];
     }
@@ -73,6 +112,17 @@ $command = isset($args[0]) ? $args[0] : '';
 $subCommand = isset($args[1]) ? $args[1] : '';
 $key = isset($args[2]) ? $args[2] : '';
 
+if ($command === 'collector') {
+    if ($subCommand !== 'run') {
+        fwrite(STDERR, "[ERROR] Unknown sub-command: {$subCommand}\n");
+        showUsage();
+        exit(1);
+    }
+    $manager = new JobManager($logDir);
+    cmdCollectorRun($manager, $socketPath);
+    exit(0);
+}
+
 if ($command !== 'job') {
     fwrite(STDERR, "[ERROR] Unknown command: {$command}\n");
     showUsage();
@@ -83,7 +133,7 @@ $manager = new JobManager($logDir);
 
 switch ($subCommand) {
     case 'start':
-        cmdJobStart($manager, $key);
+        cmdJobStart($manager, $key, $sampleRate, $jobFilter, $trigger);
         break;
     case 'end':
         cmdJobEnd($manager, $key);
@@ -106,6 +156,24 @@ switch ($subCommand) {
     case 'callers':
         cmdJobCallers($manager, $key);
         break;
+    case 'agg':
+        cmdJobAgg($manager, $key);
+        break;
+    case 'tx':
+        cmdJobTx($manager, $key);
+        break;
+    case 'conns':
+        cmdJobConns($manager, $key);
+        break;
+    case 'budget':
+        cmdJobBudget($manager, $key);
+        break;
+    case 'endpoints':
+        cmdJobEndpoints($manager, $key);
+        break;
+    case 'convert':
+        cmdJobConvert($manager, $key);
+        break;
     case 'purge':
         cmdJobPurge($manager);
         break;
@@ -119,22 +187,58 @@ switch ($subCommand) {
 // Command implementations
 // ============================================================================
 
-function cmdJobStart(JobManager $manager, $key)
+function cmdJobStart(JobManager $manager, $key, $sampleRate = null, array $filter = [], $trigger = null)
 {
+    if ($sampleRate !== null
+        && (!is_numeric($sampleRate) || $sampleRate < 0 || $sampleRate > 1)) {
+        fwrite(STDERR, "[ERROR] --sample-rate must be a number between 0 and 1.\n");
+        exit(1);
+    }
+    if (isset($filter['min_us']) && !ctype_digit((string)$filter['min_us'])) {
+        fwrite(STDERR, "[ERROR] --filter-min-us must be a whole number of microseconds.\n");
+        exit(1);
+    }
+    if (isset($filter['status']) && $filter['status'] !== 'err') {
+        fwrite(STDERR, "[ERROR] --filter-status only accepts 'err'.\n");
+        exit(1);
+    }
+
     if ($key === '') {
         // Auto-generate UUID if not provided
         $key = generateUuid();
         fwrite(STDOUT, "[INFO] Generated job key: {$key}\n");
     }
 
-    if ($manager->startJob($key)) {
+    if ($manager->startJob($key, $sampleRate !== null ? (float)$sampleRate : null, $filter, $trigger)) {
         fwrite(STDOUT, "[OK] Job '{$key}' started.\n");
         fwrite(STDOUT, "     Log dir: {$manager->getLogDir()}\n");
+        if ($sampleRate !== null) {
+            fwrite(STDOUT, "     Sample rate: " . ((float)$sampleRate * 100) . "% of requests\n");
+        }
+        $filter = JobManager::normalizeFilter($filter);
+        if (!empty($filter)) {
+            fwrite(STDOUT, "     Filter: " . formatJobFilter($filter) . "\n");
+        }
+        if ($trigger !== null) {
+            fwrite(STDOUT, "     Trigger: only requests carrying {$trigger}, e.g.\n");
+            fwrite(STDOUT, "       curl -H 'X-MariaDB-Profiler: {$trigger}' <url>\n");
+            fwrite(STDOUT, "       <url>?MARIADB_PROFILER={$trigger} (or a MARIADB_PROFILER cookie)\n");
+            fwrite(STDOUT, "       MARIADB_PROFILER={$trigger} php script.php\n");
+        }
     } else {
         exit(1);
     }
 }
 
+function formatJobFilter(array $filter)
+{
+    $parts = [];
+    foreach ($filter as $name => $value) {
+        $parts[] = $name . '=' . (is_array($value) ? implode(',', $value) : $value);
+    }
+    return implode(' ', $parts);
+}
+
 function cmdJobEnd(JobManager $manager, $key)
 {
     if ($key === '') {
@@ -167,7 +271,10 @@ function cmdJobList(JobManager $manager)
         foreach ($activeJobs as $key => $info) {
             $started = date('Y-m-d H:i:s', (int)(isset($info['started_at']) ? $info['started_at'] : 0));
             $parent = isset($info['parent']) ? $info['parent'] : '-';
-            fwrite(STDOUT, "  {$key}  started: {$started}  parent: {$parent}\n");
+            $sample = isset($info['sample_rate']) ? '  sample: ' . ($info['sample_rate'] * 100) . '%' : '';
+            $filter = !empty($info['filter']) ? '  filter: ' . formatJobFilter($info['filter']) : '';
+            $trigger = isset($info['trigger']) ? '  trigger: ' . $info['trigger'] : '';
+            fwrite(STDOUT, "  {$key}  started: {$started}  parent: {$parent}{$sample}{$filter}{$trigger}\n");
         }
     }
 
@@ -224,6 +331,23 @@ function cmdJobShow(JobManager $manager, $key, $tagFilter = null)
             $output['tag'] = $entryTag;
         }
 
+        // Include duration (microseconds) if recorded
+        if (isset($entry['dur'])) {
+            $output['dur'] = $entry['dur'];
+        }
+
+        // Include statement fingerprint (digest of the normalized query) if recorded
+        if (isset($entry['fp'])) {
+            $output['fp'] = $entry['fp'];
+        }
+
+        // Include result metrics if recorded
+        foreach (['rows', 'fetch', 'bytes', 'affected', 'insert_id'] as $field) {
+            if (isset($entry[$field])) {
+                $output[$field] = $entry[$field];
+            }
+        }
+
         // Include trace if present
         if (isset($entry['trace']) && !empty($entry['trace'])) {
             $output['trace'] = $entry['trace'];
@@ -283,6 +407,23 @@ function cmdJobExport(JobManager $manager, $key)
             'ts' => isset($entry['ts']) ? $entry['ts'] : null,
         ];
 
+        // Include duration (microseconds) if recorded
+        if (isset($entry['dur'])) {
+            $item['dur'] = $entry['dur'];
+        }
+
+        // Include statement fingerprint (digest of the normalized query) if recorded
+        if (isset($entry['fp'])) {
+            $item['fp'] = $entry['fp'];
+        }
+
+        // Include result metrics if recorded
+        foreach (['rows', 'fetch', 'bytes', 'affected', 'insert_id'] as $field) {
+            if (isset($entry[$field])) {
+                $item[$field] = $entry[$field];
+            }
+        }
+
         // Include tag if present
         if (isset($entry['tag'])) {
             $item['tag'] = $entry['tag'];
@@ -304,15 +445,13 @@ function cmdJobExport(JobManager $manager, $key)
     );
     fwrite(STDOUT, "[OK] Parsed export: {$parsedFile}\n");
 
-    // Report raw log path
-    $rawFile = $manager->getLogDir() . '/' . $key . '.raw.log';
-    if (file_exists($rawFile)) {
+    // Report raw log paths (one per process with shard_logs)
+    foreach ($manager->getJobLogFiles($key, '.raw.log') as $rawFile) {
         fwrite(STDOUT, "[OK] Raw log:      {$rawFile}\n");
     }
 
-    // Report JSONL path
-    $jsonlFile = $manager->getLogDir() . '/' . $key . '.jsonl';
-    if (file_exists($jsonlFile)) {
+    // Report JSONL paths
+    foreach ($manager->getJobLogFiles($key, '.jsonl') as $jsonlFile) {
         fwrite(STDOUT, "[OK] Query log:    {$jsonlFile}\n");
     }
 }
@@ -367,16 +506,203 @@ function cmdJobCallers(JobManager $manager, $key)
     }
 }
 
+function cmdJobAgg(JobManager $manager, $key)
+{
+    if ($key === '') {
+        fwrite(STDERR, "[ERROR] Job key is required.\n");
+        exit(1);
+    }
+
+    $summaries = $manager->getJobAggregates($key);
+
+    if (empty($summaries)) {
+        fwrite(STDOUT, "No aggregated data found for job '{$key}' (is mariadb_profiler.aggregate on?).\n");
+        return;
+    }
+
+    fwrite(STDOUT, sprintf("%8s %10s %9s %9s %9s  %s\n", "COUNT", "TOTAL ms", "AVG ms", "P95 ms", "MAX ms", "ENDPOINT / QUERY"));
+    fwrite(STDOUT, str_repeat('-', 100) . "\n");
+
+    foreach ($summaries as $agg) {
+        $p95 = JobManager::histogramPercentile($agg['hist'], 95);
+        fwrite(STDOUT, sprintf("%8d %10.3f %9.3f %9s %9s  %s\n",
+            $agg['n'],
+            $agg['sum'] / 1000,
+            $agg['n'] > 0 ? $agg['sum'] / $agg['n'] / 1000 : 0,
+            $p95 === null ? '-' : '<' . number_format($p95 / 1000, 3, '.', ''),
+            $agg['max'] === null ? '-' : number_format($agg['max'] / 1000, 3, '.', ''),
+            $agg['ep']));
+        fwrite(STDOUT, sprintf("%50s  %s%s\n", '', $agg['q'], $agg['err'] > 0 ? "  [{$agg['err']} err]" : ''));
+    }
+}
+
+function cmdJobTx(JobManager $manager, $key)
+{
+    if ($key === '') {
+        fwrite(STDERR, "[ERROR] Job key is required.\n");
+        exit(1);
+    }
+
+    $spans = $manager->getJobTransactions($key);
+
+    if (empty($spans)) {
+        fwrite(STDOUT, "No transactions found for job '{$key}'.\n");
+        return;
+    }
+
+    fwrite(STDOUT, sprintf("%-16s %10s %6s %5s  %-8s  %s\n", "TX", "DUR ms", "STMTS", "ERR", "END", "ENDPOINT"));
+    fwrite(STDOUT, str_repeat('-', 100) . "\n");
+
+    foreach ($spans as $tx) {
+        fwrite(STDOUT, sprintf("%-16s %10.3f %6d %5d  %-8s  %s\n",
+            $tx['id'],
+            (isset($tx['dur']) ? $tx['dur'] : 0) / 1000,
+            isset($tx['n']) ? $tx['n'] : 0,
+            isset($tx['err']) ? $tx['err'] : 0,
+            isset($tx['end']) ? $tx['end'] : '',
+            isset($tx['ep']) ? $tx['ep'] : ''));
+    }
+}
+
+function cmdJobConns(JobManager $manager, $key)
+{
+    if ($key === '') {
+        fwrite(STDERR, "[ERROR] Job key is required.\n");
+        exit(1);
+    }
+
+    $hosts = $manager->getJobConnections($key);
+
+    if (empty($hosts)) {
+        fwrite(STDOUT, "No connection data found for job '{$key}'.\n");
+        return;
+    }
+
+    fwrite(STDOUT, sprintf("%8s %8s %6s %11s %9s %9s %7s %8s %10s  %s\n",
+        "CONNECTS", "PERSIST", "FAILED", "CONNECT ms", "AVG ms", "MAX ms", "CLOSES", "QUERIES", "QUERY ms", "HOST"));
+    fwrite(STDOUT, str_repeat('-', 100) . "\n");
+
+    foreach ($hosts as $h) {
+        fwrite(STDOUT, sprintf("%8d %8d %6d %11.3f %9.3f %9.3f %7d %8d %10.3f  %s\n",
+            $h['connects'],
+            $h['persistent'],
+            $h['failed'],
+            $h['connect_us'] / 1000,
+            $h['connects'] > 0 ? $h['connect_us'] / $h['connects'] / 1000 : 0,
+            $h['max_us'] / 1000,
+            $h['closes'],
+            $h['queries'],
+            $h['query_us'] / 1000,
+            $h['host'] === '' ? '(unknown)' : $h['host']));
+    }
+}
+
+function cmdJobEndpoints(JobManager $manager, $key)
+{
+    if ($key === '') {
+        fwrite(STDERR, "[ERROR] Job key is required.\n");
+        exit(1);
+    }
+
+    $endpoints = $manager->getJobEndpoints($key);
+
+    if (empty($endpoints)) {
+        fwrite(STDOUT, "No request summaries found for job '{$key}'.\n");
+        return;
+    }
+
+    fwrite(STDOUT, sprintf("%8s %10s %10s %9s %8s %5s %10s  %-16s  %s\n",
+        "REQUESTS", "DB ms", "AVG DB ms", "QUERIES", "AVG Q", "ERR", "MAX Q ms", "SLOWEST REQUEST", "ENDPOINT"));
+    fwrite(STDOUT, str_repeat('-', 100) . "\n");
+
+    foreach ($endpoints as $e) {
+        fwrite(STDOUT, sprintf("%8d %10.3f %10.3f %9d %8.1f %5d %10.3f  %-16s  %s\n",
+            $e['requests'],
+            $e['db_us'] / 1000,
+            $e['db_us'] / $e['requests'] / 1000,
+            $e['queries'],
+            $e['queries'] / $e['requests'],
+            $e['err'],
+            $e['max_us'] / 1000,
+            $e['worst_id'],
+            $e['ep']));
+    }
+}
+
+function cmdJobBudget(JobManager $manager, $key)
+{
+    if ($key === '') {
+        fwrite(STDERR, "[ERROR] Job key is required.\n");
+        exit(1);
+    }
+
+    $violations = $manager->getJobBudgetViolations($key);
+
+    if (empty($violations)) {
+        fwrite(STDOUT, "No budget violations found for job '{$key}'.\n");
+        return;
+    }
+
+    fwrite(STDOUT, sprintf("%-19s %-10s %10s %10s  %-30s  %s\n", "TIME", "LIMIT", "REACHED", "MAX", "ENDPOINT", "QUERY"));
+    fwrite(STDOUT, str_repeat('-', 100) . "\n");
+
+    foreach ($violations as $v) {
+        fwrite(STDOUT, sprintf("%-19s %-10s %10d %10d  %-30s  %s\n",
+            date('Y-m-d H:i:s', (int)(isset($v['ts']) ? $v['ts'] : 0)),
+            $v['limit'],
+            isset($v['n']) ? $v['n'] : 0,
+            isset($v['max']) ? $v['max'] : 0,
+            isset($v['ep']) ? $v['ep'] : '',
+            isset($v['q']) ? $v['q'] : ''));
+    }
+}
+
+function cmdJobConvert(JobManager $manager, $key)
+{
+    if ($key === '') {
+        fwrite(STDERR, "[ERROR] Job key is required.\n");
+        exit(1);
+    }
+
+    foreach ($manager->getJobRecords($key) as $record) {
+        fwrite(STDOUT, json_encode($record, JSON_UNESCAPED_UNICODE) . "\n");
+    }
+}
+
 function cmdJobPurge(JobManager $manager)
 {
     $count = $manager->purgeCompleted();
     fwrite(STDOUT, "[OK] Purged {$count} completed jobs.\n");
 }
 
+function cmdCollectorRun(JobManager $manager, $socketPath = null)
+{
+    if (!function_exists('stream_socket_server') || stripos(PHP_OS, 'WIN') === 0) {
+        fwrite(STDERR, "[ERROR] The collector needs Unix domain sockets.\n");
+        exit(1);
+    }
+    if ($socketPath === null) {
+        $ini = ini_get('mariadb_profiler.collector_socket');
+        $socketPath = $ini ? $ini : null;
+    }
+    $collector = new Collector($manager->getLogDir(), $socketPath);
+    try {
+        $collector->run();
+    } catch (\RuntimeException $e) {
+        fwrite(STDERR, "[ERROR] " . $e->getMessage() . "\n");
+        exit(1);
+    }
+}
+
 // ============================================================================
 // Helpers
 // ============================================================================
 
+function generateTriggerToken()
+{
+    return str_replace('-', '', generateUuid());
+}
+
 function generateUuid()
 {
     if (function_exists('random_bytes')) {
@@ -401,6 +727,7 @@ MariaDB Query Profiler - CLI Tool
 
 Usage:
   php mariadb_profiler.php [--log-dir=<path>] job <command> [<key>] [options]
+  php mariadb_profiler.php [--log-dir=<path>] collector run [--socket=<path>]
 
 Commands:
   job start [<key>]    Start a profiling job (auto-generates key if omitted)
@@ -411,20 +738,48 @@ Commands:
   job export <key>     Export parsed JSON + raw log to files
   job tags <key>       Show tag summary (query count per context tag)
   job callers <key>    Show caller summary (query count per call site)
+  job agg <key>        Show per-query-shape summaries (with mariadb_profiler.aggregate)
+  job tx <key>         Show transaction spans (duration, statements, outcome)
+  job conns <key>      Show connects (persistent misses, failures), closes and queries per host
+  job budget <key>     Show query budget violations (with mariadb_profiler.budget_action=log)
+  job endpoints <key>  Rank endpoints by DB time (from the per-request summaries)
+  job convert <key>    Print all records as JSONL (decodes the binary log format)
   job purge            Remove all completed job data
+  collector run        Write the logs sent to mariadb_profiler.collector_socket
 
 Options:
   --log-dir=<path>     Override log directory (default: from php.ini or /tmp/mariadb_profiler)
   --tag=<tag>          Filter queries by context tag (for 'show' command)
+  --sample-rate=<0..1> Capture only this share of requests (for 'start' command)
+  --filter-tag=<prefix>     Capture only queries whose context tag starts with prefix ('start')
+  --filter-verb=<V[,V]>     ... only these statement verbs, e.g. SELECT,UPDATE ('start')
+  --filter-table=<name>     ... only statements mentioning name ('start')
+  --filter-min-us=<n>       ... only queries taking at least n microseconds ('start')
+  --filter-uri=<prefix>     ... only requests whose URI (CLI: script path) starts with prefix ('start')
+  --filter-status=err       ... only failed queries ('start')
+  --trigger[=<token>]       Capture only requests carrying the token in an X-MariaDB-Profiler
+                            header, MARIADB_PROFILER cookie/query parameter or env var
+                            (generated when omitted; for 'start' command)
+  --socket=<path>      Collector socket (default: from php.ini or <log-dir>/collector.sock)
 
 Examples:
   php mariadb_profiler.php job start my-trace-001
+  php mariadb_profiler.php job start prod-sample --sample-rate=0.01
+  php mariadb_profiler.php job start checkout --filter-uri=/checkout --filter-verb=UPDATE,DELETE
+  php mariadb_profiler.php job start slow-page --trigger
   php mariadb_profiler.php job end my-trace-001
   php mariadb_profiler.php job show my-trace-001
   php mariadb_profiler.php job show my-trace-001 --tag=user_registration
   php mariadb_profiler.php job tags my-trace-001
   php mariadb_profiler.php job callers my-trace-001
+  php mariadb_profiler.php job agg my-trace-001
+  php mariadb_profiler.php job tx my-trace-001
+  php mariadb_profiler.php job conns my-trace-001
+  php mariadb_profiler.php job budget my-trace-001
+  php mariadb_profiler.php job endpoints my-trace-001
+  php mariadb_profiler.php job convert my-trace-001 > my-trace-001.converted.jsonl
   php mariadb_profiler.php job export my-trace-001
+  php mariadb_profiler.php collector run --socket=/run/mariadb_profiler.sock
 
 USAGE;
     fwrite(STDOUT, $usage);
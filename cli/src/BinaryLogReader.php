@@ -0,0 +1,297 @@
+<?php
+
+namespace MariadbProfiler;
+
+/**
+ * BinaryLogReader - decodes the extension's binary log format
+ * (mariadb_profiler.log_format = binary) into the same arrays that
+ * json_decode() returns for the JSONL format.
+ *
+ * Layout (see ext/mariadb_profiler/profiler_binlog.h):
+ *   record := type:u8  body_len:varint  body
+ *   field  := tag:varint value,  tag = (field_id << 3) | wire
+ *   wire 0 = varint, 1 = 8 bytes little-endian, 2 = varint length + bytes
+ */
+class BinaryLogReader
+{
+    const TYPE_QUERY = 1;
+    const TYPE_AGG = 2;
+    const TYPE_STACK = 3;
+    const TYPE_STMT = 4;
+    const TYPE_TX = 5;
+    const TYPE_CONN = 6;
+    const TYPE_BUDGET = 7;
+    const TYPE_REQ = 8;
+
+    const WIRE_VARINT = 0;
+    const WIRE_FIXED64 = 1;
+    const WIRE_BYTES = 2;
+
+    /**
+     * Field id => [JSONL key, decoding]. Decodings: int, double, hex
+     * (fixed64 shown as 16 hex digits), string, json, hist, bool.
+     */
+    private static $fields = [
+        1 => ['q', 'string'],
+        2 => ['ts', 'double'],
+        3 => ['dur', 'int'],
+        4 => ['s', 'string'],
+        5 => ['tag', 'string'],
+        6 => ['params', 'json'],
+        7 => ['trace', 'json'],
+        8 => ['fp', 'hex'],
+        9 => ['rows', 'int'],
+        10 => ['fetch', 'int'],
+        11 => ['bytes', 'int'],
+        12 => ['affected', 'int'],
+        13 => ['insert_id', 'int'],
+        14 => ['ep', 'string'],
+        15 => ['n', 'int'],
+        16 => ['err', 'int'],
+        17 => ['sum', 'int'],
+        18 => ['min', 'int'],
+        19 => ['max', 'int'],
+        20 => ['hist', 'hist'],
+        21 => ['st', 'hex'],
+        22 => ['id', 'hex'],
+        23 => ['sid', 'hex'],
+        24 => ['tx', 'hex'],
+        25 => ['end', 'string'],
+        26 => ['cn', 'hex'],
+        27 => ['ev', 'string'],
+        28 => ['host', 'string'],
+        29 => ['db', 'string'],
+        30 => ['thread', 'int'],
+        31 => ['persistent', 'bool'],
+        32 => ['limit', 'string'],
+        33 => ['method', 'string'],
+        34 => ['pid', 'int'],
+        35 => ['tags', 'json'],
+        36 => ['rq', 'hex'],
+    ];
+
+    /** Key order of the JSONL records the extension writes */
+    private static $queryOrder = [
+        'k', 'q', 'sid', 'tag', 'cn', 'tx', 'rq', 'params', 'trace', 'st', 's', 'fp', 'ts', 'dur',
+        'rows', 'fetch', 'bytes', 'affected', 'insert_id',
+    ];
+    private static $aggOrder = [
+        'type', 'k', 'fp', 'q', 'ep', 'ts', 'n', 'err', 'sum', 'min', 'max', 'hist',
+    ];
+    private static $stackOrder = ['type', 'k', 'id', 'trace'];
+    private static $stmtOrder = ['type', 'k', 'id', 'q', 'fp'];
+    private static $txOrder = ['type', 'k', 'id', 'ep', 'ts', 'dur', 'n', 'err', 'end'];
+    private static $connOrder = [
+        'type', 'k', 'cn', 'ev', 'host', 'db', 'thread', 'persistent', 's', 'ep', 'ts', 'dur',
+    ];
+    private static $budgetOrder = ['type', 'k', 'limit', 'max', 'n', 'q', 'fp', 'tag', 'ep', 'ts'];
+    private static $reqOrder = [
+        'type', 'k', 'id', 'ep', 'method', 'pid', 'ts', 'dur', 'n', 'err', 'sum', 'max', 'tags',
+    ];
+
+    /**
+     * Decode a whole file. Records of unknown type are skipped; a
+     * truncated last record (writer still appending) is ignored.
+     *
+     * @param string $file   Path to <key>.bin
+     * @param string $jobKey Job key to put in each record's "k"
+     * @return array List of records
+     */
+    public static function readFile($file, $jobKey)
+    {
+        if (!file_exists($file)) {
+            return [];
+        }
+        $data = file_get_contents($file);
+        if ($data === false) {
+            return [];
+        }
+        return self::decode($data, $jobKey);
+    }
+
+    /**
+     * Decode a buffer of records.
+     *
+     * @return array
+     */
+    public static function decode($data, $jobKey)
+    {
+        $records = [];
+        $len = strlen($data);
+        $pos = 0;
+
+        while ($pos < $len) {
+            $type = ord($data[$pos]);
+            $pos++;
+            $bodyLen = self::readVarint($data, $pos, $len);
+            if ($bodyLen === null || $pos + $bodyLen > $len) {
+                break;
+            }
+            $body = substr($data, $pos, $bodyLen);
+            $pos += $bodyLen;
+
+            if ($type === self::TYPE_QUERY) {
+                $records[] = self::order(self::decodeBody($body), $jobKey, self::$queryOrder);
+            } elseif ($type === self::TYPE_AGG) {
+                $fields = self::decodeBody($body);
+                $fields['type'] = 'agg';
+                $records[] = self::order($fields, $jobKey, self::$aggOrder);
+            } elseif ($type === self::TYPE_STACK) {
+                $fields = self::decodeBody($body);
+                $fields['type'] = 'stack';
+                $records[] = self::order($fields, $jobKey, self::$stackOrder);
+            } elseif ($type === self::TYPE_STMT) {
+                $fields = self::decodeBody($body);
+                $fields['type'] = 'stmt';
+                $records[] = self::order($fields, $jobKey, self::$stmtOrder);
+            } elseif ($type === self::TYPE_TX) {
+                $fields = self::decodeBody($body);
+                $fields['type'] = 'tx';
+                $records[] = self::order($fields, $jobKey, self::$txOrder);
+            } elseif ($type === self::TYPE_CONN) {
+                $fields = self::decodeBody($body);
+                $fields['type'] = 'conn';
+                $records[] = self::order($fields, $jobKey, self::$connOrder);
+            } elseif ($type === self::TYPE_BUDGET) {
+                $fields = self::decodeBody($body);
+                $fields['type'] = 'budget';
+                $records[] = self::order($fields, $jobKey, self::$budgetOrder);
+            } elseif ($type === self::TYPE_REQ) {
+                $fields = self::decodeBody($body);
+                $fields['type'] = 'req';
+                $records[] = self::order($fields, $jobKey, self::$reqOrder);
+            }
+        }
+
+        return $records;
+    }
+
+    /**
+     * Decode the fields of one record body. Unknown fields are skipped.
+     *
+     * @return array
+     */
+    private static function decodeBody($body)
+    {
+        $fields = [];
+        $len = strlen($body);
+        $pos = 0;
+
+        while ($pos < $len) {
+            $tag = self::readVarint($body, $pos, $len);
+            if ($tag === null) {
+                break;
+            }
+            $id = $tag >> 3;
+            $wire = $tag & 7;
+
+            if ($wire === self::WIRE_VARINT) {
+                $value = self::readVarint($body, $pos, $len);
+            } elseif ($wire === self::WIRE_FIXED64) {
+                if ($pos + 8 > $len) {
+                    break;
+                }
+                $value = substr($body, $pos, 8);
+                $pos += 8;
+            } elseif ($wire === self::WIRE_BYTES) {
+                $n = self::readVarint($body, $pos, $len);
+                if ($n === null || $pos + $n > $len) {
+                    break;
+                }
+                $value = (string)substr($body, $pos, $n);
+                $pos += $n;
+            } else {
+                break;
+            }
+            if ($value === null) {
+                break;
+            }
+
+            if (!isset(self::$fields[$id])) {
+                continue;
+            }
+            list($key, $decoding) = self::$fields[$id];
+            $fields[$key] = self::convert($value, $decoding);
+        }
+
+        return $fields;
+    }
+
+    /**
+     * @return mixed
+     */
+    private static function convert($value, $decoding)
+    {
+        switch ($decoding) {
+            case 'double':
+                // Stored little-endian; unpack('d') uses host byte order
+                if (pack('S', 1) !== "\x01\x00") {
+                    $value = strrev($value);
+                }
+                $d = unpack('d', $value);
+                return $d[1];
+            case 'hex':
+                return bin2hex(strrev($value));
+            case 'json':
+                return json_decode($value, true);
+            case 'bool':
+                return $value !== 0;
+            case 'hist':
+                $hist = [];
+                $pos = 0;
+                $len = strlen($value);
+                while ($pos < $len) {
+                    $count = self::readVarint($value, $pos, $len);
+                    if ($count === null) {
+                        break;
+                    }
+                    $hist[] = $count;
+                }
+                return $hist;
+            default:
+                return $value;
+        }
+    }
+
+    /**
+     * Put the job key in and order keys like the JSONL writer does.
+     *
+     * @return array
+     */
+    private static function order(array $fields, $jobKey, array $order)
+    {
+        $fields['k'] = $jobKey;
+        $record = [];
+        foreach ($order as $key) {
+            if (array_key_exists($key, $fields)) {
+                $record[$key] = $fields[$key];
+            }
+        }
+        return $record;
+    }
+
+    /**
+     * Read an unsigned LEB128 varint at $pos, advancing it.
+     *
+     * @return int|null null if the buffer ends mid-varint
+     */
+    private static function readVarint($data, &$pos, $len)
+    {
+        $value = 0;
+        $shift = 0;
+
+        while ($pos < $len) {
+            $byte = ord($data[$pos]);
+            $pos++;
+            $value |= ($byte & 0x7f) << $shift;
+            if ($byte < 0x80) {
+                return $value;
+            }
+            $shift += 7;
+            if ($shift > 63) {
+                return null;
+            }
+        }
+        return null;
+    }
+}
@@ -0,0 +1,281 @@
+<?php
+
+namespace MariadbProfiler;
+
+/**
+ * Collector - receives log buffers from the extension over a Unix
+ * datagram socket (mariadb_profiler.collector_socket) and appends them
+ * to the job log files, so PHP workers never touch the files.
+ *
+ * Datagram: file name, NUL, encoded records (see
+ * ext/mariadb_profiler/profiler_collector.h).
+ *
+ * Live viewers can connect to the stream socket "<socket>.tail", send
+ * one line with a file name (e.g. "my-job.raw.log") and receive every
+ * buffer the collector appends to that file from then on.
+ */
+class Collector
+{
+    /** Larger than the extension's largest datagram (192 KiB) */
+    const MAX_DATAGRAM = 262144;
+
+    /** Close file handles not written to for this many seconds */
+    const IDLE_CLOSE = 5;
+
+    private $logDir;
+    private $socketPath;
+
+    /** file name => ['fp' => resource, 'used' => int] */
+    private $files = [];
+
+    /**
+     * tail subscribers: id => ['conn' => resource, 'file' => string|null,
+     * 'line' => string, 'pending' => string]
+     */
+    private $subscribers = [];
+
+    public function __construct($logDir, $socketPath = null)
+    {
+        $this->logDir = $logDir;
+        $this->socketPath = $socketPath !== null ? $socketPath : $logDir . '/collector.sock';
+    }
+
+    public function getSocketPath()
+    {
+        return $this->socketPath;
+    }
+
+    /**
+     * Append one datagram's records to its file. Returns the number of
+     * bytes written, or false for a malformed datagram or a file name
+     * that is not a job log.
+     */
+    public function handleDatagram($dgram)
+    {
+        $nul = strpos($dgram, "\0");
+        if ($nul === false) {
+            return false;
+        }
+        $name = substr($dgram, 0, $nul);
+        $data = (string)substr($dgram, $nul + 1);
+        if (!self::isLogFileName($name)) {
+            return false;
+        }
+        if ($data === '') {
+            return 0;
+        }
+
+        $fp = $this->openFile($name);
+        if ($fp === false) {
+            return false;
+        }
+
+        // The extension falls back to writing the file itself while the
+        // collector is unreachable, so appends stay locked
+        flock($fp, LOCK_EX);
+        $written = fwrite($fp, $data);
+        fflush($fp);
+        flock($fp, LOCK_UN);
+
+        $this->publish($name, $data);
+        return $written;
+    }
+
+    /**
+     * Whether $name is a job log file name the collector may write:
+     * no directory part, and a log file suffix.
+     */
+    public static function isLogFileName($name)
+    {
+        if ($name === '' || strpos($name, '/') !== false || strpos($name, '\\') !== false
+            || strpos($name, '..') !== false || $name[0] === '.') {
+            return false;
+        }
+        return (bool)preg_match('/\.(jsonl|raw\.log|bin)$/', $name);
+    }
+
+    /**
+     * Receive datagrams until the process is stopped.
+     */
+    public function run()
+    {
+        $server = $this->bind();
+        $tail = $this->bindTail();
+
+        fwrite(STDOUT, "[OK] Collecting into {$this->logDir} from {$this->socketPath}\n");
+
+        while (true) {
+            $read = [$server, $tail];
+            foreach ($this->subscribers as $sub) {
+                $read[] = $sub['conn'];
+            }
+            $write = [];
+            foreach ($this->subscribers as $sub) {
+                if ($sub['pending'] !== '') {
+                    $write[] = $sub['conn'];
+                }
+            }
+            $except = null;
+            $ready = @stream_select($read, $write, $except, 1);
+            if ($ready === false) {
+                continue; // interrupted by a signal
+            }
+
+            foreach ($read as $stream) {
+                if ($stream === $server) {
+                    $dgram = stream_socket_recvfrom($server, self::MAX_DATAGRAM);
+                    if ($dgram !== false && $dgram !== '') {
+                        $this->handleDatagram($dgram);
+                    }
+                } elseif ($stream === $tail) {
+                    $conn = @stream_socket_accept($tail, 0);
+                    if ($conn) {
+                        stream_set_blocking($conn, false);
+                        $this->subscribers[(int)$conn] = ['conn' => $conn, 'file' => null, 'line' => '', 'pending' => ''];
+                    }
+                } else {
+                    $this->readSubscriber($stream);
+                }
+            }
+
+            foreach ($write as $stream) {
+                if (isset($this->subscribers[(int)$stream])) {
+                    $this->flushSubscriber((int)$stream);
+                }
+            }
+
+            $this->closeIdleFiles();
+        }
+    }
+
+    private function bind()
+    {
+        if (file_exists($this->socketPath)) {
+            unlink($this->socketPath); // stale socket from a previous run
+        }
+        $server = stream_socket_server('udg://' . $this->socketPath, $errno, $errstr, STREAM_SERVER_BIND);
+        if (!$server) {
+            throw new \RuntimeException("Cannot bind {$this->socketPath}: {$errstr}");
+        }
+        // PHP workers usually run as another user
+        chmod($this->socketPath, 0666);
+        return $server;
+    }
+
+    private function bindTail()
+    {
+        $path = $this->socketPath . '.tail';
+        if (file_exists($path)) {
+            unlink($path);
+        }
+        $tail = stream_socket_server('unix://' . $path, $errno, $errstr);
+        if (!$tail) {
+            throw new \RuntimeException("Cannot bind {$path}: {$errstr}");
+        }
+        chmod($path, 0666);
+        return $tail;
+    }
+
+    private function readSubscriber($conn)
+    {
+        $id = (int)$conn;
+        $chunk = fread($conn, 4096);
+        if ($chunk === false || ($chunk === '' && feof($conn))) {
+            $this->dropSubscriber($id);
+            return;
+        }
+        if ($this->subscribers[$id]['file'] !== null) {
+            return; // only the first line is meaningful
+        }
+        $line = $this->subscribers[$id]['line'] . $chunk;
+        $eol = strpos($line, "\n");
+        if ($eol === false) {
+            $this->subscribers[$id]['line'] = $line;
+            return;
+        }
+        $name = trim(substr($line, 0, $eol));
+        if (!self::isLogFileName($name)) {
+            $this->dropSubscriber($id);
+            return;
+        }
+        $this->subscribers[$id]['file'] = $name;
+        $this->subscribers[$id]['line'] = '';
+    }
+
+    private function publish($name, $data)
+    {
+        foreach ($this->subscribers as $id => $sub) {
+            if ($sub['file'] !== $name) {
+                continue;
+            }
+            $this->subscribers[$id]['pending'] .= $data;
+            $this->flushSubscriber($id);
+        }
+    }
+
+    /**
+     * Write as much of a subscriber's pending output as its socket takes.
+     * The socket is non-blocking, so a short write keeps the remainder
+     * for when stream_select reports it writable; cutting it would hand
+     * the viewer a record torn mid-line.
+     */
+    private function flushSubscriber($id)
+    {
+        $pending = $this->subscribers[$id]['pending'];
+        if ($pending === '') {
+            return;
+        }
+        $written = @fwrite($this->subscribers[$id]['conn'], $pending);
+        if ($written === false) {
+            $this->dropSubscriber($id);
+            return;
+        }
+        $this->subscribers[$id]['pending'] = (string)substr($pending, $written);
+    }
+
+    private function dropSubscriber($id)
+    {
+        fclose($this->subscribers[$id]['conn']);
+        unset($this->subscribers[$id]);
+    }
+
+    private function openFile($name)
+    {
+        if (isset($this->files[$name])) {
+            $this->files[$name]['used'] = time();
+            return $this->files[$name]['fp'];
+        }
+        $fp = @fopen($this->logDir . '/' . $name, 'ab');
+        if ($fp === false) {
+            return false;
+        }
+        $this->files[$name] = ['fp' => $fp, 'used' => time()];
+        return $fp;
+    }
+
+    /**
+     * Close handles of files nobody wrote to lately, so purged jobs do
+     * not keep deleted files open.
+     */
+    private function closeIdleFiles()
+    {
+        $now = time();
+        foreach ($this->files as $name => $file) {
+            if ($now - $file['used'] >= self::IDLE_CLOSE) {
+                fclose($file['fp']);
+                unset($this->files[$name]);
+            }
+        }
+    }
+
+    /**
+     * Close all open files.
+     */
+    public function close()
+    {
+        foreach ($this->files as $file) {
+            fclose($file['fp']);
+        }
+        $this->files = [];
+    }
+}
@@ -7,13 +7,27 @@ namespace MariadbProfiler;
  */
 class JobManager
 {
+    /**
+     * jobs.gen layout (little-endian, fixed size so the extension can mmap it):
+     *   "MPJR" magic, u32 version, u64 generation, u32 active job count,
+     *   12 reserved bytes.
+     */
+    const REGISTRY_MAGIC = 'MPJR';
+    const REGISTRY_VERSION = 1;
+    const REGISTRY_SIZE = 32;
+
+    /** Separates a job key from the pid in per-process shard file names */
+    const SHARD_MARKER = '.shard-';
+
     private $logDir;
     private $jobsFile;
+    private $registryFile;
 
     public function __construct($logDir = null)
     {
         $this->logDir = $logDir !== null ? $logDir : $this->detectLogDir();
         $this->jobsFile = $this->logDir . '/jobs.json';
+        $this->registryFile = $this->logDir . '/jobs.gen';
 
         if (!is_dir($this->logDir)) {
             mkdir($this->logDir, 0777, true);
@@ -39,9 +53,27 @@ class JobManager
 
     /**
      * Start a new profiling job.
+     *
+     * @param string     $key
+     * @param float|null $sampleRate Share of requests to capture (0..1);
+     *                               null uses mariadb_profiler.sample_rate
+     * @param array      $filter     Capture only matching queries, evaluated by
+     *                               the extension (see normalizeFilter())
+     * @param string|null $trigger   Capture only requests carrying this token
+     *                               (header, cookie, query parameter or env)
      */
-    public function startJob($key)
+    public function startJob($key, $sampleRate = null, array $filter = [], $trigger = null)
     {
+        if (!self::isValidKey($key)) {
+            fwrite(STDERR, "[ERROR] Job key must not be empty or contain '" . self::SHARD_MARKER
+                . "' (reserved for per-process log files).\n");
+            return false;
+        }
+        if ($trigger !== null && !self::isValidTrigger($trigger)) {
+            fwrite(STDERR, "[ERROR] Trigger token must be 1-255 characters of A-Z, a-z, 0-9, '.', '_' or '-'.\n");
+            return false;
+        }
+
         $data = $this->readJobsFile();
 
         if (isset($data['active_jobs'][$key])) {
@@ -68,12 +100,85 @@ class JobManager
             'started_at' => microtime(true),
             'parent' => $parent,
         ];
+        if ($sampleRate !== null) {
+            $data['active_jobs'][$key]['sample_rate'] = max(0.0, min(1.0, (float)$sampleRate));
+        }
+        $filter = self::normalizeFilter($filter);
+        if (!empty($filter)) {
+            $data['active_jobs'][$key]['filter'] = $filter;
+        }
+        if ($trigger !== null) {
+            $data['active_jobs'][$key]['trigger'] = $trigger;
+        }
 
         $this->writeJobsFile($data);
 
         return true;
     }
 
+    /**
+     * Job keys name the log files. The per-process shards of a job are
+     * <key>.shard-<pid>.<ext>, so a key containing ".shard-" could be
+     * taken for a shard of another job.
+     *
+     * @return bool
+     */
+    public static function isValidKey($key)
+    {
+        return is_string($key) && $key !== '' && strpos($key, self::SHARD_MARKER) === false;
+    }
+
+    /**
+     * Trigger tokens are matched byte for byte by the extension and read
+     * from jobs.json without unescaping, so keep them to a safe alphabet.
+     *
+     * @return bool
+     */
+    public static function isValidTrigger($trigger)
+    {
+        return is_string($trigger) && preg_match('/^[A-Za-z0-9._-]{1,255}$/', $trigger) === 1;
+    }
+
+    /**
+     * Reduce a job filter to the keys the extension understands, dropping
+     * empty ones. All given keys must match for a query to be captured:
+     *   tag    context tag prefix
+     *   verb   statement verbs (list or comma-separated), e.g. SELECT,UPDATE
+     *   table  substring of the statement text, case-insensitive
+     *   min_us minimum duration in microseconds
+     *   uri    request URI prefix (script path for CLI requests)
+     *   status "err" to capture failed statements only
+     *
+     * @return array
+     */
+    public static function normalizeFilter(array $filter)
+    {
+        $normalized = [];
+
+        foreach (['tag', 'table', 'uri'] as $name) {
+            if (isset($filter[$name]) && (string)$filter[$name] !== '') {
+                $normalized[$name] = (string)$filter[$name];
+            }
+        }
+        if (isset($filter['verb'])) {
+            $verbs = is_array($filter['verb']) ? $filter['verb'] : explode(',', (string)$filter['verb']);
+            $verbs = array_values(array_unique(array_filter(array_map(function ($verb) {
+                return strtoupper(trim((string)$verb));
+            }, $verbs), 'strlen')));
+            if (!empty($verbs)) {
+                $normalized['verb'] = $verbs;
+            }
+        }
+        if (isset($filter['min_us']) && (int)$filter['min_us'] > 0) {
+            $normalized['min_us'] = (int)$filter['min_us'];
+        }
+        if (isset($filter['status']) && $filter['status'] === 'err') {
+            $normalized['status'] = 'err';
+        }
+
+        return $normalized;
+    }
+
     /**
      * End a profiling job.
      *
@@ -147,17 +252,448 @@ class JobManager
 
     /**
      * Get raw queries for a job from the JSONL file.
+     * Typed records (those with a "type" field, e.g. aggregation
+     * summaries) are not queries and are skipped. Interned traces
+     * ("st" referring to a "stack" record) are resolved into "trace",
+     * interned statement templates ("sid" referring to a "stmt" record)
+     * into "q" and "fp".
      *
      * @return array
      */
     public function getJobQueries($key)
     {
-        $file = $this->logDir . '/' . $key . '.jsonl';
+        $queries = [];
+        $stacks = [];
+        $stmts = [];
+        foreach ($this->getJobRecords($key) as $entry) {
+            if (!isset($entry['type'])) {
+                $queries[] = $entry;
+            } elseif ($entry['type'] === 'stack' && isset($entry['id'], $entry['trace'])) {
+                $stacks[$entry['id']] = $entry['trace'];
+            } elseif ($entry['type'] === 'stmt' && isset($entry['id'], $entry['q'])) {
+                $stmts[$entry['id']] = $entry;
+            }
+        }
+
+        if ($stacks || $stmts) {
+            foreach ($queries as &$query) {
+                if (isset($query['st']) && isset($stacks[$query['st']])) {
+                    $query['trace'] = $stacks[$query['st']];
+                    unset($query['st']);
+                }
+                if (isset($query['sid']) && isset($stmts[$query['sid']])) {
+                    $query = self::expandStatement($query, $stmts[$query['sid']]);
+                }
+            }
+            unset($query);
+        }
+        return $queries;
+    }
+
+    /**
+     * Replace a query's "sid" with the template text and fingerprint
+     * of its "stmt" record, keeping "q" the first field after "k".
+     *
+     * @return array
+     */
+    private static function expandStatement(array $query, array $stmt)
+    {
+        $expanded = [];
+        foreach ($query as $field => $value) {
+            if ($field === 'sid') {
+                $expanded['q'] = $stmt['q'];
+            } else {
+                $expanded[$field] = $value;
+            }
+        }
+        if (isset($stmt['fp']) && !isset($expanded['fp'])) {
+            $expanded['fp'] = $stmt['fp'];
+        }
+        return $expanded;
+    }
+
+    /**
+     * Get per-query-shape summaries for a job, merged across requests.
+     * Summary records ("type":"agg") with the same fingerprint and
+     * endpoint are combined; histograms are added bucket by bucket.
+     *
+     * @return array List of summaries sorted by total time, descending
+     */
+    public function getJobAggregates($key)
+    {
+        $merged = [];
+
+        foreach ($this->getJobRecords($key) as $entry) {
+            if (!isset($entry['type']) || $entry['type'] !== 'agg' || !isset($entry['fp'])) {
+                continue;
+            }
+
+            $ep = isset($entry['ep']) ? $entry['ep'] : '';
+            $id = $entry['fp'] . "\0" . $ep;
+
+            if (!isset($merged[$id])) {
+                $merged[$id] = [
+                    'fp' => $entry['fp'],
+                    'q' => isset($entry['q']) ? $entry['q'] : '',
+                    'ep' => $ep,
+                    'n' => 0,
+                    'err' => 0,
+                    'sum' => 0,
+                    'min' => null,
+                    'max' => null,
+                    'hist' => [],
+                ];
+            }
+            $agg = &$merged[$id];
+
+            $agg['n'] += isset($entry['n']) ? (int)$entry['n'] : 0;
+            $agg['err'] += isset($entry['err']) ? (int)$entry['err'] : 0;
+            if (isset($entry['sum'])) {
+                $agg['sum'] += (int)$entry['sum'];
+                $agg['min'] = $agg['min'] === null ? (int)$entry['min'] : min($agg['min'], (int)$entry['min']);
+                $agg['max'] = $agg['max'] === null ? (int)$entry['max'] : max($agg['max'], (int)$entry['max']);
+            }
+            if (isset($entry['hist']) && is_array($entry['hist'])) {
+                foreach ($entry['hist'] as $bucket => $count) {
+                    $agg['hist'][$bucket] = (isset($agg['hist'][$bucket]) ? $agg['hist'][$bucket] : 0) + (int)$count;
+                }
+            }
+            unset($agg);
+        }
+
+        $result = array_values($merged);
+        usort($result, function ($a, $b) {
+            return $b['sum'] - $a['sum'];
+        });
+        return $result;
+    }
+
+    /**
+     * Get the transaction span summaries ("type":"tx") of a job. Each
+     * has the span "id" that its statements carry as "tx", the endpoint,
+     * start time, duration, statement and error counts and how it ended
+     * ("commit", "rollback", or "open" when the request ended first).
+     *
+     * @return array List of spans sorted by duration, descending
+     */
+    public function getJobTransactions($key)
+    {
+        $spans = [];
+        foreach ($this->getJobRecords($key) as $entry) {
+            if (isset($entry['type'], $entry['id']) && $entry['type'] === 'tx') {
+                $spans[] = $entry;
+            }
+        }
+
+        usort($spans, function ($a, $b) {
+            $da = isset($a['dur']) ? (int)$a['dur'] : 0;
+            $db = isset($b['dur']) ? (int)$b['dur'] : 0;
+            return $db - $da;
+        });
+        return $spans;
+    }
+
+    /**
+     * Rank the endpoints of a job by DB time from its request summaries
+     * ("type":"req", one per captured request): requests, statements,
+     * errors, total and slowest-statement DB time, and the slowest
+     * request's total DB time and id (its queries carry it as "rq").
+     *
+     * @return array List of endpoints sorted by total DB time, descending
+     */
+    public function getJobEndpoints($key)
+    {
+        $endpoints = [];
+
+        foreach ($this->getJobRecords($key) as $entry) {
+            if (!isset($entry['type'], $entry['id']) || $entry['type'] !== 'req') {
+                continue;
+            }
+            $ep = isset($entry['ep']) ? $entry['ep'] : '';
+            if (!isset($endpoints[$ep])) {
+                $endpoints[$ep] = [
+                    'ep' => $ep,
+                    'requests' => 0,
+                    'queries' => 0,
+                    'err' => 0,
+                    'db_us' => 0,
+                    'max_us' => 0,
+                    'worst_db_us' => -1,
+                    'worst_id' => '',
+                ];
+            }
+            $e = &$endpoints[$ep];
+            $sum = isset($entry['sum']) ? (int)$entry['sum'] : 0;
+            $e['requests']++;
+            $e['queries'] += isset($entry['n']) ? (int)$entry['n'] : 0;
+            $e['err'] += isset($entry['err']) ? (int)$entry['err'] : 0;
+            $e['db_us'] += $sum;
+            $e['max_us'] = max($e['max_us'], isset($entry['max']) ? (int)$entry['max'] : 0);
+            if ($sum > $e['worst_db_us']) {
+                $e['worst_db_us'] = $sum;
+                $e['worst_id'] = $entry['id'];
+            }
+            unset($e);
+        }
+
+        $result = array_values($endpoints);
+        usort($result, function ($a, $b) {
+            return $b['db_us'] - $a['db_us'];
+        });
+        return $result;
+    }
+
+    /**
+     * Get the query budget violations ("type":"budget") of a job, written
+     * with mariadb_profiler.budget_action = log: which limit ("queries",
+     * "db_time_us" or "repeats") went over its "max" ("n" is the count or
+     * microseconds reached), at which statement "q", tag and endpoint.
+     *
+     * @return array List of violations in time order
+     */
+    public function getJobBudgetViolations($key)
+    {
+        $violations = [];
+        foreach ($this->getJobRecords($key) as $entry) {
+            if (isset($entry['type'], $entry['limit']) && $entry['type'] === 'budget') {
+                $violations[] = $entry;
+            }
+        }
+
+        usort($violations, function ($a, $b) {
+            $ta = isset($a['ts']) ? (float)$a['ts'] : 0;
+            $tb = isset($b['ts']) ? (float)$b['ts'] : 0;
+            return $ta < $tb ? -1 : ($ta > $tb ? 1 : 0);
+        });
+        return $violations;
+    }
+
+    /**
+     * Get the connection activity of a job per host: connects (of which
+     * persistent, i.e. persistent-connection misses, and failed), time
+     * spent connecting, closes, change_user/select_db calls, and the
+     * queries run on those connections ("cn" of a query matched to the
+     * host of its connection's events; "" when no event was seen).
+     *
+     * @return array List of hosts sorted by connect time, descending
+     */
+    public function getJobConnections($key)
+    {
+        $records = $this->getJobRecords($key);
+        $connHost = [];
+        $hosts = [];
+
+        foreach ($records as $entry) {
+            if (!isset($entry['type'], $entry['cn']) || $entry['type'] !== 'conn') {
+                continue;
+            }
+            $ev = isset($entry['ev']) ? $entry['ev'] : '';
+            $host = isset($entry['host']) ? $entry['host'] : '';
+            if (!isset($connHost[$entry['cn']]) || $ev === 'connect') {
+                $connHost[$entry['cn']] = $host;
+            }
+
+            $h = &$this->connectionHost($hosts, $host);
+            $dur = isset($entry['dur']) ? (int)$entry['dur'] : 0;
+            if ($ev === 'connect') {
+                $h['connects']++;
+                $h['connect_us'] += $dur;
+                $h['max_us'] = max($h['max_us'], $dur);
+                if (!empty($entry['persistent'])) {
+                    $h['persistent']++;
+                }
+                if (isset($entry['s']) && $entry['s'] === 'err') {
+                    $h['failed']++;
+                }
+            } elseif ($ev === 'close') {
+                $h['closes']++;
+            } elseif ($ev === 'change_user' || $ev === 'select_db') {
+                $h[$ev]++;
+            }
+            unset($h);
+        }
+
+        foreach ($records as $entry) {
+            if (isset($entry['type']) || !isset($entry['cn'])) {
+                continue;
+            }
+            $host = isset($connHost[$entry['cn']]) ? $connHost[$entry['cn']] : '';
+            $h = &$this->connectionHost($hosts, $host);
+            $h['queries']++;
+            $h['query_us'] += isset($entry['dur']) ? (int)$entry['dur'] : 0;
+            unset($h);
+        }
+
+        $result = array_values($hosts);
+        usort($result, function ($a, $b) {
+            return $b['connect_us'] - $a['connect_us'];
+        });
+        return $result;
+    }
+
+    /**
+     * Entry of getJobConnections() for $host, created empty on first use.
+     *
+     * @return array
+     */
+    private function &connectionHost(array &$hosts, $host)
+    {
+        if (!isset($hosts[$host])) {
+            $hosts[$host] = [
+                'host' => $host,
+                'connects' => 0,
+                'persistent' => 0,
+                'failed' => 0,
+                'connect_us' => 0,
+                'max_us' => 0,
+                'closes' => 0,
+                'change_user' => 0,
+                'select_db' => 0,
+                'queries' => 0,
+                'query_us' => 0,
+            ];
+        }
+        return $hosts[$host];
+    }
+
+    /**
+     * Upper bound (microseconds) of the histogram bucket holding the
+     * given percentile. Bucket i covers [2^i, 2^(i+1)) us.
+     *
+     * @return int|null null when the histogram is empty
+     */
+    public static function histogramPercentile(array $hist, $percentile)
+    {
+        $total = array_sum($hist);
+        if ($total === 0) {
+            return null;
+        }
+
+        ksort($hist);
+        $target = $total * $percentile / 100;
+        $seen = 0;
+        foreach ($hist as $bucket => $count) {
+            $seen += $count;
+            if ($seen >= $target) {
+                return 1 << ($bucket + 1);
+            }
+        }
+        return null;
+    }
+
+    /**
+     * Get every record of a job, queries and typed records alike, from
+     * the JSONL and binary (mariadb_profiler.log_format = binary) logs
+     * and their per-process shards, merged into one stream by "ts".
+     *
+     * @return array
+     */
+    public function getJobRecords($key)
+    {
+        $streams = [];
+        foreach ($this->getJobLogFiles($key, '.jsonl') as $file) {
+            $streams[] = $this->readJsonl($file);
+        }
+        foreach ($this->getJobLogFiles($key, '.bin') as $file) {
+            $streams[] = BinaryLogReader::readFile($file, $key);
+        }
+        return self::mergeByTimestamp($streams);
+    }
+
+    /**
+     * Log files of a job ending in $suffix: the shared <key><suffix>,
+     * then the per-process shards <key>.shard-<pid><suffix> written with
+     * mariadb_profiler.shard_logs, in pid order. Keys may not contain
+     * ".shard-", so another job's files never match.
+     *
+     * @return array Paths of the files that exist
+     */
+    public function getJobLogFiles($key, $suffix)
+    {
+        $files = [];
+        $base = $this->logDir . '/' . $key . $suffix;
+        if (file_exists($base)) {
+            $files[] = $base;
+        }
+
+        $pattern = '/^' . preg_quote($key . self::SHARD_MARKER, '/') . '(\d+)'
+            . preg_quote($suffix, '/') . '$/';
+        $shards = [];
+        $names = @scandir($this->logDir);
+        foreach ($names ?: [] as $name) {
+            if (preg_match($pattern, $name, $m)) {
+                $shards[$this->logDir . '/' . $name] = (int)$m[1];
+            }
+        }
+        asort($shards);
+
+        return array_merge($files, array_keys($shards));
+    }
+
+    /**
+     * Merge record lists, each in write order, into one list ordered by
+     * "ts" (k-way merge). Records without a timestamp (stack definitions)
+     * stay right behind the record written before them.
+     *
+     * @param array $streams List of record lists
+     * @return array
+     */
+    public static function mergeByTimestamp(array $streams)
+    {
+        return self::mergeStreams($streams, function ($entry) {
+            return isset($entry['ts']) ? (float)$entry['ts'] : null;
+        });
+    }
+
+    /**
+     * k-way merge of ordered lists by a numeric key. $keyOf returns the
+     * key of an item, or null to inherit the key of the previous item of
+     * the same list. Ties go to the earlier list.
+     */
+    private static function mergeStreams(array $streams, $keyOf)
+    {
+        $streams = array_values(array_filter($streams));
+        if (count($streams) <= 1) {
+            return $streams ? $streams[0] : [];
+        }
+
+        $heap = new \SplPriorityQueue();
+        $heap->setExtractFlags(\SplPriorityQueue::EXTR_DATA);
+        $keys = [];
+        foreach ($streams as $i => $stream) {
+            $key = $keyOf($stream[0]);
+            $keys[$i] = $key !== null ? $key : 0.0;
+            // Max-heap: negate so the smallest key (then list index) comes first
+            $heap->insert([$i, 0], [-$keys[$i], -$i]);
+        }
+
+        $merged = [];
+        while (!$heap->isEmpty()) {
+            list($i, $n) = $heap->extract();
+            $merged[] = $streams[$i][$n];
+            if (++$n < count($streams[$i])) {
+                $key = $keyOf($streams[$i][$n]);
+                if ($key !== null) {
+                    $keys[$i] = $key;
+                }
+                $heap->insert([$i, $n], [-$keys[$i], -$i]);
+            }
+        }
+        return $merged;
+    }
+
+    /**
+     * Decode every JSON line of a JSONL log file.
+     *
+     * @return array
+     */
+    private function readJsonl($file)
+    {
         if (!file_exists($file)) {
             return [];
         }
 
-        $queries = [];
+        $entries = [];
         $handle = fopen($file, 'r');
         if (!$handle) {
             return [];
@@ -170,53 +706,93 @@ class JobManager
             }
             $entry = json_decode($line, true);
             if (is_array($entry)) {
-                $queries[] = $entry;
+                $entries[] = $entry;
             }
         }
 
         fclose($handle);
-        return $queries;
+        return $entries;
     }
 
     /**
-     * Get raw log content for a job.
+     * Get raw log content for a job. Shards are merged entry by entry
+     * (an entry is a "[time] ..." line plus its indented lines).
      *
      * @return string|null
      */
     public function getRawLog($key)
     {
-        $file = $this->logDir . '/' . $key . '.raw.log';
-        if (!file_exists($file)) {
+        $files = $this->getJobLogFiles($key, '.raw.log');
+        if (!$files) {
             return null;
         }
-        return file_get_contents($file);
+        if (count($files) === 1) {
+            return file_get_contents($files[0]);
+        }
+
+        $streams = [];
+        foreach ($files as $file) {
+            $entries = [];
+            foreach (preg_split('/^(?=\[)/m', (string)file_get_contents($file)) as $entry) {
+                if ($entry !== '') {
+                    $entries[] = $entry;
+                }
+            }
+            $streams[] = $entries;
+        }
+
+        return implode('', self::mergeStreams($streams, function ($entry) {
+            // "[Y-m-d H:i:s.mmm] ..."
+            $time = strtotime(substr($entry, 1, 19));
+            return $time !== false ? $time + (float)substr($entry, 20, 4) : null;
+        }));
     }
 
     /**
-     * Count queries in a job's JSONL file.
+     * Count queries in a job's JSONL (and binary) log.
+     * A query record counts once, an aggregation summary counts its "n".
      *
-     * @return int Number of non-empty lines (queries) in the JSONL file; 0 if the file does not exist
+     * @return int Number of queries recorded; 0 if there is no log file
      */
     private function countQueries($key)
     {
-        $file = $this->logDir . '/' . $key . '.jsonl';
-        if (!file_exists($file)) {
-            return 0;
-        }
-
         $count = 0;
-        $handle = fopen($file, 'r');
-        if (!$handle) {
-            return 0;
+
+        foreach ($this->getJobLogFiles($key, '.bin') as $binFile) {
+            foreach (BinaryLogReader::readFile($binFile, $key) as $entry) {
+                if (!isset($entry['type'])) {
+                    $count++;
+                } elseif ($entry['type'] === 'agg' && isset($entry['n'])) {
+                    $count += (int)$entry['n'];
+                }
+            }
         }
 
-        while (($line = fgets($handle)) !== false) {
-            if (trim($line) !== '') {
+        foreach ($this->getJobLogFiles($key, '.jsonl') as $file) {
+            $handle = fopen($file, 'r');
+            if (!$handle) {
+                continue;
+            }
+
+            while (($line = fgets($handle)) !== false) {
+                $line = trim($line);
+                if ($line === '') {
+                    continue;
+                }
+                // Typed records put "type" first, so queries skip the decode
+                if (strpos($line, '{"type":') === 0) {
+                    $entry = json_decode($line, true);
+                    if (is_array($entry) && $entry['type'] === 'agg' && isset($entry['n'])) {
+                        $count += (int)$entry['n'];
+                    }
+                    continue;
+                }
                 $count++;
             }
+
+            fclose($handle);
         }
 
-        fclose($handle);
         return $count;
     }
 
@@ -274,10 +850,81 @@ class JobManager
         rewind($handle);
         fwrite($handle, json_encode($data, JSON_PRETTY_PRINT | JSON_UNESCAPED_UNICODE));
         fflush($handle);
+
+        // Publish while still holding the jobs.json lock so a reader that
+        // sees the new generation also reads the new job list.
+        $activeCount = isset($data['active_jobs']) ? count($data['active_jobs']) : 0;
+        $this->publishRegistry($activeCount);
+
+        flock($handle, LOCK_UN);
+        fclose($handle);
+    }
+
+    /**
+     * Bump the generation counter in jobs.gen and record the active job count.
+     *
+     * The extension maps this file and compares the generation once per
+     * request, re-reading jobs.json only when it changes. The file is
+     * rewritten in place (never truncated or replaced) so existing
+     * mappings stay valid.
+     */
+    private function publishRegistry($activeCount)
+    {
+        $handle = fopen($this->registryFile, 'c+');
+        if (!$handle) {
+            fwrite(STDERR, "[ERROR] Cannot open {$this->registryFile} for writing.\n");
+            return;
+        }
+
+        flock($handle, LOCK_EX);
+
+        $generation = 0;
+        $header = fread($handle, self::REGISTRY_SIZE);
+        if ($header !== false && strlen($header) === self::REGISTRY_SIZE
+            && substr($header, 0, 4) === self::REGISTRY_MAGIC) {
+            $parts = unpack('Vlo/Vhi', substr($header, 8, 8));
+            $generation = $parts['hi'] * 4294967296 + $parts['lo'];
+        }
+        $generation++;
+
+        $record = self::REGISTRY_MAGIC
+            . pack('V', self::REGISTRY_VERSION)
+            . pack('V', (int)fmod($generation, 4294967296))
+            . pack('V', (int)floor($generation / 4294967296))
+            . pack('V', $activeCount)
+            . str_repeat("\0", 12);
+
+        rewind($handle);
+        fwrite($handle, $record);
+        fflush($handle);
         flock($handle, LOCK_UN);
         fclose($handle);
     }
 
+    /**
+     * Read the job registry header.
+     *
+     * @return array|null ['generation' => int, 'active' => int], or null if missing/invalid
+     */
+    public function readRegistry()
+    {
+        if (!file_exists($this->registryFile)) {
+            return null;
+        }
+
+        $header = file_get_contents($this->registryFile);
+        if ($header === false || strlen($header) < self::REGISTRY_SIZE
+            || substr($header, 0, 4) !== self::REGISTRY_MAGIC) {
+            return null;
+        }
+
+        $fields = unpack('Vversion/Vlo/Vhi/Vactive', substr($header, 4, 16));
+        return [
+            'generation' => $fields['hi'] * 4294967296 + $fields['lo'],
+            'active' => $fields['active'],
+        ];
+    }
+
     /**
      * Remove all completed job data.
      */
@@ -361,11 +1008,12 @@ class JobManager
      */
     private function removeJobFiles($key)
     {
-        $files = [
-            $this->logDir . '/' . $key . '.jsonl',
-            $this->logDir . '/' . $key . '.raw.log',
-            $this->logDir . '/' . $key . '.parsed.json',
-        ];
+        $files = array_merge(
+            $this->getJobLogFiles($key, '.jsonl'),
+            $this->getJobLogFiles($key, '.bin'),
+            $this->getJobLogFiles($key, '.raw.log'),
+            [$this->logDir . '/' . $key . '.parsed.json']
+        );
 
         foreach ($files as $file) {
             if (file_exists($file)) {
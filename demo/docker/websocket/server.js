@@ -3,9 +3,12 @@ const { WebSocketServer } = require('ws');
 const { spawn } = require('child_process');
 const path = require('path');
 const fs = require('fs');
+const net = require('net');
 
 const LOG_DIR = '/var/profiler';
 const PORT = 3000;
+// Set to <collector socket>.tail when PHP logs through `collector run`
+const COLLECTOR_TAIL_SOCKET = process.env.COLLECTOR_TAIL_SOCKET || '';
 
 const server = http.createServer((req, res) => {
   res.writeHead(200, { 'Content-Type': 'text/plain' });
@@ -28,6 +31,28 @@ wss.on('connection', (ws, req) => {
 
   console.log(`[connect] job=${jobKey}`);
 
+  if (COLLECTOR_TAIL_SOCKET) {
+    // Subscribe to the collector: it pushes every buffer it appends to
+    // the file, so there is no file to poll
+    const sub = net.createConnection(COLLECTOR_TAIL_SOCKET, () => {
+      sub.write(`${jobKey}.raw.log\n`);
+    });
+    sub.on('data', (data) => {
+      if (ws.readyState === ws.OPEN) {
+        ws.send(data.toString().replace(/\n/g, '\r\n'));
+      }
+    });
+    sub.on('error', (err) => {
+      console.error(`[collector error] job=${jobKey}: ${err.message}`);
+      if (ws.readyState === ws.OPEN) ws.close();
+    });
+    ws.on('close', () => {
+      console.log(`[disconnect] job=${jobKey}`);
+      sub.destroy();
+    });
+    return;
+  }
+
   // Wait for the log file to appear (created by PHP extension), then stream it.
   // Use a polling approach since the volume is read-only for this container.
   let tail = null;
@@ -5,9 +5,12 @@ Runs against the Docker Compose environment, takes screenshots at each stage,
 and collects profiler logs for upload as CI artifacts.
 """
 
+import json
 import os
+import subprocess
 import time
 import unittest
+import uuid
 from pathlib import Path
 
 from selenium import webdriver
@@ -20,6 +23,38 @@ BASE_URL = os.environ.get("DEMO_URL", "http://localhost:8080")
 SCREENSHOT_DIR = Path(os.environ.get("SCREENSHOT_DIR", "screenshots"))
 LOG_OUTPUT_DIR = Path(os.environ.get("LOG_OUTPUT_DIR", "logs"))
 WAIT_TIMEOUT = 30
+COMPOSE_DIR = Path(__file__).parent.parent
+PROFILER_CLI = "/opt/profiler/cli/mariadb_profiler.php"
+
+# Opens $pdo on the demo database; failed statements return false
+PHP_PRELUDE = """<?php
+$pdo = new PDO('mysql:host=mariadb;dbname=demo', 'demo', 'demo');
+$pdo->setAttribute(PDO::ATTR_ERRMODE, PDO::ERRMODE_SILENT);
+"""
+
+
+def param_hash(data: bytes) -> str:
+    """MurmurHash64A as the extension tags truncated parameters with."""
+    mask = (1 << 64) - 1
+    m = 0xC6A4A7935BD1E995
+    h = (0x9747B28C ^ (len(data) * m)) & mask
+    whole = len(data) & ~7
+    for i in range(0, whole, 8):
+        k = int.from_bytes(data[i:i + 8], "little")
+        k = (k * m) & mask
+        k ^= k >> 47
+        k = (k * m) & mask
+        h ^= k
+        h = (h * m) & mask
+    tail = data[whole:]
+    if tail:
+        for i, byte in enumerate(tail):
+            h ^= byte << (8 * i)
+        h = (h * m) & mask
+    h ^= h >> 47
+    h = (h * m) & mask
+    h ^= h >> 47
+    return f"{h:016x}"
 
 
 class DemoE2ETest(unittest.TestCase):
@@ -335,5 +370,357 @@ class DemoE2ETest(unittest.TestCase):
             self.skipTest(f"Could not verify extension: {e}")
 
 
+class ExtensionE2ETest(unittest.TestCase):
+    """Extension behaviour checked by running PHP in the app container.
+
+    Every test gets its own empty log directory, so sessions left open by
+    the UI tests do not capture (or receive) anything here.
+    """
+
+    def setUp(self):
+        self.log_dir = f"/tmp/e2e-{self._testMethodName}-{uuid.uuid4().hex[:8]}"
+        self.app_exec("mkdir", "-p", self.log_dir)
+
+    def app_exec(self, *args, stdin=None):
+        """Run a command in the app container as the PHP-FPM user."""
+        result = subprocess.run(
+            ["docker", "compose", "-f", "docker-compose.yml",
+             "exec", "-T", "-u", "www-data", "app", *args],
+            input=stdin, capture_output=True, text=True, cwd=str(COMPOSE_DIR)
+        )
+        if result.returncode != 0 and args[0] != "php":
+            self.fail(f"{' '.join(args)} failed: {result.stderr}")
+        return result
+
+    def run_php(self, body, **ini):
+        """Run PHP_PRELUDE + body as a script file under this test's log_dir.
+
+        Keyword arguments are mariadb_profiler.* INI settings. Returns the
+        completed process; stdout holds whatever the script echoed.
+        """
+        script = f"{self.log_dir}/script.php"
+        self.app_exec("sh", "-c", f"cat > {script}", stdin=PHP_PRELUDE + body)
+        args = ["php", "-d", f"mariadb_profiler.log_dir={self.log_dir}"]
+        for name, value in ini.items():
+            args += ["-d", f"mariadb_profiler.{name}={value}"]
+        return self.app_exec(*args, script)
+
+    def run_php_json(self, body, **ini):
+        """run_php() for a script that ends by echoing one JSON value."""
+        result = self.run_php(body, **ini)
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        return json.loads(result.stdout.strip().splitlines()[-1])
+
+    def start_job(self, key, *options):
+        """Start a job in this test's log_dir with CLI options."""
+        result = self.app_exec("php", PROFILER_CLI, "--log-dir", self.log_dir,
+                               "job", "start", key, *options)
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+
+    def job_records(self, key):
+        """Decoded JSONL records of a job's log, [] if it has none."""
+        result = self.app_exec("sh", "-c", f"cat {self.log_dir}/{key}.jsonl 2>/dev/null || true")
+        return [json.loads(line) for line in result.stdout.splitlines() if line.strip()]
+
+    def test_01_stats_without_job(self):
+        """mariadb_profiler_stats() counts statements while no job is active."""
+        print("\n[Ext 01] In-request stats without a job...")
+        stats = self.run_php_json("""
+mariadb_profiler_reset_stats();
+mariadb_profiler_tag('e2e-read');
+for ($i = 0; $i < 3; $i++) {
+    $pdo->query('SELECT 1');
+}
+mariadb_profiler_untag();
+mariadb_profiler_tag('e2e-write');
+$pdo->query('SELECT * FROM e2e_no_such_table');
+mariadb_profiler_untag();
+$pdo->query('SELECT 2');
+$before = mariadb_profiler_stats();
+
+mariadb_profiler_reset_stats();
+$reset = mariadb_profiler_stats();
+$pdo->query('SELECT 3');
+$after = mariadb_profiler_stats();
+echo json_encode(['before' => $before, 'reset' => $reset, 'after' => $after]);
+""")
+        before = stats["before"]
+        self.assertEqual(before["queries"], 5)
+        self.assertEqual(before["errors"], 1)
+        self.assertGreaterEqual(before["db_time_us"], before["max_us"])
+        self.assertEqual(before["tags"]["e2e-read"]["queries"], 3)
+        self.assertEqual(before["tags"]["e2e-read"]["errors"], 0)
+        self.assertEqual(before["tags"]["e2e-write"]["queries"], 1)
+        self.assertEqual(before["tags"]["e2e-write"]["errors"], 1)
+        self.assertEqual(len(before["tags"]), 2)
+
+        reset = stats["reset"]
+        self.assertEqual(reset["queries"], 0)
+        self.assertEqual(reset["errors"], 0)
+        self.assertEqual(reset["db_time_us"], 0)
+        self.assertEqual(reset["tags"], [])
+        self.assertGreaterEqual(reset["since"], before["since"])
+
+        after = stats["after"]
+        self.assertEqual(after["queries"], 1)
+        self.assertEqual(after["errors"], 0)
+        self.assertEqual(after["tags"], [])
+
+        # Nothing was captured: no job exists in this log directory
+        listing = self.app_exec("ls", self.log_dir).stdout.split()
+        self.assertEqual(listing, ["script.php"])
+        print("  Stats counted and reset as expected")
+
+    def test_02_budget_warn(self):
+        """A budget over its limit warns once per request."""
+        print("\n[Ext 02] Query budget, warn...")
+        result = self.run_php_json("""
+$warnings = [];
+set_error_handler(function ($no, $msg) use (&$warnings) {
+    $warnings[] = $msg;
+    return true;
+});
+for ($i = 0; $i < 5; $i++) {
+    $pdo->query("SELECT $i");
+}
+echo json_encode($warnings);
+""", budget_queries=2, budget_action="warn")
+        self.assertEqual(len(result), 1, result)
+        self.assertIn("Query budget exceeded: 3 statements (max 2) at: SELECT 2", result[0])
+        print("  Warned once for the third statement")
+
+    def test_03_budget_log(self):
+        """With budget_action=log the violation is written to the job's log."""
+        print("\n[Ext 03] Query budget, log...")
+        self.start_job("budget")
+        result = self.run_php("""
+mariadb_profiler_tag('e2e-budget');
+for ($i = 0; $i < 4; $i++) {
+    $pdo->query('SELECT 42');
+}
+""", budget_repeats=2, budget_action="log")
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        self.assertNotIn("budget", result.stdout + result.stderr)
+
+        budgets = [r for r in self.job_records("budget") if r.get("type") == "budget"]
+        self.assertEqual(len(budgets), 1, budgets)
+        self.assertEqual(budgets[0]["limit"], "repeats")
+        self.assertEqual(budgets[0]["max"], 2)
+        self.assertEqual(budgets[0]["n"], 3)
+        self.assertEqual(budgets[0]["q"], "SELECT 42")
+        self.assertEqual(budgets[0]["tag"], "e2e-budget")
+        self.assertRegex(budgets[0]["fp"], r"^[0-9a-f]{16}$")
+        self.assertTrue(budgets[0]["ep"].endswith("script.php"))
+        print("  Budget record logged once")
+
+    def test_04_budget_throw(self):
+        """throw raises MariadbProfilerBudgetException from the query hook,
+        falls back to a warning while that exception is pending, and
+        mariadb_profiler_set_budget() rejects invalid arguments."""
+        print("\n[Ext 04] Query budget, throw...")
+        # No error handler: PHP does not call one while an exception is
+        # pending, so warnings are read back with error_get_last()
+        result = self.run_php_json("""
+ini_set('display_errors', '0');
+$out = [];
+$out['bad_limit'] = mariadb_profiler_set_budget(-1);
+$out['bad_limit_error'] = error_get_last()['message'];
+$out['bad_action'] = mariadb_profiler_set_budget(1, 0, 0, 'explode');
+$out['bad_action_error'] = error_get_last()['message'];
+error_clear_last();
+
+// Statements and repeats both go over on the third run: the first
+// limit throws, the second can only warn
+$out['set'] = mariadb_profiler_set_budget(2, 0, 2, 'throw');
+$out['thrown'] = [];
+for ($i = 0; $i < 5; $i++) {
+    try {
+        $pdo->query('SELECT 7');
+    } catch (MariadbProfilerBudgetException $e) {
+        $out['thrown'][] = [$i, $e->getMessage()];
+        $out['warning'] = error_get_last()['message'] ?? null;
+        error_clear_last();
+    }
+}
+$out['later_warning'] = error_get_last();
+echo json_encode($out);
+""")
+        self.assertFalse(result["bad_limit"])
+        self.assertIn("Budget limits must be 0 or greater", result["bad_limit_error"])
+        self.assertFalse(result["bad_action"])
+        self.assertIn('Budget action must be "warn", "log" or "throw"',
+                      result["bad_action_error"])
+
+        self.assertTrue(result["set"])
+        self.assertEqual(len(result["thrown"]), 1, result["thrown"])
+        self.assertEqual(result["thrown"][0][0], 2)
+        self.assertIn("3 statements (max 2) at: SELECT 7", result["thrown"][0][1])
+        self.assertIn("3 runs of one statement (max 2)", result["warning"] or "")
+        self.assertIsNone(result["later_warning"])
+        print("  Thrown once, pending-exception fallback warned, bad arguments rejected")
+
+    def queries(self, records):
+        """Statement text of the query records (those without a type)."""
+        return [r["q"] for r in records if "type" not in r]
+
+    def types(self, records):
+        """Record types other than queries, e.g. {"tx", "req"}."""
+        return {r["type"] for r in records if "type" in r}
+
+    def test_05_job_filters(self):
+        """Each filtered job gets only the records its filter accepts."""
+        print("\n[Ext 05] Per-job capture filters...")
+        self.start_job("all")
+        self.start_job("verb", "--filter-verb=UPDATE,DELETE")
+        self.start_job("table", "--filter-table=POSTS")
+        self.start_job("slow", "--filter-min-us=200000")
+        self.start_job("err", "--filter-status=err")
+        self.start_job("tag", "--filter-tag=e2e-checkout")
+        self.start_job("uri", "--filter-uri=/tmp/e2e-", "--filter-verb=SELECT")
+        self.start_job("other-uri", "--filter-uri=/api/")
+
+        result = self.run_php("""
+mariadb_profiler_tag('e2e-checkout/cart');
+$pdo->query('SELECT COUNT(*) FROM posts');
+mariadb_profiler_untag();
+$pdo->query('UPDATE users SET active = active WHERE id = 0');
+$pdo->query('SELECT SLEEP(0.3)');
+$pdo->query('SELECT * FROM e2e_no_such_table');
+$pdo->query('START TRANSACTION');
+$pdo->query('SELECT 1');
+$pdo->query('COMMIT');
+""", intern_stacks=0, intern_statements=0, slow_threshold_us=0)
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+
+        everything = self.job_records("all")
+        self.assertEqual(self.queries(everything), [
+            "SELECT COUNT(*) FROM posts",
+            "UPDATE users SET active = active WHERE id = 0",
+            "SELECT SLEEP(0.3)",
+            "SELECT * FROM e2e_no_such_table",
+            "START TRANSACTION",
+            "SELECT 1",
+            "COMMIT",
+        ])
+        self.assertTrue({"conn", "tx", "req"} <= self.types(everything))
+
+        # Verb and table filters: typed records have no statement text
+        verb = self.job_records("verb")
+        self.assertEqual(self.queries(verb), ["UPDATE users SET active = active WHERE id = 0"])
+        self.assertEqual(self.types(verb), set())
+        table = self.job_records("table")
+        self.assertEqual(self.queries(table), ["SELECT COUNT(*) FROM posts"])
+        self.assertEqual(self.types(table), set())
+
+        # min_us: the request took longer than the threshold, the
+        # connect and the transaction did not
+        slow = self.job_records("slow")
+        self.assertEqual(self.queries(slow), ["SELECT SLEEP(0.3)"])
+        self.assertEqual(self.types(slow), {"req"})
+
+        # status=err: the request had a failed statement
+        err = self.job_records("err")
+        self.assertEqual(self.queries(err), ["SELECT * FROM e2e_no_such_table"])
+        self.assertTrue(all(r["s"] == "err" for r in err if "type" not in r))
+        self.assertEqual(self.types(err), {"req"})
+
+        # Tag prefix: nothing but the tagged statement ran under the tag
+        tag = self.job_records("tag")
+        self.assertEqual(self.queries(tag), ["SELECT COUNT(*) FROM posts"])
+        self.assertEqual(tag[0]["tag"], "e2e-checkout/cart")
+        self.assertEqual(self.types(tag), set())
+
+        # uri is checked once per request (CLI: the script path)
+        uri = self.job_records("uri")
+        self.assertEqual(self.queries(uri), [
+            "SELECT COUNT(*) FROM posts",
+            "SELECT SLEEP(0.3)",
+            "SELECT * FROM e2e_no_such_table",
+            "SELECT 1",
+        ])
+        self.assertEqual(self.job_records("other-uri"), [])
+        print("  Every job got exactly what its filter accepts")
+
+    def test_06_job_filters_aggregate(self):
+        """With aggregate=1 a filtered job gets summaries of its own queries."""
+        print("\n[Ext 06] Per-job filters with aggregation...")
+        self.start_job("all")
+        self.start_job("verb", "--filter-verb=UPDATE")
+
+        result = self.run_php("""
+for ($i = 0; $i < 3; $i++) {
+    $pdo->query("SELECT $i");
+}
+for ($i = 0; $i < 2; $i++) {
+    $pdo->query("UPDATE users SET active = active WHERE id = -$i");
+}
+""", aggregate=1)
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+
+        def shapes(key):
+            return {r["q"].split(" ")[0].lower(): r["n"]
+                    for r in self.job_records(key) if r.get("type") == "agg"}
+
+        self.assertEqual(shapes("all"), {"select": 3, "update": 2})
+        self.assertEqual(shapes("verb"), {"update": 2})
+        self.assertEqual(self.queries(self.job_records("verb")), [])
+        print("  Summaries split per job")
+
+    def test_07_statement_params(self):
+        """Long parameters are cut at a UTF-8 boundary within the
+        per-value and per-record caps, and streamed blobs are counted."""
+        print("\n[Ext 07] Prepared statement parameters...")
+        self.start_job("params")
+
+        result = self.run_php("""
+$db = new mysqli('mariadb', 'demo', 'demo', 'demo');
+$db->query('CREATE TEMPORARY TABLE e2e_params (a TEXT, b TEXT, c LONGBLOB, d INT)');
+$stmt = $db->prepare('INSERT INTO e2e_params (a, b, c, d) VALUES (?, ?, ?, ?)');
+$a = str_repeat("\\u{e9}", 20);
+$b = str_repeat('x', 100);
+$c = null;
+$d = 7;
+$stmt->bind_param('ssbi', $a, $b, $c, $d);
+$stmt->send_long_data(2, str_repeat('z', 1000));
+$stmt->send_long_data(2, str_repeat('z', 500));
+$stmt->execute();
+""", intern_statements=0, param_max_bytes=25, params_max_bytes=40)
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+
+        inserts = [r for r in self.job_records("params")
+                   if "type" not in r and r["q"].startswith("INSERT")]
+        self.assertEqual(len(inserts), 1, inserts)
+        a = "\u00e9" * 20
+        b = "x" * 100
+        self.assertEqual(inserts[0]["params"], [
+            # 25 bytes would split a character: 24 are kept
+            "\u00e9" * 12 + f"...[40 bytes #{param_hash(a.encode())}]",
+            # 16 bytes left of the record's 40
+            "x" * 16 + f"...[100 bytes #{param_hash(b.encode())}]",
+            "[BLOB 2 chunks, 1500 bytes]",
+            "7",
+        ])
+        print("  Parameters truncated and blob counted as expected")
+
+    def test_08_sample_rate_key(self):
+        """A job's sample_rate is found even when "sample_rate" also
+        appears as a value earlier in its object (parent key, tag)."""
+        print("\n[Ext 08] sample_rate next to look-alike values...")
+        self.start_job("sample_rate", "--filter-uri=/api/")
+        self.start_job("never", "--sample-rate=0", "--filter-tag=sample_rate")
+
+        # The look-alike value comes first in the job's object
+        jobs = "".join(self.app_exec("cat", f"{self.log_dir}/jobs.json").stdout.split())
+        self.assertLess(jobs.index('"parent":"sample_rate"'), jobs.index('"sample_rate":0'))
+
+        result = self.run_php("""
+mariadb_profiler_tag('sample_rate');
+$pdo->query('SELECT 1');
+""")
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        self.assertEqual(self.job_records("never"), [])
+        print("  Job sampled at 0 captured nothing")
+
+
 if __name__ == "__main__":
     unittest.main(verbosity=2)
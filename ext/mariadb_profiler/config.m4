@@ -19,9 +19,15 @@ if test "$PHP_MARIADB_PROFILER" != "no"; then
   fi
 
   PHP_NEW_EXTENSION(mariadb_profiler,
-    mariadb_profiler.c profiler_mysqlnd_plugin.c profiler_job.c profiler_log.c profiler_tag.c profiler_trace.c,
+    mariadb_profiler.c profiler_mysqlnd_plugin.c profiler_job.c profiler_log.c profiler_tag.c profiler_trace.c profiler_buf.c profiler_writer.c profiler_result.c profiler_fingerprint.c profiler_agg.c profiler_binlog.c profiler_json.c profiler_encode.c profiler_stack.c profiler_tmpl.c profiler_async.c profiler_collector.c profiler_tx.c profiler_filter.c profiler_trigger.c profiler_budget.c profiler_request.c profiler_stats.c,
     $ext_shared,, $PROFILER_CFLAGS)
 
+  dnl Background writer thread (mariadb_profiler.async_writer)
+  AC_CHECK_LIB(pthread, pthread_create, [
+    PHP_ADD_LIBRARY(pthread, 1, MARIADB_PROFILER_SHARED_LIBADD)
+  ])
+  PHP_SUBST(MARIADB_PROFILER_SHARED_LIBADD)
+
   dnl Require mysqlnd
   PHP_ADD_EXTENSION_DEP(mariadb_profiler, mysqlnd, true)
 fi
@@ -15,6 +15,14 @@
 #include "php_ini.h"
 #include "ext/standard/info.h"
 #include "php_mariadb_profiler.h"
+#include "profiler_result.h"
+#include "profiler_fingerprint.h"
+#include "profiler_json.h"
+#include "profiler_stack.h"
+#include "profiler_tmpl.h"
+#include "profiler_async.h"
+#include "profiler_collector.h"
+#include "profiler_budget.h"
 
 #include <sys/stat.h>
 #include <errno.h>
@@ -47,6 +55,14 @@ PHP_INI_BEGIN()
         zend_mariadb_profiler_globals,
         mariadb_profiler_globals)
 
+    STD_PHP_INI_ENTRY("mariadb_profiler.log_format",
+        "jsonl",
+        PHP_INI_SYSTEM,
+        OnUpdateString,
+        log_format,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
     STD_PHP_INI_ENTRY("mariadb_profiler.job_check_interval",
         "1",
         PHP_INI_SYSTEM,
@@ -62,6 +78,151 @@ PHP_INI_BEGIN()
         trace_depth,
         zend_mariadb_profiler_globals,
         mariadb_profiler_globals)
+
+    STD_PHP_INI_BOOLEAN("mariadb_profiler.intern_stacks",
+        "1",
+        PHP_INI_SYSTEM,
+        OnUpdateBool,
+        intern_stacks,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_BOOLEAN("mariadb_profiler.intern_statements",
+        "1",
+        PHP_INI_SYSTEM,
+        OnUpdateBool,
+        intern_statements,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.param_max_bytes",
+        "1024",
+        PHP_INI_SYSTEM,
+        OnUpdateLong,
+        param_max_bytes,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.params_max_bytes",
+        "8192",
+        PHP_INI_SYSTEM,
+        OnUpdateLong,
+        params_max_bytes,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.slow_threshold_us",
+        "0",
+        PHP_INI_SYSTEM,
+        OnUpdateLong,
+        slow_threshold_us,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_BOOLEAN("mariadb_profiler.slow_only",
+        "0",
+        PHP_INI_SYSTEM,
+        OnUpdateBool,
+        slow_only,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_BOOLEAN("mariadb_profiler.aggregate",
+        "0",
+        PHP_INI_SYSTEM,
+        OnUpdateBool,
+        aggregate,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.buffer_size",
+        "65536",
+        PHP_INI_SYSTEM,
+        OnUpdateLong,
+        buffer_size,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_BOOLEAN("mariadb_profiler.shard_logs",
+        "0",
+        PHP_INI_SYSTEM,
+        OnUpdateBool,
+        shard_logs,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_BOOLEAN("mariadb_profiler.async_writer",
+        "0",
+        PHP_INI_SYSTEM,
+        OnUpdateBool,
+        async_writer,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.async_queue_size",
+        "1024",
+        PHP_INI_SYSTEM,
+        OnUpdateLong,
+        async_queue_size,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.async_full_policy",
+        "drop",
+        PHP_INI_SYSTEM,
+        OnUpdateString,
+        async_full_policy,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.collector_socket",
+        "",
+        PHP_INI_SYSTEM,
+        OnUpdateString,
+        collector_socket,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.sample_rate",
+        "1.0",
+        PHP_INI_SYSTEM,
+        OnUpdateReal,
+        sample_rate,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    /* Budgets may differ per application: also settable per directory */
+    STD_PHP_INI_ENTRY("mariadb_profiler.budget_queries",
+        "0",
+        PHP_INI_PERDIR,
+        OnUpdateLong,
+        budget_queries,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.budget_db_time_us",
+        "0",
+        PHP_INI_PERDIR,
+        OnUpdateLong,
+        budget_db_time_us,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.budget_repeats",
+        "0",
+        PHP_INI_PERDIR,
+        OnUpdateLong,
+        budget_repeats,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
+
+    STD_PHP_INI_ENTRY("mariadb_profiler.budget_action",
+        "warn",
+        PHP_INI_PERDIR,
+        OnUpdateString,
+        budget_action,
+        zend_mariadb_profiler_globals,
+        mariadb_profiler_globals)
 PHP_INI_END()
 /* }}} */
 
@@ -69,6 +230,22 @@ PHP_INI_END()
 static void php_mariadb_profiler_init_globals(zend_mariadb_profiler_globals *g)
 {
     memset(g, 0, sizeof(zend_mariadb_profiler_globals));
+    g->collector_fd = -1;
+}
+/* }}} */
+
+/* {{{ php_mariadb_profiler_shutdown_globals
+ * Release state that persists across requests (job list, registry map,
+ * trace frame array, interned stack set, statement templates,
+ * collector socket).
+ * ZTS calls this per thread; NTS calls it from MSHUTDOWN. */
+static void php_mariadb_profiler_shutdown_globals(zend_mariadb_profiler_globals *g)
+{
+    profiler_job_shutdown(g);
+    profiler_trace_shutdown(g);
+    profiler_stack_shutdown(g);
+    profiler_tmpl_shutdown(g);
+    profiler_collector_shutdown(g);
 }
 /* }}} */
 
@@ -176,12 +353,16 @@ static int profiler_ensure_log_dir(TSRMLS_D)
 /* {{{ PHP_MINIT_FUNCTION */
 PHP_MINIT_FUNCTION(mariadb_profiler)
 {
-    ZEND_INIT_MODULE_GLOBALS(mariadb_profiler, php_mariadb_profiler_init_globals, NULL);
+    ZEND_INIT_MODULE_GLOBALS(mariadb_profiler, php_mariadb_profiler_init_globals,
+        php_mariadb_profiler_shutdown_globals);
     REGISTER_INI_ENTRIES();
+    profiler_budget_init();
 
     if (PROFILER_G(enabled)) {
         mariadb_profiler_mysqlnd_plugin_register();
         profiler_log_init();
+        profiler_fingerprint_init();
+        profiler_json_init();
     }
 
     return SUCCESS;
@@ -193,8 +374,13 @@ PHP_MSHUTDOWN_FUNCTION(mariadb_profiler)
 {
     if (PROFILER_G(enabled)) {
         profiler_log_shutdown();
+        profiler_async_shutdown();
     }
 
+#ifndef ZTS
+    php_mariadb_profiler_shutdown_globals(&mariadb_profiler_globals);
+#endif
+
     UNREGISTER_INI_ENTRIES();
     return SUCCESS;
 }
@@ -208,14 +394,24 @@ PHP_RINIT_FUNCTION(mariadb_profiler)
 #endif
 
     if (PROFILER_G(enabled)) {
+        PROFILER_G(in_request) = 1;
+        profiler_request_init();
+        profiler_stats_request_init();
         /* Ensure log dir exists on first request */
         profiler_ensure_log_dir(TSRMLS_C);
-        /* Load active jobs at request start */
-        profiler_job_refresh_active_jobs();
+        profiler_writer_request_init();
+        /* A fatal error inside a hook can skip the decrement */
+        PROFILER_G(query_depth) = 0;
+        /* Pick up job changes (cheap unless the registry generation moved)
+         * and decide which jobs sample this request */
+        profiler_job_request_init();
+        profiler_budget_request_init();
 #if PHP_VERSION_ID >= 70000
         /* Initialize prepared statement query template storage */
         ALLOC_HASHTABLE(PROFILER_G(stmt_queries));
         zend_hash_init(PROFILER_G(stmt_queries), 16, NULL, ZVAL_PTR_DTOR, 0);
+        /* Records waiting for their result set */
+        profiler_result_request_init();
 #endif
     }
 
@@ -227,8 +423,18 @@ PHP_RINIT_FUNCTION(mariadb_profiler)
 PHP_RSHUTDOWN_FUNCTION(mariadb_profiler)
 {
     if (PROFILER_G(enabled)) {
+        /* Log statements whose result was never freed, add the
+         * per-shape and request summaries, then write out everything
+         * buffered during this request */
+        mariadb_profiler_mysqlnd_plugin_request_shutdown();
+        profiler_agg_request_shutdown();
+        profiler_request_shutdown();
+        profiler_writer_request_shutdown();
+        profiler_trace_request_shutdown();
         profiler_tag_clear_all();
-        profiler_job_free_active_jobs();
+        profiler_job_request_shutdown();
+        profiler_budget_request_shutdown();
+        profiler_stats_request_shutdown();
 #if PHP_VERSION_ID >= 70000
         /* Free prepared statement query template storage */
         if (PROFILER_G(stmt_queries)) {
@@ -237,6 +443,9 @@ PHP_RSHUTDOWN_FUNCTION(mariadb_profiler)
             PROFILER_G(stmt_queries) = NULL;
         }
 #endif
+        /* Objects freed after RSHUTDOWN (e.g. an implicit mysqli close)
+         * still run the hooks: keep them from starting request state */
+        PROFILER_G(in_request) = 0;
     }
     return SUCCESS;
 }
@@ -246,16 +455,84 @@ PHP_RSHUTDOWN_FUNCTION(mariadb_profiler)
 PHP_MINFO_FUNCTION(mariadb_profiler)
 {
     char trace_depth_str[32];
+    char buffer_size_str[32];
+    char sample_rate_str[32];
+    char slow_threshold_str[64];
+    char async_str[128];
+    profiler_async_stats async_stats;
+    char collector_str[160];
+    char params_str[96];
+    char budget_str[160];
 
     snprintf(trace_depth_str, sizeof(trace_depth_str), "%ld",
         (long)PROFILER_G(trace_depth));
+    snprintf(buffer_size_str, sizeof(buffer_size_str), "%ld",
+        (long)PROFILER_G(buffer_size));
+    snprintf(sample_rate_str, sizeof(sample_rate_str), "%g",
+        PROFILER_G(sample_rate));
+    if (PROFILER_G(slow_threshold_us) > 0) {
+        snprintf(slow_threshold_str, sizeof(slow_threshold_str), "%ld us (%s)",
+            (long)PROFILER_G(slow_threshold_us),
+            PROFILER_G(slow_only) ? "slow queries only" : "trace slow queries only");
+    } else {
+        snprintf(slow_threshold_str, sizeof(slow_threshold_str), "Off");
+    }
+    if (!PROFILER_G(async_writer)) {
+        snprintf(async_str, sizeof(async_str), "Off");
+    } else if (!profiler_async_available()) {
+        snprintf(async_str, sizeof(async_str), "Unavailable on this platform (writes are synchronous)");
+    } else {
+        profiler_async_get_stats(&async_stats);
+        snprintf(async_str, sizeof(async_str), "On, %s when full (%llu written, %llu dropped)",
+            PROFILER_G(async_full_policy), (unsigned long long)async_stats.written,
+            (unsigned long long)async_stats.dropped);
+    }
+    if (PROFILER_G(param_max_bytes) > 0 || PROFILER_G(params_max_bytes) > 0) {
+        snprintf(params_str, sizeof(params_str), "%ld bytes per value, %ld per query (0 = unlimited)",
+            (long)PROFILER_G(param_max_bytes), (long)PROFILER_G(params_max_bytes));
+    } else {
+        snprintf(params_str, sizeof(params_str), "Unlimited");
+    }
+    if (PROFILER_G(budget_queries) > 0 || PROFILER_G(budget_db_time_us) > 0
+        || PROFILER_G(budget_repeats) > 0) {
+        snprintf(budget_str, sizeof(budget_str),
+            "%ld statements, %ld us, %ld runs per shape (0 = no limit), %s",
+            (long)PROFILER_G(budget_queries), (long)PROFILER_G(budget_db_time_us),
+            (long)PROFILER_G(budget_repeats), PROFILER_G(budget_action));
+    } else {
+        snprintf(budget_str, sizeof(budget_str), "Off");
+    }
+    if (!PROFILER_G(collector_socket) || !PROFILER_G(collector_socket)[0]) {
+        snprintf(collector_str, sizeof(collector_str), "Off");
+    } else {
+        snprintf(collector_str, sizeof(collector_str), "%s (%llu sent, %llu dropped)",
+            PROFILER_G(collector_socket), (unsigned long long)PROFILER_G(collector_sent),
+            (unsigned long long)PROFILER_G(collector_dropped));
+    }
 
     php_info_print_table_start();
     php_info_print_table_header(2, "MariaDB Query Profiler", "enabled");
     php_info_print_table_row(2, "Version", PHP_MARIADB_PROFILER_VERSION);
     php_info_print_table_row(2, "Log directory", PROFILER_G(log_dir));
     php_info_print_table_row(2, "Raw logging", PROFILER_G(raw_log) ? "Yes" : "No");
+    php_info_print_table_row(2, "Log format", PROFILER_G(log_format));
+    php_info_print_table_row(2, "JSON escaper", profiler_json_impl());
     php_info_print_table_row(2, "Trace depth", trace_depth_str);
+    php_info_print_table_row(2, "Stack interning", PROFILER_G(intern_stacks) ? "Yes" : "No");
+    php_info_print_table_row(2, "Parameter capture", params_str);
+    php_info_print_table_row(2, "Statement interning", PROFILER_G(intern_statements) ? "Yes" : "No");
+    php_info_print_table_row(2, "Write buffer (bytes)", buffer_size_str);
+#ifdef ZTS
+    php_info_print_table_row(2, "Log files", PROFILER_G(shard_logs) ? "One per process (flock)" : "Shared (flock)");
+#else
+    php_info_print_table_row(2, "Log files", PROFILER_G(shard_logs) ? "One per process (no lock)" : "Shared (flock)");
+#endif
+    php_info_print_table_row(2, "Background writer", async_str);
+    php_info_print_table_row(2, "Collector socket", collector_str);
+    php_info_print_table_row(2, "Sample rate", sample_rate_str);
+    php_info_print_table_row(2, "Slow threshold", slow_threshold_str);
+    php_info_print_table_row(2, "Aggregation", PROFILER_G(aggregate) ? "Per query shape" : "Off");
+    php_info_print_table_row(2, "Query budget", budget_str);
     php_info_print_table_end();
 
     DISPLAY_INI_ENTRIES();
@@ -273,13 +550,29 @@ ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_INFO_EX(arginfo_mariadb_profiler_get_tag, 0, 0, 0)
 ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_mariadb_profiler_set_budget, 0, 0, 1)
+    ZEND_ARG_INFO(0, max_queries)
+    ZEND_ARG_INFO(0, max_db_time_us)
+    ZEND_ARG_INFO(0, max_repeats)
+    ZEND_ARG_INFO(0, action)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_mariadb_profiler_stats, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_mariadb_profiler_reset_stats, 0, 0, 0)
+ZEND_END_ARG_INFO()
 /* }}} */
 
 /* {{{ mariadb_profiler_functions[] */
 static const zend_function_entry mariadb_profiler_functions[] = {
-    PHP_FE(mariadb_profiler_tag,     arginfo_mariadb_profiler_tag)
-    PHP_FE(mariadb_profiler_untag,   arginfo_mariadb_profiler_untag)
-    PHP_FE(mariadb_profiler_get_tag, arginfo_mariadb_profiler_get_tag)
+    PHP_FE(mariadb_profiler_tag,        arginfo_mariadb_profiler_tag)
+    PHP_FE(mariadb_profiler_untag,      arginfo_mariadb_profiler_untag)
+    PHP_FE(mariadb_profiler_get_tag,    arginfo_mariadb_profiler_get_tag)
+    PHP_FE(mariadb_profiler_set_budget, arginfo_mariadb_profiler_set_budget)
+    PHP_FE(mariadb_profiler_stats,      arginfo_mariadb_profiler_stats)
+    PHP_FE(mariadb_profiler_reset_stats, arginfo_mariadb_profiler_reset_stats)
     PHP_FE_END
 };
 /* }}} */
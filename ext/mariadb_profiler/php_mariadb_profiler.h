@@ -43,6 +43,21 @@ extern zend_module_entry mariadb_profiler_module_entry;
 /* Include compatibility layer (must come after php.h and mysqlnd headers) */
 #include "php_mariadb_profiler_compat.h"
 
+#include "profiler_clock.h"
+#include "profiler_record.h"
+#include "profiler_agg.h"
+#include "profiler_writer.h"
+#include "profiler_trace.h"
+#include "profiler_request.h"
+#include "profiler_stats.h"
+
+struct _profiler_filter;
+
+/* Slow-query filter verdicts (profiler_log_slow_verdict) */
+#define PROFILER_LOG_FULL      0 /* log with trace */
+#define PROFILER_LOG_NO_TRACE  1 /* fast query: log without trace */
+#define PROFILER_LOG_DROP      2 /* fast query and slow_only: skip it */
+
 /* Context tag limits */
 #define PROFILER_MAX_TAG_DEPTH 64
 #define PROFILER_MAX_TAG_LEN   256
@@ -52,19 +67,102 @@ ZEND_BEGIN_MODULE_GLOBALS(mariadb_profiler)
     zend_bool  enabled;
     char      *log_dir;
     zend_bool  raw_log;
+    char      *log_format;          /* "jsonl" or "binary" */
     /* Runtime state */
+    zend_bool  in_request;          /* between RINIT and the end of RSHUTDOWN */
     time_t     last_job_check;
     zend_long  job_check_interval; /* seconds between job file checks */
-    char     **active_jobs;
+    char     **active_jobs;         /* persistent: kept across requests */
+    double    *active_job_rates;    /* per-job sample_rate, <0 = use ini default */
+    struct _profiler_filter **active_job_filters; /* per-job filter, NULL = capture all */
+    char     **active_job_triggers; /* per-job trigger token, NULL = sampled instead */
     int        active_job_count;
+    /* Request sampling */
+    double     sample_rate;         /* default share of requests captured */
+    double     sample_point;        /* this request's draw in [0, 1) */
+    char      *request_trigger;     /* trigger value this request carries, NULL = none */
+    char     **sampled_jobs;        /* active jobs capturing this request */
+    struct _profiler_filter **sampled_job_filters; /* parallel to sampled_jobs */
+    int        sampled_job_count;
+    zend_bool  sampled_filtered;    /* some sampled job filters individual queries */
+    /* Job registry mapping (jobs.gen), kept across requests */
+    const unsigned char *registry;
+    uint64_t   registry_gen;        /* generation active_jobs was read at */
+    uint64_t   registry_ino;        /* inode of the mapped file */
     /* Context tag stack */
     char      *tag_stack[PROFILER_MAX_TAG_DEPTH];
     int        tag_depth;
+    int        query_depth;         /* >0 while inside the conn::query hook */
+    /* Transaction spans (profiler_tx.c) */
+    int        tx_hook_event;       /* control statement of the running tx_* hook, 0 = none */
+    uint32_t   tx_seq;              /* per-process span counter, kept across requests */
+    uint32_t   conn_seq;            /* per-process connection counter, kept across requests */
+    /* Request summary (profiler_request.c) */
+    profiler_request request;       /* this request's totals */
+    uint32_t   request_seq;         /* per-process request counter, kept across requests */
+    /* In-request stats (profiler_stats.c) */
+    profiler_stats stats;           /* every statement of this request, job or not */
+    /* Query budget (profiler_budget.c) */
+    zend_long  budget_queries;      /* ini: statements per request, 0 = no limit */
+    zend_long  budget_db_time_us;   /* ini: total statement time per request */
+    zend_long  budget_repeats;      /* ini: runs of one statement shape per request */
+    char      *budget_action;       /* ini: "warn", "log" or "throw" */
+    zend_bool  budget_on;           /* some limit is set for this request */
+    int        budget_mode;         /* PROFILER_BUDGET_WARN / LOG / THROW */
+    uint64_t   budget_max_queries;  /* this request's limits (ini or set_budget) */
+    uint64_t   budget_max_us;
+    uint64_t   budget_max_repeats;
+    uint64_t   budget_n;            /* statements counted so far */
+    uint64_t   budget_us;           /* their total time */
+    unsigned int budget_fired;      /* limits already reported (PROFILER_BUDGET_*) */
+    HashTable *budget_shapes;       /* fingerprint -> runs (uint64_t), NULL until needed */
     /* Trace settings */
     zend_long  trace_depth;         /* 0=disabled, N=capture N frames */
+    profiler_trace trace;           /* last capture; frame array kept across requests */
+    zend_bool  intern_stacks;       /* write each trace once per job, refer to it by id */
+    uint64_t  *stacks_sent;         /* persistent: (job file, stack id) pairs written */
+    size_t     stacks_sent_used;
+    uint64_t   stacks_gen;          /* registry_gen the set was built for */
+    /* Prepared statement templates (profiler_tmpl.c) */
+    zend_bool  intern_statements;   /* write each template once per job, refer to it by id */
+    struct _profiler_tmpl *tmpls;   /* persistent dictionary, kept across requests */
+    size_t     tmpls_used;
+    size_t     tmpls_bytes;
+    /* Bound parameter capture limits (0 = unlimited) */
+    zend_long  param_max_bytes;     /* per string parameter */
+    zend_long  params_max_bytes;    /* all string parameters of one record */
+    /* Slow-query filter */
+    zend_long  slow_threshold_us;   /* 0=disabled, else trace only slower queries */
+    zend_bool  slow_only;           /* drop queries below the threshold */
+    /* Aggregation mode: one summary per query shape instead of every query */
+    zend_bool     aggregate;
+    profiler_agg *agg;              /* this request's shape tables, NULL until first query */
+    /* Buffered writer: per-request sinks (one per job log file) */
+    zend_long      buffer_size;     /* flush threshold in bytes, 0=write-through */
+    profiler_sink *sinks;
+    int            sink_count;
+    int            sink_capacity;
+    zend_bool      shard_logs;        /* one <job>.shard-<pid><ext> file per process, no flock */
+    long           shard_pid;         /* pid in this request's file names, 0 = not sharded */
+    /* Background writer (profiler_async.c) */
+    zend_bool      async_writer;      /* hand flushed buffers to the writer thread */
+    zend_long      async_queue_size;  /* queue slots (rounded up to a power of two) */
+    char          *async_full_policy; /* "drop" or "block" when the queue is full */
+    /* Collector sink (profiler_collector.c) */
+    char          *collector_socket;  /* datagram socket path, "" = write files */
+    int            collector_fd;      /* connected socket, -1 = not connected */
+    time_t         collector_retry_at; /* no reconnect before this time */
+    uint64_t       collector_sent;
+    uint64_t       collector_dropped; /* collector queue full */
 #if PHP_VERSION_ID >= 70000
     /* Prepared statement query template storage (PHP 7.0+) */
-    HashTable *stmt_queries;        /* stmt ptr -> query template string */
+    HashTable *stmt_queries;        /* stmt ptr -> profiler_tmpl* (IS_PTR) or template copy */
+    /* Records waiting for their result set (PHP 7.0+) */
+    HashTable *pending_results;     /* conn/res/stmt ptr -> profiler_pending* */
+    /* send_long_data() accounting until the next execute (PHP 7.0+) */
+    HashTable *stmt_long_data;      /* stmt ptr -> per-parameter chunk/byte counts */
+    /* Transaction span of each connection (PHP 7.0+) */
+    HashTable *tx_conns;            /* conn ptr -> profiler_tx_conn* */
 #endif
 ZEND_END_MODULE_GLOBALS(mariadb_profiler)
 
@@ -83,6 +181,23 @@ ZEND_EXTERN_MODULE_GLOBALS(mariadb_profiler)
 #define PROFILER_G(v) (mariadb_profiler_globals.v)
 #endif
 
+/*
+ * PROFILER_GP(): this thread's globals as a pointer, for the helpers
+ * that free persistent state of the globals they are given (under ZTS
+ * the globals dtor runs once per thread, passing that thread's).
+ * PHP 5.x ZTS needs tsrm_ls in scope (TSRMLS_FETCH).
+ */
+#ifdef ZTS
+# if PHP_VERSION_ID >= 70000
+#  define PROFILER_GP() ZEND_MODULE_GLOBALS_BULK(mariadb_profiler)
+# else
+#  define PROFILER_GP() ((zend_mariadb_profiler_globals *) \
+     (*((void ***)tsrm_ls))[TSRM_UNSHUFFLE_RSRC_ID(mariadb_profiler_globals_id)])
+# endif
+#else
+# define PROFILER_GP() (&mariadb_profiler_globals)
+#endif
+
 /* Function declarations */
 PHP_MINIT_FUNCTION(mariadb_profiler);
 PHP_MSHUTDOWN_FUNCTION(mariadb_profiler);
@@ -92,20 +207,36 @@ PHP_MINFO_FUNCTION(mariadb_profiler);
 
 /* mysqlnd plugin */
 void mariadb_profiler_mysqlnd_plugin_register(void);
+void mariadb_profiler_mysqlnd_plugin_request_shutdown(void);
 
 /* Job management */
 int  profiler_job_refresh_active_jobs(void);
 void profiler_job_free_active_jobs(void);
+void profiler_job_sync(void);
+void profiler_job_request_init(void);
+void profiler_job_request_shutdown(void);
+void profiler_job_shutdown(zend_mariadb_profiler_globals *g);
 int  profiler_job_is_any_active(void);
 char **profiler_job_get_active_list(int *count);
+struct _profiler_filter **profiler_job_get_filters(void);
 
-/* Logging – status is "ok" or "err" (NULL treated as "ok") */
-void profiler_log_query(const char *query, size_t query_len, const char *status);
+struct _profiler_tx;
+
+/* Logging – status is "ok" or "err" (NULL treated as "ok");
+ * timer holds start time and duration (NULL = now, no duration) */
+void profiler_log_query(const char *query, size_t query_len, const char *status,
+                        const profiler_timer *timer);
 void profiler_log_query_with_params(const char *query, size_t query_len,
-                                    const char *params_json, const char *status);
-void profiler_log_raw(const char *job_key, const char *query, size_t query_len,
-                      const char *tag, const char *trace_json,
-                      const char *params_json, const char *status);
+                                    const char *params_json, const char *status,
+                                    const profiler_timer *timer);
+void profiler_log_record(const profiler_record *rec);
+int  profiler_log_slow_verdict(const profiler_timer *timer);
+int  profiler_log_wanted(const profiler_record *rec);
+void profiler_log_summary(const profiler_agg_entry *e, const char *job);
+void profiler_log_tx(const struct _profiler_tx *tx);
+void profiler_log_conn(const profiler_conn_event *ev);
+void profiler_log_budget(const profiler_budget_event *ev);
+void profiler_log_request(const profiler_request *req);
 void profiler_log_init(void);
 void profiler_log_shutdown(void);
 
@@ -116,12 +247,12 @@ char       *profiler_tag_pop(void);
 char       *profiler_tag_pop_until(const char *target, size_t target_len);
 void        profiler_tag_clear_all(void);
 
-/* Trace */
-char *profiler_trace_capture_json(void);
-
 /* PHP functions */
 PHP_FUNCTION(mariadb_profiler_tag);
 PHP_FUNCTION(mariadb_profiler_untag);
 PHP_FUNCTION(mariadb_profiler_get_tag);
+PHP_FUNCTION(mariadb_profiler_set_budget);
+PHP_FUNCTION(mariadb_profiler_stats);
+PHP_FUNCTION(mariadb_profiler_reset_stats);
 
 #endif /* PHP_MARIADB_PROFILER_H */
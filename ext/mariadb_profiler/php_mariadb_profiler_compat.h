@@ -142,6 +142,19 @@ typedef long zend_long;
     zend_fetch_debug_backtrace((zv), (skip), (opts), (limit))
 #endif
 
+/*
+ * ---- $this of a call frame (trace walker) ----
+ *
+ * PHP 7.0:  Z_OBJ(ex->This) is NULL for function and static calls
+ * PHP 7.1+: This also carries call info; only an object if IS_OBJECT
+ */
+#if PHP_VERSION_ID >= 70100
+# define PROFILER_EX_OBJ(ex) \
+    (Z_TYPE((ex)->This) == IS_OBJECT ? Z_OBJ((ex)->This) : NULL)
+#elif PHP_VERSION_ID >= 70000
+# define PROFILER_EX_OBJ(ex) Z_OBJ((ex)->This)
+#endif
+
 /*
  * ---- zend_parse_parameters string length type ----
  *
@@ -191,6 +204,20 @@ typedef long zend_long;
 # define PROFILER_BOOL_T zend_bool
 #endif
 
+/*
+ * ---- conn_data::store_result / use_result flags argument ----
+ *
+ * PHP 8.1+: (conn)
+ * PHP 7.x-8.0: (conn, const unsigned int flags)
+ */
+#if PHP_VERSION_ID >= 80100
+# define PROFILER_RESULT_FLAGS_DC
+# define PROFILER_RESULT_FLAGS_CC
+#else
+# define PROFILER_RESULT_FLAGS_DC , const unsigned int flags
+# define PROFILER_RESULT_FLAGS_CC , flags
+#endif
+
 /*
  * ---- Platform I/O compatibility (Windows) ----
  *
@@ -204,6 +231,7 @@ typedef long zend_long;
 #ifdef PHP_WIN32
 # include <io.h>
 # include <direct.h>
+# include <process.h>
 
 /* ssize_t is not defined in MSVC */
 typedef intptr_t profiler_ssize_t;
@@ -211,7 +239,12 @@ typedef intptr_t profiler_ssize_t;
 /* POSIX I/O function mapping */
 # define profiler_open     _open
 # define profiler_read     _read
+# define profiler_write    _write
 # define profiler_close    _close
+# define profiler_getpid   _getpid
+
+/* Log files are written byte-for-byte (no CRLF translation) */
+# define PROFILER_O_BINARY _O_BINARY
 
 /* S_ISDIR may not be defined on all MSVC versions */
 # ifndef S_ISDIR
@@ -311,7 +344,11 @@ typedef ssize_t profiler_ssize_t;
 
 # define profiler_open     open
 # define profiler_read     read
+# define profiler_write    write
 # define profiler_close    close
+# define profiler_getpid   getpid
+
+# define PROFILER_O_BINARY 0
 
 # define PROFILER_MKDIR(path, mode)  mkdir(path, mode)
 
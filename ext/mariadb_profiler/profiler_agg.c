@@ -0,0 +1,164 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Per-Fingerprint Aggregation                 |
+  +----------------------------------------------------------------------+
+  | Request-scoped tables of query shapes with count, error count,       |
+  | total/min/max duration and a log2 latency histogram. The normalized  |
+  | statement is only built the first time a fingerprint is seen.        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_agg.h"
+#include "profiler_fingerprint.h"
+
+#define PROFILER_AGG_MIN_CAP 32
+
+/* {{{ profiler_agg_bucket */
+static int profiler_agg_bucket(uint64_t us)
+{
+    int b = 0;
+
+    while (us >= 2 && b < PROFILER_AGG_BUCKETS - 1) {
+        us >>= 1;
+        b++;
+    }
+    return b;
+}
+/* }}} */
+
+/* {{{ profiler_agg_slot
+ * Slot holding fp, or the free slot where it belongs. */
+static profiler_agg_entry *profiler_agg_slot(profiler_agg *agg, uint64_t fp)
+{
+    size_t mask = agg->cap - 1;
+    size_t i = (size_t)(fp ^ (fp >> 32)) & mask;
+
+    while (agg->slots[i].norm && agg->slots[i].fp != fp) {
+        i = (i + 1) & mask;
+    }
+    return &agg->slots[i];
+}
+/* }}} */
+
+/* {{{ profiler_agg_grow */
+static void profiler_agg_grow(profiler_agg *agg)
+{
+    profiler_agg_entry *old = agg->slots;
+    size_t old_cap = agg->cap;
+    size_t i;
+
+    agg->cap = old_cap ? old_cap * 2 : PROFILER_AGG_MIN_CAP;
+    agg->slots = (profiler_agg_entry *)ecalloc(agg->cap, sizeof(profiler_agg_entry));
+
+    for (i = 0; i < old_cap; i++) {
+        if (old[i].norm) {
+            *profiler_agg_slot(agg, old[i].fp) = old[i];
+        }
+    }
+    if (old) {
+        efree(old);
+    }
+}
+/* }}} */
+
+/* {{{ profiler_agg_table
+ * job's table (NULL = the shared one), created on first use. */
+static profiler_agg *profiler_agg_table(const char *job)
+{
+    profiler_agg *agg;
+    TSRMLS_FETCH();
+
+    for (agg = PROFILER_G(agg); agg; agg = agg->next) {
+        if (job ? agg->job && strcmp(agg->job, job) == 0 : !agg->job) {
+            return agg;
+        }
+    }
+    agg = (profiler_agg *)ecalloc(1, sizeof(profiler_agg));
+    agg->job = job ? estrdup(job) : NULL;
+    agg->next = PROFILER_G(agg);
+    PROFILER_G(agg) = agg;
+    return agg;
+}
+/* }}} */
+
+/* {{{ profiler_agg_add */
+void profiler_agg_add(const profiler_record *rec, const char *job)
+{
+    profiler_agg *agg = profiler_agg_table(job);
+    profiler_agg_entry *e;
+
+    if ((agg->used + 1) * 2 > agg->cap) {
+        profiler_agg_grow(agg);
+    }
+
+    e = profiler_agg_slot(agg, rec->fp);
+    if (!e->norm) {
+        profiler_buf norm;
+
+        profiler_buf_init(&norm);
+        profiler_fingerprint(rec->query, rec->query_len, &norm);
+        if (!norm.data) {
+            profiler_buf_append(&norm, "", 0);
+        }
+        e->fp = rec->fp;
+        e->norm = norm.data;
+        e->norm_len = norm.len;
+        e->first_ts = rec->timer ? rec->timer->start_ts : profiler_clock_wall();
+        e->min_us = (uint64_t)-1;
+        agg->used++;
+    }
+
+    e->count++;
+    if (rec->status && strcmp(rec->status, "err") == 0) {
+        e->errors++;
+    }
+    if (rec->timer) {
+        uint64_t us = rec->timer->dur_us;
+
+        e->sum_us += us;
+        if (us < e->min_us) {
+            e->min_us = us;
+        }
+        if (us > e->max_us) {
+            e->max_us = us;
+        }
+        e->hist[profiler_agg_bucket(us)]++;
+    }
+}
+/* }}} */
+
+/* {{{ profiler_agg_request_shutdown */
+void profiler_agg_request_shutdown(void)
+{
+    profiler_agg *agg;
+    profiler_agg *next;
+    size_t i;
+    TSRMLS_FETCH();
+
+    agg = PROFILER_G(agg);
+    PROFILER_G(agg) = NULL;
+
+    for (; agg; agg = next) {
+        next = agg->next;
+        for (i = 0; i < agg->cap; i++) {
+            if (agg->slots[i].norm) {
+                profiler_log_summary(&agg->slots[i], agg->job);
+                efree(agg->slots[i].norm);
+            }
+        }
+        if (agg->slots) {
+            efree(agg->slots);
+        }
+        if (agg->job) {
+            efree(agg->job);
+        }
+        efree(agg);
+    }
+}
+/* }}} */
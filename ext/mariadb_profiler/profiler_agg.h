@@ -0,0 +1,49 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Per-Fingerprint Aggregation Header          |
+  +----------------------------------------------------------------------+
+  | With mariadb_profiler.aggregate on, records are folded into one      |
+  | entry per query shape for the request and written out as summary     |
+  | records at request shutdown instead of one line per query.           |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_AGG_H
+#define PROFILER_AGG_H
+
+/* Latency histogram: bucket 0 counts durations below 2us, bucket i
+ * counts [2^i, 2^(i+1)) us, the last bucket everything from ~8.4s up. */
+#define PROFILER_AGG_BUCKETS 24
+
+typedef struct _profiler_agg_entry {
+    uint64_t  fp;
+    char     *norm;       /* normalized statement, NULL = free slot */
+    size_t    norm_len;
+    double    first_ts;   /* start time of the first query of this shape */
+    uint64_t  count;
+    uint64_t  errors;
+    uint64_t  sum_us;
+    uint64_t  min_us;
+    uint64_t  max_us;
+    uint32_t  hist[PROFILER_AGG_BUCKETS];
+} profiler_agg_entry;
+
+/* Open-addressing table keyed by fingerprint. One table is shared by
+ * the jobs that take every query; a job with a per-query filter gets
+ * its own, holding only the queries its filter accepted. */
+typedef struct _profiler_agg {
+    char                *job;  /* that job's key, NULL = shared table */
+    profiler_agg_entry  *slots;
+    size_t               cap;  /* power of two */
+    size_t               used;
+    struct _profiler_agg *next;
+} profiler_agg;
+
+/* Fold one record into its fingerprint's entry (rec->flags has FP) in
+ * job's table, or in the shared one if job is NULL. */
+void profiler_agg_add(const profiler_record *rec, const char *job);
+
+/* Write one summary record per fingerprint and release the tables. */
+void profiler_agg_request_shutdown(void);
+
+#endif /* PROFILER_AGG_H */
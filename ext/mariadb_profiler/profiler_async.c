@@ -0,0 +1,413 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Background Writer                           |
+  +----------------------------------------------------------------------+
+  | Request threads push (path, bytes) items into a bounded MPSC ring    |
+  | (Vyukov's sequence-numbered slots, producers claim a slot with one   |
+  | CAS). A single writer thread per process pops them in order and      |
+  | appends them to the job files the way the request would have. The    |
+  | ring is shared by all threads of a ZTS process; a forked child       |
+  | starts its own writer on first use.                                  |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_async.h"
+#include "profiler_writer.h"
+
+#include <fcntl.h>
+#include <errno.h>
+
+#if !defined(PHP_WIN32) && defined(__ATOMIC_SEQ_CST)
+# define PROFILER_ASYNC 1
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+#ifdef PROFILER_ASYNC
+
+/* Files the writer keeps open while the queue is busy */
+#define PROFILER_ASYNC_FDS      16
+/* Idle wait of the writer between checks, in milliseconds */
+#define PROFILER_ASYNC_IDLE_MS  200
+
+typedef struct _profiler_async_item {
+    char   *path;
+    size_t  len;
+    char    data[1];  /* data, then the NUL-terminated path */
+} profiler_async_item;
+
+typedef struct _profiler_async_slot {
+    size_t               seq;
+    profiler_async_item *item;
+} profiler_async_slot;
+
+typedef struct _profiler_async_fd {
+    char *path;
+    int   fd;
+} profiler_async_fd;
+
+static struct {
+    /* Producers only touch head, the writer only tail: keep them apart */
+    size_t               head;
+    char                 pad1[64 - sizeof(size_t)];
+    size_t               tail;
+    char                 pad2[64 - sizeof(size_t)];
+    profiler_async_slot *slots;
+    size_t               mask;
+    int                  block;     /* async_full_policy = block */
+    int                  use_flock; /* flock the files (off with NTS shard_logs) */
+    int                  sleeping;  /* writer is (about to be) waiting */
+    int                  stop;
+    pid_t                pid;       /* process the thread runs in, 0 = none */
+    pthread_t            thread;
+    pthread_mutex_t      lock;
+    pthread_cond_t       wake;
+    profiler_async_fd    fds[PROFILER_ASYNC_FDS];
+    int                  fd_count;
+    profiler_async_stats stats;
+} profiler_async;
+
+/* Serializes thread start-up between request threads */
+static pthread_mutex_t profiler_async_start_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* {{{ profiler_async_push
+ * Claim the slot at head and publish item in it. 0 if the ring is full. */
+static int profiler_async_push(profiler_async_item *item)
+{
+    size_t pos = __atomic_load_n(&profiler_async.head, __ATOMIC_RELAXED);
+    profiler_async_slot *slot;
+
+    for (;;) {
+        intptr_t diff;
+
+        slot = &profiler_async.slots[pos & profiler_async.mask];
+        diff = (intptr_t)__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&profiler_async.head, &pos, pos + 1, 1,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&profiler_async.head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->item = item;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+    return 1;
+}
+/* }}} */
+
+/* {{{ profiler_async_pop
+ * Next item in push order, NULL if the ring is empty (writer only). */
+static profiler_async_item *profiler_async_pop(void)
+{
+    size_t pos = profiler_async.tail;
+    profiler_async_slot *slot = &profiler_async.slots[pos & profiler_async.mask];
+    profiler_async_item *item;
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) != pos + 1) {
+        return NULL;
+    }
+
+    item = slot->item;
+    __atomic_store_n(&slot->seq, pos + profiler_async.mask + 1, __ATOMIC_RELEASE);
+    profiler_async.tail = pos + 1;
+    return item;
+}
+/* }}} */
+
+/* {{{ profiler_async_wake
+ * Signal the writer if it is waiting. The SEQ_CST store of the slot and
+ * load of sleeping pair with the writer's store of sleeping and re-check
+ * of the ring, so one side always sees the other. */
+static void profiler_async_wake(void)
+{
+    if (__atomic_load_n(&profiler_async.sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&profiler_async.lock);
+        pthread_cond_signal(&profiler_async.wake);
+        pthread_mutex_unlock(&profiler_async.lock);
+    }
+}
+/* }}} */
+
+/* {{{ profiler_async_fd_for
+ * Descriptor for path from the writer's small cache, -1 on error. */
+static int profiler_async_fd_for(const char *path)
+{
+    profiler_async_fd *entry;
+    int fd;
+    int i;
+
+    for (i = 0; i < profiler_async.fd_count; i++) {
+        if (strcmp(profiler_async.fds[i].path, path) == 0) {
+            return profiler_async.fds[i].fd;
+        }
+    }
+
+    fd = profiler_open(path, O_WRONLY | O_APPEND | O_CREAT | PROFILER_O_BINARY, 0666);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (profiler_async.fd_count == PROFILER_ASYNC_FDS) {
+        /* Full: evict the oldest */
+        profiler_close(profiler_async.fds[0].fd);
+        free(profiler_async.fds[0].path);
+        memmove(&profiler_async.fds[0], &profiler_async.fds[1],
+            (PROFILER_ASYNC_FDS - 1) * sizeof(profiler_async_fd));
+        profiler_async.fd_count--;
+    }
+
+    entry = &profiler_async.fds[profiler_async.fd_count++];
+    entry->path = strdup(path);
+    entry->fd = fd;
+    return fd;
+}
+/* }}} */
+
+/* {{{ profiler_async_close_fds
+ * Called whenever the queue runs empty, so files removed by
+ * "job purge" are not kept alive by the writer. */
+static void profiler_async_close_fds(void)
+{
+    int i;
+
+    for (i = 0; i < profiler_async.fd_count; i++) {
+        profiler_close(profiler_async.fds[i].fd);
+        free(profiler_async.fds[i].path);
+    }
+    profiler_async.fd_count = 0;
+}
+/* }}} */
+
+/* {{{ profiler_async_main
+ * Writer thread: drain the ring, then wait for a wake-up (or the idle
+ * timeout, which also covers a missed signal). Exits once stop is set
+ * and the ring is empty. */
+static void *profiler_async_main(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+        profiler_async_item *item = profiler_async_pop();
+        struct timespec until;
+        int stop;
+
+        if (item) {
+            int fd = profiler_async_fd_for(item->path);
+
+            if (fd >= 0) {
+                profiler_writer_append(fd, item->data, item->len, profiler_async.use_flock);
+            }
+            free(item);
+            __atomic_add_fetch(&profiler_async.stats.written, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        profiler_async_close_fds();
+
+        pthread_mutex_lock(&profiler_async.lock);
+        __atomic_store_n(&profiler_async.sleeping, 1, __ATOMIC_SEQ_CST);
+        {
+            size_t pos = profiler_async.tail;
+            profiler_async_slot *slot = &profiler_async.slots[pos & profiler_async.mask];
+
+            if (!profiler_async.stop
+                && __atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) != pos + 1) {
+                clock_gettime(CLOCK_REALTIME, &until);
+                until.tv_nsec += PROFILER_ASYNC_IDLE_MS * 1000000L;
+                if (until.tv_nsec >= 1000000000L) {
+                    until.tv_sec++;
+                    until.tv_nsec -= 1000000000L;
+                }
+                pthread_cond_timedwait(&profiler_async.wake, &profiler_async.lock, &until);
+            }
+        }
+        __atomic_store_n(&profiler_async.sleeping, 0, __ATOMIC_SEQ_CST);
+        stop = profiler_async.stop;
+        pthread_mutex_unlock(&profiler_async.lock);
+
+        if (stop) {
+            /* Anything pushed before stop was set is still written */
+            while ((item = profiler_async_pop()) != NULL) {
+                int fd = profiler_async_fd_for(item->path);
+
+                if (fd >= 0) {
+                    profiler_writer_append(fd, item->data, item->len, profiler_async.use_flock);
+                }
+                free(item);
+                __atomic_add_fetch(&profiler_async.stats.written, 1, __ATOMIC_RELAXED);
+            }
+            profiler_async_close_fds();
+            return NULL;
+        }
+    }
+}
+/* }}} */
+
+/* {{{ profiler_async_start
+ * Start the writer for this process if it is not running yet. A child
+ * forked from a process with a writer inherits the ring but not the
+ * thread, so everything is set up afresh (items left in the parent's
+ * ring belong to the parent). */
+static int profiler_async_start(void)
+{
+    pid_t pid = profiler_getpid();
+    size_t size;
+    size_t i;
+    int ret = SUCCESS;
+    TSRMLS_FETCH();
+
+    if (__atomic_load_n(&profiler_async.pid, __ATOMIC_ACQUIRE) == pid) {
+        return SUCCESS;
+    }
+
+    pthread_mutex_lock(&profiler_async_start_lock);
+
+    if (profiler_async.pid != pid) {
+        size = 16;
+        while (size < (size_t)PROFILER_G(async_queue_size) && size < ((size_t)1 << 20)) {
+            size <<= 1;
+        }
+
+        memset(&profiler_async, 0, sizeof(profiler_async));
+        profiler_async.slots = (profiler_async_slot *)pemalloc(size * sizeof(profiler_async_slot), 1);
+        for (i = 0; i < size; i++) {
+            profiler_async.slots[i].seq = i;
+            profiler_async.slots[i].item = NULL;
+        }
+        profiler_async.mask = size - 1;
+        profiler_async.block = PROFILER_G(async_full_policy)
+            && strcmp(PROFILER_G(async_full_policy), "block") == 0;
+        profiler_async.use_flock = profiler_writer_use_lock();
+        pthread_mutex_init(&profiler_async.lock, NULL);
+        pthread_cond_init(&profiler_async.wake, NULL);
+
+        if (pthread_create(&profiler_async.thread, NULL, profiler_async_main, NULL) == 0) {
+            __atomic_store_n(&profiler_async.pid, pid, __ATOMIC_RELEASE);
+        } else {
+            pefree(profiler_async.slots, 1);
+            profiler_async.slots = NULL;
+            ret = FAILURE;
+        }
+    }
+
+    pthread_mutex_unlock(&profiler_async_start_lock);
+    return ret;
+}
+/* }}} */
+
+/* {{{ profiler_async_write */
+int profiler_async_write(const char *path, const char *data, size_t len)
+{
+    size_t path_len = strlen(path);
+    profiler_async_item *item;
+
+    if (profiler_async_start() != SUCCESS) {
+        return FAILURE;
+    }
+
+    item = (profiler_async_item *)malloc(sizeof(profiler_async_item) + len + path_len);
+    if (!item) {
+        return FAILURE;
+    }
+    item->len = len;
+    memcpy(item->data, data, len);
+    item->path = item->data + len;
+    memcpy(item->path, path, path_len + 1);
+
+    while (!profiler_async_push(item)) {
+        if (!profiler_async.block || __atomic_load_n(&profiler_async.stop, __ATOMIC_RELAXED)) {
+            free(item);
+            __atomic_add_fetch(&profiler_async.stats.dropped, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&profiler_async.stats.dropped_bytes, len, __ATOMIC_RELAXED);
+            return PROFILER_ASYNC_DROPPED;
+        }
+        /* block: let the writer catch up */
+        profiler_async_wake();
+        sched_yield();
+    }
+
+    __atomic_add_fetch(&profiler_async.stats.queued, 1, __ATOMIC_RELAXED);
+    profiler_async_wake();
+    return SUCCESS;
+}
+/* }}} */
+
+/* {{{ profiler_async_available */
+int profiler_async_available(void)
+{
+    return 1;
+}
+/* }}} */
+
+/* {{{ profiler_async_get_stats */
+void profiler_async_get_stats(profiler_async_stats *stats)
+{
+    stats->queued = __atomic_load_n(&profiler_async.stats.queued, __ATOMIC_RELAXED);
+    stats->written = __atomic_load_n(&profiler_async.stats.written, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&profiler_async.stats.dropped, __ATOMIC_RELAXED);
+    stats->dropped_bytes = __atomic_load_n(&profiler_async.stats.dropped_bytes, __ATOMIC_RELAXED);
+}
+/* }}} */
+
+/* {{{ profiler_async_shutdown */
+void profiler_async_shutdown(void)
+{
+    pthread_mutex_lock(&profiler_async_start_lock);
+
+    if (profiler_async.pid == profiler_getpid()) {
+        pthread_mutex_lock(&profiler_async.lock);
+        profiler_async.stop = 1;
+        pthread_cond_signal(&profiler_async.wake);
+        pthread_mutex_unlock(&profiler_async.lock);
+
+        pthread_join(profiler_async.thread, NULL);
+
+        pthread_cond_destroy(&profiler_async.wake);
+        pthread_mutex_destroy(&profiler_async.lock);
+        pefree(profiler_async.slots, 1);
+        profiler_async.slots = NULL;
+        profiler_async.pid = 0;
+    }
+
+    pthread_mutex_unlock(&profiler_async_start_lock);
+}
+/* }}} */
+
+#else /* !PROFILER_ASYNC */
+
+/* No thread support (Windows builds): every write stays synchronous */
+
+int profiler_async_write(const char *path, const char *data, size_t len)
+{
+    (void)path;
+    (void)data;
+    (void)len;
+    return FAILURE;
+}
+
+int profiler_async_available(void)
+{
+    return 0;
+}
+
+void profiler_async_get_stats(profiler_async_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void profiler_async_shutdown(void)
+{
+}
+
+#endif /* PROFILER_ASYNC */
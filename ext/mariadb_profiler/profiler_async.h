@@ -0,0 +1,42 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Background Writer Header                    |
+  +----------------------------------------------------------------------+
+  | With mariadb_profiler.async_writer on, flushed sink buffers are      |
+  | handed to one writer thread per process through a bounded lock-free  |
+  | queue instead of being written by the request itself.                |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_ASYNC_H
+#define PROFILER_ASYNC_H
+
+/* Counters since process start (or the last fork) */
+typedef struct _profiler_async_stats {
+    uint64_t queued;        /* writes handed to the writer thread */
+    uint64_t written;       /* writes the thread completed */
+    uint64_t dropped;       /* writes discarded because the queue was full */
+    uint64_t dropped_bytes;
+} profiler_async_stats;
+
+/* profiler_async_write() result: the data was discarded */
+#define PROFILER_ASYNC_DROPPED 1
+
+/*
+ * Queue data for appending to path. Starts the writer thread on first
+ * use in this process. Returns SUCCESS when the data was queued,
+ * PROFILER_ASYNC_DROPPED when the queue was full under the "drop"
+ * policy, and FAILURE when the caller has to write it itself (no
+ * thread support, thread could not be started). data is copied.
+ */
+int  profiler_async_write(const char *path, const char *data, size_t len);
+
+/* Whether this build can run the writer thread */
+int  profiler_async_available(void);
+
+void profiler_async_get_stats(profiler_async_stats *stats);
+
+/* Drain the queue and stop the thread (MSHUTDOWN) */
+void profiler_async_shutdown(void);
+
+#endif /* PROFILER_ASYNC_H */
@@ -0,0 +1,351 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Binary Log Format                           |
+  +----------------------------------------------------------------------+
+  | Encoders for the length-prefixed record format described in          |
+  | profiler_binlog.h. Records are built in place in the sink buffer.    |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_binlog.h"
+#include "profiler_trace.h"
+#include "profiler_tx.h"
+
+#define PROFILER_VARINT_MAX 10
+
+/* {{{ profiler_bin_varint_encode
+ * Write v as unsigned LEB128 into dst, return the byte count. */
+static size_t profiler_bin_varint_encode(unsigned char *dst, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        dst[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    dst[n++] = (unsigned char)v;
+    return n;
+}
+/* }}} */
+
+/* {{{ profiler_bin_varint */
+static void profiler_bin_varint(profiler_buf *out, uint64_t v)
+{
+    profiler_buf_reserve(out, PROFILER_VARINT_MAX);
+    out->len += profiler_bin_varint_encode((unsigned char *)out->data + out->len, v);
+    out->data[out->len] = '\0';
+}
+/* }}} */
+
+/* {{{ profiler_bin_tag */
+static void profiler_bin_tag(profiler_buf *out, unsigned int field, unsigned int wire)
+{
+    profiler_bin_varint(out, ((uint64_t)field << 3) | wire);
+}
+/* }}} */
+
+/* {{{ profiler_bin_uint */
+static void profiler_bin_uint(profiler_buf *out, unsigned int field, uint64_t v)
+{
+    profiler_bin_tag(out, field, PROFILER_BIN_VARINT);
+    profiler_bin_varint(out, v);
+}
+/* }}} */
+
+/* {{{ profiler_bin_fixed64
+ * Little-endian regardless of host byte order. */
+static void profiler_bin_fixed64(profiler_buf *out, unsigned int field, uint64_t v)
+{
+    unsigned char le[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        le[i] = (unsigned char)(v >> (8 * i));
+    }
+    profiler_bin_tag(out, field, PROFILER_BIN_FIXED64);
+    profiler_buf_append(out, (const char *)le, 8);
+}
+/* }}} */
+
+/* {{{ profiler_bin_double */
+static void profiler_bin_double(profiler_buf *out, unsigned int field, double d)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &d, sizeof(bits));
+    profiler_bin_fixed64(out, field, bits);
+}
+/* }}} */
+
+/* {{{ profiler_bin_bytes */
+static void profiler_bin_bytes(profiler_buf *out, unsigned int field,
+                               const char *str, size_t len)
+{
+    profiler_bin_tag(out, field, PROFILER_BIN_BYTES);
+    profiler_bin_varint(out, len);
+    profiler_buf_append(out, str, len);
+}
+/* }}} */
+
+/* {{{ profiler_bin_trace
+ * The trace as a JSON array, same as in the JSONL format. */
+static void profiler_bin_trace(profiler_buf *out, const profiler_trace *trace)
+{
+    profiler_buf json;
+
+    profiler_buf_init(&json);
+    profiler_trace_append_json(&json, trace);
+    profiler_bin_bytes(out, PROFILER_BIN_F_TRACE, json.data, json.len);
+    profiler_buf_free(&json);
+}
+/* }}} */
+
+/* {{{ profiler_bin_begin
+ * Start a record: write its type, return where the body starts. */
+static size_t profiler_bin_begin(profiler_buf *out, unsigned char type)
+{
+    profiler_buf_appendc(out, (char)type);
+    return out->len;
+}
+/* }}} */
+
+/* {{{ profiler_bin_end
+ * Insert the body length between the type byte and the body. */
+static void profiler_bin_end(profiler_buf *out, size_t body_start)
+{
+    unsigned char len_buf[PROFILER_VARINT_MAX];
+    size_t body_len = out->len - body_start;
+    size_t n = profiler_bin_varint_encode(len_buf, body_len);
+
+    profiler_buf_reserve(out, n);
+    memmove(out->data + body_start + n, out->data + body_start, body_len);
+    memcpy(out->data + body_start, len_buf, n);
+    out->len += n;
+    out->data[out->len] = '\0';
+}
+/* }}} */
+
+/* {{{ profiler_binlog_query */
+void profiler_binlog_query(profiler_buf *out, const profiler_record *rec)
+{
+    size_t body = profiler_bin_begin(out, PROFILER_BIN_QUERY);
+
+    if (rec->flags & PROFILER_RECORD_TMPL) {
+        profiler_bin_fixed64(out, PROFILER_BIN_F_SID, rec->tmpl_id);
+    } else {
+        profiler_bin_bytes(out, PROFILER_BIN_F_Q, rec->query, rec->query_len);
+    }
+    if (rec->tag) {
+        profiler_bin_bytes(out, PROFILER_BIN_F_TAG, rec->tag, strlen(rec->tag));
+    }
+    if (rec->conn_id) {
+        profiler_bin_fixed64(out, PROFILER_BIN_F_CN, rec->conn_id);
+    }
+    if (rec->tx_id) {
+        profiler_bin_fixed64(out, PROFILER_BIN_F_TX, rec->tx_id);
+    }
+    if (rec->req_id) {
+        profiler_bin_fixed64(out, PROFILER_BIN_F_RQ, rec->req_id);
+    }
+    if (rec->params_json) {
+        profiler_bin_bytes(out, PROFILER_BIN_F_PARAMS, rec->params_json,
+            strlen(rec->params_json));
+    }
+    if (rec->flags & PROFILER_RECORD_STACK) {
+        profiler_bin_fixed64(out, PROFILER_BIN_F_ST, rec->stack_id);
+    } else if (rec->trace) {
+        profiler_bin_trace(out, rec->trace);
+    }
+    if (rec->status) {
+        profiler_bin_bytes(out, PROFILER_BIN_F_S, rec->status, strlen(rec->status));
+    }
+    if ((rec->flags & (PROFILER_RECORD_FP | PROFILER_RECORD_TMPL)) == PROFILER_RECORD_FP) {
+        profiler_bin_fixed64(out, PROFILER_BIN_F_FP, rec->fp);
+    }
+    profiler_bin_double(out, PROFILER_BIN_F_TS,
+        rec->timer ? rec->timer->start_ts : profiler_clock_wall());
+    if (rec->timer) {
+        profiler_bin_uint(out, PROFILER_BIN_F_DUR, rec->timer->dur_us);
+    }
+    if (rec->flags & PROFILER_RECORD_ROWS) {
+        profiler_bin_uint(out, PROFILER_BIN_F_ROWS, rec->rows);
+        profiler_bin_uint(out, PROFILER_BIN_F_FETCH, rec->fetch_us);
+    }
+    if (rec->flags & PROFILER_RECORD_BYTES) {
+        profiler_bin_uint(out, PROFILER_BIN_F_BYTES, rec->bytes);
+    }
+    if (rec->flags & PROFILER_RECORD_AFFECTED) {
+        profiler_bin_uint(out, PROFILER_BIN_F_AFFECTED, rec->affected);
+        if (rec->insert_id) {
+            profiler_bin_uint(out, PROFILER_BIN_F_INSERT_ID, rec->insert_id);
+        }
+    }
+
+    profiler_bin_end(out, body);
+}
+/* }}} */
+
+/* {{{ profiler_binlog_summary */
+void profiler_binlog_summary(profiler_buf *out, const profiler_agg_entry *e,
+                             const char *ep, size_t ep_len)
+{
+    size_t body = profiler_bin_begin(out, PROFILER_BIN_AGG);
+    int last_bucket = -1;
+    int i;
+
+    profiler_bin_fixed64(out, PROFILER_BIN_F_FP, e->fp);
+    profiler_bin_bytes(out, PROFILER_BIN_F_Q, e->norm, e->norm_len);
+    profiler_bin_bytes(out, PROFILER_BIN_F_EP, ep, ep_len);
+    profiler_bin_double(out, PROFILER_BIN_F_TS, e->first_ts);
+    profiler_bin_uint(out, PROFILER_BIN_F_N, e->count);
+    profiler_bin_uint(out, PROFILER_BIN_F_ERR, e->errors);
+
+    for (i = 0; i < PROFILER_AGG_BUCKETS; i++) {
+        if (e->hist[i]) {
+            last_bucket = i;
+        }
+    }
+    if (last_bucket >= 0) {
+        profiler_buf hist;
+
+        profiler_bin_uint(out, PROFILER_BIN_F_SUM, e->sum_us);
+        profiler_bin_uint(out, PROFILER_BIN_F_MIN, e->min_us);
+        profiler_bin_uint(out, PROFILER_BIN_F_MAX, e->max_us);
+
+        profiler_buf_init(&hist);
+        for (i = 0; i <= last_bucket; i++) {
+            profiler_bin_varint(&hist, e->hist[i]);
+        }
+        profiler_bin_bytes(out, PROFILER_BIN_F_HIST, hist.data, hist.len);
+        profiler_buf_free(&hist);
+    }
+
+    profiler_bin_end(out, body);
+}
+/* }}} */
+
+/* {{{ profiler_binlog_stack */
+void profiler_binlog_stack(profiler_buf *out, uint64_t id, const profiler_trace *trace)
+{
+    size_t body = profiler_bin_begin(out, PROFILER_BIN_STACK);
+
+    profiler_bin_fixed64(out, PROFILER_BIN_F_ID, id);
+    profiler_bin_trace(out, trace);
+    profiler_bin_end(out, body);
+}
+/* }}} */
+
+/* {{{ profiler_binlog_tmpl */
+void profiler_binlog_tmpl(profiler_buf *out, const profiler_record *rec)
+{
+    size_t body = profiler_bin_begin(out, PROFILER_BIN_STMT);
+
+    profiler_bin_fixed64(out, PROFILER_BIN_F_ID, rec->tmpl_id);
+    profiler_bin_bytes(out, PROFILER_BIN_F_Q, rec->query, rec->query_len);
+    profiler_bin_fixed64(out, PROFILER_BIN_F_FP, rec->fp);
+    profiler_bin_end(out, body);
+}
+/* }}} */
+
+/* {{{ profiler_binlog_tx */
+void profiler_binlog_tx(profiler_buf *out, const profiler_tx *tx,
+                        const char *ep, size_t ep_len)
+{
+    size_t body = profiler_bin_begin(out, PROFILER_BIN_TX);
+
+    profiler_bin_fixed64(out, PROFILER_BIN_F_ID, tx->id);
+    profiler_bin_bytes(out, PROFILER_BIN_F_EP, ep, ep_len);
+    profiler_bin_double(out, PROFILER_BIN_F_TS, tx->start_ts);
+    profiler_bin_uint(out, PROFILER_BIN_F_DUR, tx->dur_us);
+    profiler_bin_uint(out, PROFILER_BIN_F_N, tx->statements);
+    profiler_bin_uint(out, PROFILER_BIN_F_ERR, tx->errors);
+    profiler_bin_bytes(out, PROFILER_BIN_F_END, tx->end, strlen(tx->end));
+    profiler_bin_end(out, body);
+}
+/* }}} */
+
+/* {{{ profiler_binlog_conn */
+void profiler_binlog_conn(profiler_buf *out, const profiler_conn_event *ev,
+                          const char *ep, size_t ep_len)
+{
+    size_t body = profiler_bin_begin(out, PROFILER_BIN_CONN);
+
+    profiler_bin_fixed64(out, PROFILER_BIN_F_CN, ev->conn_id);
+    profiler_bin_bytes(out, PROFILER_BIN_F_EV, ev->event, strlen(ev->event));
+    if (ev->host) {
+        profiler_bin_bytes(out, PROFILER_BIN_F_HOST, ev->host, ev->host_len);
+    }
+    if (ev->db) {
+        profiler_bin_bytes(out, PROFILER_BIN_F_DB, ev->db, ev->db_len);
+    }
+    if (ev->thread_id) {
+        profiler_bin_uint(out, PROFILER_BIN_F_THREAD, ev->thread_id);
+    }
+    if (ev->persistent) {
+        profiler_bin_uint(out, PROFILER_BIN_F_PERSISTENT, 1);
+    }
+    profiler_bin_bytes(out, PROFILER_BIN_F_S, ev->status, strlen(ev->status));
+    profiler_bin_bytes(out, PROFILER_BIN_F_EP, ep, ep_len);
+    profiler_bin_double(out, PROFILER_BIN_F_TS, ev->timer->start_ts);
+    profiler_bin_uint(out, PROFILER_BIN_F_DUR, ev->timer->dur_us);
+    profiler_bin_end(out, body);
+}
+/* }}} */
+
+/* {{{ profiler_binlog_budget */
+void profiler_binlog_budget(profiler_buf *out, const profiler_budget_event *ev,
+                            const char *ep, size_t ep_len)
+{
+    size_t body = profiler_bin_begin(out, PROFILER_BIN_BUDGET);
+
+    profiler_bin_bytes(out, PROFILER_BIN_F_LIMIT, ev->limit, strlen(ev->limit));
+    profiler_bin_uint(out, PROFILER_BIN_F_MAX, ev->max);
+    profiler_bin_uint(out, PROFILER_BIN_F_N, ev->value);
+    profiler_bin_bytes(out, PROFILER_BIN_F_Q, ev->query, ev->query_len);
+    if (ev->fp) {
+        profiler_bin_fixed64(out, PROFILER_BIN_F_FP, ev->fp);
+    }
+    if (ev->tag) {
+        profiler_bin_bytes(out, PROFILER_BIN_F_TAG, ev->tag, strlen(ev->tag));
+    }
+    profiler_bin_bytes(out, PROFILER_BIN_F_EP, ep, ep_len);
+    profiler_bin_double(out, PROFILER_BIN_F_TS, ev->ts);
+    profiler_bin_end(out, body);
+}
+/* }}} */
+
+/* {{{ profiler_binlog_request */
+void profiler_binlog_request(profiler_buf *out, const profiler_request *req,
+                             const char *ep, size_t ep_len)
+{
+    size_t body = profiler_bin_begin(out, PROFILER_BIN_REQ);
+
+    profiler_bin_fixed64(out, PROFILER_BIN_F_ID, req->id);
+    profiler_bin_bytes(out, PROFILER_BIN_F_EP, ep, ep_len);
+    if (req->method) {
+        profiler_bin_bytes(out, PROFILER_BIN_F_METHOD, req->method, strlen(req->method));
+    }
+    profiler_bin_uint(out, PROFILER_BIN_F_PID, (uint64_t)req->pid);
+    profiler_bin_double(out, PROFILER_BIN_F_TS, req->start_ts);
+    profiler_bin_uint(out, PROFILER_BIN_F_DUR, req->dur_us);
+    profiler_bin_uint(out, PROFILER_BIN_F_N, req->queries);
+    profiler_bin_uint(out, PROFILER_BIN_F_ERR, req->errors);
+    profiler_bin_uint(out, PROFILER_BIN_F_SUM, req->sum_us);
+    profiler_bin_uint(out, PROFILER_BIN_F_MAX, req->max_us);
+    if (req->tag_count) {
+        profiler_buf json;
+
+        profiler_buf_init(&json);
+        profiler_request_append_tags_json(&json, req);
+        profiler_bin_bytes(out, PROFILER_BIN_F_TAGS, json.data, json.len);
+        profiler_buf_free(&json);
+    }
+    profiler_bin_end(out, body);
+}
+/* }}} */
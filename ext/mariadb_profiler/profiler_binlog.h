@@ -0,0 +1,100 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Binary Log Format Header                    |
+  +----------------------------------------------------------------------+
+  | Compact alternative to JSONL (mariadb_profiler.log_format=binary).   |
+  | Nothing is escaped and numbers are stored natively; the CLI decodes  |
+  | it (cli/src/BinaryLogReader.php) and converts it to JSONL.           |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_BINLOG_H
+#define PROFILER_BINLOG_H
+
+/*
+ * File layout: a plain sequence of records, appended like JSONL lines.
+ *
+ *   record := type:u8  body_len:varint  body
+ *   body   := field*
+ *   field  := tag:varint value        tag = (field_id << 3) | wire
+ *
+ *   wire 0: varint (unsigned LEB128)
+ *   wire 1: fixed 8 bytes, little-endian (fp as integer, ts as double)
+ *   wire 2: varint length + bytes (UTF-8 text, or JSON for params/trace)
+ *
+ * Readers skip records of unknown type and fields of unknown id using
+ * body_len and the wire type. The job key is the file name, not a field.
+ */
+
+/* Record types */
+#define PROFILER_BIN_QUERY      0x01
+#define PROFILER_BIN_AGG        0x02
+#define PROFILER_BIN_STACK      0x03
+#define PROFILER_BIN_STMT       0x04
+#define PROFILER_BIN_TX         0x05
+#define PROFILER_BIN_CONN       0x06
+#define PROFILER_BIN_BUDGET     0x07
+#define PROFILER_BIN_REQ        0x08
+
+/* Wire types */
+#define PROFILER_BIN_VARINT     0
+#define PROFILER_BIN_FIXED64    1
+#define PROFILER_BIN_BYTES      2
+
+/* Field ids (names match the JSONL keys) */
+#define PROFILER_BIN_F_Q         1  /* bytes */
+#define PROFILER_BIN_F_TS        2  /* fixed64 double */
+#define PROFILER_BIN_F_DUR       3  /* varint us */
+#define PROFILER_BIN_F_S         4  /* bytes */
+#define PROFILER_BIN_F_TAG       5  /* bytes */
+#define PROFILER_BIN_F_PARAMS    6  /* bytes, JSON array */
+#define PROFILER_BIN_F_TRACE     7  /* bytes, JSON array */
+#define PROFILER_BIN_F_FP        8  /* fixed64 */
+#define PROFILER_BIN_F_ROWS      9  /* varint */
+#define PROFILER_BIN_F_FETCH    10  /* varint us */
+#define PROFILER_BIN_F_BYTES    11  /* varint */
+#define PROFILER_BIN_F_AFFECTED 12  /* varint */
+#define PROFILER_BIN_F_INSERT_ID 13 /* varint */
+#define PROFILER_BIN_F_EP       14  /* bytes */
+#define PROFILER_BIN_F_N        15  /* varint */
+#define PROFILER_BIN_F_ERR      16  /* varint */
+#define PROFILER_BIN_F_SUM      17  /* varint us */
+#define PROFILER_BIN_F_MIN      18  /* varint us */
+#define PROFILER_BIN_F_MAX      19  /* varint us */
+#define PROFILER_BIN_F_HIST     20  /* bytes: packed varints */
+#define PROFILER_BIN_F_ST       21  /* fixed64: stack id referenced */
+#define PROFILER_BIN_F_ID       22  /* fixed64: stack or statement id defined */
+#define PROFILER_BIN_F_SID      23  /* fixed64: statement template referenced */
+#define PROFILER_BIN_F_TX       24  /* fixed64: transaction span the query ran in */
+#define PROFILER_BIN_F_END      25  /* bytes: how the span ended */
+#define PROFILER_BIN_F_CN       26  /* fixed64: connection id */
+#define PROFILER_BIN_F_EV       27  /* bytes: connection event */
+#define PROFILER_BIN_F_HOST     28  /* bytes */
+#define PROFILER_BIN_F_DB       29  /* bytes */
+#define PROFILER_BIN_F_THREAD   30  /* varint: server-side connection id */
+#define PROFILER_BIN_F_PERSISTENT 31 /* varint: 1 = persistent connection */
+#define PROFILER_BIN_F_LIMIT    32  /* bytes: budget limit exceeded */
+#define PROFILER_BIN_F_METHOD   33  /* bytes: HTTP method */
+#define PROFILER_BIN_F_PID      34  /* varint */
+#define PROFILER_BIN_F_TAGS     35  /* bytes, JSON array of the request's tags */
+#define PROFILER_BIN_F_RQ       36  /* fixed64: request the query ran in */
+
+/* Append one query record / aggregation summary / stack definition /
+ * statement template definition / transaction summary / connection
+ * event / budget violation / request summary to out. */
+void profiler_binlog_query(profiler_buf *out, const profiler_record *rec);
+void profiler_binlog_summary(profiler_buf *out, const profiler_agg_entry *e,
+                             const char *ep, size_t ep_len);
+void profiler_binlog_stack(profiler_buf *out, uint64_t id,
+                           const struct _profiler_trace *trace);
+void profiler_binlog_tmpl(profiler_buf *out, const profiler_record *rec);
+void profiler_binlog_tx(profiler_buf *out, const struct _profiler_tx *tx,
+                        const char *ep, size_t ep_len);
+void profiler_binlog_conn(profiler_buf *out, const profiler_conn_event *ev,
+                          const char *ep, size_t ep_len);
+void profiler_binlog_budget(profiler_buf *out, const profiler_budget_event *ev,
+                            const char *ep, size_t ep_len);
+void profiler_binlog_request(profiler_buf *out, const profiler_request *req,
+                             const char *ep, size_t ep_len);
+
+#endif /* PROFILER_BINLOG_H */
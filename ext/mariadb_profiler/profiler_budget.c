@@ -0,0 +1,294 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Query Budget                                |
+  +----------------------------------------------------------------------+
+  | Counts the statements of a request, their total time and the runs    |
+  | of each statement shape (fingerprint, so an N+1 loop with different  |
+  | ids counts as one shape). Each limit is reported once per request.   |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "zend_exceptions.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_budget.h"
+#include "profiler_fingerprint.h"
+
+#define PROFILER_BUDGET_MAX_QUERY 200 /* statement text quoted in messages */
+
+static zend_class_entry *profiler_budget_exception_ce;
+
+/* {{{ profiler_budget_init */
+void profiler_budget_init(void)
+{
+    zend_class_entry ce;
+    TSRMLS_FETCH();
+
+    INIT_CLASS_ENTRY(ce, PROFILER_BUDGET_EXCEPTION, NULL);
+#if PHP_VERSION_ID >= 70000
+    profiler_budget_exception_ce = zend_register_internal_class_ex(&ce, zend_ce_exception);
+#else
+    profiler_budget_exception_ce = zend_register_internal_class_ex(&ce,
+        zend_exception_get_default(TSRMLS_C), NULL TSRMLS_CC);
+#endif
+}
+/* }}} */
+
+/* {{{ profiler_budget_action */
+int profiler_budget_action(const char *name)
+{
+    if (!name || !*name || strcmp(name, "warn") == 0) {
+        return PROFILER_BUDGET_WARN;
+    }
+    if (strcmp(name, "log") == 0) {
+        return PROFILER_BUDGET_LOG;
+    }
+    if (strcmp(name, "throw") == 0) {
+        return PROFILER_BUDGET_THROW;
+    }
+    return -1;
+}
+/* }}} */
+
+/* {{{ profiler_budget_reset
+ * New limits for the rest of the request; counting starts over. */
+static void profiler_budget_reset(zend_long queries, zend_long db_time_us, zend_long repeats,
+                                  int action)
+{
+    TSRMLS_FETCH();
+
+    PROFILER_G(budget_max_queries) = queries > 0 ? (uint64_t)queries : 0;
+    PROFILER_G(budget_max_us) = db_time_us > 0 ? (uint64_t)db_time_us : 0;
+    PROFILER_G(budget_max_repeats) = repeats > 0 ? (uint64_t)repeats : 0;
+    PROFILER_G(budget_mode) = action;
+    PROFILER_G(budget_n) = 0;
+    PROFILER_G(budget_us) = 0;
+    PROFILER_G(budget_fired) = 0;
+    if (PROFILER_G(budget_shapes)) {
+        zend_hash_clean(PROFILER_G(budget_shapes));
+    }
+    PROFILER_G(budget_on) = PROFILER_G(budget_max_queries) || PROFILER_G(budget_max_us)
+        || PROFILER_G(budget_max_repeats);
+}
+/* }}} */
+
+/* {{{ profiler_budget_request_init */
+void profiler_budget_request_init(void)
+{
+    int action;
+    TSRMLS_FETCH();
+
+    action = profiler_budget_action(PROFILER_G(budget_action));
+    if (action < 0) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "mariadb_profiler.budget_action '%s' is not warn, log or throw; using warn",
+            PROFILER_G(budget_action));
+        action = PROFILER_BUDGET_WARN;
+    }
+    profiler_budget_reset(PROFILER_G(budget_queries), PROFILER_G(budget_db_time_us),
+        PROFILER_G(budget_repeats), action);
+}
+/* }}} */
+
+/* {{{ profiler_budget_request_shutdown */
+void profiler_budget_request_shutdown(void)
+{
+    TSRMLS_FETCH();
+
+    if (PROFILER_G(budget_shapes)) {
+        zend_hash_destroy(PROFILER_G(budget_shapes));
+        FREE_HASHTABLE(PROFILER_G(budget_shapes));
+        PROFILER_G(budget_shapes) = NULL;
+    }
+    PROFILER_G(budget_on) = 0;
+}
+/* }}} */
+
+#if PHP_VERSION_ID >= 70000
+/* {{{ profiler_budget_shape_dtor */
+static void profiler_budget_shape_dtor(zval *zv)
+{
+    efree(Z_PTR_P(zv));
+}
+/* }}} */
+#endif
+
+/* {{{ profiler_budget_repeat
+ * Count one run of fp's shape, return how often it has run. */
+static uint64_t profiler_budget_repeat(uint64_t fp)
+{
+    uint64_t *count;
+    TSRMLS_FETCH();
+
+    if (!PROFILER_G(budget_shapes)) {
+        ALLOC_HASHTABLE(PROFILER_G(budget_shapes));
+#if PHP_VERSION_ID >= 70000
+        zend_hash_init(PROFILER_G(budget_shapes), 16, NULL, profiler_budget_shape_dtor, 0);
+#else
+        zend_hash_init(PROFILER_G(budget_shapes), 16, NULL, NULL, 0);
+#endif
+    }
+
+#if PHP_VERSION_ID >= 70000
+    count = (uint64_t *)zend_hash_index_find_ptr(PROFILER_G(budget_shapes), (zend_ulong)fp);
+    if (!count) {
+        count = (uint64_t *)ecalloc(1, sizeof(uint64_t));
+        zend_hash_index_update_ptr(PROFILER_G(budget_shapes), (zend_ulong)fp, count);
+    }
+#else
+    if (zend_hash_index_find(PROFILER_G(budget_shapes), (ulong)fp, (void **)&count) == FAILURE) {
+        uint64_t zero = 0;
+
+        zend_hash_index_update(PROFILER_G(budget_shapes), (ulong)fp, &zero, sizeof(zero),
+            (void **)&count);
+    }
+#endif
+    return ++*count;
+}
+/* }}} */
+
+/* {{{ profiler_budget_exceeded
+ * Report ev the way budget_action says. An exception is only thrown
+ * while PHP code is running and none is pending; a warning is raised
+ * instead. */
+static void profiler_budget_exceeded(const profiler_budget_event *ev)
+{
+    char msg[160 + PROFILER_BUDGET_MAX_QUERY];
+    int query_len = ev->query_len > PROFILER_BUDGET_MAX_QUERY
+        ? PROFILER_BUDGET_MAX_QUERY : (int)ev->query_len;
+    TSRMLS_FETCH();
+
+    if (PROFILER_G(budget_mode) == PROFILER_BUDGET_LOG) {
+        profiler_log_budget(ev);
+        return;
+    }
+
+    if (strcmp(ev->limit, "db_time_us") == 0) {
+        snprintf(msg, sizeof(msg),
+            "Query budget exceeded: %.3f ms of statement time (max %.3f ms) at: %.*s%s",
+            (double)ev->value / 1000.0, (double)ev->max / 1000.0,
+            query_len, ev->query, (size_t)query_len < ev->query_len ? "..." : "");
+    } else {
+        snprintf(msg, sizeof(msg),
+            "Query budget exceeded: %llu %s (max %llu) at: %.*s%s",
+            (unsigned long long)ev->value,
+            strcmp(ev->limit, "repeats") == 0 ? "runs of one statement" : "statements",
+            (unsigned long long)ev->max,
+            query_len, ev->query, (size_t)query_len < ev->query_len ? "..." : "");
+    }
+
+    if (PROFILER_G(budget_mode) == PROFILER_BUDGET_THROW
+        && EG(current_execute_data) && !EG(exception)) {
+        zend_throw_exception(profiler_budget_exception_ce, msg, 0 TSRMLS_CC);
+        return;
+    }
+    php_error_docref(NULL TSRMLS_CC, E_WARNING, "mariadb_profiler: %s", msg);
+}
+/* }}} */
+
+/* {{{ profiler_budget_check
+ * Report limit once per request when value goes over max. */
+static void profiler_budget_check(unsigned int limit, const char *name, uint64_t max,
+                                  uint64_t value, const char *query, size_t query_len,
+                                  uint64_t fp, const profiler_timer *timer)
+{
+    profiler_budget_event ev;
+    TSRMLS_FETCH();
+
+    if (!max || value <= max || (PROFILER_G(budget_fired) & limit)) {
+        return;
+    }
+    PROFILER_G(budget_fired) |= limit;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.limit = name;
+    ev.max = max;
+    ev.value = value;
+    ev.query = query;
+    ev.query_len = query_len;
+    ev.fp = fp;
+    ev.tag = profiler_tag_current();
+    ev.timer = timer;
+    ev.ts = profiler_clock_wall();
+    profiler_budget_exceeded(&ev);
+}
+/* }}} */
+
+/* {{{ profiler_budget_statement */
+void profiler_budget_statement(const char *query, size_t query_len,
+                               const profiler_timer *timer)
+{
+    TSRMLS_FETCH();
+
+    PROFILER_G(budget_n)++;
+    if (timer) {
+        PROFILER_G(budget_us) += timer->dur_us;
+    }
+
+    profiler_budget_check(PROFILER_BUDGET_QUERIES, "queries",
+        PROFILER_G(budget_max_queries), PROFILER_G(budget_n), query, query_len, 0, timer);
+    profiler_budget_check(PROFILER_BUDGET_DB_TIME, "db_time_us",
+        PROFILER_G(budget_max_us), PROFILER_G(budget_us), query, query_len, 0, timer);
+
+    if (PROFILER_G(budget_max_repeats) && !(PROFILER_G(budget_fired) & PROFILER_BUDGET_REPEATS)) {
+        uint64_t fp = profiler_fingerprint(query, query_len, NULL);
+
+        profiler_budget_check(PROFILER_BUDGET_REPEATS, "repeats",
+            PROFILER_G(budget_max_repeats), profiler_budget_repeat(fp), query, query_len, fp, timer);
+    }
+}
+/* }}} */
+
+/* {{{ proto bool mariadb_profiler_set_budget(int $max_queries [, int $max_db_time_us [, int $max_repeats [, string $action]]])
+ * Replace this request's budget (0 = no limit) and start counting
+ * from zero, e.g. once per test case. action keeps the current one
+ * when omitted. Returns false if the profiler is disabled or the
+ * arguments are invalid. */
+PHP_FUNCTION(mariadb_profiler_set_budget)
+{
+    zend_long queries;
+    zend_long db_time_us = 0;
+    zend_long repeats = 0;
+    char *action_name = NULL;
+    PROFILER_PARAM_STR_LEN_T action_name_len = 0;
+    int action;
+    TSRMLS_FETCH();
+
+#if PHP_VERSION_ID >= 70000
+    ZEND_PARSE_PARAMETERS_START(1, 4)
+        Z_PARAM_LONG(queries)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_LONG(db_time_us)
+        Z_PARAM_LONG(repeats)
+        Z_PARAM_STRING(action_name, action_name_len)
+    ZEND_PARSE_PARAMETERS_END();
+#else
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l|lls",
+            &queries, &db_time_us, &repeats, &action_name, &action_name_len) == FAILURE) {
+        RETURN_FALSE;
+    }
+#endif
+
+    if (!PROFILER_G(enabled)) {
+        RETURN_FALSE;
+    }
+    if (queries < 0 || db_time_us < 0 || repeats < 0) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING, "Budget limits must be 0 or greater");
+        RETURN_FALSE;
+    }
+
+    action = action_name_len ? profiler_budget_action(action_name) : PROFILER_G(budget_mode);
+    if (action < 0) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "Budget action must be \"warn\", \"log\" or \"throw\"");
+        RETURN_FALSE;
+    }
+
+    profiler_budget_reset(queries, db_time_us, repeats, action);
+    RETURN_TRUE;
+}
+/* }}} */
@@ -0,0 +1,44 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Query Budget Header                         |
+  +----------------------------------------------------------------------+
+  | Per-request limits on statement count, total statement time and      |
+  | repeats of one statement shape. The first statement over a limit     |
+  | raises a warning, writes a {"type":"budget"} record or throws.       |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_BUDGET_H
+#define PROFILER_BUDGET_H
+
+/* What happens when a limit is exceeded (mariadb_profiler.budget_action) */
+#define PROFILER_BUDGET_WARN   0 /* E_WARNING */
+#define PROFILER_BUDGET_LOG    1 /* budget record in the jobs capturing the request */
+#define PROFILER_BUDGET_THROW  2 /* MariadbProfilerBudgetException */
+
+/* Limits, as bits of budget_fired */
+#define PROFILER_BUDGET_QUERIES  0x01
+#define PROFILER_BUDGET_DB_TIME  0x02
+#define PROFILER_BUDGET_REPEATS  0x04
+
+#define PROFILER_BUDGET_EXCEPTION "MariadbProfilerBudgetException"
+
+/* Register the exception class (MINIT) */
+void profiler_budget_init(void);
+
+/* Action named by name ("warn", "log", "throw"), -1 if unknown */
+int  profiler_budget_action(const char *name);
+
+/* Start this request's budget from the ini settings (RINIT) */
+void profiler_budget_request_init(void);
+void profiler_budget_request_shutdown(void);
+
+/*
+ * Count one statement that has run (timer: its duration). Called from
+ * the mysqlnd hooks while budget_on is set, whether or not a job is
+ * capturing the request.
+ */
+void profiler_budget_statement(const char *query, size_t query_len,
+                               const profiler_timer *timer);
+
+#endif /* PROFILER_BUDGET_H */
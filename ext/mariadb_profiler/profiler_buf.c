@@ -0,0 +1,130 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Growable Byte Buffer                        |
+  +----------------------------------------------------------------------+
+  | Request-scoped append buffer. Contents are always NUL-terminated so  |
+  | callers can treat data as a C string once something was appended.    |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "profiler_buf.h"
+
+#include <stdarg.h>
+
+/* MSVC before 2013 lacks va_copy; a plain copy is fine on its va_list */
+#ifndef va_copy
+# define va_copy(dst, src) ((dst) = (src))
+#endif
+
+#define PROFILER_BUF_MIN_CAP 256
+
+/* {{{ profiler_buf_init */
+void profiler_buf_init(profiler_buf *buf)
+{
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+}
+/* }}} */
+
+/* {{{ profiler_buf_reserve */
+void profiler_buf_reserve(profiler_buf *buf, size_t extra)
+{
+    size_t need = buf->len + extra + 1;
+    size_t cap;
+
+    if (need <= buf->cap) {
+        return;
+    }
+
+    cap = buf->cap ? buf->cap : PROFILER_BUF_MIN_CAP;
+    while (cap < need) {
+        cap *= 2;
+    }
+
+    buf->data = (char *)erealloc(buf->data, cap);
+    buf->cap = cap;
+}
+/* }}} */
+
+/* {{{ profiler_buf_append */
+void profiler_buf_append(profiler_buf *buf, const char *str, size_t len)
+{
+    profiler_buf_reserve(buf, len);
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+/* }}} */
+
+/* {{{ profiler_buf_appends */
+void profiler_buf_appends(profiler_buf *buf, const char *str)
+{
+    profiler_buf_append(buf, str, strlen(str));
+}
+/* }}} */
+
+/* {{{ profiler_buf_appendc */
+void profiler_buf_appendc(profiler_buf *buf, char c)
+{
+    profiler_buf_reserve(buf, 1);
+    buf->data[buf->len++] = c;
+    buf->data[buf->len] = '\0';
+}
+/* }}} */
+
+/* {{{ profiler_buf_appendf
+ * printf-style append. Formats in place, growing once if the first
+ * attempt did not fit. */
+void profiler_buf_appendf(profiler_buf *buf, const char *fmt, ...)
+{
+    va_list args, args_copy;
+    int written;
+
+    profiler_buf_reserve(buf, 64);
+
+    va_start(args, fmt);
+    va_copy(args_copy, args);
+    written = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+    va_end(args);
+
+    if (written < 0) {
+        va_end(args_copy);
+        buf->data[buf->len] = '\0';
+        return;
+    }
+
+    if ((size_t)written >= buf->cap - buf->len) {
+        profiler_buf_reserve(buf, (size_t)written);
+        vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args_copy);
+    }
+    va_end(args_copy);
+
+    buf->len += (size_t)written;
+}
+/* }}} */
+
+/* {{{ profiler_buf_reset */
+void profiler_buf_reset(profiler_buf *buf)
+{
+    buf->len = 0;
+    if (buf->data) {
+        buf->data[0] = '\0';
+    }
+}
+/* }}} */
+
+/* {{{ profiler_buf_free */
+void profiler_buf_free(profiler_buf *buf)
+{
+    if (buf->data) {
+        efree(buf->data);
+    }
+    profiler_buf_init(buf);
+}
+/* }}} */
@@ -0,0 +1,37 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Growable Byte Buffer Header                 |
+  +----------------------------------------------------------------------+
+  | Request-scoped (emalloc) append buffer used to assemble log records  |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_BUF_H
+#define PROFILER_BUF_H
+
+#include <stddef.h> /* size_t */
+
+typedef struct _profiler_buf {
+    char   *data;
+    size_t  len;
+    size_t  cap;
+} profiler_buf;
+
+/* Initialise an empty buffer. No memory is allocated until first append. */
+void profiler_buf_init(profiler_buf *buf);
+
+/* Ensure at least `extra` more bytes fit (plus a trailing NUL). */
+void profiler_buf_reserve(profiler_buf *buf, size_t extra);
+
+void profiler_buf_append(profiler_buf *buf, const char *str, size_t len);
+void profiler_buf_appends(profiler_buf *buf, const char *str);
+void profiler_buf_appendc(profiler_buf *buf, char c);
+void profiler_buf_appendf(profiler_buf *buf, const char *fmt, ...);
+
+/* Drop contents but keep the allocation for reuse. */
+void profiler_buf_reset(profiler_buf *buf);
+
+/* Release the allocation. */
+void profiler_buf_free(profiler_buf *buf);
+
+#endif /* PROFILER_BUF_H */
@@ -0,0 +1,82 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Clock Helpers                               |
+  +----------------------------------------------------------------------+
+  | Wall-clock timestamps for log records and a monotonic clock for      |
+  | measuring durations (immune to NTP steps and manual clock changes).  |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_CLOCK_H
+#define PROFILER_CLOCK_H
+
+#if PHP_VERSION_ID >= 80300
+# include "zend_hrtime.h"
+#endif
+
+#ifndef PHP_WIN32
+# include <sys/time.h>
+#endif
+#include <time.h>
+
+/* Timing of one measured operation */
+typedef struct _profiler_timer {
+    double   start_ts;  /* wall clock at start, seconds since epoch */
+    uint64_t start_ns;  /* monotonic clock at start */
+    uint64_t dur_us;    /* elapsed microseconds, set by profiler_timer_stop() */
+} profiler_timer;
+
+/*
+ * Monotonic clock in nanoseconds.
+ *   PHP 8.3+: zend_hrtime() (already picks the best source per platform)
+ *   Windows:  QueryPerformanceCounter
+ *   POSIX:    clock_gettime(CLOCK_MONOTONIC), gettimeofday() as last resort
+ */
+static inline uint64_t profiler_clock_mono_ns(void)
+{
+#if PHP_VERSION_ID >= 80300
+    return (uint64_t)zend_hrtime();
+#elif defined(PHP_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1000000000.0 / (double)freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000000ULL + (uint64_t)tv.tv_usec * 1000ULL;
+#endif
+}
+
+/* Wall clock as float seconds (the "ts" field of log records) */
+static inline double profiler_clock_wall(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+static inline void profiler_timer_start(profiler_timer *t)
+{
+    t->start_ts = profiler_clock_wall();
+    t->start_ns = profiler_clock_mono_ns();
+    t->dur_us = 0;
+}
+
+static inline void profiler_timer_stop(profiler_timer *t)
+{
+    t->dur_us = (profiler_clock_mono_ns() - t->start_ns) / 1000;
+}
+
+#endif /* PROFILER_CLOCK_H */
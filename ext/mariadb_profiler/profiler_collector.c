@@ -0,0 +1,148 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Collector Sink                              |
+  +----------------------------------------------------------------------+
+  | One connected AF_UNIX datagram socket per process (per thread in     |
+  | ZTS), kept across requests. Sends never block: a full collector      |
+  | queue drops the buffer, a missing collector makes the writer fall    |
+  | back to the log file and the socket is retried a second later.       |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_collector.h"
+
+#ifndef PHP_WIN32
+# include <sys/socket.h>
+# include <sys/uio.h>
+# include <sys/un.h>
+# include <fcntl.h>
+# include <errno.h>
+#endif
+
+#ifndef PHP_WIN32
+
+/* {{{ profiler_collector_connect
+ * Connect the process socket to collector_socket. -1 on failure. */
+static int profiler_collector_connect(void)
+{
+    struct sockaddr_un addr;
+    const char *path;
+    int fd;
+    TSRMLS_FETCH();
+
+    path = PROFILER_G(collector_socket);
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+/* }}} */
+
+/* {{{ profiler_collector_send */
+int profiler_collector_send(const char *name, const char *data, size_t len)
+{
+    struct iovec iov[2];
+    struct msghdr msg;
+    size_t name_len = strlen(name) + 1; /* with the NUL separator */
+    TSRMLS_FETCH();
+
+    if (name_len + len > PROFILER_COLLECTOR_MAX_DGRAM) {
+        return FAILURE;
+    }
+
+    if (PROFILER_G(collector_fd) < 0) {
+        time_t now = time(NULL);
+
+        if (now < PROFILER_G(collector_retry_at)) {
+            return FAILURE;
+        }
+        PROFILER_G(collector_fd) = profiler_collector_connect();
+        if (PROFILER_G(collector_fd) < 0) {
+            PROFILER_G(collector_retry_at) = now + 1;
+            return FAILURE;
+        }
+    }
+
+    iov[0].iov_base = (void *)name;
+    iov[0].iov_len = name_len;
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    for (;;) {
+        if (sendmsg(PROFILER_G(collector_fd), &msg, MSG_DONTWAIT) >= 0) {
+            PROFILER_G(collector_sent)++;
+            return SUCCESS;
+        }
+        if (errno != EINTR) {
+            break;
+        }
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+        /* Collector is behind: dropping keeps the request non-blocking */
+        PROFILER_G(collector_dropped)++;
+        return PROFILER_COLLECTOR_DROPPED;
+    }
+
+    if (errno != EMSGSIZE) {
+        /* Collector gone (restarted, socket removed): reconnect later */
+        close(PROFILER_G(collector_fd));
+        PROFILER_G(collector_fd) = -1;
+        PROFILER_G(collector_retry_at) = time(NULL) + 1;
+    }
+    return FAILURE;
+}
+/* }}} */
+
+/* {{{ profiler_collector_shutdown */
+void profiler_collector_shutdown(zend_mariadb_profiler_globals *g)
+{
+    if (g->collector_fd >= 0) {
+        close(g->collector_fd);
+        g->collector_fd = -1;
+    }
+}
+/* }}} */
+
+#else /* PHP_WIN32 */
+
+/* No AF_UNIX datagram sockets: always write the files directly */
+
+int profiler_collector_send(const char *name, const char *data, size_t len)
+{
+    (void)name;
+    (void)data;
+    (void)len;
+    return FAILURE;
+}
+
+void profiler_collector_shutdown(zend_mariadb_profiler_globals *g)
+{
+    (void)g;
+}
+
+#endif /* PHP_WIN32 */
@@ -0,0 +1,35 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Collector Sink Header                       |
+  +----------------------------------------------------------------------+
+  | With mariadb_profiler.collector_socket set, flushed sink buffers are |
+  | sent as datagrams to a local collector process (cli collector run)   |
+  | which owns the log files. Datagram: file name, NUL, encoded records. |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_COLLECTOR_H
+#define PROFILER_COLLECTOR_H
+
+/* Largest datagram sent; bigger buffers are written to the file directly */
+#define PROFILER_COLLECTOR_MAX_DGRAM  (192 * 1024)
+
+/* profiler_collector_send() result: the data was discarded */
+#define PROFILER_COLLECTOR_DROPPED    1
+
+/*
+ * Send data destined for <log_dir>/<name> to the collector without
+ * blocking. Returns SUCCESS when the collector took the data,
+ * PROFILER_COLLECTOR_DROPPED when it was dropped because the
+ * collector's queue is full (counted), FAILURE when the caller has to
+ * write the file itself (no collector listening, datagram too large,
+ * platform without Unix datagram sockets).
+ */
+int  profiler_collector_send(const char *name, const char *data, size_t len);
+
+struct _zend_mariadb_profiler_globals;
+
+/* Close g's socket (thread/module shutdown) */
+void profiler_collector_shutdown(struct _zend_mariadb_profiler_globals *g);
+
+#endif /* PROFILER_COLLECTOR_H */
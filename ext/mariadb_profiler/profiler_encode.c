@@ -0,0 +1,582 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Record Encoders                             |
+  +----------------------------------------------------------------------+
+  | Serialize query records and aggregation summaries as JSONL, raw      |
+  | text or binary (profiler_binlog.c). Encoders write into a scratch    |
+  | buffer that profiler_log.c copies to each job's sink.                |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_encode.h"
+#include "profiler_binlog.h"
+#include "profiler_json.h"
+#include "profiler_log.h"
+#include "profiler_trace.h"
+#include "profiler_tx.h"
+
+#ifndef PHP_WIN32
+# include <sys/time.h>
+#endif
+#include <time.h>
+
+/* {{{ profiler_encode_last_bucket
+ * Highest non-empty histogram bucket (-1 if none); *timed gets the
+ * number of queries that had a duration. */
+static int profiler_encode_last_bucket(const profiler_agg_entry *e, uint64_t *timed)
+{
+    int last = -1;
+    int i;
+
+    *timed = 0;
+    for (i = 0; i < PROFILER_AGG_BUCKETS; i++) {
+        if (e->hist[i]) {
+            last = i;
+            *timed += e->hist[i];
+        }
+    }
+    return last;
+}
+/* }}} */
+
+/* ---- JSONL ---- */
+
+/* {{{ profiler_encode_jsonl_head
+ * "type" comes first so readers can skip non-query records cheaply,
+ * then the job key; the shared body continues with ",". */
+static void profiler_encode_jsonl_head(profiler_buf *out, const char *job_key, int kind)
+{
+    switch (kind) {
+        case PROFILER_ENCODE_SUMMARY:
+            profiler_buf_appends(out, "{\"type\":\"agg\",\"k\":");
+            break;
+        case PROFILER_ENCODE_STACK:
+            profiler_buf_appends(out, "{\"type\":\"stack\",\"k\":");
+            break;
+        case PROFILER_ENCODE_TMPL:
+            profiler_buf_appends(out, "{\"type\":\"stmt\",\"k\":");
+            break;
+        case PROFILER_ENCODE_TX:
+            profiler_buf_appends(out, "{\"type\":\"tx\",\"k\":");
+            break;
+        case PROFILER_ENCODE_CONN:
+            profiler_buf_appends(out, "{\"type\":\"conn\",\"k\":");
+            break;
+        case PROFILER_ENCODE_BUDGET:
+            profiler_buf_appends(out, "{\"type\":\"budget\",\"k\":");
+            break;
+        case PROFILER_ENCODE_REQUEST:
+            profiler_buf_appends(out, "{\"type\":\"req\",\"k\":");
+            break;
+        default:
+            profiler_buf_appends(out, "{\"k\":");
+    }
+    profiler_buf_append_json_quoted(out, job_key, strlen(job_key));
+}
+/* }}} */
+
+/* {{{ profiler_encode_jsonl_query
+ * "ts" is the query start time, "dur" its duration in microseconds,
+ * "fp" the digest of the normalized statement (see profiler_fingerprint.h).
+ * An interned template is written as "sid" instead of "q" and "fp",
+ * which its "stmt" record carries. "cn" is the id of the connection
+ * (see its "conn" records), "tx" that of the transaction span the
+ * statement ran in and "rq" that of the request (its "req" record).
+ * SQL parsing (table/column extraction) is done by the CLI tool. */
+static void profiler_encode_jsonl_query(profiler_buf *out, const profiler_record *rec)
+{
+    if (rec->flags & PROFILER_RECORD_TMPL) {
+        profiler_buf_appendf(out, ",\"sid\":\"%016llx\"", (unsigned long long)rec->tmpl_id);
+    } else {
+        profiler_buf_appends(out, ",\"q\":");
+        profiler_buf_append_json_quoted(out, rec->query, rec->query_len);
+    }
+
+    if (rec->tag) {
+        profiler_buf_appends(out, ",\"tag\":");
+        profiler_buf_append_json_quoted(out, rec->tag, strlen(rec->tag));
+    }
+
+    if (rec->conn_id) {
+        profiler_buf_appendf(out, ",\"cn\":\"%016llx\"", (unsigned long long)rec->conn_id);
+    }
+    if (rec->tx_id) {
+        profiler_buf_appendf(out, ",\"tx\":\"%016llx\"", (unsigned long long)rec->tx_id);
+    }
+    if (rec->req_id) {
+        profiler_buf_appendf(out, ",\"rq\":\"%016llx\"", (unsigned long long)rec->req_id);
+    }
+
+    /* params_json is already a valid JSON array string e.g. ["123","active",null] */
+    if (rec->params_json) {
+        profiler_buf_appends(out, ",\"params\":");
+        profiler_buf_appends(out, rec->params_json);
+    }
+
+    /* Interned traces are defined by a "stack" record and referenced by id */
+    if (rec->flags & PROFILER_RECORD_STACK) {
+        profiler_buf_appendf(out, ",\"st\":\"%016llx\"", (unsigned long long)rec->stack_id);
+    } else if (rec->trace) {
+        profiler_buf_appends(out, ",\"trace\":");
+        profiler_trace_append_json(out, rec->trace);
+    }
+
+    if (rec->status) {
+        profiler_buf_appendf(out, ",\"s\":\"%s\"", rec->status);
+    }
+
+    /* Hex string: a 64-bit integer does not survive JSON number parsing */
+    if ((rec->flags & (PROFILER_RECORD_FP | PROFILER_RECORD_TMPL)) == PROFILER_RECORD_FP) {
+        profiler_buf_appendf(out, ",\"fp\":\"%016llx\"", (unsigned long long)rec->fp);
+    }
+
+    profiler_buf_appendf(out, ",\"ts\":%.6f",
+        rec->timer ? rec->timer->start_ts : profiler_clock_wall());
+
+    if (rec->timer) {
+        profiler_buf_appendf(out, ",\"dur\":%llu", (unsigned long long)rec->timer->dur_us);
+    }
+
+    /* Result metrics: rows/fetch for result sets, affected/insert_id for DML */
+    if (rec->flags & PROFILER_RECORD_ROWS) {
+        profiler_buf_appendf(out, ",\"rows\":%llu,\"fetch\":%llu",
+            (unsigned long long)rec->rows, (unsigned long long)rec->fetch_us);
+    }
+    if (rec->flags & PROFILER_RECORD_BYTES) {
+        profiler_buf_appendf(out, ",\"bytes\":%llu", (unsigned long long)rec->bytes);
+    }
+    if (rec->flags & PROFILER_RECORD_AFFECTED) {
+        profiler_buf_appendf(out, ",\"affected\":%llu", (unsigned long long)rec->affected);
+        if (rec->insert_id) {
+            profiler_buf_appendf(out, ",\"insert_id\":%llu",
+                (unsigned long long)rec->insert_id);
+        }
+    }
+
+    profiler_buf_append(out, "}\n", 2);
+}
+/* }}} */
+
+/* {{{ profiler_encode_jsonl_summary
+ * {"type":"agg","k":...,"fp":...,"q":<normalized>,"ep":...,"ts":...,
+ *  "n":N,"err":E,"sum":us,"min":us,"max":us,"hist":[...]}
+ * hist[i] counts queries taking [2^i, 2^(i+1)) us (hist[0]: below 2us),
+ * trailing empty buckets are left out. */
+static void profiler_encode_jsonl_summary(profiler_buf *out, const profiler_agg_entry *e,
+                                          const char *ep, size_t ep_len)
+{
+    uint64_t timed;
+    int last_bucket = profiler_encode_last_bucket(e, &timed);
+    int b;
+
+    profiler_buf_appendf(out, ",\"fp\":\"%016llx\",\"q\":", (unsigned long long)e->fp);
+    profiler_buf_append_json_quoted(out, e->norm, e->norm_len);
+    profiler_buf_appends(out, ",\"ep\":");
+    profiler_buf_append_json_quoted(out, ep, ep_len);
+    profiler_buf_appendf(out, ",\"ts\":%.6f,\"n\":%llu,\"err\":%llu",
+        e->first_ts, (unsigned long long)e->count, (unsigned long long)e->errors);
+    if (timed) {
+        profiler_buf_appendf(out, ",\"sum\":%llu,\"min\":%llu,\"max\":%llu,\"hist\":[",
+            (unsigned long long)e->sum_us, (unsigned long long)e->min_us,
+            (unsigned long long)e->max_us);
+        for (b = 0; b <= last_bucket; b++) {
+            profiler_buf_appendf(out, b ? ",%u" : "%u", (unsigned int)e->hist[b]);
+        }
+        profiler_buf_appendc(out, ']');
+    }
+    profiler_buf_append(out, "}\n", 2);
+}
+/* }}} */
+
+/* {{{ profiler_encode_jsonl_stack
+ * {"type":"stack","k":...,"id":<hex>,"trace":[...]} */
+static void profiler_encode_jsonl_stack(profiler_buf *out, uint64_t id,
+                                        const profiler_trace *trace)
+{
+    profiler_buf_appendf(out, ",\"id\":\"%016llx\",\"trace\":", (unsigned long long)id);
+    profiler_trace_append_json(out, trace);
+    profiler_buf_append(out, "}\n", 2);
+}
+/* }}} */
+
+/* {{{ profiler_encode_jsonl_tmpl
+ * {"type":"stmt","k":...,"id":<hex>,"q":<template>,"fp":<hex>} */
+static void profiler_encode_jsonl_tmpl(profiler_buf *out, const profiler_record *rec)
+{
+    profiler_buf_appendf(out, ",\"id\":\"%016llx\",\"q\":", (unsigned long long)rec->tmpl_id);
+    profiler_buf_append_json_quoted(out, rec->query, rec->query_len);
+    profiler_buf_appendf(out, ",\"fp\":\"%016llx\"}\n", (unsigned long long)rec->fp);
+}
+/* }}} */
+
+/* {{{ profiler_encode_jsonl_tx
+ * {"type":"tx","k":...,"id":<hex>,"ep":...,"ts":...,"dur":us,"n":N,
+ *  "err":E,"end":"commit"|"rollback"|"open"} */
+static void profiler_encode_jsonl_tx(profiler_buf *out, const profiler_tx *tx,
+                                     const char *ep, size_t ep_len)
+{
+    profiler_buf_appendf(out, ",\"id\":\"%016llx\",\"ep\":", (unsigned long long)tx->id);
+    profiler_buf_append_json_quoted(out, ep, ep_len);
+    profiler_buf_appendf(out, ",\"ts\":%.6f,\"dur\":%llu,\"n\":%llu,\"err\":%llu,\"end\":\"%s\"}\n",
+        tx->start_ts, (unsigned long long)tx->dur_us,
+        (unsigned long long)tx->statements, (unsigned long long)tx->errors, tx->end);
+}
+/* }}} */
+
+/* {{{ profiler_encode_jsonl_conn
+ * {"type":"conn","k":...,"cn":<hex>,"ev":"connect","host":...,"db":...,
+ *  "thread":N,"persistent":true,"s":"ok","ep":...,"ts":...,"dur":us}
+ * host, db, thread and persistent are left out when unknown / false. */
+static void profiler_encode_jsonl_conn(profiler_buf *out, const profiler_conn_event *ev,
+                                       const char *ep, size_t ep_len)
+{
+    profiler_buf_appendf(out, ",\"cn\":\"%016llx\",\"ev\":\"%s\"",
+        (unsigned long long)ev->conn_id, ev->event);
+    if (ev->host) {
+        profiler_buf_appends(out, ",\"host\":");
+        profiler_buf_append_json_quoted(out, ev->host, ev->host_len);
+    }
+    if (ev->db) {
+        profiler_buf_appends(out, ",\"db\":");
+        profiler_buf_append_json_quoted(out, ev->db, ev->db_len);
+    }
+    if (ev->thread_id) {
+        profiler_buf_appendf(out, ",\"thread\":%llu", (unsigned long long)ev->thread_id);
+    }
+    if (ev->persistent) {
+        profiler_buf_appends(out, ",\"persistent\":true");
+    }
+    profiler_buf_appendf(out, ",\"s\":\"%s\",\"ep\":", ev->status);
+    profiler_buf_append_json_quoted(out, ep, ep_len);
+    profiler_buf_appendf(out, ",\"ts\":%.6f,\"dur\":%llu}\n",
+        ev->timer->start_ts, (unsigned long long)ev->timer->dur_us);
+}
+/* }}} */
+
+/* {{{ profiler_encode_jsonl_budget
+ * {"type":"budget","k":...,"limit":"queries"|"db_time_us"|"repeats",
+ *  "max":N,"n":N,"q":...,"fp":<hex>,"tag":...,"ep":...,"ts":...}
+ * n is the count (or us) that went over max at statement q; fp is
+ * only there for "repeats". */
+static void profiler_encode_jsonl_budget(profiler_buf *out, const profiler_budget_event *ev,
+                                         const char *ep, size_t ep_len)
+{
+    profiler_buf_appendf(out, ",\"limit\":\"%s\",\"max\":%llu,\"n\":%llu,\"q\":", ev->limit,
+        (unsigned long long)ev->max, (unsigned long long)ev->value);
+    profiler_buf_append_json_quoted(out, ev->query, ev->query_len);
+    if (ev->fp) {
+        profiler_buf_appendf(out, ",\"fp\":\"%016llx\"", (unsigned long long)ev->fp);
+    }
+    if (ev->tag) {
+        profiler_buf_appends(out, ",\"tag\":");
+        profiler_buf_append_json_quoted(out, ev->tag, strlen(ev->tag));
+    }
+    profiler_buf_appends(out, ",\"ep\":");
+    profiler_buf_append_json_quoted(out, ep, ep_len);
+    profiler_buf_appendf(out, ",\"ts\":%.6f}\n", ev->ts);
+}
+/* }}} */
+
+/* {{{ profiler_encode_jsonl_request
+ * {"type":"req","k":...,"id":<hex>,"ep":...,"method":"GET","pid":N,
+ *  "ts":...,"dur":us,"n":N,"err":E,"sum":us,"max":us,"tags":[...]}
+ * ts is the request start, dur its length; n, err, sum and max cover
+ * its statements. method is left out under CLI, tags when none. */
+static void profiler_encode_jsonl_request(profiler_buf *out, const profiler_request *req,
+                                          const char *ep, size_t ep_len)
+{
+    profiler_buf_appendf(out, ",\"id\":\"%016llx\",\"ep\":", (unsigned long long)req->id);
+    profiler_buf_append_json_quoted(out, ep, ep_len);
+    if (req->method) {
+        profiler_buf_appends(out, ",\"method\":");
+        profiler_buf_append_json_quoted(out, req->method, strlen(req->method));
+    }
+    profiler_buf_appendf(out, ",\"pid\":%ld,\"ts\":%.6f,\"dur\":%llu,\"n\":%llu,\"err\":%llu"
+        ",\"sum\":%llu,\"max\":%llu",
+        req->pid, req->start_ts, (unsigned long long)req->dur_us,
+        (unsigned long long)req->queries, (unsigned long long)req->errors,
+        (unsigned long long)req->sum_us, (unsigned long long)req->max_us);
+    if (req->tag_count) {
+        profiler_buf_appends(out, ",\"tags\":");
+        profiler_request_append_tags_json(out, req);
+    }
+    profiler_buf_append(out, "}\n", 2);
+}
+/* }}} */
+
+const profiler_encoder profiler_encoder_jsonl = {
+    PROFILER_PARSED_LOG_EXT,
+    profiler_encode_jsonl_head,
+    profiler_encode_jsonl_query,
+    profiler_encode_jsonl_summary,
+    profiler_encode_jsonl_stack,
+    profiler_encode_jsonl_tmpl,
+    profiler_encode_jsonl_tx,
+    profiler_encode_jsonl_conn,
+    profiler_encode_jsonl_budget,
+    profiler_encode_jsonl_request
+};
+
+/* ---- Binary (profiler_binlog.h); the job key is the file name ---- */
+
+const profiler_encoder profiler_encoder_binary = {
+    PROFILER_BINARY_LOG_EXT,
+    NULL,
+    profiler_binlog_query,
+    profiler_binlog_summary,
+    profiler_binlog_stack,
+    profiler_binlog_tmpl,
+    profiler_binlog_tx,
+    profiler_binlog_conn,
+    profiler_binlog_budget,
+    profiler_binlog_request
+};
+
+/* ---- Raw text ---- */
+
+/* {{{ profiler_encode_format_timestamp
+ * Format a wall-clock time (float seconds) as local "Y-m-d H:i:s.mmm" */
+static void profiler_encode_format_timestamp(double ts, char *buf, size_t buf_size)
+{
+    time_t sec = (time_t)ts;
+    struct tm tm_buf;
+
+    localtime_r(&sec, &tm_buf);
+
+    snprintf(buf, buf_size, "%04d-%02d-%02d %02d:%02d:%02d.%03d",
+        tm_buf.tm_year + 1900, tm_buf.tm_mon + 1, tm_buf.tm_mday,
+        tm_buf.tm_hour, tm_buf.tm_min, tm_buf.tm_sec,
+        (int)((ts - (double)sec) * 1000.0));
+}
+/* }}} */
+
+/* {{{ profiler_encode_raw_query
+ * Line format: [start time] [status] [duration] [tag] query
+ * followed by optional indented params/result/trace lines. */
+static void profiler_encode_raw_query(profiler_buf *out, const profiler_record *rec)
+{
+    char timestamp[64];
+    const char *params_json = rec->params_json;
+
+    profiler_encode_format_timestamp(rec->timer ? rec->timer->start_ts : profiler_clock_wall(),
+        timestamp, sizeof(timestamp));
+
+    profiler_buf_appendf(out, "[%s] [%s] ", timestamp, rec->status ? rec->status : "ok");
+    if (rec->timer) {
+        profiler_buf_appendf(out, "[%.3fms] ", (double)rec->timer->dur_us / 1000.0);
+    }
+    if (rec->tag) {
+        profiler_buf_appendf(out, "[%s] ", rec->tag);
+    }
+    profiler_buf_append(out, rec->query, rec->query_len);
+    profiler_buf_appendc(out, '\n');
+
+    /* Append bound parameter values if present */
+    if (params_json && params_json[0] == '[' && params_json[1] != ']') {
+        profiler_buf_appendf(out, "  params: %s\n", params_json);
+    }
+
+    /* Append result metrics if the statement produced any */
+    if (rec->flags & PROFILER_RECORD_ROWS) {
+        profiler_buf_appendf(out, "  result: %llu rows, fetch %.3fms",
+            (unsigned long long)rec->rows, (double)rec->fetch_us / 1000.0);
+        if (rec->flags & PROFILER_RECORD_BYTES) {
+            profiler_buf_appendf(out, ", %llu bytes", (unsigned long long)rec->bytes);
+        }
+        profiler_buf_appendc(out, '\n');
+    } else if (rec->flags & PROFILER_RECORD_AFFECTED) {
+        profiler_buf_appendf(out, "  result: %llu affected",
+            (unsigned long long)rec->affected);
+        if (rec->insert_id) {
+            profiler_buf_appendf(out, ", insert id %llu", (unsigned long long)rec->insert_id);
+        }
+        profiler_buf_appendc(out, '\n');
+    }
+
+    /* Append trace lines (indented with arrow prefix) */
+    if (rec->trace) {
+        int i;
+
+        for (i = 0; i < rec->trace->count; i++) {
+            const profiler_frame *f = &rec->trace->frames[i];
+
+            profiler_buf_append(out, "  <- ", 5);
+            profiler_trace_append_call(out, f);
+            profiler_buf_append(out, "() ", 3);
+            profiler_buf_append(out, f->file, f->file_len);
+            profiler_buf_appendf(out, ":%ld\n", f->line);
+        }
+    }
+}
+/* }}} */
+
+/* {{{ profiler_encode_raw_summary
+ * [first start time] [agg] [N x, avg, max, errors] normalized query
+ * followed by the endpoint. */
+static void profiler_encode_raw_summary(profiler_buf *out, const profiler_agg_entry *e,
+                                        const char *ep, size_t ep_len)
+{
+    char timestamp[64];
+    uint64_t timed;
+
+    profiler_encode_last_bucket(e, &timed);
+    profiler_encode_format_timestamp(e->first_ts, timestamp, sizeof(timestamp));
+
+    profiler_buf_appendf(out, "[%s] [agg] [%llu x", timestamp,
+        (unsigned long long)e->count);
+    if (timed) {
+        profiler_buf_appendf(out, ", avg %.3fms, max %.3fms",
+            (double)e->sum_us / (double)timed / 1000.0,
+            (double)e->max_us / 1000.0);
+    }
+    if (e->errors) {
+        profiler_buf_appendf(out, ", %llu err", (unsigned long long)e->errors);
+    }
+    profiler_buf_appends(out, "] ");
+    profiler_buf_append(out, e->norm, e->norm_len);
+    profiler_buf_appendc(out, '\n');
+    if (ep_len) {
+        profiler_buf_append(out, "  endpoint: ", 12);
+        profiler_buf_append(out, ep, ep_len);
+        profiler_buf_appendc(out, '\n');
+    }
+}
+/* }}} */
+
+/* {{{ profiler_encode_raw_tx
+ * [start time] [tx <outcome>] [duration] N statements, errors
+ * followed by the span id and endpoint. */
+static void profiler_encode_raw_tx(profiler_buf *out, const profiler_tx *tx,
+                                   const char *ep, size_t ep_len)
+{
+    char timestamp[64];
+
+    profiler_encode_format_timestamp(tx->start_ts, timestamp, sizeof(timestamp));
+
+    profiler_buf_appendf(out, "[%s] [tx %s] [%.3fms] %llu statements", timestamp, tx->end,
+        (double)tx->dur_us / 1000.0, (unsigned long long)tx->statements);
+    if (tx->errors) {
+        profiler_buf_appendf(out, ", %llu err", (unsigned long long)tx->errors);
+    }
+    profiler_buf_appendf(out, "\n  tx: %016llx\n", (unsigned long long)tx->id);
+    if (ep_len) {
+        profiler_buf_append(out, "  endpoint: ", 12);
+        profiler_buf_append(out, ep, ep_len);
+        profiler_buf_appendc(out, '\n');
+    }
+}
+/* }}} */
+
+/* {{{ profiler_encode_raw_conn
+ * [start time] [conn <event>] [duration] host
+ * followed by the connection id, thread, schema and endpoint. */
+static void profiler_encode_raw_conn(profiler_buf *out, const profiler_conn_event *ev,
+                                     const char *ep, size_t ep_len)
+{
+    char timestamp[64];
+
+    profiler_encode_format_timestamp(ev->timer->start_ts, timestamp, sizeof(timestamp));
+
+    profiler_buf_appendf(out, "[%s] [conn %s] [%s] [%.3fms] ", timestamp, ev->event,
+        ev->status, (double)ev->timer->dur_us / 1000.0);
+    if (ev->host) {
+        profiler_buf_append(out, ev->host, ev->host_len);
+    }
+    profiler_buf_appendf(out, "\n  conn: %016llx", (unsigned long long)ev->conn_id);
+    if (ev->thread_id) {
+        profiler_buf_appendf(out, ", thread %llu", (unsigned long long)ev->thread_id);
+    }
+    if (ev->persistent) {
+        profiler_buf_appends(out, ", persistent");
+    }
+    if (ev->db) {
+        profiler_buf_appends(out, ", db ");
+        profiler_buf_append(out, ev->db, ev->db_len);
+    }
+    profiler_buf_appendc(out, '\n');
+    if (ep_len) {
+        profiler_buf_append(out, "  endpoint: ", 12);
+        profiler_buf_append(out, ep, ep_len);
+        profiler_buf_appendc(out, '\n');
+    }
+}
+/* }}} */
+
+/* {{{ profiler_encode_raw_budget
+ * [time] [budget <limit>] [n > max] [tag] statement
+ * followed by the endpoint. */
+static void profiler_encode_raw_budget(profiler_buf *out, const profiler_budget_event *ev,
+                                       const char *ep, size_t ep_len)
+{
+    char timestamp[64];
+
+    profiler_encode_format_timestamp(ev->ts, timestamp, sizeof(timestamp));
+
+    profiler_buf_appendf(out, "[%s] [budget %s] [%llu > %llu] ", timestamp, ev->limit,
+        (unsigned long long)ev->value, (unsigned long long)ev->max);
+    if (ev->tag) {
+        profiler_buf_appendf(out, "[%s] ", ev->tag);
+    }
+    profiler_buf_append(out, ev->query, ev->query_len);
+    profiler_buf_appendc(out, '\n');
+    if (ep_len) {
+        profiler_buf_append(out, "  endpoint: ", 12);
+        profiler_buf_append(out, ep, ep_len);
+        profiler_buf_appendc(out, '\n');
+    }
+}
+/* }}} */
+
+/* {{{ profiler_encode_raw_request
+ * [start time] [request] [duration] N queries, DB time, max, errors
+ * followed by the request id, pid, tags and endpoint. */
+static void profiler_encode_raw_request(profiler_buf *out, const profiler_request *req,
+                                        const char *ep, size_t ep_len)
+{
+    char timestamp[64];
+    int i;
+
+    profiler_encode_format_timestamp(req->start_ts, timestamp, sizeof(timestamp));
+
+    profiler_buf_appendf(out, "[%s] [request] [%.3fms] %llu queries, db %.3fms, max %.3fms",
+        timestamp, (double)req->dur_us / 1000.0, (unsigned long long)req->queries,
+        (double)req->sum_us / 1000.0, (double)req->max_us / 1000.0);
+    if (req->errors) {
+        profiler_buf_appendf(out, ", %llu err", (unsigned long long)req->errors);
+    }
+    profiler_buf_appendf(out, "\n  request: %016llx, pid %ld\n", (unsigned long long)req->id,
+        req->pid);
+    if (req->tag_count) {
+        profiler_buf_appends(out, "  tags: ");
+        for (i = 0; i < req->tag_count; i++) {
+            profiler_buf_appends(out, i ? ", " : "");
+            profiler_buf_appends(out, req->tags[i]);
+        }
+        profiler_buf_appendc(out, '\n');
+    }
+    if (ep_len) {
+        profiler_buf_append(out, "  endpoint: ", 12);
+        profiler_buf_append(out, ep, ep_len);
+        profiler_buf_appendc(out, '\n');
+    }
+}
+/* }}} */
+
+const profiler_encoder profiler_encoder_raw = {
+    PROFILER_RAW_LOG_EXT,
+    NULL,
+    profiler_encode_raw_query,
+    profiler_encode_raw_summary,
+    NULL, /* traces stay inline: the raw log is read by people */
+    NULL,
+    profiler_encode_raw_tx,
+    profiler_encode_raw_conn,
+    profiler_encode_raw_budget,
+    profiler_encode_raw_request
+};
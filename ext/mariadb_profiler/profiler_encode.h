@@ -0,0 +1,57 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Record Encoders Header                      |
+  +----------------------------------------------------------------------+
+  | One encoder per log file type. A record is serialized once per       |
+  | encoder and the same bytes are appended to every active job's sink;  |
+  | only the job_head (e.g. the JSONL "k" field) is written per job.     |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_ENCODE_H
+#define PROFILER_ENCODE_H
+
+/* What a record describes, passed to job_head */
+#define PROFILER_ENCODE_QUERY    0
+#define PROFILER_ENCODE_SUMMARY  1
+#define PROFILER_ENCODE_STACK    2
+#define PROFILER_ENCODE_TMPL     3
+#define PROFILER_ENCODE_TX       4
+#define PROFILER_ENCODE_CONN     5
+#define PROFILER_ENCODE_BUDGET   6
+#define PROFILER_ENCODE_REQUEST  7
+
+struct _profiler_tx;
+
+typedef struct _profiler_encoder {
+    const char *ext; /* sink file extension, e.g. ".jsonl" */
+    /* Job-specific bytes written in front of the shared body, may be NULL */
+    void (*job_head)(profiler_buf *out, const char *job_key, int kind);
+    void (*query)(profiler_buf *out, const profiler_record *rec);
+    void (*summary)(profiler_buf *out, const profiler_agg_entry *e,
+                    const char *ep, size_t ep_len);
+    /* Stack definition for interned traces; NULL if the format always
+     * writes traces inline */
+    void (*stack)(profiler_buf *out, uint64_t id, const struct _profiler_trace *trace);
+    /* Statement template definition (rec->tmpl_id, query, fp); NULL if
+     * the format always writes the query text */
+    void (*tmpl)(profiler_buf *out, const profiler_record *rec);
+    /* Summary of an ended transaction span */
+    void (*tx)(profiler_buf *out, const struct _profiler_tx *tx,
+               const char *ep, size_t ep_len);
+    /* Connection lifecycle event */
+    void (*conn)(profiler_buf *out, const profiler_conn_event *ev,
+                 const char *ep, size_t ep_len);
+    /* Query budget limit exceeded */
+    void (*budget)(profiler_buf *out, const profiler_budget_event *ev,
+                   const char *ep, size_t ep_len);
+    /* Summary of the ending request */
+    void (*request)(profiler_buf *out, const profiler_request *req,
+                    const char *ep, size_t ep_len);
+} profiler_encoder;
+
+extern const profiler_encoder profiler_encoder_jsonl;
+extern const profiler_encoder profiler_encoder_binary;
+extern const profiler_encoder profiler_encoder_raw;
+
+#endif /* PROFILER_ENCODE_H */
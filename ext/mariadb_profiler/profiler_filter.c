@@ -0,0 +1,474 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Job Capture Filters                         |
+  +----------------------------------------------------------------------+
+  | Compiles {"tag","verb","table","min_us","uri","status"} into a flat  |
+  | matcher: prefixes and the table name are kept as plain byte strings, |
+  | verbs as short lowercase words, so a query a job does not want costs |
+  | a few comparisons instead of an encode and a write.                  |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "SAPI.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_filter.h"
+
+/* {{{ profiler_filter_lower */
+static unsigned char profiler_filter_lower(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+/* }}} */
+
+/* {{{ profiler_filter_ws
+ * Skip JSON whitespace. */
+static const char *profiler_filter_ws(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+/* }}} */
+
+/* {{{ profiler_filter_hex4 */
+static int profiler_filter_hex4(const char *p, const char *end, unsigned int *cp)
+{
+    int i;
+
+    *cp = 0;
+    if (end - p < 4) {
+        return 0;
+    }
+    for (i = 0; i < 4; i++) {
+        char c = p[i];
+
+        *cp <<= 4;
+        if (c >= '0' && c <= '9') {
+            *cp |= (unsigned int)(c - '0');
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            *cp |= (unsigned int)((c | 0x20) - 'a' + 10);
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+/* }}} */
+
+/* {{{ profiler_filter_string
+ * Decode the JSON string starting at the opening quote *p into a
+ * persistent NUL-terminated copy. Advances *p past the closing quote.
+ * Returns NULL on a malformed string. */
+static char *profiler_filter_string(const char **p, const char *end, size_t *len)
+{
+    const char *s = *p + 1;
+    char *out;
+    size_t n = 0;
+    unsigned int cp;
+
+    /* Decoding never makes the text longer */
+    out = (char *)pemalloc(end - s + 1, 1);
+
+    while (s < end && *s != '"') {
+        if (*s != '\\') {
+            out[n++] = *s++;
+            continue;
+        }
+        if (++s >= end) {
+            break;
+        }
+        switch (*s) {
+            case 'b': out[n++] = '\b'; s++; break;
+            case 'f': out[n++] = '\f'; s++; break;
+            case 'n': out[n++] = '\n'; s++; break;
+            case 'r': out[n++] = '\r'; s++; break;
+            case 't': out[n++] = '\t'; s++; break;
+            case 'u':
+                if (!profiler_filter_hex4(s + 1, end, &cp)) {
+                    pefree(out, 1);
+                    return NULL;
+                }
+                s += 5;
+                /* Basic plane only; jobs.json is written with unescaped UTF-8 */
+                if (cp < 0x80) {
+                    out[n++] = (char)cp;
+                } else if (cp < 0x800) {
+                    out[n++] = (char)(0xc0 | (cp >> 6));
+                    out[n++] = (char)(0x80 | (cp & 0x3f));
+                } else {
+                    out[n++] = (char)(0xe0 | (cp >> 12));
+                    out[n++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+                    out[n++] = (char)(0x80 | (cp & 0x3f));
+                }
+                break;
+            default: /* '"', '\\', '/' */
+                out[n++] = *s++;
+                break;
+        }
+    }
+    if (s >= end) {
+        pefree(out, 1);
+        return NULL;
+    }
+
+    out[n] = '\0';
+    *len = n;
+    *p = s + 1;
+    return out;
+}
+/* }}} */
+
+/* {{{ profiler_filter_skip_value
+ * Move past a value this parser does not use (nested object, array,
+ * number or literal). */
+static const char *profiler_filter_skip_value(const char *p, const char *end)
+{
+    int depth = 0;
+
+    while (p < end) {
+        if (*p == '"') {
+            p++;
+            while (p < end && *p != '"') {
+                if (*p == '\\') p++;
+                p++;
+            }
+        } else if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (depth == 0) {
+                return p;
+            }
+            depth--;
+        } else if (*p == ',' && depth == 0) {
+            return p;
+        }
+        p++;
+    }
+    return p;
+}
+/* }}} */
+
+/* {{{ profiler_filter_add_verb */
+static void profiler_filter_add_verb(profiler_filter *f, const char *verb, size_t len)
+{
+    size_t i;
+
+    if (len == 0 || len >= PROFILER_FILTER_VERB_LEN
+        || f->verb_count >= PROFILER_FILTER_MAX_VERBS) {
+        return;
+    }
+    for (i = 0; i < len; i++) {
+        f->verbs[f->verb_count][i] = (char)profiler_filter_lower((unsigned char)verb[i]);
+    }
+    f->verbs[f->verb_count][len] = '\0';
+    f->verb_count++;
+}
+/* }}} */
+
+/* {{{ profiler_filter_verbs
+ * "verb": "SELECT" or ["SELECT", "UPDATE"] */
+static const char *profiler_filter_verbs(profiler_filter *f, const char *p, const char *end)
+{
+    char *s;
+    size_t len;
+
+    if (*p == '"') {
+        if ((s = profiler_filter_string(&p, end, &len)) != NULL) {
+            profiler_filter_add_verb(f, s, len);
+            pefree(s, 1);
+        }
+        return p;
+    }
+    if (*p != '[') {
+        return profiler_filter_skip_value(p, end);
+    }
+
+    p++;
+    while (p < end) {
+        p = profiler_filter_ws(p, end);
+        if (p >= end || *p == ']') {
+            return p < end ? p + 1 : p;
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p == '"') {
+            if ((s = profiler_filter_string(&p, end, &len)) == NULL) {
+                return end;
+            }
+            profiler_filter_add_verb(f, s, len);
+            pefree(s, 1);
+        } else {
+            p = profiler_filter_skip_value(p, end);
+        }
+    }
+    return p;
+}
+/* }}} */
+
+/* {{{ profiler_filter_find
+ * The opening brace of the "filter" object in [start, end), or NULL. */
+static const char *profiler_filter_find(const char *start, const char *end)
+{
+    static const char needle[] = "\"filter\"";
+    const size_t needle_len = sizeof(needle) - 1;
+    const char *p;
+    const char *q;
+
+    for (p = start; p + needle_len <= end; p++) {
+        if (*p != '"' || memcmp(p, needle, needle_len) != 0) {
+            continue;
+        }
+        /* A key, not a string value that happens to read "filter" */
+        q = profiler_filter_ws(p + needle_len, end);
+        if (q < end && *q == ':') {
+            q = profiler_filter_ws(q + 1, end);
+            return q < end && *q == '{' ? q : NULL;
+        }
+    }
+    return NULL;
+}
+/* }}} */
+
+/* {{{ profiler_filter_parse */
+profiler_filter *profiler_filter_parse(const char *start, const char *end)
+{
+    profiler_filter *f;
+    const char *p = profiler_filter_find(start, end);
+    const char *key;
+    size_t key_len;
+    size_t i;
+
+    if (!p) {
+        return NULL;
+    }
+
+    f = (profiler_filter *)pecalloc(1, sizeof(profiler_filter), 1);
+    p++; /* skip { */
+
+    while (p < end) {
+        p = profiler_filter_ws(p, end);
+        if (p < end && *p == ',') {
+            p++;
+            continue;
+        }
+        if (p >= end || *p != '"') {
+            break; /* closing brace, or something unexpected */
+        }
+
+        key = ++p;
+        while (p < end && *p != '"') {
+            p++;
+        }
+        key_len = p - key;
+        p = profiler_filter_ws(p + 1, end);
+        if (p >= end || *p != ':') {
+            break;
+        }
+        p = profiler_filter_ws(p + 1, end);
+        if (p >= end) {
+            break;
+        }
+
+#define PROFILER_FILTER_KEY(name) \
+        (key_len == sizeof(name) - 1 && memcmp(key, name, key_len) == 0)
+
+        if (PROFILER_FILTER_KEY("tag") && *p == '"' && !f->tag) {
+            f->tag = profiler_filter_string(&p, end, &f->tag_len);
+        } else if (PROFILER_FILTER_KEY("uri") && *p == '"' && !f->uri) {
+            f->uri = profiler_filter_string(&p, end, &f->uri_len);
+        } else if (PROFILER_FILTER_KEY("table") && *p == '"' && !f->table) {
+            f->table = profiler_filter_string(&p, end, &f->table_len);
+            for (i = 0; f->table && i < f->table_len; i++) {
+                f->table[i] = (char)profiler_filter_lower((unsigned char)f->table[i]);
+            }
+        } else if (PROFILER_FILTER_KEY("verb")) {
+            p = profiler_filter_verbs(f, p, end);
+        } else if (PROFILER_FILTER_KEY("min_us") && *p >= '0' && *p <= '9') {
+            f->min_us = (uint64_t)zend_strtod(p, NULL);
+            p = profiler_filter_skip_value(p, end);
+        } else if (PROFILER_FILTER_KEY("status") && *p == '"') {
+            char *status;
+            size_t status_len;
+
+            status = profiler_filter_string(&p, end, &status_len);
+            if (status) {
+                f->err_only = strcmp(status, "err") == 0;
+                pefree(status, 1);
+            }
+        } else {
+            p = profiler_filter_skip_value(p, end);
+        }
+
+#undef PROFILER_FILTER_KEY
+    }
+
+    /* Empty prefixes and substrings match everything */
+    if (f->tag && f->tag_len == 0) {
+        pefree(f->tag, 1);
+        f->tag = NULL;
+    }
+    if (f->uri && f->uri_len == 0) {
+        pefree(f->uri, 1);
+        f->uri = NULL;
+    }
+    if (f->table && f->table_len == 0) {
+        pefree(f->table, 1);
+        f->table = NULL;
+    }
+
+    f->per_query = f->tag || f->table || f->verb_count || f->min_us || f->err_only;
+    if (!f->per_query && !f->uri) {
+        profiler_filter_free(f);
+        return NULL;
+    }
+    return f;
+}
+/* }}} */
+
+/* {{{ profiler_filter_free */
+void profiler_filter_free(profiler_filter *f)
+{
+    if (!f) {
+        return;
+    }
+    if (f->tag) {
+        pefree(f->tag, 1);
+    }
+    if (f->table) {
+        pefree(f->table, 1);
+    }
+    if (f->uri) {
+        pefree(f->uri, 1);
+    }
+    pefree(f, 1);
+}
+/* }}} */
+
+/* {{{ profiler_filter_match_request */
+int profiler_filter_match_request(const profiler_filter *f)
+{
+    const char *s;
+    TSRMLS_FETCH();
+
+    if (!f || !f->uri) {
+        return 1;
+    }
+    s = SG(request_info).request_uri;
+    if (!s) {
+        s = SG(request_info).path_translated;
+    }
+    return s && strncmp(s, f->uri, f->uri_len) == 0;
+}
+/* }}} */
+
+/* {{{ profiler_filter_verb
+ * Lowercase first keyword of a statement into buf (at most
+ * PROFILER_FILTER_VERB_LEN - 1 letters), skipping leading whitespace,
+ * comments and parentheses. */
+static void profiler_filter_verb(const char *p, const char *end, char *buf)
+{
+    size_t n = 0;
+
+    while (p < end) {
+        if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '(') {
+            p++;
+        } else if (*p == '/' && p + 1 < end && p[1] == '*') {
+            p += 2;
+            while (p + 1 < end && !(p[0] == '*' && p[1] == '/')) {
+                p++;
+            }
+            p = p + 1 < end ? p + 2 : end;
+        } else if (*p == '#' || (*p == '-' && p + 1 < end && p[1] == '-')) {
+            while (p < end && *p != '\n') {
+                p++;
+            }
+        } else {
+            break;
+        }
+    }
+
+    while (p < end && n < PROFILER_FILTER_VERB_LEN - 1
+           && (((unsigned char)*p | 0x20) >= 'a' && ((unsigned char)*p | 0x20) <= 'z')) {
+        buf[n++] = (char)((unsigned char)*p | 0x20);
+        p++;
+    }
+    buf[n] = '\0';
+}
+/* }}} */
+
+/* {{{ profiler_filter_contains
+ * Whether needle (lowercase) occurs in hay, ignoring ASCII case. */
+static int profiler_filter_contains(const char *hay, size_t hay_len,
+                                    const char *needle, size_t needle_len)
+{
+    const unsigned char first = (unsigned char)needle[0];
+    size_t i;
+    size_t j;
+
+    if (needle_len > hay_len) {
+        return 0;
+    }
+    for (i = 0; i + needle_len <= hay_len; i++) {
+        if (profiler_filter_lower((unsigned char)hay[i]) != first) {
+            continue;
+        }
+        for (j = 1; j < needle_len; j++) {
+            if (profiler_filter_lower((unsigned char)hay[i + j]) != (unsigned char)needle[j]) {
+                break;
+            }
+        }
+        if (j == needle_len) {
+            return 1;
+        }
+    }
+    return 0;
+}
+/* }}} */
+
+/* {{{ profiler_filter_match
+ * Cheapest checks first; the statement text is only scanned when the
+ * tag, status and duration already match. */
+int profiler_filter_match(const profiler_filter *f, const profiler_record *rec)
+{
+    char verb[PROFILER_FILTER_VERB_LEN];
+    int i;
+
+    if (!f || !f->per_query) {
+        return 1;
+    }
+
+    if (f->err_only && !(rec->status && strcmp(rec->status, "err") == 0)) {
+        return 0;
+    }
+    if (f->min_us && (!rec->timer || rec->timer->dur_us < f->min_us)) {
+        return 0;
+    }
+    if (f->tag && !(rec->tag && strncmp(rec->tag, f->tag, f->tag_len) == 0)) {
+        return 0;
+    }
+
+    if (f->verb_count) {
+        profiler_filter_verb(rec->query, rec->query + rec->query_len, verb);
+        for (i = 0; i < f->verb_count; i++) {
+            if (strcmp(verb, f->verbs[i]) == 0) {
+                break;
+            }
+        }
+        if (i == f->verb_count) {
+            return 0;
+        }
+    }
+
+    if (f->table && !profiler_filter_contains(rec->query, rec->query_len,
+                                              f->table, f->table_len)) {
+        return 0;
+    }
+    return 1;
+}
+/* }}} */
@@ -0,0 +1,46 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Job Capture Filter Header                   |
+  +----------------------------------------------------------------------+
+  | A job's optional "filter" object in jobs.json, compiled once when    |
+  | the job list is read. The uri prefix is checked once per request     |
+  | (at sampling); the rest is checked per query before it is encoded.   |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_FILTER_H
+#define PROFILER_FILTER_H
+
+#define PROFILER_FILTER_MAX_VERBS 8
+#define PROFILER_FILTER_VERB_LEN  16 /* longest verb + NUL */
+
+typedef struct _profiler_filter {
+    char     *tag;         /* context tag prefix, NULL = any */
+    size_t    tag_len;
+    char     *table;       /* lowercase substring of the statement, NULL = any */
+    size_t    table_len;
+    char     *uri;         /* request URI (or CLI script path) prefix, NULL = any */
+    size_t    uri_len;
+    char      verbs[PROFILER_FILTER_MAX_VERBS][PROFILER_FILTER_VERB_LEN]; /* lowercase */
+    int       verb_count;  /* 0 = any statement */
+    uint64_t  min_us;      /* 0 = any duration */
+    int       err_only;    /* only failed statements */
+    int       per_query;   /* anything besides uri is set */
+} profiler_filter;
+
+/*
+ * Compile the "filter" object found in one job's JSON object [start, end).
+ * Returns NULL (capture everything) when the job has none or it is empty.
+ * Allocated persistently, like the job list that owns it.
+ */
+profiler_filter *profiler_filter_parse(const char *start, const char *end);
+
+void profiler_filter_free(profiler_filter *f);
+
+/* Whether the current request passes f's uri prefix */
+int profiler_filter_match_request(const profiler_filter *f);
+
+/* Whether rec (query, tag, status and timer set) passes f's per-query part */
+int profiler_filter_match(const profiler_filter *f, const profiler_record *rec);
+
+#endif /* PROFILER_FILTER_H */
@@ -0,0 +1,425 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - SQL Fingerprint                             |
+  +----------------------------------------------------------------------+
+  | Single-pass tokenizer driven by a 256-entry character class table:   |
+  | identifier runs and whitespace are consumed with one table lookup    |
+  | per byte, literals are skipped without copying, and only the         |
+  | normalized tokens are written out and hashed.                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "profiler_fingerprint.h"
+
+/* Character classes */
+#define FP_C_OTHER     0 /* operators: = < > + - * / ... */
+#define FP_C_SPACE     1
+#define FP_C_WORD      2 /* letters, _, $, @ and bytes >= 0x80 */
+#define FP_C_DIGIT     3
+#define FP_C_QUOTE     4 /* ' and " string literals */
+#define FP_C_BACKTICK  5
+#define FP_C_PUNCT     6 /* ( ) , ; */
+
+/* Kind of the last token written to the output */
+#define FP_T_NONE      0
+#define FP_T_WORD      1 /* keyword, identifier or placeholder */
+#define FP_T_OP        2
+#define FP_T_PUNCT     3
+
+
+static unsigned char profiler_fp_class[256];
+
+typedef struct _profiler_fp_state {
+    profiler_buf *out;
+    int    last;         /* FP_T_* of the last token */
+    char   last_char;    /* last byte written */
+    size_t word_start;   /* output offset of the last word token */
+    size_t word_len;
+    /* Placeholder list being collapsed, opened by "in(" or "values(" */
+    int    list_open;
+    int    list_values;  /* the list is a VALUES row */
+    int    list_repeat;  /* a second VALUES row: dropped entirely */
+    int    list_items;   /* placeholders seen in the list */
+    size_t list_start;   /* output offset just after '(' */
+    /* Between VALUES rows: 1 = after a collapsed row, 2 = after its ',' */
+    int    row_state;
+    size_t row_cut;      /* output offset of that ',' */
+} profiler_fp_state;
+
+/* {{{ profiler_fingerprint_init */
+void profiler_fingerprint_init(void)
+{
+    int c;
+
+    for (c = 0; c < 256; c++) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+            || c == '_' || c == '$' || c == '@' || c >= 0x80) {
+            profiler_fp_class[c] = FP_C_WORD;
+        } else if (c >= '0' && c <= '9') {
+            profiler_fp_class[c] = FP_C_DIGIT;
+        } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r'
+            || c == '\f' || c == '\v') {
+            profiler_fp_class[c] = FP_C_SPACE;
+        } else if (c == '\'' || c == '"') {
+            profiler_fp_class[c] = FP_C_QUOTE;
+        } else if (c == '`') {
+            profiler_fp_class[c] = FP_C_BACKTICK;
+        } else if (c == '(' || c == ')' || c == ',' || c == ';') {
+            profiler_fp_class[c] = FP_C_PUNCT;
+        } else {
+            profiler_fp_class[c] = FP_C_OTHER;
+        }
+    }
+}
+/* }}} */
+
+#define FP_CLASS(c) profiler_fp_class[(unsigned char)(c)]
+
+/* {{{ profiler_fp_skip_string
+ * Return the position after the literal opened by *p (backslash and
+ * doubled-quote escapes), or end if it is unterminated. */
+static const char *profiler_fp_skip_string(const char *p, const char *end)
+{
+    char quote = *p++;
+
+    while (p < end) {
+        if (*p == '\\') {
+            p += 2;
+            continue;
+        }
+        if (*p == quote) {
+            if (p + 1 < end && p[1] == quote) {
+                p += 2;
+                continue;
+            }
+            return p + 1;
+        }
+        p++;
+    }
+    return end;
+}
+/* }}} */
+
+/* {{{ profiler_fp_scan_number
+ * Length of the numeric literal at p (decimal, float with exponent or
+ * 0x hex), or 0 if the digits start an identifier such as `1st_col`. */
+static size_t profiler_fp_scan_number(const char *p, const char *end)
+{
+    const char *q = p;
+
+    if (end - q > 2 && q[0] == '0' && (q[1] == 'x' || q[1] == 'X')) {
+        q += 2;
+        while (q < end && (FP_CLASS(*q) == FP_C_DIGIT
+                || ((*q | 0x20) >= 'a' && (*q | 0x20) <= 'f'))) {
+            q++;
+        }
+    } else {
+        while (q < end && FP_CLASS(*q) == FP_C_DIGIT) {
+            q++;
+        }
+        if (q + 1 < end && *q == '.' && FP_CLASS(q[1]) == FP_C_DIGIT) {
+            q++;
+            while (q < end && FP_CLASS(*q) == FP_C_DIGIT) {
+                q++;
+            }
+        }
+        if (q < end && (*q == 'e' || *q == 'E')) {
+            const char *e = q + 1;
+
+            if (e < end && (*e == '+' || *e == '-')) {
+                e++;
+            }
+            if (e < end && FP_CLASS(*e) == FP_C_DIGIT) {
+                q = e;
+                while (q < end && FP_CLASS(*q) == FP_C_DIGIT) {
+                    q++;
+                }
+            }
+        }
+    }
+
+    if (q < end && (FP_CLASS(*q) == FP_C_WORD || FP_CLASS(*q) == FP_C_DIGIT)) {
+        return 0;
+    }
+    return (size_t)(q - p);
+}
+/* }}} */
+
+/* {{{ profiler_fp_comment_start
+ * Whether p starts a comment ("-- ", "#" or a block comment). */
+static int profiler_fp_comment_start(const char *p, const char *end)
+{
+    if (*p == '#') {
+        return 1;
+    }
+    if (p + 1 < end && *p == '/' && p[1] == '*') {
+        return 1;
+    }
+    return *p == '-' && p + 1 < end && p[1] == '-'
+        && (p + 2 == end || FP_CLASS(p[2]) == FP_C_SPACE);
+}
+/* }}} */
+
+/* {{{ profiler_fp_signed_number
+ * Whether the sign at p belongs to a numeric literal: it must be
+ * followed by a digit and come where no operand ends (after an
+ * operator, '(' or ',', or at the start). */
+static int profiler_fp_signed_number(const profiler_fp_state *st,
+                                     const char *p, const char *end)
+{
+    if (p + 1 >= end || FP_CLASS(p[1]) != FP_C_DIGIT) {
+        return 0;
+    }
+    if (st->last == FP_T_WORD || (st->last == FP_T_PUNCT && st->last_char == ')')) {
+        return 0;
+    }
+    return profiler_fp_scan_number(p + 1, end) > 0;
+}
+/* }}} */
+
+/* {{{ profiler_fp_last_word_is */
+static int profiler_fp_last_word_is(const profiler_fp_state *st, const char *word)
+{
+    size_t len = strlen(word);
+
+    return st->last == FP_T_WORD && st->word_len == len
+        && memcmp(st->out->data + st->word_start, word, len) == 0;
+}
+/* }}} */
+
+/* {{{ profiler_fp_emit
+ * Append one token. Spacing does not depend on the input: tokens are
+ * separated by one space except inside parentheses, before ',' and ';',
+ * around '.' and between a name and its '(' (function calls, IN, VALUES). */
+static void profiler_fp_emit(profiler_fp_state *st, int type,
+                             const char *tok, size_t len, int lower)
+{
+    profiler_buf *out = st->out;
+    size_t i;
+
+    if (st->last != FP_T_NONE
+        && st->last_char != '(' && st->last_char != '.'
+        && !(type == FP_T_PUNCT && tok[0] != '(')
+        && !(type == FP_T_PUNCT && st->last == FP_T_WORD)
+        && !(type == FP_T_OP && len == 1 && tok[0] == '.')) {
+        profiler_buf_appendc(out, ' ');
+    }
+
+    if (type == FP_T_WORD) {
+        st->word_start = out->len;
+        st->word_len = len;
+    }
+
+    if (lower) {
+        profiler_buf_reserve(out, len);
+        for (i = 0; i < len; i++) {
+            char c = tok[i];
+            out->data[out->len++] = (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+        }
+        out->data[out->len] = '\0';
+    } else {
+        profiler_buf_append(out, tok, len);
+    }
+
+    st->last = type;
+    st->last_char = out->data[out->len - 1];
+}
+/* }}} */
+
+/* {{{ profiler_fp_token
+ * Feed one token through the list-collapsing state machine, then emit it.
+ * `ph` marks a placeholder (a literal already replaced by `?`). */
+static void profiler_fp_token(profiler_fp_state *st, int type,
+                              const char *tok, size_t len, int lower, int ph)
+{
+    char punct = type == FP_T_PUNCT ? tok[0] : '\0';
+    int opens_list = 0;
+
+    if (st->list_open) {
+        if (ph) {
+            st->list_items++;
+        } else if (punct == ',') {
+            /* separator, list still collapsible */
+        } else if (punct == ')' && st->list_items > 0) {
+            if (st->list_repeat) {
+                /* Same shape as the first row: drop ",(...)" */
+                st->out->len = st->row_cut;
+            } else {
+                st->out->len = st->list_start;
+                profiler_buf_append(st->out, "...)", 4);
+            }
+            st->out->data[st->out->len] = '\0';
+            st->last = FP_T_PUNCT;
+            st->last_char = ')';
+            st->list_open = 0;
+            st->row_state = st->list_values ? 1 : 0;
+            return;
+        } else {
+            st->list_open = 0;
+        }
+    }
+
+    if (st->row_state == 1 && punct == ',') {
+        st->row_state = 2;
+        st->row_cut = st->out->len;
+    } else if (st->row_state == 2 && punct == '(') {
+        st->row_state = 0;
+        opens_list = 2;
+    } else {
+        st->row_state = 0;
+        if (punct == '('
+            && (profiler_fp_last_word_is(st, "in")
+                || profiler_fp_last_word_is(st, "values")
+                || profiler_fp_last_word_is(st, "value"))) {
+            opens_list = profiler_fp_last_word_is(st, "in") ? 1 : 3;
+        }
+    }
+
+    profiler_fp_emit(st, type, tok, len, lower);
+
+    if (opens_list) {
+        st->list_open = 1;
+        st->list_values = opens_list != 1;
+        st->list_repeat = opens_list == 2;
+        st->list_items = 0;
+        st->list_start = st->out->len;
+    }
+}
+/* }}} */
+
+/* {{{ profiler_fingerprint */
+uint64_t profiler_fingerprint(const char *query, size_t query_len, profiler_buf *norm)
+{
+    profiler_fp_state st;
+    profiler_buf local;
+    const char *p = query;
+    const char *end = query + query_len;
+    uint64_t hash;
+    size_t start;
+
+    profiler_buf_init(&local);
+    memset(&st, 0, sizeof(st));
+    st.out = norm ? norm : &local;
+    start = st.out->len;
+
+    while (p < end) {
+        char c = *p;
+        const char *q;
+        size_t n;
+
+        switch (FP_CLASS(c)) {
+        case FP_C_SPACE:
+            p++;
+            while (p < end && FP_CLASS(*p) == FP_C_SPACE) {
+                p++;
+            }
+            continue;
+
+        case FP_C_QUOTE:
+            p = profiler_fp_skip_string(p, end);
+            profiler_fp_token(&st, FP_T_WORD, "?", 1, 0, 1);
+            continue;
+
+        case FP_C_BACKTICK:
+            q = p + 1;
+            while (q < end) {
+                if (*q == '`') {
+                    if (q + 1 < end && q[1] == '`') {
+                        q += 2;
+                        continue;
+                    }
+                    q++;
+                    break;
+                }
+                q++;
+            }
+            profiler_fp_token(&st, FP_T_WORD, p, (size_t)(q - p), 0, 0);
+            p = q;
+            continue;
+
+        case FP_C_DIGIT:
+            n = profiler_fp_scan_number(p, end);
+            if (n) {
+                profiler_fp_token(&st, FP_T_WORD, "?", 1, 0, 1);
+                p += n;
+                continue;
+            }
+            /* fall through - digits starting an identifier */
+        case FP_C_WORD:
+            q = p + 1;
+            while (q < end && (FP_CLASS(*q) == FP_C_WORD || FP_CLASS(*q) == FP_C_DIGIT)) {
+                q++;
+            }
+            /* x'..', b'..', N'..' literals and _charset'..' introducers */
+            if (q < end && *q == '\''
+                && ((q - p == 1 && strchr("xXbBnN", c)) || c == '_')) {
+                p = profiler_fp_skip_string(q, end);
+                profiler_fp_token(&st, FP_T_WORD, "?", 1, 0, 1);
+                continue;
+            }
+            profiler_fp_token(&st, FP_T_WORD, p, (size_t)(q - p), 1, 0);
+            p = q;
+            continue;
+
+        case FP_C_PUNCT:
+            profiler_fp_token(&st, FP_T_PUNCT, p, 1, 0, 0);
+            p++;
+            continue;
+
+        default:
+            break;
+        }
+
+        /* Operators, comments and existing placeholders */
+        if (c == '-' && profiler_fp_comment_start(p, end)) {
+            while (p < end && *p != '\n') {
+                p++;
+            }
+        } else if (c == '#') {
+            while (p < end && *p != '\n') {
+                p++;
+            }
+        } else if (c == '/' && p + 1 < end && p[1] == '*') {
+            q = p + 2;
+            while (q + 1 < end && !(q[0] == '*' && q[1] == '/')) {
+                q++;
+            }
+            p = q + 1 < end ? q + 2 : end;
+        } else if (c == '?') {
+            profiler_fp_token(&st, FP_T_WORD, "?", 1, 0, 1);
+            p++;
+        } else if ((c == '-' || c == '+') && profiler_fp_signed_number(&st, p, end)) {
+            /* "= -1" is the same shape as "= 1" */
+            n = profiler_fp_scan_number(p + 1, end);
+            profiler_fp_token(&st, FP_T_WORD, "?", 1, 0, 1);
+            p += 1 + n;
+        } else {
+            /* Multi-character operators (>=, <>, :=, ||) form one token */
+            q = p + 1;
+            while (q < end && FP_CLASS(*q) == FP_C_OTHER && *q != '?' && *q != '.'
+                && c != '.' && !profiler_fp_comment_start(q, end)
+                && !((*q == '-' || *q == '+') && q + 1 < end
+                    && FP_CLASS(q[1]) == FP_C_DIGIT)) {
+                q++;
+            }
+            profiler_fp_token(&st, FP_T_OP, p, (size_t)(q - p), 0, 0);
+            p = q;
+        }
+    }
+
+    /* A trailing ';' does not change the statement */
+    if (st.out->len > start && st.out->data[st.out->len - 1] == ';') {
+        st.out->data[--st.out->len] = '\0';
+    }
+
+    hash = profiler_fnv1a(PROFILER_FNV_OFFSET, st.out->data + start, st.out->len - start);
+
+    profiler_buf_free(&local);
+    return hash;
+}
+/* }}} */
@@ -0,0 +1,52 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - SQL Fingerprint Header                      |
+  +----------------------------------------------------------------------+
+  | Reduces a statement to its shape (literals replaced by `?`,          |
+  | comments dropped, whitespace collapsed) and a 64-bit digest of it,   |
+  | so records can be grouped by query shape without parsing SQL again.  |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_FINGERPRINT_H
+#define PROFILER_FINGERPRINT_H
+
+#include "profiler_buf.h"
+
+/* 64-bit FNV-1a, used for every digest the extension computes */
+#define PROFILER_FNV_OFFSET 0xcbf29ce484222325ULL
+#define PROFILER_FNV_PRIME  0x100000001b3ULL
+
+/* Continue FNV-1a digest h (start from PROFILER_FNV_OFFSET) over data */
+static inline uint64_t profiler_fnv1a(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + len;
+
+    while (p < end) {
+        h = (h ^ *p++) * PROFILER_FNV_PRIME;
+    }
+    return h;
+}
+
+/* Build the character class table. Called once from MINIT. */
+void profiler_fingerprint_init(void);
+
+/*
+ * Normalize `query` and return the FNV-1a digest of the normalized form.
+ *
+ * If `norm` is not NULL the normalized statement is appended to it,
+ * e.g. "SELECT * FROM t WHERE id IN (1, 2, 3) AND name = 'x' -- c"
+ * becomes "select * from t where id in(...) and name = ?".
+ *
+ * Rules:
+ *   - string, numeric, hex and bit literals become `?`
+ *   - IN (...) lists and VALUES rows made only of placeholders collapse
+ *     to `(...)`; repeated VALUES rows are dropped
+ *   - comments are removed, spacing is rewritten to one canonical form
+ *     and keywords are lower-cased
+ *   - backtick-quoted identifiers are kept verbatim
+ */
+uint64_t profiler_fingerprint(const char *query, size_t query_len, profiler_buf *norm);
+
+#endif /* PROFILER_FINGERPRINT_H */
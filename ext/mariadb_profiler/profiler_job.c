@@ -3,6 +3,7 @@
   | MariaDB Query Profiler - Job State Reader                            |
   +----------------------------------------------------------------------+
   | Reads active job state from shared jobs.json file                    |
+  | only when the memory-mapped jobs.gen generation counter changes      |
   +----------------------------------------------------------------------+
 */
 
@@ -13,9 +14,12 @@
 #include "php.h"
 #include "php_mariadb_profiler.h"
 #include "profiler_job.h"
+#include "profiler_filter.h"
+#include "profiler_trigger.h"
 
 #ifndef PHP_WIN32
 # include <sys/file.h>
+# include <sys/mman.h>
 #endif
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -32,18 +36,121 @@ static char *profiler_job_get_jobs_path(void)
 }
 /* }}} */
 
+/* {{{ profiler_job_parse_sample_rate
+ * Find "sample_rate": <number> inside one job's object [start, end).
+ * Returns the rate clamped to [0, 1], or -1 if the job has none. */
+static double profiler_job_parse_sample_rate(const char *start, const char *end)
+{
+    static const char needle[] = "\"sample_rate\"";
+    const size_t needle_len = sizeof(needle) - 1;
+    const char *p;
+    double rate;
+
+    for (p = start; p + needle_len <= end; p++) {
+        if (*p != '"' || memcmp(p, needle, needle_len) != 0) {
+            continue;
+        }
+        p += needle_len;
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+        if (p >= end || *p != ':') {
+            continue; /* a string value reading "sample_rate", not the key */
+        }
+        p++;
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+        if (p >= end || !((*p >= '0' && *p <= '9') || *p == '.' || *p == '-')) {
+            return -1.0; /* null or not a number: use the ini default */
+        }
+        rate = zend_strtod(p, NULL);
+        if (rate < 0.0) {
+            rate = 0.0;
+        } else if (rate > 1.0) {
+            rate = 1.0;
+        }
+        return rate;
+    }
+
+    return -1.0;
+}
+/* }}} */
+
+/* {{{ profiler_job_parse_trigger
+ * Find "trigger": "<token>" inside one job's object [start, end).
+ * Returns a persistent copy of the token, or NULL if the job has none.
+ * Tokens are plain [A-Za-z0-9._-] (checked by the CLI), so no
+ * unescaping is needed. */
+static char *profiler_job_parse_trigger(const char *start, const char *end)
+{
+    static const char needle[] = "\"trigger\"";
+    const size_t needle_len = sizeof(needle) - 1;
+    const char *p;
+    const char *token;
+    char *copy;
+
+    for (p = start; p + needle_len <= end; p++) {
+        if (*p != '"' || memcmp(p, needle, needle_len) != 0) {
+            continue;
+        }
+        p += needle_len;
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+        if (p >= end || *p != ':') {
+            continue; /* a string value reading "trigger", not the key */
+        }
+        p++;
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+        if (p >= end || *p != '"') {
+            return NULL; /* null: no trigger */
+        }
+        token = ++p;
+        while (p < end && *p != '"' && *p != '\\') {
+            p++;
+        }
+        if (p >= end || *p != '"' || (size_t)(p - token) >= PROFILER_MAX_JOB_KEY) {
+            return NULL;
+        }
+        copy = (char *)pemalloc(p - token + 1, 1);
+        memcpy(copy, token, p - token);
+        copy[p - token] = '\0';
+        return copy;
+    }
+
+    return NULL;
+}
+/* }}} */
+
 /* {{{ profiler_job_parse_active_jobs
  * Simple JSON parser for jobs.json - extracts active job keys
- * Format: {"active_jobs":{"uuid1":{...},"uuid2":{...}}}
- * We only need the keys of active_jobs object */
-static int profiler_job_parse_active_jobs(const char *json, char ***keys, int *count)
+ * Format: {"active_jobs":{"uuid1":{...,"sample_rate":0.01,"filter":{...}},"uuid2":{...}}}
+ * We need the keys of active_jobs object, each job's optional
+ * sample_rate (-1 when absent), its compiled filter and its trigger
+ * token (NULL when absent).
+ * Keys are allocated persistently: the list outlives the request and is
+ * only replaced when the registry generation changes. */
+static int profiler_job_parse_active_jobs(const char *json, char ***keys,
+                                          double **rates,
+                                          profiler_filter ***filters,
+                                          char ***triggers, int *count)
 {
-    const char *ptr, *key_start;
+    const char *ptr, *key_start, *value_start;
     char **job_keys = NULL;
+    double *job_rates = NULL;
+    profiler_filter **job_filters = NULL;
+    char **job_triggers = NULL;
     int job_count = 0;
     int capacity = 8;
+    int have_key;
 
     *keys = NULL;
+    *rates = NULL;
+    *filters = NULL;
+    *triggers = NULL;
     *count = 0;
 
     if (!json || !*json) {
@@ -63,7 +170,10 @@ static int profiler_job_parse_active_jobs(const char *json, char ***keys, int *c
     }
     ptr++; /* skip { */
 
-    job_keys = (char **)pecalloc(capacity, sizeof(char *), 0);
+    job_keys = (char **)pecalloc(capacity, sizeof(char *), 1);
+    job_rates = (double *)pecalloc(capacity, sizeof(double), 1);
+    job_filters = (profiler_filter **)pecalloc(capacity, sizeof(profiler_filter *), 1);
+    job_triggers = (char **)pecalloc(capacity, sizeof(char *), 1);
 
     /* Parse keys from the object */
     while (*ptr) {
@@ -79,6 +189,7 @@ static int profiler_job_parse_active_jobs(const char *json, char ***keys, int *c
         if (*ptr == '"') {
             ptr++; /* skip opening quote */
             key_start = ptr;
+            have_key = 0;
 
             /* Find closing quote */
             while (*ptr && *ptr != '"') {
@@ -92,18 +203,27 @@ static int profiler_job_parse_active_jobs(const char *json, char ***keys, int *c
                     /* Grow array if needed */
                     if (job_count >= capacity) {
                         capacity *= 2;
-                        job_keys = (char **)perealloc(job_keys, capacity * sizeof(char *), 0);
+                        job_keys = (char **)perealloc(job_keys, capacity * sizeof(char *), 1);
+                        job_rates = (double *)perealloc(job_rates, capacity * sizeof(double), 1);
+                        job_filters = (profiler_filter **)perealloc(job_filters,
+                            capacity * sizeof(profiler_filter *), 1);
+                        job_triggers = (char **)perealloc(job_triggers, capacity * sizeof(char *), 1);
                     }
 
-                    job_keys[job_count] = (char *)pemalloc(key_len + 1, 0);
+                    job_keys[job_count] = (char *)pemalloc(key_len + 1, 1);
                     memcpy(job_keys[job_count], key_start, key_len);
                     job_keys[job_count][key_len] = '\0';
+                    job_rates[job_count] = -1.0;
+                    job_filters[job_count] = NULL;
+                    job_triggers[job_count] = NULL;
                     job_count++;
+                    have_key = 1;
                 }
                 ptr++; /* skip closing quote */
             }
 
             /* Skip the value (everything until next key or end) */
+            value_start = ptr;
             {
                 int depth = 0;
                 while (*ptr) {
@@ -123,22 +243,108 @@ static int profiler_job_parse_active_jobs(const char *json, char ***keys, int *c
                     ptr++;
                 }
             }
+
+            if (have_key) {
+                job_rates[job_count - 1] = profiler_job_parse_sample_rate(value_start, ptr);
+                job_filters[job_count - 1] = profiler_filter_parse(value_start, ptr);
+                job_triggers[job_count - 1] = profiler_job_parse_trigger(value_start, ptr);
+            }
         } else {
             ptr++; /* skip unexpected char */
         }
     }
 
     if (job_count == 0) {
-        pefree(job_keys, 0);
+        pefree(job_keys, 1);
+        pefree(job_rates, 1);
+        pefree(job_filters, 1);
+        pefree(job_triggers, 1);
         return SUCCESS;
     }
 
     *keys = job_keys;
+    *rates = job_rates;
+    *filters = job_filters;
+    *triggers = job_triggers;
     *count = job_count;
     return SUCCESS;
 }
 /* }}} */
 
+/* {{{ profiler_job_apply_sampling
+ * Rebuild the list of jobs capturing this request: job i captures when
+ * the request's draw is below its rate. One draw per request keeps the
+ * decision stable for the whole request (coherent traces, also for jobs
+ * appearing mid-request), and a request captured at 1% is also captured
+ * by every job sampling at a higher rate. A job with a trigger token
+ * captures exactly the requests carrying it, whatever the draw. A job
+ * whose filter names a uri prefix the request does not have skips the
+ * request entirely. */
+static void profiler_job_apply_sampling(void)
+{
+    int i;
+    TSRMLS_FETCH();
+
+    if (PROFILER_G(sampled_jobs)) {
+        pefree(PROFILER_G(sampled_jobs), 1);
+        PROFILER_G(sampled_jobs) = NULL;
+    }
+    if (PROFILER_G(sampled_job_filters)) {
+        pefree(PROFILER_G(sampled_job_filters), 1);
+        PROFILER_G(sampled_job_filters) = NULL;
+    }
+    PROFILER_G(sampled_job_count) = 0;
+    PROFILER_G(sampled_filtered) = 0;
+
+    if (PROFILER_G(active_job_count) == 0) {
+        return;
+    }
+
+    PROFILER_G(sampled_jobs) = (char **)pemalloc(
+        PROFILER_G(active_job_count) * sizeof(char *), 1);
+    PROFILER_G(sampled_job_filters) = (profiler_filter **)pemalloc(
+        PROFILER_G(active_job_count) * sizeof(profiler_filter *), 1);
+
+    for (i = 0; i < PROFILER_G(active_job_count); i++) {
+        double rate = PROFILER_G(active_job_rates)[i];
+        profiler_filter *filter = PROFILER_G(active_job_filters)[i];
+        const char *trigger = PROFILER_G(active_job_triggers)[i];
+        int captured;
+
+        if (rate < 0.0) {
+            rate = PROFILER_G(sample_rate);
+        }
+        captured = trigger
+            ? profiler_trigger_match(trigger, PROFILER_G(request_trigger))
+            : PROFILER_G(sample_point) < rate;
+        if (captured && profiler_filter_match_request(filter)) {
+            PROFILER_G(sampled_jobs)[PROFILER_G(sampled_job_count)] =
+                PROFILER_G(active_jobs)[i];
+            PROFILER_G(sampled_job_filters)[PROFILER_G(sampled_job_count)++] = filter;
+            if (filter && filter->per_query) {
+                PROFILER_G(sampled_filtered) = 1;
+            }
+        }
+    }
+}
+/* }}} */
+
+/* {{{ profiler_job_sample_draw
+ * Uniform draw in [0, 1) for the current request, seeded from the
+ * monotonic clock and pid (splitmix64 finalizer). */
+static double profiler_job_sample_draw(void)
+{
+    uint64_t x = profiler_clock_mono_ns() ^ ((uint64_t)profiler_getpid() << 32);
+
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    return (double)(x >> 11) * (1.0 / 9007199254740992.0); /* 2^53 */
+}
+/* }}} */
+
 /* {{{ profiler_job_refresh_active_jobs */
 int profiler_job_refresh_active_jobs(void)
 {
@@ -183,8 +389,11 @@ int profiler_job_refresh_active_jobs(void)
     flock(fd, LOCK_UN);
     profiler_close(fd);
 
-    /* Parse the JSON to get active job keys */
-    profiler_job_parse_active_jobs(buf, &PROFILER_G(active_jobs), &PROFILER_G(active_job_count));
+    /* Parse the JSON to get active job keys and their sample rates */
+    profiler_job_parse_active_jobs(buf, &PROFILER_G(active_jobs),
+        &PROFILER_G(active_job_rates), &PROFILER_G(active_job_filters),
+        &PROFILER_G(active_job_triggers), &PROFILER_G(active_job_count));
+    profiler_job_apply_sampling();
 
     efree(buf);
     PROFILER_G(last_job_check) = time(NULL);
@@ -193,55 +402,282 @@ int profiler_job_refresh_active_jobs(void)
 }
 /* }}} */
 
-/* {{{ profiler_job_free_active_jobs */
-void profiler_job_free_active_jobs(void)
+/* {{{ profiler_job_free_lists
+ * Free g's active and sampled job lists. */
+static void profiler_job_free_lists(zend_mariadb_profiler_globals *g)
 {
     int i;
-    TSRMLS_FETCH();
 
-    if (PROFILER_G(active_jobs)) {
-        for (i = 0; i < PROFILER_G(active_job_count); i++) {
-            if (PROFILER_G(active_jobs)[i]) {
-                pefree(PROFILER_G(active_jobs)[i], 0);
+    if (g->active_jobs) {
+        for (i = 0; i < g->active_job_count; i++) {
+            if (g->active_jobs[i]) {
+                pefree(g->active_jobs[i], 1);
+            }
+        }
+        pefree(g->active_jobs, 1);
+        g->active_jobs = NULL;
+    }
+    if (g->active_job_rates) {
+        pefree(g->active_job_rates, 1);
+        g->active_job_rates = NULL;
+    }
+    if (g->active_job_filters) {
+        for (i = 0; i < g->active_job_count; i++) {
+            profiler_filter_free(g->active_job_filters[i]);
+        }
+        pefree(g->active_job_filters, 1);
+        g->active_job_filters = NULL;
+    }
+    if (g->active_job_triggers) {
+        for (i = 0; i < g->active_job_count; i++) {
+            if (g->active_job_triggers[i]) {
+                pefree(g->active_job_triggers[i], 1);
             }
         }
-        pefree(PROFILER_G(active_jobs), 0);
-        PROFILER_G(active_jobs) = NULL;
+        pefree(g->active_job_triggers, 1);
+        g->active_job_triggers = NULL;
+    }
+    g->active_job_count = 0;
+
+    /* sampled_jobs and sampled_job_filters point into the active lists */
+    if (g->sampled_jobs) {
+        pefree(g->sampled_jobs, 1);
+        g->sampled_jobs = NULL;
+    }
+    if (g->sampled_job_filters) {
+        pefree(g->sampled_job_filters, 1);
+        g->sampled_job_filters = NULL;
     }
-    PROFILER_G(active_job_count) = 0;
+    g->sampled_job_count = 0;
+    g->sampled_filtered = 0;
 }
 /* }}} */
 
-/* {{{ profiler_job_is_any_active
- * Check if there are active jobs, refreshing from file if interval elapsed */
-int profiler_job_is_any_active(void)
+/* {{{ profiler_job_free_active_jobs */
+void profiler_job_free_active_jobs(void)
 {
-    time_t now;
     TSRMLS_FETCH();
 
-    if (!PROFILER_G(enabled)) {
-        return 0;
+    profiler_job_free_lists(PROFILER_GP());
+}
+/* }}} */
+
+#ifndef PHP_WIN32
+/* {{{ profiler_job_registry_u32 / profiler_job_registry_u64
+ * Little-endian field reads from the mapped registry. The CLI rewrites
+ * the file in place, so a torn read is possible but harmless: any change
+ * of value just triggers one extra jobs.json parse. */
+static uint32_t profiler_job_registry_u32(const volatile unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8)
+        | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t profiler_job_registry_u64(const volatile unsigned char *p)
+{
+    return (uint64_t)profiler_job_registry_u32(p)
+        | ((uint64_t)profiler_job_registry_u32(p + 4) << 32);
+}
+/* }}} */
+
+/* {{{ profiler_job_registry_unmap */
+static void profiler_job_registry_unmap(zend_mariadb_profiler_globals *g)
+{
+    if (g->registry) {
+        munmap((void *)g->registry, PROFILER_REGISTRY_SIZE);
+        g->registry = NULL;
+        g->registry_ino = 0;
+    }
+}
+/* }}} */
+
+/* {{{ profiler_job_registry_check
+ * Map jobs.gen if it exists, or remap it if the file was replaced
+ * (e.g. log_dir wiped and recreated). Called once per job_check_interval,
+ * so the steady-state cost is a single stat(). */
+static void profiler_job_registry_check(void)
+{
+    char *path;
+    struct stat st;
+    int fd;
+    void *map;
+    TSRMLS_FETCH();
+
+    spprintf(&path, 0, "%s/%s", PROFILER_G(log_dir), PROFILER_REGISTRY_FILENAME);
+
+    if (stat(path, &st) != 0 || st.st_size < PROFILER_REGISTRY_SIZE) {
+        efree(path);
+        profiler_job_registry_unmap(PROFILER_GP());
+        return;
+    }
+
+    if (PROFILER_G(registry) && PROFILER_G(registry_ino) == (uint64_t)st.st_ino) {
+        efree(path);
+        return;
+    }
+
+    profiler_job_registry_unmap(PROFILER_GP());
+
+    fd = profiler_open(path, O_RDONLY);
+    efree(path);
+    if (fd < 0) {
+        return;
+    }
+
+    map = mmap(NULL, PROFILER_REGISTRY_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    profiler_close(fd);
+
+    if (map == MAP_FAILED) {
+        return;
     }
 
+    if (memcmp(map, PROFILER_REGISTRY_MAGIC, 4) != 0
+        || profiler_job_registry_u32((const unsigned char *)map + 4) != PROFILER_REGISTRY_VERSION) {
+        munmap(map, PROFILER_REGISTRY_SIZE);
+        return;
+    }
+
+    PROFILER_G(registry) = (const unsigned char *)map;
+    PROFILER_G(registry_ino) = (uint64_t)st.st_ino;
+
+    /* Force a jobs.json read against the freshly mapped generation */
+    PROFILER_G(registry_gen) = profiler_job_registry_u64(PROFILER_G(registry) + 8) - 1;
+}
+/* }}} */
+#endif /* !PHP_WIN32 */
+
+/* {{{ profiler_job_sync
+ * Bring the active job list up to date.
+ *
+ * With a mapped registry this is one integer comparison; jobs.json is only
+ * parsed when the generation moved, and not at all when it says no job is
+ * active. Without a registry (older CLI, Windows) jobs.json is re-read
+ * every job_check_interval seconds. */
+void profiler_job_sync(void)
+{
+    time_t now;
+    TSRMLS_FETCH();
+
     now = time(NULL);
 
-    /* Refresh job list if check interval has elapsed */
     if ((now - PROFILER_G(last_job_check)) >= PROFILER_G(job_check_interval)) {
+        /* Hand buffered records to disk before the job set can change, so
+         * long-running scripts stay visible to tail -F and `job end` counts */
+        profiler_writer_flush_all();
+#ifndef PHP_WIN32
+        profiler_job_registry_check();
+        if (!PROFILER_G(registry)) {
+            profiler_job_refresh_active_jobs();
+        }
+#else
         profiler_job_refresh_active_jobs();
+#endif
+        PROFILER_G(last_job_check) = now;
     }
 
-    return PROFILER_G(active_job_count) > 0;
+#ifndef PHP_WIN32
+    if (PROFILER_G(registry)) {
+        const unsigned char *reg = PROFILER_G(registry);
+        uint64_t gen = profiler_job_registry_u64(reg + 8);
+
+        if (gen != PROFILER_G(registry_gen)) {
+            profiler_writer_flush_all();
+            if (profiler_job_registry_u32(reg + 16) == 0) {
+                profiler_job_free_active_jobs();
+            } else {
+                profiler_job_refresh_active_jobs();
+            }
+            PROFILER_G(registry_gen) = gen;
+        }
+    }
+#endif
 }
 /* }}} */
 
-/* {{{ profiler_job_get_active_list */
+/* {{{ profiler_job_request_init
+ * Sync the job list, draw this request's sample point and, when some
+ * job waits for a trigger, read the request's trigger value. Jobs whose
+ * trigger appears later in the request do not capture it. */
+void profiler_job_request_init(void)
+{
+    int i;
+    TSRMLS_FETCH();
+
+    PROFILER_G(sample_point) = profiler_job_sample_draw();
+
+    profiler_job_sync();
+
+    for (i = 0; i < PROFILER_G(active_job_count); i++) {
+        if (PROFILER_G(active_job_triggers)[i]) {
+            PROFILER_G(request_trigger) = profiler_trigger_request_value();
+            break;
+        }
+    }
+
+    profiler_job_apply_sampling();
+}
+/* }}} */
+
+/* {{{ profiler_job_request_shutdown */
+void profiler_job_request_shutdown(void)
+{
+    TSRMLS_FETCH();
+
+    if (PROFILER_G(request_trigger)) {
+        efree(PROFILER_G(request_trigger));
+        PROFILER_G(request_trigger) = NULL;
+    }
+}
+/* }}} */
+
+/* {{{ profiler_job_shutdown
+ * Release g's persistent job list and registry mapping. */
+void profiler_job_shutdown(zend_mariadb_profiler_globals *g)
+{
+    profiler_job_free_lists(g);
+#ifndef PHP_WIN32
+    profiler_job_registry_unmap(g);
+#endif
+}
+/* }}} */
+
+/* {{{ profiler_job_is_any_active
+ * Check if there are active jobs, syncing with the registry first.
+ * Never outside a request: its sinks and tables are gone by then. */
+int profiler_job_is_any_active(void)
+{
+    TSRMLS_FETCH();
+
+    if (!PROFILER_G(enabled) || !PROFILER_G(in_request)) {
+        return 0;
+    }
+
+    profiler_job_sync();
+
+    return PROFILER_G(sampled_job_count) > 0;
+}
+/* }}} */
+
+/* {{{ profiler_job_get_active_list
+ * Active jobs that sampled the current request. */
 char **profiler_job_get_active_list(int *count)
 {
     TSRMLS_FETCH();
 
     if (count) {
-        *count = PROFILER_G(active_job_count);
+        *count = PROFILER_G(sampled_job_count);
     }
-    return PROFILER_G(active_jobs);
+    return PROFILER_G(sampled_jobs);
+}
+/* }}} */
+
+/* {{{ profiler_job_get_filters
+ * Filters of the sampled jobs, parallel to profiler_job_get_active_list(),
+ * or NULL when none of them filters individual queries. */
+profiler_filter **profiler_job_get_filters(void)
+{
+    TSRMLS_FETCH();
+
+    return PROFILER_G(sampled_filtered) ? PROFILER_G(sampled_job_filters) : NULL;
 }
 /* }}} */
@@ -11,4 +11,19 @@
 #define PROFILER_MAX_JOB_KEY   256
 #define PROFILER_MAX_JOBS      64
 
+/*
+ * Job registry: fixed-size file published by the CLI next to jobs.json.
+ * The extension maps it read-only and re-reads jobs.json only when the
+ * generation changes. Layout (little-endian):
+ *   0  "MPJR"   magic
+ *   4  uint32   layout version
+ *   8  uint64   generation (bumped on every jobs.json write)
+ *   16 uint32   number of active jobs
+ *   20 ...      reserved (zero)
+ */
+#define PROFILER_REGISTRY_FILENAME "jobs.gen"
+#define PROFILER_REGISTRY_MAGIC    "MPJR"
+#define PROFILER_REGISTRY_VERSION  1
+#define PROFILER_REGISTRY_SIZE     32
+
 #endif /* PROFILER_JOB_H */
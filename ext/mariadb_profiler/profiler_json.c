@@ -0,0 +1,218 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - JSON String Escaping                        |
+  +----------------------------------------------------------------------+
+  | Every logged query, tag, job key, bound string and trace frame goes  |
+  | through here. Most of that text needs no escaping at all, so the     |
+  | work is finding the next byte that does: 32 bytes per step with      |
+  | AVX2 (chosen at runtime), 16 with SSE2, one byte otherwise.          |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "profiler_json.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define PROFILER_JSON_SSE2 1
+# include <emmintrin.h>
+#endif
+
+/* AVX2 is compiled in with a function-level target attribute and only
+ * used when the CPU reports it, so the build needs no -mavx2. */
+#if defined(PROFILER_JSON_SSE2) && (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+# define PROFILER_JSON_AVX2 1
+# include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+typedef size_t (*profiler_json_scan_fn)(const unsigned char *s, size_t len);
+
+/* {{{ profiler_json_needs_escape */
+static inline int profiler_json_needs_escape(unsigned char c)
+{
+    return c < 0x20 || c == '"' || c == '\\';
+}
+/* }}} */
+
+/* {{{ profiler_json_scan_scalar
+ * Number of leading bytes of s that can be copied as they are. */
+static size_t profiler_json_scan_scalar(const unsigned char *s, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (profiler_json_needs_escape(s[i])) {
+            break;
+        }
+    }
+    return i;
+}
+/* }}} */
+
+#ifdef PROFILER_JSON_SSE2
+
+/* {{{ profiler_json_ctz */
+static inline unsigned int profiler_json_ctz(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+
+    _BitScanForward(&idx, mask);
+    return (unsigned int)idx;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+/* }}} */
+
+/* {{{ profiler_json_scan_sse2
+ * A byte needs escaping if it equals '"' or '\\', or if it is below
+ * 0x20, i.e. min(byte, 0x1f) == byte (SSE2 has no unsigned compare). */
+static size_t profiler_json_scan_sse2(const unsigned char *s, size_t len)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i ctl = _mm_set1_epi8(0x1f);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(v, ctl), v));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(m);
+
+        if (mask) {
+            return i + profiler_json_ctz(mask);
+        }
+    }
+    return i + profiler_json_scan_scalar(s + i, len - i);
+}
+/* }}} */
+
+#endif /* PROFILER_JSON_SSE2 */
+
+#ifdef PROFILER_JSON_AVX2
+
+/* {{{ profiler_json_scan_avx2 */
+__attribute__((target("avx2")))
+static size_t profiler_json_scan_avx2(const unsigned char *s, size_t len)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i bslash = _mm256_set1_epi8('\\');
+    const __m256i ctl = _mm256_set1_epi8(0x1f);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bslash)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctl), v));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(m);
+
+        if (mask) {
+            return i + (unsigned int)__builtin_ctz(mask);
+        }
+    }
+    return i + profiler_json_scan_sse2(s + i, len - i);
+}
+/* }}} */
+
+#endif /* PROFILER_JSON_AVX2 */
+
+#ifdef PROFILER_JSON_SSE2
+static profiler_json_scan_fn profiler_json_scan = profiler_json_scan_sse2;
+static const char *profiler_json_scan_name = "sse2";
+#else
+static profiler_json_scan_fn profiler_json_scan = profiler_json_scan_scalar;
+static const char *profiler_json_scan_name = "scalar";
+#endif
+
+/* {{{ profiler_json_init */
+void profiler_json_init(void)
+{
+#ifdef PROFILER_JSON_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        profiler_json_scan = profiler_json_scan_avx2;
+        profiler_json_scan_name = "avx2";
+    }
+#endif
+}
+/* }}} */
+
+/* {{{ profiler_json_impl */
+const char *profiler_json_impl(void)
+{
+    return profiler_json_scan_name;
+}
+/* }}} */
+
+/* {{{ profiler_buf_append_json */
+void profiler_buf_append_json(profiler_buf *out, const char *str, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *s = (const unsigned char *)str;
+    size_t i = 0;
+
+    /* Room for the common case (nothing to escape) up front */
+    profiler_buf_reserve(out, len);
+
+    while (i < len) {
+        size_t run = profiler_json_scan(s + i, len - i);
+        unsigned char c;
+        char *p;
+
+        if (run) {
+            memcpy(out->data + out->len, s + i, run);
+            out->len += run;
+            i += run;
+            if (i == len) {
+                break;
+            }
+        }
+
+        /* Escapes grow the output: keep room for the rest as well */
+        profiler_buf_reserve(out, 6 + (len - i));
+        p = out->data + out->len;
+        c = s[i++];
+        *p++ = '\\';
+        switch (c) {
+            case '"':  *p++ = '"';  break;
+            case '\\': *p++ = '\\'; break;
+            case '\b': *p++ = 'b';  break;
+            case '\f': *p++ = 'f';  break;
+            case '\n': *p++ = 'n';  break;
+            case '\r': *p++ = 'r';  break;
+            case '\t': *p++ = 't';  break;
+            default:
+                *p++ = 'u';
+                *p++ = '0';
+                *p++ = '0';
+                *p++ = hex[c >> 4];
+                *p++ = hex[c & 0xf];
+        }
+        out->len = (size_t)(p - out->data);
+    }
+    out->data[out->len] = '\0';
+}
+/* }}} */
+
+/* {{{ profiler_buf_append_json_quoted */
+void profiler_buf_append_json_quoted(profiler_buf *out, const char *str, size_t len)
+{
+    profiler_buf_appendc(out, '"');
+    profiler_buf_append_json(out, str, len);
+    profiler_buf_appendc(out, '"');
+}
+/* }}} */
@@ -0,0 +1,34 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - JSON String Escaping Header                 |
+  +----------------------------------------------------------------------+
+  | Single-pass escaper that writes straight into a profiler_buf.        |
+  | Clean runs are found 16/32 bytes at a time (SSE2/AVX2) and copied    |
+  | with memcpy; only the bytes that need escaping are handled one by    |
+  | one.                                                                 |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_JSON_H
+#define PROFILER_JSON_H
+
+#include "profiler_buf.h"
+
+/* Pick the widest scanner this CPU supports. Called once from MINIT;
+ * until then the compile-time baseline (SSE2 or scalar) is used. */
+void profiler_json_init(void);
+
+/* Name of the scanner in use ("avx2", "sse2" or "scalar"), for phpinfo */
+const char *profiler_json_impl(void);
+
+/*
+ * Append str as the contents of a JSON string (no surrounding quotes).
+ * Escapes '"', '\\' and control bytes below 0x20; everything else,
+ * including '/' and UTF-8 sequences, is copied unchanged.
+ */
+void profiler_buf_append_json(profiler_buf *out, const char *str, size_t len);
+
+/* Same, wrapped in double quotes */
+void profiler_buf_append_json_quoted(profiler_buf *out, const char *str, size_t len);
+
+#endif /* PROFILER_JSON_H */
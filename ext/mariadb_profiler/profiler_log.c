@@ -2,8 +2,9 @@
   +----------------------------------------------------------------------+
   | MariaDB Query Profiler - Log Writer                                  |
   +----------------------------------------------------------------------+
-  | Writes query logs to per-job files                                   |
-  | Supports context tags and PHP backtrace in log output                |
+  | Captures tag and trace once per query and hands each record to the   |
+  | encoders (profiler_encode.c): every encoder serializes it once, the  |
+  | bytes are then appended to each active job's buffered sink.          |
   +----------------------------------------------------------------------+
 */
 
@@ -12,312 +13,533 @@
 #endif
 
 #include "php.h"
+#include "SAPI.h"
 #include "php_mariadb_profiler.h"
 #include "profiler_log.h"
 #include "profiler_job.h"
 #include "profiler_tag.h"
 #include "profiler_trace.h"
+#include "profiler_fingerprint.h"
+#include "profiler_encode.h"
+#include "profiler_writer.h"
+#include "profiler_stack.h"
+#include "profiler_tx.h"
+#include "profiler_filter.h"
+
+/* Jobs one record is written to */
+typedef struct _profiler_log_targets {
+    char **jobs;     /* the active list itself, buf or emalloc'ed */
+    int    count;
+    int    owned;    /* jobs was emalloc'ed */
+    char  *buf[16];
+} profiler_log_targets;
+
+/* {{{ profiler_log_is_binary
+ * Whether mariadb_profiler.log_format selects the binary format
+ * instead of JSONL. */
+static int profiler_log_is_binary(void)
+{
+    TSRMLS_FETCH();
 
-#ifndef PHP_WIN32
-# include <sys/file.h>
-# include <sys/time.h>
-#endif
-#include <time.h>
+    return PROFILER_G(log_format) && strcmp(PROFILER_G(log_format), "binary") == 0;
+}
+/* }}} */
 
-/* {{{ profiler_log_escape_json_string
- * Escape a string for JSON output. Caller must efree result. */
-char *profiler_log_escape_json_string(const char *str, size_t len)
+/* {{{ profiler_log_slow_verdict
+ * Decide from the measured duration how much of a query to log.
+ * The backtrace is only worth its cost for queries at or above
+ * slow_threshold_us; faster ones are logged bare or, with slow_only,
+ * not at all. Records without a timer are always logged in full.
+ * Aggregation mode counts every query and never writes a trace. */
+int profiler_log_slow_verdict(const profiler_timer *timer)
 {
-    size_t i;
-    size_t out_len = 0;
-    char *out;
-    char *p;
-
-    /* First pass: calculate output length */
-    for (i = 0; i < len; i++) {
-        switch (str[i]) {
-            case '"':  case '\\': case '/':
-                out_len += 2; break;
-            case '\b': case '\f': case '\n': case '\r': case '\t':
-                out_len += 2; break;
-            default:
-                if ((unsigned char)str[i] < 0x20) {
-                    out_len += 6; /* \uXXXX */
-                } else {
-                    out_len++;
-                }
-        }
+    TSRMLS_FETCH();
+
+    if (PROFILER_G(aggregate)) {
+        return PROFILER_LOG_NO_TRACE;
     }
 
-    out = (char *)emalloc(out_len + 1);
-    p = out;
-
-    /* Second pass: write escaped output */
-    for (i = 0; i < len; i++) {
-        switch (str[i]) {
-            case '"':  *p++ = '\\'; *p++ = '"';  break;
-            case '\\': *p++ = '\\'; *p++ = '\\'; break;
-            case '/':  *p++ = '\\'; *p++ = '/';  break;
-            case '\b': *p++ = '\\'; *p++ = 'b';  break;
-            case '\f': *p++ = '\\'; *p++ = 'f';  break;
-            case '\n': *p++ = '\\'; *p++ = 'n';  break;
-            case '\r': *p++ = '\\'; *p++ = 'r';  break;
-            case '\t': *p++ = '\\'; *p++ = 't';  break;
-            default:
-                if ((unsigned char)str[i] < 0x20) {
-                    p += snprintf(p, 7, "\\u%04x", (unsigned char)str[i]);
-                } else {
-                    *p++ = str[i];
-                }
-        }
+    if (PROFILER_G(slow_threshold_us) <= 0 || !timer
+        || timer->dur_us >= (uint64_t)PROFILER_G(slow_threshold_us)) {
+        return PROFILER_LOG_FULL;
     }
-    *p = '\0';
 
-    return out;
+    return PROFILER_G(slow_only) ? PROFILER_LOG_DROP : PROFILER_LOG_NO_TRACE;
 }
 /* }}} */
 
-/* {{{ profiler_log_get_timestamp
- * Returns current timestamp as string (caller must efree) */
-static char *profiler_log_get_timestamp(void)
+/* {{{ profiler_log_wanted
+ * Whether any job capturing this request accepts rec under its filter
+ * (query, tag, status and timer are enough). Lets callers drop a query
+ * before fingerprinting it or capturing its trace. */
+int profiler_log_wanted(const profiler_record *rec)
 {
-    struct timeval tv;
-    struct tm tm_buf;
-    char *buf;
+    profiler_filter **filters = profiler_job_get_filters();
+    int job_count;
+    int i;
 
-    buf = (char *)emalloc(64);
-    gettimeofday(&tv, NULL);
-    localtime_r(&tv.tv_sec, &tm_buf);
+    if (!profiler_job_get_active_list(&job_count) || job_count == 0) {
+        return 0;
+    }
+    if (!filters) {
+        return 1;
+    }
+    for (i = 0; i < job_count; i++) {
+        if (profiler_filter_match(filters[i], rec)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+/* }}} */
 
-    snprintf(buf, 64, "%04d-%02d-%02d %02d:%02d:%02d.%03d",
-        tm_buf.tm_year + 1900, tm_buf.tm_mon + 1, tm_buf.tm_mday,
-        tm_buf.tm_hour, tm_buf.tm_min, tm_buf.tm_sec,
-        (int)(tv.tv_usec / 1000));
+/* {{{ profiler_log_encoders
+ * Encoders for the files this request writes: JSONL or binary, plus
+ * raw text when raw_log is on. Returns how many were stored. */
+static int profiler_log_encoders(const profiler_encoder **encoders)
+{
+    int n = 0;
+    TSRMLS_FETCH();
 
-    return buf;
+    encoders[n++] = profiler_log_is_binary()
+        ? &profiler_encoder_binary : &profiler_encoder_jsonl;
+    if (PROFILER_G(raw_log)) {
+        encoders[n++] = &profiler_encoder_raw;
+    }
+    return n;
 }
 /* }}} */
 
-/* {{{ profiler_log_get_microtime
- * Returns current time as float string for JSON */
-static double profiler_log_get_microtime(void)
+/* {{{ profiler_log_fanout
+ * Append one encoded record to the encoder's file of every job. */
+static void profiler_log_fanout(const profiler_encoder *enc, int kind,
+                                const profiler_buf *body,
+                                char **jobs, int job_count)
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+    int i;
+
+    for (i = 0; i < job_count; i++) {
+        profiler_sink *sink = profiler_writer_get_sink(jobs[i], enc->ext);
+
+        if (enc->job_head) {
+            enc->job_head(&sink->buf, jobs[i], kind);
+        }
+        profiler_buf_append(&sink->buf, body->data, body->len);
+        profiler_writer_commit(sink);
+    }
 }
 /* }}} */
 
-/* {{{ profiler_log_raw
- * Write raw query to job's raw log file.
- * tag, trace_json, params_json, and status may be NULL. */
-void profiler_log_raw(const char *job_key, const char *query, size_t query_len,
-                      const char *tag, const char *trace_json,
-                      const char *params_json, const char *status)
+/* {{{ profiler_log_define
+ * Write the definition of rec's stack or statement template (kind) to
+ * the jobs whose log does not have it yet. Encoded at most once, into
+ * body. */
+static void profiler_log_define(const profiler_encoder *enc, int kind,
+                                const profiler_record *rec, profiler_buf *body,
+                                char **jobs, int job_count)
 {
-    char *filepath;
-    FILE *fp;
-    char *timestamp;
-    TSRMLS_FETCH();
+    uint64_t id = kind == PROFILER_ENCODE_STACK ? rec->stack_id : rec->tmpl_id;
+    int encoded = 0;
+    int i;
 
-    spprintf(&filepath, 0, "%s/%s%s", PROFILER_G(log_dir), job_key, PROFILER_RAW_LOG_EXT);
+    for (i = 0; i < job_count; i++) {
+        if (!profiler_stack_first_use(jobs[i], enc->ext, kind, id)) {
+            continue;
+        }
+        if (!encoded) {
+            profiler_buf_reset(body);
+            if (kind == PROFILER_ENCODE_STACK) {
+                enc->stack(body, rec->stack_id, rec->trace);
+            } else {
+                enc->tmpl(body, rec);
+            }
+            encoded = 1;
+        }
+        profiler_log_fanout(enc, kind, body, &jobs[i], 1);
+    }
+}
+/* }}} */
 
-    fp = fopen(filepath, "a");
-    efree(filepath);
+/* {{{ profiler_log_record_jobs
+ * Encode rec once per log format and append it to jobs. With
+ * intern_stacks the trace is replaced by a stack id, and with
+ * intern_statements a prepared statement's text by its template id,
+ * each defined in a job's log before its first use. */
+static void profiler_log_record_jobs(const profiler_record *rec, char **jobs, int job_count)
+{
+    const profiler_encoder *encoders[2];
+    profiler_record interned;
+    profiler_buf body;
+    int n;
+    int i;
+    TSRMLS_FETCH();
 
-    if (!fp) {
-        return;
+    if ((rec->trace && rec->trace->count > 0 && PROFILER_G(intern_stacks))
+        || (rec->tmpl_id && PROFILER_G(intern_statements))) {
+        interned = *rec;
+        if (rec->trace && rec->trace->count > 0 && PROFILER_G(intern_stacks)) {
+            interned.flags |= PROFILER_RECORD_STACK;
+            interned.stack_id = profiler_trace_id(rec->trace);
+        }
+        if (rec->tmpl_id && PROFILER_G(intern_statements)) {
+            interned.flags |= PROFILER_RECORD_TMPL;
+        }
+        rec = &interned;
     }
 
-    /* Lock for writing */
-    flock(fileno(fp), LOCK_EX);
+    profiler_buf_init(&body);
+    n = profiler_log_encoders(encoders);
+    for (i = 0; i < n; i++) {
+        if ((rec->flags & PROFILER_RECORD_STACK) && encoders[i]->stack) {
+            profiler_log_define(encoders[i], PROFILER_ENCODE_STACK, rec, &body, jobs, job_count);
+        }
+        if ((rec->flags & PROFILER_RECORD_TMPL) && encoders[i]->tmpl) {
+            profiler_log_define(encoders[i], PROFILER_ENCODE_TMPL, rec, &body, jobs, job_count);
+        }
+        profiler_buf_reset(&body);
+        encoders[i]->query(&body, rec);
+        profiler_log_fanout(encoders[i], PROFILER_ENCODE_QUERY, &body, jobs, job_count);
+    }
+    profiler_buf_free(&body);
+}
+/* }}} */
 
-    timestamp = profiler_log_get_timestamp();
+/* {{{ profiler_log_aggregate
+ * Fold rec into the shared shape table if some job takes every query,
+ * and into the own table of each job whose per-query filter accepts it. */
+static void profiler_log_aggregate(const profiler_record *rec)
+{
+    profiler_filter **filters = profiler_job_get_filters();
+    char **jobs;
+    int job_count;
+    int shared;
+    int i;
 
-    if (tag) {
-        fprintf(fp, "[%s] [%s] [%s] %.*s\n", timestamp,
-                status ? status : "ok", tag, (int)query_len, query);
-    } else {
-        fprintf(fp, "[%s] [%s] %.*s\n", timestamp,
-                status ? status : "ok", (int)query_len, query);
+    jobs = profiler_job_get_active_list(&job_count);
+    if (!jobs || job_count == 0) {
+        return;
     }
 
-    /* Append bound parameter values if present */
-    if (params_json && params_json[0] == '[' && params_json[1] != ']') {
-        fprintf(fp, "  params: %s\n", params_json);
+    shared = !filters;
+    for (i = 0; filters && i < job_count; i++) {
+        if (!filters[i] || !filters[i]->per_query) {
+            shared = 1;
+        } else if (profiler_filter_match(filters[i], rec)) {
+            profiler_agg_add(rec, jobs[i]);
+        }
     }
+    if (shared) {
+        profiler_agg_add(rec, NULL);
+    }
+}
+/* }}} */
 
-    /* Append trace lines (indented with arrow prefix) */
-    if (trace_json && trace_json[0] == '[' && trace_json[1] != ']') {
-        /*
-         * trace_json is a JSON array like:
-         *   [{"call":"Foo->bar","file":"/app/Foo.php","line":42}, ...]
-         * We do a lightweight parse to extract call/file/line for raw log.
-         */
-        const char *p = trace_json;
-        while ((p = strstr(p, "\"call\":\"")) != NULL) {
-            const char *call_start, *call_end;
-            const char *file_start, *file_end;
-            const char *line_start;
-            long line_val = 0;
-
-            /* Extract call */
-            p += 8; /* skip "call":" */
-            call_start = p;
-            call_end = strchr(p, '"');
-            if (!call_end) break;
-            p = call_end + 1;
-
-            /* Extract file */
-            file_start = file_end = "";
-            {
-                const char *fp2 = strstr(p, "\"file\":\"");
-                if (fp2 && fp2 < p + 200) {
-                    fp2 += 8;
-                    file_start = fp2;
-                    file_end = strchr(fp2, '"');
-                    if (!file_end) break;
-                    p = file_end + 1;
-                }
-            }
+/* {{{ profiler_log_targets_select
+ * Active jobs a record goes to: job alone if set, otherwise every job
+ * whose filter accepts scope. With scope NULL only the jobs without a
+ * per-query filter take it. */
+static void profiler_log_targets_select(profiler_log_targets *t,
+                                        const profiler_record *scope,
+                                        const char *job)
+{
+    profiler_filter **filters = profiler_job_get_filters();
+    char **jobs;
+    int job_count;
+    int i;
 
-            /* Extract line */
-            {
-                const char *lp = strstr(p, "\"line\":");
-                if (lp && lp < p + 100) {
-                    lp += 7;
-                    line_val = strtol(lp, NULL, 10);
-                }
-            }
+    t->count = 0;
+    t->owned = 0;
+    jobs = profiler_job_get_active_list(&job_count);
+    if (!jobs || job_count == 0) {
+        t->jobs = NULL;
+        return;
+    }
 
-            fprintf(fp, "  <- %.*s() %.*s:%ld\n",
-                (int)(call_end - call_start), call_start,
-                (int)(file_end - file_start), file_start,
-                line_val);
-        }
+    if (!filters && !job) {
+        t->jobs = jobs;
+        t->count = job_count;
+        return;
     }
 
-    efree(timestamp);
+    t->jobs = t->buf;
+    if (job_count > (int)(sizeof(t->buf) / sizeof(t->buf[0]))) {
+        t->jobs = (char **)emalloc(job_count * sizeof(char *));
+        t->owned = 1;
+    }
+    for (i = 0; i < job_count; i++) {
+        if (job ? strcmp(jobs[i], job) == 0
+                : !filters || !filters[i] || !filters[i]->per_query
+                  || (scope && profiler_filter_match(filters[i], scope))) {
+            t->jobs[t->count++] = jobs[i];
+        }
+    }
+}
+/* }}} */
 
-    flock(fileno(fp), LOCK_UN);
-    fclose(fp);
+/* {{{ profiler_log_targets_free */
+static void profiler_log_targets_free(profiler_log_targets *t)
+{
+    if (t->owned) {
+        efree(t->jobs);
+    }
 }
 /* }}} */
 
-/* {{{ profiler_log_jsonl
- * Write JSON line to job's parsed log file.
- * tag, trace_json, params_json, and status may be NULL.
- * SQL parsing (table/column extraction) is done by the CLI tool. */
-static void profiler_log_jsonl(const char *job_key, const char *query, size_t query_len,
-                               const char *tag, const char *trace_json,
-                               const char *params_json, const char *status)
+/* {{{ profiler_log_record
+ * Write a fully populated record (tag and trace already captured)
+ * to the active jobs whose filter accepts it. In aggregation mode the
+ * record is only folded into its query shape's summaries. */
+void profiler_log_record(const profiler_record *rec)
 {
-    char *filepath;
-    FILE *fp;
-    char *escaped_query;
-    char *escaped_key;
-    char *escaped_tag = NULL;
-    double ts;
+    profiler_log_targets targets;
     TSRMLS_FETCH();
 
-    spprintf(&filepath, 0, "%s/%s%s", PROFILER_G(log_dir), job_key, PROFILER_PARSED_LOG_EXT);
-
-    fp = fopen(filepath, "a");
-    efree(filepath);
-
-    if (!fp) {
+    if (PROFILER_G(aggregate) && (rec->flags & PROFILER_RECORD_FP)) {
+        profiler_log_aggregate(rec);
         return;
     }
 
-    flock(fileno(fp), LOCK_EX);
-
-    escaped_query = profiler_log_escape_json_string(query, query_len);
-    escaped_key = profiler_log_escape_json_string(job_key, strlen(job_key));
-    if (tag) {
-        escaped_tag = profiler_log_escape_json_string(tag, strlen(tag));
+    profiler_log_targets_select(&targets, rec, NULL);
+    if (targets.count > 0) {
+        profiler_log_record_jobs(rec, targets.jobs, targets.count);
     }
-    ts = profiler_log_get_microtime();
+    profiler_log_targets_free(&targets);
+}
+/* }}} */
+
+/* {{{ profiler_log_endpoint
+ * "METHOD /path" of the current request (query string dropped), or the
+ * script path for CLI requests. */
+static void profiler_log_endpoint(profiler_buf *out)
+{
+    const char *method = SG(request_info).request_method;
+    const char *uri = SG(request_info).request_uri;
 
-    /* Build JSON line with optional tag, params, and trace fields */
-    fprintf(fp, "{\"k\":\"%s\",\"q\":\"%s\"", escaped_key, escaped_query);
+    if (uri) {
+        const char *qs = strchr(uri, '?');
 
-    if (escaped_tag) {
-        fprintf(fp, ",\"tag\":\"%s\"", escaped_tag);
+        if (method) {
+            profiler_buf_appends(out, method);
+            profiler_buf_appendc(out, ' ');
+        }
+        profiler_buf_append(out, uri, qs ? (size_t)(qs - uri) : strlen(uri));
+    } else if (SG(request_info).path_translated) {
+        profiler_buf_appends(out, SG(request_info).path_translated);
+    } else {
+        profiler_buf_appends(out, sapi_module.name);
     }
+}
+/* }}} */
 
-    /* params_json is already a valid JSON array string e.g. ["123","active",null] */
-    if (params_json) {
-        fprintf(fp, ",\"params\":%s", params_json);
+/* {{{ profiler_log_encode_event
+ * Serialize one typed record (kind) with enc; arg points to the
+ * struct of that kind. */
+static void profiler_log_encode_event(const profiler_encoder *enc, int kind,
+                                      const void *arg, profiler_buf *body,
+                                      const profiler_buf *ep)
+{
+    switch (kind) {
+    case PROFILER_ENCODE_SUMMARY:
+        enc->summary(body, (const profiler_agg_entry *)arg, ep->data, ep->len);
+        break;
+    case PROFILER_ENCODE_TX:
+        enc->tx(body, (const profiler_tx *)arg, ep->data, ep->len);
+        break;
+    case PROFILER_ENCODE_CONN:
+        enc->conn(body, (const profiler_conn_event *)arg, ep->data, ep->len);
+        break;
+    case PROFILER_ENCODE_BUDGET:
+        enc->budget(body, (const profiler_budget_event *)arg, ep->data, ep->len);
+        break;
+    case PROFILER_ENCODE_REQUEST:
+        enc->request(body, (const profiler_request *)arg, ep->data, ep->len);
+        break;
     }
+}
+/* }}} */
 
-    if (trace_json) {
-        /* trace_json is already a valid JSON array string */
-        fprintf(fp, ",\"trace\":%s", trace_json);
-    }
+/* {{{ profiler_log_event
+ * Write one typed record (summary, transaction, ...) tagged with the
+ * request's endpoint, encoded once per log format. It goes to job
+ * alone if set, otherwise to the active jobs whose filter accepts
+ * scope (see profiler_log_targets_select). */
+static void profiler_log_event(int kind, const void *arg,
+                               const profiler_record *scope, const char *job)
+{
+    const profiler_encoder *encoders[2];
+    profiler_log_targets targets;
+    profiler_buf body;
+    profiler_buf ep;
+    int n;
+    int i;
 
-    if (status) {
-        fprintf(fp, ",\"s\":\"%s\"", status);
+    profiler_log_targets_select(&targets, scope, job);
+    if (targets.count == 0) {
+        profiler_log_targets_free(&targets);
+        return;
     }
 
-    fprintf(fp, ",\"ts\":%.6f}\n", ts);
+    profiler_buf_init(&ep);
+    profiler_log_endpoint(&ep);
+    if (!ep.data) {
+        profiler_buf_append(&ep, "", 0);
+    }
 
-    efree(escaped_query);
-    efree(escaped_key);
-    if (escaped_tag) {
-        efree(escaped_tag);
+    profiler_buf_init(&body);
+    n = profiler_log_encoders(encoders);
+    for (i = 0; i < n; i++) {
+        profiler_buf_reset(&body);
+        profiler_log_encode_event(encoders[i], kind, arg, &body, &ep);
+        profiler_log_fanout(encoders[i], kind, &body, targets.jobs, targets.count);
     }
+    profiler_buf_free(&body);
+    profiler_buf_free(&ep);
+    profiler_log_targets_free(&targets);
+}
+/* }}} */
+
+/* {{{ profiler_log_scope
+ * What a per-query filter is checked against for a record that is not
+ * a statement: its status, duration and the current context tag. The
+ * statement text is empty, so a filter on verb or table rejects it. */
+static void profiler_log_scope(profiler_record *scope, const char *status,
+                               const profiler_timer *timer)
+{
+    memset(scope, 0, sizeof(*scope));
+    scope->query = "";
+    scope->status = status;
+    scope->timer = timer;
+    scope->tag = profiler_tag_current();
+}
+/* }}} */
+
+/* {{{ profiler_log_summary
+ * Write one query-shape summary of this request to job, or with job
+ * NULL to the active jobs without a per-query filter (see
+ * profiler_encode.c for the record layouts). */
+void profiler_log_summary(const profiler_agg_entry *e, const char *job)
+{
+    profiler_log_event(PROFILER_ENCODE_SUMMARY, e, NULL, job);
+}
+/* }}} */
+
+/* {{{ profiler_log_tx
+ * Write the summary of an ended transaction span to the active jobs
+ * whose filter accepts the span's status and duration. */
+void profiler_log_tx(const profiler_tx *tx)
+{
+    profiler_record scope;
+    profiler_timer timer;
+
+    timer.start_ts = tx->start_ts;
+    timer.start_ns = tx->start_ns;
+    timer.dur_us = tx->dur_us;
+    profiler_log_scope(&scope, tx->errors ? "err" : "ok", &timer);
+    profiler_log_event(PROFILER_ENCODE_TX, tx, &scope, NULL);
+}
+/* }}} */
+
+/* {{{ profiler_log_conn
+ * Write a connection lifecycle event to the active jobs whose filter
+ * accepts its status and duration. */
+void profiler_log_conn(const profiler_conn_event *ev)
+{
+    profiler_record scope;
+
+    profiler_log_scope(&scope, ev->status, ev->timer);
+    profiler_log_event(PROFILER_ENCODE_CONN, ev, &scope, NULL);
+}
+/* }}} */
+
+/* {{{ profiler_log_budget
+ * Write a query budget violation to the active jobs whose filter
+ * accepts the statement that went over. */
+void profiler_log_budget(const profiler_budget_event *ev)
+{
+    profiler_record scope;
+
+    memset(&scope, 0, sizeof(scope));
+    scope.query = ev->query;
+    scope.query_len = ev->query_len;
+    scope.timer = ev->timer;
+    scope.tag = ev->tag;
+    profiler_log_event(PROFILER_ENCODE_BUDGET, ev, &scope, NULL);
+}
+/* }}} */
 
-    flock(fileno(fp), LOCK_UN);
-    fclose(fp);
+/* {{{ profiler_log_request
+ * Write the summary of the ending request to the active jobs whose
+ * filter accepts the request's status and duration. */
+void profiler_log_request(const profiler_request *req)
+{
+    profiler_record scope;
+    profiler_timer timer;
+
+    timer.start_ts = req->start_ts;
+    timer.start_ns = req->start_ns;
+    timer.dur_us = req->dur_us;
+    profiler_log_scope(&scope, req->errors ? "err" : "ok", &timer);
+    profiler_log_event(PROFILER_ENCODE_REQUEST, req, &scope, NULL);
 }
 /* }}} */
 
 /* {{{ profiler_log_query_internal
  * Internal: log a query to all active jobs with optional params and status.
- * Captures the current context tag and PHP trace once, shared across all jobs. */
+ * Captures the current context tag and PHP trace once, shared across all jobs;
+ * the trace is skipped for queries under the slow threshold. Queries no
+ * job's filter accepts are dropped before anything else is computed. */
 static void profiler_log_query_internal(const char *query, size_t query_len,
                                         const char *params_json,
-                                        const char *status)
+                                        const char *status,
+                                        const profiler_timer *timer)
 {
-    char **jobs;
+    profiler_record rec;
     int job_count;
-    int i;
-    const char *tag;
-    char *trace_json;
-    TSRMLS_FETCH();
-
-    jobs = profiler_job_get_active_list(&job_count);
+    int verdict;
+    const profiler_trace *trace;
 
-    if (!jobs || job_count == 0) {
+    if (!profiler_job_get_active_list(&job_count) || job_count == 0) {
         return;
     }
 
-    /* Capture tag and trace once (shared across all active jobs) */
-    tag = profiler_tag_current();
-    trace_json = profiler_trace_capture_json(); /* NULL if disabled */
+    verdict = profiler_log_slow_verdict(timer);
+    if (verdict == PROFILER_LOG_DROP) {
+        return;
+    }
 
-    for (i = 0; i < job_count; i++) {
-        /* Write JSONL entry */
-        profiler_log_jsonl(jobs[i], query, query_len, tag, trace_json, params_json, status);
+    memset(&rec, 0, sizeof(rec));
+    rec.query = query;
+    rec.query_len = query_len;
+    rec.params_json = params_json;
+    rec.status = status;
+    rec.timer = timer;
+    rec.tag = profiler_tag_current();
 
-        /* Write raw log if enabled */
-        if (PROFILER_G(raw_log)) {
-            profiler_log_raw(jobs[i], query, query_len, tag, trace_json, params_json, status);
-        }
+    if (!profiler_log_wanted(&rec)) {
+        return;
     }
+    rec.req_id = profiler_request_id();
 
-    if (trace_json) {
-        efree(trace_json);
-    }
+    rec.fp = profiler_fingerprint(query, query_len, NULL);
+    rec.flags = PROFILER_RECORD_FP;
+
+    /* Capture the trace once (shared across all active jobs) */
+    trace = verdict == PROFILER_LOG_FULL
+        ? profiler_trace_capture() /* NULL if disabled */
+        : NULL;
+    rec.trace = trace;
+
+    profiler_log_record(&rec);
 }
 /* }}} */
 
 /* {{{ profiler_log_query
  * Main entry point: log a query (without params) to all active jobs.
  * status is "ok" or "err" (NULL treated as "ok"). */
-void profiler_log_query(const char *query, size_t query_len, const char *status)
+void profiler_log_query(const char *query, size_t query_len, const char *status,
+                        const profiler_timer *timer)
 {
-    profiler_log_query_internal(query, query_len, NULL, status);
+    profiler_log_query_internal(query, query_len, NULL, status, timer);
 }
 /* }}} */
 
@@ -325,16 +547,17 @@ void profiler_log_query(const char *query, size_t query_len, const char *status)
  * Log a prepared statement query with bound parameter values to all active jobs.
  * status is "ok" or "err" (NULL treated as "ok"). */
 void profiler_log_query_with_params(const char *query, size_t query_len,
-                                    const char *params_json, const char *status)
+                                    const char *params_json, const char *status,
+                                    const profiler_timer *timer)
 {
-    profiler_log_query_internal(query, query_len, params_json, status);
+    profiler_log_query_internal(query, query_len, params_json, status, timer);
 }
 /* }}} */
 
 /* {{{ profiler_log_init */
 void profiler_log_init(void)
 {
-    /* Nothing to initialize for now - file handles opened per-write */
+    /* Nothing to initialize - sinks are created per request (profiler_writer.c) */
 }
 /* }}} */
 
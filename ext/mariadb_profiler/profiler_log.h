@@ -9,8 +9,6 @@
 
 #define PROFILER_RAW_LOG_EXT    ".raw.log"
 #define PROFILER_PARSED_LOG_EXT ".jsonl"
-
-/* Shared JSON escape utility (defined in profiler_log.c) */
-char *profiler_log_escape_json_string(const char *str, size_t len);
+#define PROFILER_BINARY_LOG_EXT ".bin"
 
 #endif /* PROFILER_LOG_H */
@@ -14,6 +14,11 @@
 #include "php.h"
 #include "php_mariadb_profiler.h"
 #include "profiler_log.h"
+#include "profiler_json.h"
+#include "profiler_result.h"
+#include "profiler_tmpl.h"
+#include "profiler_tx.h"
+#include "profiler_budget.h"
 
 /*
  * mysqlnd internal API changed across PHP versions:
@@ -51,6 +56,199 @@ static unsigned int profiler_plugin_id;
 /* Original method pointers we save for chaining */
 static PROFILER_CONN_METHODS_T *orig_conn_data_methods = NULL;
 static struct st_mysqlnd_stmt_methods *orig_stmt_methods = NULL;
+#if PHP_VERSION_ID >= 70000
+static struct st_mysqlnd_res_methods *orig_res_methods = NULL;
+#endif
+
+#if PHP_VERSION_ID >= 70000
+
+/*
+ * MYSQLND_VERSION_ID equals PHP_VERSION_ID.  The internal layout of
+ * st_mysqlnd_stmt_data (fields param_bind, param_count) has been stable
+ * from PHP 7.0 through 8.4.  Guard direct access so that an unknown
+ * future mysqlnd silently degrades to "no params" instead of crashing.
+ *
+ * NOTE: The upper bound (80500) is a defensive estimate – it should be
+ * updated once PHP 8.5 is released and its mysqlnd ABI has been verified.
+ * If the ABI remains unchanged, simply bump the upper bound.
+ */
+#define PROFILER_MYSQLND_PARAM_ACCESS_SAFE \
+    (MYSQLND_VERSION_ID >= 70000 && MYSQLND_VERSION_ID < 80500)
+
+/*
+ * The result metrics read a few more fields directly (conn->stats,
+ * res->conn, stmt->data->conn); same layout guarantee, same bound.
+ */
+#define PROFILER_MYSQLND_RESULT_ACCESS_SAFE PROFILER_MYSQLND_PARAM_ACCESS_SAFE
+
+/*
+ * Connection lifecycle hooks need the PHP 7.1+ connect() signature
+ * (MYSQLND_CSTRING arguments) and read conn->scheme, ->thread_id and
+ * ->persistent directly; same upper bound as above.
+ */
+#define PROFILER_MYSQLND_CONN_ACCESS_SAFE \
+    (PROFILER_MYSQLND_RESULT_ACCESS_SAFE && MYSQLND_VERSION_ID >= 70100)
+
+/* {{{ profiler_conn_id
+ * Id of conn for its records: pid in the high half, a per-process
+ * connection number below. The number is kept in the connection's
+ * plugin data, so a persistent connection keeps its id across requests
+ * while every (re)connect gets a new one. 0 if conn is unknown. */
+static uint64_t profiler_conn_id(const MYSQLND_CONN_DATA *conn)
+{
+    void **slot;
+
+    if (!conn) {
+        return 0;
+    }
+    slot = mysqlnd_plugin_get_plugin_connection_data_data(conn, profiler_plugin_id);
+    if (!slot) {
+        return 0;
+    }
+    if (!*slot) {
+        if (++PROFILER_G(conn_seq) == 0) {
+            PROFILER_G(conn_seq) = 1;
+        }
+        *slot = (void *)(uintptr_t)PROFILER_G(conn_seq);
+    }
+    return ((uint64_t)profiler_getpid() << 32) | (uint64_t)(uintptr_t)*slot;
+}
+/* }}} */
+
+/* {{{ profiler_conn_bytes_received
+ * Per-connection STAT_BYTES_RECEIVED counter (0 if statistics are off). */
+static uint64_t profiler_conn_bytes_received(const MYSQLND_CONN_DATA *conn)
+{
+#if PROFILER_MYSQLND_RESULT_ACCESS_SAFE
+    if (conn && conn->stats && conn->stats->values) {
+        return conn->stats->values[STAT_BYTES_RECEIVED];
+    }
+#else
+    (void)conn;
+#endif
+    return 0;
+}
+/* }}} */
+
+/* {{{ profiler_stmt_conn */
+static MYSQLND_CONN_DATA *profiler_stmt_conn(const MYSQLND_STMT *stmt)
+{
+#if PROFILER_MYSQLND_RESULT_ACCESS_SAFE
+    return (stmt && stmt->data) ? stmt->data->conn : NULL;
+#else
+    (void)stmt;
+    return NULL;
+#endif
+}
+/* }}} */
+
+/* {{{ profiler_res_conn */
+static MYSQLND_CONN_DATA *profiler_res_conn(const MYSQLND_RES *res)
+{
+#if PROFILER_MYSQLND_RESULT_ACCESS_SAFE
+    return res ? res->conn : NULL;
+#else
+    (void)res;
+    return NULL;
+#endif
+}
+/* }}} */
+
+/* {{{ profiler_pending_set_rows
+ * Attach row count and fetch time to a pending record, plus the bytes
+ * received on conn since the query was sent. */
+static void profiler_pending_set_rows(profiler_pending *p, uint64_t rows,
+                                      uint64_t fetch_us, MYSQLND_CONN_DATA *conn)
+{
+    uint64_t rx = profiler_conn_bytes_received(conn);
+
+    p->rec.flags |= PROFILER_RECORD_ROWS;
+    p->rec.rows = rows;
+    p->rec.fetch_us = fetch_us;
+
+    if (rx > p->rx_start) {
+        p->rec.flags |= PROFILER_RECORD_BYTES;
+        p->rec.bytes = rx - p->rx_start;
+    }
+}
+/* }}} */
+
+/* {{{ profiler_pending_fetch_us
+ * Time since an unbuffered result was handed out. */
+static uint64_t profiler_pending_fetch_us(const profiler_pending *p)
+{
+    return (profiler_clock_mono_ns() - p->fetch_start_ns) / 1000;
+}
+/* }}} */
+
+/* {{{ profiler_conn_log_statement
+ * Log a statement executed via conn::query() or send_query().
+ * A result set stays pending on the connection until store_result or
+ * use_result picks it up. Anything else is written right away, with the
+ * affected-row count when the outcome is already known (reaped != 0).
+ * tx_event is what the statement does to the transaction span. */
+static void profiler_conn_log_statement(MYSQLND_CONN_DATA *conn,
+                                        const char *query, size_t query_len,
+                                        enum_func_status result,
+                                        const profiler_timer *timer,
+                                        uint64_t rx_start, int reaped, int tx_event)
+{
+    profiler_pending *p;
+    uint64_t tx_id = profiler_tx_statement(conn, tx_event, result == PASS, timer);
+
+    p = profiler_result_begin(conn, PROFILER_OWNER_CONN, query, query_len, NULL, NULL,
+        result == PASS ? "ok" : "err", timer);
+    if (!p) {
+        return;
+    }
+    p->rx_start = rx_start;
+    p->rec.tx_id = tx_id;
+    p->rec.conn_id = profiler_conn_id(conn);
+
+    if (result != PASS) {
+        profiler_result_finish(conn);
+        return;
+    }
+
+    /* Async send: the result is reaped (and fetched) later */
+    if (!reaped) {
+        return;
+    }
+
+    if (orig_conn_data_methods->get_field_count(conn) > 0) {
+        return;
+    }
+
+    p->rec.flags |= PROFILER_RECORD_AFFECTED;
+    p->rec.affected = orig_conn_data_methods->get_affected_rows(conn);
+    p->rec.insert_id = orig_conn_data_methods->get_last_insert_id(conn);
+    profiler_result_finish(conn);
+}
+/* }}} */
+
+#endif /* PHP_VERSION_ID >= 70000 */
+
+/* {{{ profiler_statement_done
+ * Per-request accounting of a statement that has run, logged or not:
+ * the in-request stats, the request summary while a job captures the
+ * request, and the query budget. query is NULL if unknown. */
+static void profiler_statement_done(const char *query, size_t query_len,
+                                    enum_func_status result, const profiler_timer *timer)
+{
+    TSRMLS_FETCH();
+
+    if (!PROFILER_G(enabled)) {
+        return;
+    }
+    profiler_stats_statement(result == PASS, timer);
+    if (profiler_job_is_any_active()) {
+        profiler_request_statement(result == PASS, timer);
+    }
+    if (PROFILER_G(budget_on) && query) {
+        profiler_budget_statement(query, query_len, timer);
+    }
+}
+/* }}} */
 
 /* {{{ profiler_query_hook
  * Called for every mysqlnd_conn_data::query() call.
@@ -62,14 +260,49 @@ MYSQLND_METHOD(profiler_conn, query)(
     PROFILER_QUERY_LEN_T query_len TSRMLS_DC)
 {
     enum_func_status result;
+    profiler_timer timer;
+#if PHP_VERSION_ID >= 70000
+    uint64_t rx_start = profiler_conn_bytes_received(conn);
+    int tx_event = PROFILER_TX_NONE;
+    int tx_own = 0;
 
-    /* Call the original method first */
+    /* Inside a tx_* hook the statement is that hook's; otherwise look
+     * for BEGIN/COMMIT/ROLLBACK/SET autocommit sent as SQL text */
+    if (PROFILER_G(enabled) && profiler_job_is_any_active()) {
+        tx_event = PROFILER_G(tx_hook_event);
+        if (tx_event == PROFILER_TX_NONE) {
+            tx_event = profiler_tx_classify(query, query_len);
+            tx_own = tx_event != PROFILER_TX_NONE;
+            profiler_tx_before(conn, tx_event);
+        }
+    }
+#endif
+
+    /* Call the original method, timing it on the monotonic clock.
+     * mysqlnd implements query() as send_query() + reap_query() through the
+     * method table, so mark the nesting to keep send_query from logging the
+     * same statement again with only the send time. */
+    PROFILER_G(query_depth)++;
+    profiler_timer_start(&timer);
     result = orig_conn_data_methods->query(conn, query, query_len TSRMLS_CC);
+    profiler_timer_stop(&timer);
+    PROFILER_G(query_depth)--;
 
     /* Log the query with execution status */
     if (PROFILER_G(enabled) && profiler_job_is_any_active()) {
-        profiler_log_query(query, query_len, result == PASS ? "ok" : "err");
+#if PHP_VERSION_ID >= 70000
+        profiler_conn_log_statement(conn, query, query_len, result, &timer, rx_start, 1,
+            tx_event);
+#else
+        profiler_log_query(query, query_len, result == PASS ? "ok" : "err", &timer);
+#endif
+    }
+#if PHP_VERSION_ID >= 70000
+    if (tx_own) {
+        profiler_tx_after(conn, tx_event, result == PASS);
     }
+#endif
+    profiler_statement_done(query, query_len, result, &timer);
 
     return result;
 }
@@ -80,6 +313,9 @@ MYSQLND_METHOD(profiler_conn, query)(
  *   PHP 5.3-5.6: (conn, query, query_len TSRMLS_DC)
  *   PHP 7.0-8.0: (conn, query, query_len, type, read_cb, err_cb)
  *   PHP 8.1+:    (conn, query, query_len, read_cb, err_cb)
+ * Only logs direct callers (async mysqli_query); calls made from inside
+ * query() are logged by the query hook with the full round-trip time.
+ * On PHP 7.0+ the record then waits for the result to be fetched.
  */
 #if PHP_VERSION_ID >= 80100
 /* PHP 8.1+: enum_mysqlnd_send_query_type removed */
@@ -92,9 +328,19 @@ MYSQLND_METHOD(profiler_conn, send_query)(
     zval *err_cb)
 {
     enum_func_status result;
+    profiler_timer timer;
+    uint64_t rx_start = profiler_conn_bytes_received(conn);
+
+    profiler_timer_start(&timer);
     result = orig_conn_data_methods->send_query(conn, query, query_len, read_cb, err_cb);
-    if (PROFILER_G(enabled) && profiler_job_is_any_active()) {
-        profiler_log_query(query, query_len, result == PASS ? "ok" : "err");
+    profiler_timer_stop(&timer);
+    if (PROFILER_G(enabled) && PROFILER_G(query_depth) == 0
+        && profiler_job_is_any_active()) {
+        profiler_conn_log_statement(conn, query, query_len, result, &timer, rx_start, 0,
+            PROFILER_TX_NONE);
+    }
+    if (PROFILER_G(query_depth) == 0) {
+        profiler_statement_done(query, query_len, result, &timer);
     }
     return result;
 }
@@ -110,9 +356,19 @@ MYSQLND_METHOD(profiler_conn, send_query)(
     zval *err_cb)
 {
     enum_func_status result;
+    profiler_timer timer;
+    uint64_t rx_start = profiler_conn_bytes_received(conn);
+
+    profiler_timer_start(&timer);
     result = orig_conn_data_methods->send_query(conn, query, query_len, type, read_cb, err_cb);
-    if (PROFILER_G(enabled) && profiler_job_is_any_active()) {
-        profiler_log_query(query, query_len, result == PASS ? "ok" : "err");
+    profiler_timer_stop(&timer);
+    if (PROFILER_G(enabled) && PROFILER_G(query_depth) == 0
+        && profiler_job_is_any_active()) {
+        profiler_conn_log_statement(conn, query, query_len, result, &timer, rx_start, 0,
+            PROFILER_TX_NONE);
+    }
+    if (PROFILER_G(query_depth) == 0) {
+        profiler_statement_done(query, query_len, result, &timer);
     }
     return result;
 }
@@ -125,9 +381,17 @@ MYSQLND_METHOD(profiler_conn, send_query)(
     unsigned int query_len TSRMLS_DC)
 {
     enum_func_status result;
+    profiler_timer timer;
+
+    profiler_timer_start(&timer);
     result = orig_conn_data_methods->send_query(conn, query, query_len TSRMLS_CC);
-    if (PROFILER_G(enabled) && profiler_job_is_any_active()) {
-        profiler_log_query(query, query_len, result == PASS ? "ok" : "err");
+    profiler_timer_stop(&timer);
+    if (PROFILER_G(enabled) && PROFILER_G(query_depth) == 0
+        && profiler_job_is_any_active()) {
+        profiler_log_query(query, query_len, result == PASS ? "ok" : "err", &timer);
+    }
+    if (PROFILER_G(query_depth) == 0) {
+        profiler_statement_done(query, query_len, result, &timer);
     }
     return result;
 }
@@ -136,7 +400,8 @@ MYSQLND_METHOD(profiler_conn, send_query)(
 
 /* {{{ profiler_stmt_prepare_hook
  * Intercepts prepared statements at prepare time.
- * PHP 7.0+: stores query template for later use at execute() time.
+ * PHP 7.0+: stores query template for later use at execute() time,
+ *           interned in the per-process dictionary (profiler_tmpl.c).
  * PHP 5.x:  logs template immediately (no param capture support). */
 static enum_func_status
 MYSQLND_METHOD(profiler_stmt, prepare)(
@@ -145,15 +410,29 @@ MYSQLND_METHOD(profiler_stmt, prepare)(
     PROFILER_QUERY_LEN_T query_len TSRMLS_DC)
 {
     enum_func_status result;
+    profiler_timer timer;
 
+    profiler_timer_start(&timer);
     result = orig_stmt_methods->prepare(stmt, query, query_len TSRMLS_CC);
+    profiler_timer_stop(&timer);
 
 #if PHP_VERSION_ID >= 70000
+    if (PROFILER_G(stmt_long_data)) {
+        /* Long data counters are sized for the previous parameter count */
+        zend_hash_index_del(PROFILER_G(stmt_long_data), (zend_ulong)(uintptr_t)stmt);
+    }
     if (PROFILER_G(enabled)) {
         if (result == PASS && PROFILER_G(stmt_queries)) {
             /* Store query template on success - will be logged at execute() with bound params */
+            const profiler_tmpl *tmpl = profiler_tmpl_intern(query, query_len);
             zval zv;
-            ZVAL_STRINGL(&zv, query, query_len);
+
+            if (tmpl) {
+                ZVAL_PTR(&zv, (void *)tmpl);
+            } else {
+                /* Dictionary full: keep a copy for this statement */
+                ZVAL_STRINGL(&zv, query, query_len);
+            }
             zend_hash_index_update(
                 PROFILER_G(stmt_queries),
                 (zend_ulong)(uintptr_t)stmt,
@@ -161,13 +440,14 @@ MYSQLND_METHOD(profiler_stmt, prepare)(
             );
         } else if (result != PASS && profiler_job_is_any_active()) {
             /* Failed prepare has no subsequent execute(); log immediately with err status */
-            profiler_log_query(query, query_len, "err");
+            profiler_log_query(query, query_len, "err", &timer);
         }
     }
 #else
-    /* PHP 5.x: log template at prepare time (no param support) */
+    /* PHP 5.x: log template at prepare time (no param support);
+     * the recorded duration is that of the prepare round-trip */
     if (PROFILER_G(enabled) && profiler_job_is_any_active()) {
-        profiler_log_query(query, query_len, result == PASS ? "ok" : "err");
+        profiler_log_query(query, query_len, result == PASS ? "ok" : "err", &timer);
     }
 #endif
 
@@ -177,92 +457,170 @@ MYSQLND_METHOD(profiler_stmt, prepare)(
 
 #if PHP_VERSION_ID >= 70000
 
-/*
- * MYSQLND_VERSION_ID equals PHP_VERSION_ID.  The internal layout of
- * st_mysqlnd_stmt_data (fields param_bind, param_count) has been stable
- * from PHP 7.0 through 8.4.  Guard direct access so that an unknown
- * future mysqlnd silently degrades to "no params" instead of crashing.
- *
- * NOTE: The upper bound (80500) is a defensive estimate – it should be
- * updated once PHP 8.5 is released and its mysqlnd ABI has been verified.
- * If the ABI remains unchanged, simply bump the upper bound.
- */
-#define PROFILER_MYSQLND_PARAM_ACCESS_SAFE \
-    (MYSQLND_VERSION_ID >= 70000 && MYSQLND_VERSION_ID < 80500)
+/* Chunks and bytes streamed into one parameter with send_long_data() */
+typedef struct _profiler_long_data {
+    uint64_t chunks;
+    uint64_t bytes;
+} profiler_long_data;
+
+/* {{{ profiler_long_data_dtor */
+static void profiler_long_data_dtor(zval *zv)
+{
+    efree(Z_PTR_P(zv));
+}
+/* }}} */
+
+/* {{{ profiler_stmt_long_data
+ * stmt's per-parameter long data counters (param_count entries), NULL
+ * if nothing was streamed since the last execute. */
+static profiler_long_data *profiler_stmt_long_data(const MYSQLND_STMT *stmt)
+{
+    if (!PROFILER_G(stmt_long_data)) {
+        return NULL;
+    }
+    return (profiler_long_data *)zend_hash_index_find_ptr(
+        PROFILER_G(stmt_long_data), (zend_ulong)(uintptr_t)stmt);
+}
+/* }}} */
+
+/* {{{ profiler_stmt_long_data_reset
+ * Forget stmt's counters: mysqlnd starts over after execute, and a
+ * re-prepare may change the parameter count. */
+static void profiler_stmt_long_data_reset(const MYSQLND_STMT *stmt)
+{
+    if (PROFILER_G(stmt_long_data)) {
+        zend_hash_index_del(PROFILER_G(stmt_long_data), (zend_ulong)(uintptr_t)stmt);
+    }
+}
+/* }}} */
 
-/* {{{ profiler_build_params_json_write_string
- * Helper: write a JSON-escaped string value into the buffer.
- * Grows the buffer as needed via *buf_ptr / *buf_size_ptr.
- * Returns updated write position. */
-static size_t profiler_build_params_json_write_string(
-    char **buf_ptr, size_t *buf_size_ptr, size_t pos,
-    const char *str, size_t str_len)
+/* {{{ profiler_param_hash
+ * MurmurHash64A of a parameter value: identifies a truncated value
+ * without keeping it, eight bytes per step. */
+static uint64_t profiler_param_hash(const char *data, size_t len)
 {
-    char *buf = *buf_ptr;
-    size_t buf_size = *buf_size_ptr;
-    char *escaped = profiler_log_escape_json_string(str, str_len);
-    size_t esc_len = strlen(escaped);
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + (len & ~(size_t)7);
+    uint64_t h = 0x9747b28cULL ^ ((uint64_t)len * m);
+    uint64_t k;
 
-    if (pos + esc_len + 4 > buf_size) {
-        buf_size = pos + esc_len + 256;
-        buf = (char *)erealloc(buf, buf_size);
-        *buf_ptr = buf;
-        *buf_size_ptr = buf_size;
+    for (; p < end; p += 8) {
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        h ^= k;
+        h *= m;
     }
 
-    buf[pos++] = '"';
-    memcpy(buf + pos, escaped, esc_len);
-    pos += esc_len;
-    buf[pos++] = '"';
-    efree(escaped);
-    return pos;
+    switch (len & 7) {
+        case 7: h ^= (uint64_t)p[6] << 48; /* fall through */
+        case 6: h ^= (uint64_t)p[5] << 40; /* fall through */
+        case 5: h ^= (uint64_t)p[4] << 32; /* fall through */
+        case 4: h ^= (uint64_t)p[3] << 24; /* fall through */
+        case 3: h ^= (uint64_t)p[2] << 16; /* fall through */
+        case 2: h ^= (uint64_t)p[1] << 8;  /* fall through */
+        case 1: h ^= (uint64_t)p[0];
+                h *= m;
+    }
+
+    h ^= h >> 47;
+    h *= m;
+    h ^= h >> 47;
+    return h;
 }
+/* }}} */
+
+/* {{{ profiler_param_append_string
+ * Append a string parameter as a JSON string holding at most cap bytes
+ * of the value. A longer value keeps a prefix cut at a UTF-8 character
+ * boundary, then its full length and hash:
+ *   "prefix...[5242880 bytes #1f2e3d4c5b6a7988]"
+ * Returns the number of value bytes written. */
+static size_t profiler_param_append_string(profiler_buf *buf, const char *str,
+                                           size_t len, size_t cap)
+{
+    size_t keep;
+
+    if (len <= cap) {
+        profiler_buf_append_json_quoted(buf, str, len);
+        return len;
+    }
+
+    keep = cap;
+    while (keep > 0 && ((unsigned char)str[keep] & 0xC0) == 0x80) {
+        keep--;
+    }
+
+    profiler_buf_appendc(buf, '"');
+    profiler_buf_append_json(buf, str, keep);
+    profiler_buf_appendf(buf, "...[%llu bytes #%016llx]\"",
+        (unsigned long long)len, (unsigned long long)profiler_param_hash(str, len));
+    return keep;
+}
+/* }}} */
 
 /* {{{ profiler_build_params_json
  * Build JSON array string from stmt's bound parameter values.
  * Formats each value according to the declared bind type (MYSQL_TYPE_*)
  * rather than the zval's runtime type, matching the coercion mysqlnd
  * performs before sending data to the server.
+ * String values are capped at param_max_bytes each and params_max_bytes
+ * for the whole record, so a large upload does not end up in memory
+ * twice and on disk (see profiler_param_append_string).
  * Returns emalloc'd string or NULL if no params. Caller must efree. */
 static char *profiler_build_params_json(MYSQLND_STMT * const stmt)
 {
 #if PROFILER_MYSQLND_PARAM_ACCESS_SAFE
     MYSQLND_STMT_DATA *data = stmt->data;
+    const profiler_long_data *long_data;
+    size_t param_cap = (size_t)-1;
+    size_t budget = (size_t)-1;
     unsigned int i;
-    size_t buf_size, pos;
-    char *buf;
+    profiler_buf buf;
 
     if (!data || !data->param_bind || data->param_count == 0) {
         return NULL;
     }
 
-    buf_size = 256;
-    buf = (char *)emalloc(buf_size);
-    pos = 0;
+    if (PROFILER_G(param_max_bytes) > 0) {
+        param_cap = (size_t)PROFILER_G(param_max_bytes);
+    }
+    if (PROFILER_G(params_max_bytes) > 0) {
+        budget = (size_t)PROFILER_G(params_max_bytes);
+    }
+    long_data = profiler_stmt_long_data(stmt);
 
-    buf[pos++] = '[';
+    profiler_buf_init(&buf);
+    /* Sized for short values; long strings grow the buffer as they are
+     * appended, up to the budget */
+    profiler_buf_reserve(&buf, data->param_count * 24);
+    profiler_buf_appendc(&buf, '[');
 
     for (i = 0; i < data->param_count; i++) {
         zval *zv = &data->param_bind[i].zv;
         zend_uchar bind_type = data->param_bind[i].type;
 
         if (i > 0) {
-            buf[pos++] = ',';
-        }
-
-        /* Ensure space for this param (grow if needed) */
-        if (pos + 128 > buf_size) {
-            buf_size *= 2;
-            buf = (char *)erealloc(buf, buf_size);
+            profiler_buf_appendc(&buf, ',');
         }
 
         /* Dereference if reference (bind_param uses references) */
         ZVAL_DEREF(zv);
 
+        /* Blob data sent via send_long_data: mysqlnd sends what was
+         * streamed, not the bound variable (usually null) */
+        if (bind_type == MYSQL_TYPE_LONG_BLOB && long_data && long_data[i].chunks) {
+            profiler_buf_appendf(&buf, "\"[BLOB %llu chunks, %llu bytes]\"",
+                (unsigned long long)long_data[i].chunks,
+                (unsigned long long)long_data[i].bytes);
+            continue;
+        }
+
         /* NULL zval is always serialized as JSON null regardless of bind type */
         if (Z_TYPE_P(zv) == IS_NULL) {
-            memcpy(buf + pos, "null", 4);
-            pos += 4;
+            profiler_buf_append(&buf, "null", 4);
             continue;
         }
 
@@ -277,19 +635,7 @@ static char *profiler_build_params_json(MYSQLND_STMT * const stmt)
             case MYSQL_TYPE_LONGLONG: {
                 zend_long val = (Z_TYPE_P(zv) == IS_LONG)
                     ? Z_LVAL_P(zv) : zval_get_long(zv);
-                int written = snprintf(buf + pos, buf_size - pos,
-                    "\"%ld\"", (long)val);
-                if (written < 0) {
-                    break;
-                }
-                if ((size_t)written >= buf_size - pos) {
-                    buf_size = pos + (size_t)written + 64;
-                    buf = (char *)erealloc(buf, buf_size);
-                    pos += snprintf(buf + pos, buf_size - pos,
-                        "\"%ld\"", (long)val);
-                } else {
-                    pos += (size_t)written;
-                }
+                profiler_buf_appendf(&buf, "\"%ld\"", (long)val);
                 break;
             }
 
@@ -297,51 +643,41 @@ static char *profiler_build_params_json(MYSQLND_STMT * const stmt)
             case MYSQL_TYPE_FLOAT: {
                 double val = (Z_TYPE_P(zv) == IS_DOUBLE)
                     ? Z_DVAL_P(zv) : zval_get_double(zv);
-                int written = snprintf(buf + pos, buf_size - pos,
-                    "\"%g\"", val);
-                if (written < 0) {
-                    break;
-                }
-                if ((size_t)written >= buf_size - pos) {
-                    buf_size = pos + (size_t)written + 64;
-                    buf = (char *)erealloc(buf, buf_size);
-                    pos += snprintf(buf + pos, buf_size - pos,
-                        "\"%g\"", val);
-                } else {
-                    pos += (size_t)written;
-                }
+                profiler_buf_appendf(&buf, "\"%g\"", val);
                 break;
             }
 
             case MYSQL_TYPE_LONG_BLOB:
-                /* Blob data sent via send_long_data – log placeholder */
-                memcpy(buf + pos, "\"[BLOB]\"", 8);
-                pos += 8;
+                /* Bound as 'b' but nothing streamed */
+                profiler_buf_append(&buf, "\"[BLOB]\"", 8);
                 break;
 
             default: {
                 /* String types (MYSQL_TYPE_VAR_STRING, etc.) and any
                  * unrecognised bind type: coerce to string */
+                size_t cap = param_cap < budget ? param_cap : budget;
+                size_t written;
+
                 if (Z_TYPE_P(zv) == IS_STRING) {
-                    pos = profiler_build_params_json_write_string(
-                        &buf, &buf_size, pos,
-                        Z_STRVAL_P(zv), Z_STRLEN_P(zv));
+                    written = profiler_param_append_string(&buf,
+                        Z_STRVAL_P(zv), Z_STRLEN_P(zv), cap);
                 } else {
                     zend_string *str = zval_get_string(zv);
-                    pos = profiler_build_params_json_write_string(
-                        &buf, &buf_size, pos,
-                        ZSTR_VAL(str), ZSTR_LEN(str));
+                    written = profiler_param_append_string(&buf,
+                        ZSTR_VAL(str), ZSTR_LEN(str), cap);
                     zend_string_release(str);
                 }
+                if (budget != (size_t)-1) {
+                    budget -= written;
+                }
                 break;
             }
         }
     }
 
-    buf[pos++] = ']';
-    buf[pos] = '\0';
+    profiler_buf_appendc(&buf, ']');
 
-    return buf;
+    return buf.data;
 #else
     /* Unknown mysqlnd version – skip param capture to avoid ABI issues */
     (void)stmt;
@@ -350,18 +686,80 @@ static char *profiler_build_params_json(MYSQLND_STMT * const stmt)
 }
 /* }}} */
 
+/* {{{ profiler_stmt_collect
+ * Fill in what a statement's current result can still tell us.
+ * Called before the result goes away (next execute, free, close). */
+static void profiler_stmt_collect(const MYSQLND_STMT *stmt, profiler_pending *p)
+{
+    if (p->rec.flags & PROFILER_RECORD_ROWS) {
+        return;
+    }
+
+    /* Unbuffered: mysqlnd knows the row count once read to the end */
+    profiler_pending_set_rows(p,
+        orig_stmt_methods->num_rows((MYSQLND_STMT *)stmt),
+        profiler_pending_fetch_us(p),
+        profiler_stmt_conn(stmt));
+}
+/* }}} */
+
+/* {{{ profiler_stmt_finish */
+static void profiler_stmt_finish(MYSQLND_STMT *stmt)
+{
+    profiler_pending *p = profiler_result_find(stmt);
+
+    if (p) {
+        profiler_stmt_collect(stmt, p);
+        profiler_result_finish(stmt);
+    }
+}
+/* }}} */
+
+/* {{{ profiler_stmt_query
+ * Template stmt was prepared with, NULL if unknown. */
+static const char *profiler_stmt_query(const MYSQLND_STMT *stmt, size_t *query_len)
+{
+    zval *entry;
+
+    if (!PROFILER_G(stmt_queries)) {
+        return NULL;
+    }
+    entry = zend_hash_index_find(PROFILER_G(stmt_queries), (zend_ulong)(uintptr_t)stmt);
+    if (entry && Z_TYPE_P(entry) == IS_PTR) {
+        const profiler_tmpl *tmpl = (const profiler_tmpl *)Z_PTR_P(entry);
+
+        *query_len = tmpl->query_len;
+        return tmpl->query;
+    }
+    if (entry && Z_TYPE_P(entry) == IS_STRING) {
+        *query_len = Z_STRLEN_P(entry);
+        return Z_STRVAL_P(entry);
+    }
+    return NULL;
+}
+/* }}} */
+
 /* {{{ profiler_stmt_execute_hook
  * Intercepts prepared statement execution to log query with bound params.
- * Logging is performed after execute so the result status can be recorded.
+ * Logging is performed after execute so the result status can be recorded;
+ * a statement returning rows is held until its result has been fetched.
  * param_bind remains valid after execute (freed only on stmt dtor / rebind). */
 static enum_func_status
 MYSQLND_METHOD(profiler_stmt, execute)(
     MYSQLND_STMT * const stmt)
 {
     enum_func_status result;
+    profiler_timer timer;
+    uint64_t rx_start;
+
+    /* Re-executing discards the previous result: report it now */
+    profiler_stmt_finish(stmt);
+    rx_start = profiler_conn_bytes_received(profiler_stmt_conn(stmt));
 
     /* Call the original method first */
+    profiler_timer_start(&timer);
     result = orig_stmt_methods->execute(stmt);
+    profiler_timer_stop(&timer);
 
     /* Log with status and params after execution */
     if (PROFILER_G(enabled) && profiler_job_is_any_active() && PROFILER_G(stmt_queries)) {
@@ -369,29 +767,166 @@ MYSQLND_METHOD(profiler_stmt, execute)(
             PROFILER_G(stmt_queries),
             (zend_ulong)(uintptr_t)stmt
         );
-        if (entry && Z_TYPE_P(entry) == IS_STRING) {
-            char *params_json = profiler_build_params_json(stmt);
-            profiler_log_query_with_params(
-                Z_STRVAL_P(entry), Z_STRLEN_P(entry), params_json,
-                result == PASS ? "ok" : "err"
-            );
+        if (entry && (Z_TYPE_P(entry) == IS_PTR || Z_TYPE_P(entry) == IS_STRING)) {
+            const profiler_tmpl *tmpl = Z_TYPE_P(entry) == IS_PTR
+                ? (const profiler_tmpl *)Z_PTR_P(entry) : NULL;
+            uint64_t tx_id = profiler_tx_statement(profiler_stmt_conn(stmt),
+                PROFILER_TX_NONE, result == PASS, &timer);
+            profiler_record probe;
+            char *params_json = NULL;
+            profiler_pending *p = NULL;
+
+            /* Parameters are only encoded for a record some job will take */
+            memset(&probe, 0, sizeof(probe));
+            probe.query = tmpl ? tmpl->query : Z_STRVAL_P(entry);
+            probe.query_len = tmpl ? tmpl->query_len : Z_STRLEN_P(entry);
+            probe.status = result == PASS ? "ok" : "err";
+            probe.timer = &timer;
+            probe.tag = profiler_tag_current();
+            if (profiler_log_wanted(&probe)) {
+                params_json = profiler_build_params_json(stmt);
+                p = profiler_result_begin(stmt, PROFILER_OWNER_STMT,
+                    tmpl ? NULL : Z_STRVAL_P(entry), tmpl ? 0 : Z_STRLEN_P(entry), tmpl,
+                    params_json, probe.status, &timer);
+            }
+
+            if (p) {
+                p->rx_start = rx_start;
+                p->rec.tx_id = tx_id;
+                p->rec.conn_id = profiler_conn_id(profiler_stmt_conn(stmt));
+                if (result != PASS) {
+                    profiler_result_finish(stmt);
+                } else if (orig_stmt_methods->get_field_count(stmt) == 0) {
+                    p->rec.flags |= PROFILER_RECORD_AFFECTED;
+                    p->rec.affected = orig_stmt_methods->get_affected_rows(stmt);
+                    p->rec.insert_id = orig_stmt_methods->get_last_insert_id(stmt);
+                    profiler_result_finish(stmt);
+                } else {
+                    /* fetch() may read rows without an explicit use_result() */
+                    p->fetch_start_ns = profiler_clock_mono_ns();
+                }
+            }
             if (params_json) {
                 efree(params_json);
             }
         }
     }
+    if (PROFILER_G(enabled)) {
+        size_t query_len = 0;
+        const char *query = PROFILER_G(budget_on) ? profiler_stmt_query(stmt, &query_len) : NULL;
+
+        profiler_statement_done(query, query_len, result, &timer);
+    }
+    profiler_stmt_long_data_reset(stmt);
 
     return result;
 }
 /* }}} */
 
+/* {{{ profiler_stmt_send_long_data_hook
+ * Count the chunks and bytes streamed into a parameter; the next
+ * execute logs them in place of the value. */
+static enum_func_status
+MYSQLND_METHOD(profiler_stmt, send_long_data)(
+    MYSQLND_STMT * const stmt,
+    unsigned int param_no,
+    const char * const data,
+    zend_ulong length)
+{
+    enum_func_status result = orig_stmt_methods->send_long_data(stmt, param_no, data, length);
+
+#if PROFILER_MYSQLND_PARAM_ACCESS_SAFE
+    if (result == PASS && PROFILER_G(enabled) && profiler_job_is_any_active()
+        && stmt->data && param_no < stmt->data->param_count) {
+        profiler_long_data *ld = profiler_stmt_long_data(stmt);
+
+        if (!ld) {
+            if (!PROFILER_G(stmt_long_data)) {
+                ALLOC_HASHTABLE(PROFILER_G(stmt_long_data));
+                zend_hash_init(PROFILER_G(stmt_long_data), 4, NULL,
+                    profiler_long_data_dtor, 0);
+            }
+            ld = (profiler_long_data *)ecalloc(stmt->data->param_count,
+                sizeof(profiler_long_data));
+            zend_hash_index_update_ptr(PROFILER_G(stmt_long_data),
+                (zend_ulong)(uintptr_t)stmt, ld);
+        }
+        ld[param_no].chunks++;
+        ld[param_no].bytes += length;
+    }
+#endif
+
+    return result;
+}
+/* }}} */
+
+/* {{{ profiler_stmt_store_result_hook
+ * Buffered statement result: all rows are transferred here. */
+static MYSQLND_RES *
+MYSQLND_METHOD(profiler_stmt, store_result)(
+    MYSQLND_STMT * const stmt)
+{
+    MYSQLND_RES *res;
+    profiler_timer timer;
+    profiler_pending *p;
+
+    profiler_timer_start(&timer);
+    res = orig_stmt_methods->store_result(stmt);
+    profiler_timer_stop(&timer);
+
+    p = profiler_result_find(stmt);
+    if (p) {
+        if (res) {
+            profiler_pending_set_rows(p, orig_stmt_methods->num_rows(stmt),
+                timer.dur_us, profiler_stmt_conn(stmt));
+        }
+        profiler_result_finish(stmt);
+    }
+
+    return res;
+}
+/* }}} */
+
+/* {{{ profiler_stmt_use_result_hook
+ * Unbuffered statement result: rows are read by later fetch() calls,
+ * so only start the fetch clock here. */
+static MYSQLND_RES *
+MYSQLND_METHOD(profiler_stmt, use_result)(
+    MYSQLND_STMT *stmt)
+{
+    MYSQLND_RES *res = orig_stmt_methods->use_result(stmt);
+    profiler_pending *p = profiler_result_find(stmt);
+
+    if (p && res) {
+        p->fetch_start_ns = profiler_clock_mono_ns();
+    }
+
+    return res;
+}
+/* }}} */
+
+/* {{{ profiler_stmt_free_result_hook */
+static enum_func_status
+MYSQLND_METHOD(profiler_stmt, free_result)(
+    MYSQLND_STMT * const stmt)
+{
+    profiler_stmt_finish(stmt);
+
+    return orig_stmt_methods->free_result(stmt);
+}
+/* }}} */
+
 /* {{{ profiler_stmt_dtor_hook
- * Clean up stored query template when statement is destroyed. */
+ * Report a result still pending and clean up the stored query template
+ * when the statement is destroyed. */
 static enum_func_status
 MYSQLND_METHOD(profiler_stmt, dtor)(
     MYSQLND_STMT * const stmt,
     PROFILER_BOOL_T implicit)
 {
+    profiler_stmt_finish(stmt);
+    profiler_stmt_long_data_reset(stmt);
+
     if (PROFILER_G(stmt_queries)) {
         zend_hash_index_del(
             PROFILER_G(stmt_queries),
@@ -403,13 +938,370 @@ MYSQLND_METHOD(profiler_stmt, dtor)(
 }
 /* }}} */
 
+/* {{{ profiler_conn_store_result_hook
+ * Buffered result of conn::query(): all rows are transferred here. */
+static MYSQLND_RES *
+MYSQLND_METHOD(profiler_conn, store_result)(
+    MYSQLND_CONN_DATA * const conn PROFILER_RESULT_FLAGS_DC)
+{
+    MYSQLND_RES *res;
+    profiler_timer timer;
+    profiler_pending *p;
+
+    profiler_timer_start(&timer);
+    res = orig_conn_data_methods->store_result(conn PROFILER_RESULT_FLAGS_CC);
+    profiler_timer_stop(&timer);
+
+    p = profiler_result_find(conn);
+    if (p) {
+        if (res) {
+            profiler_pending_set_rows(p, orig_res_methods->num_rows(res),
+                timer.dur_us, conn);
+        }
+        profiler_result_finish(conn);
+    }
+
+    return res;
+}
+/* }}} */
+
+/* {{{ profiler_conn_use_result_hook
+ * Unbuffered result of conn::query(): the record follows the result
+ * object until it is freed. */
+static MYSQLND_RES *
+MYSQLND_METHOD(profiler_conn, use_result)(
+    MYSQLND_CONN_DATA * const conn PROFILER_RESULT_FLAGS_DC)
+{
+    MYSQLND_RES *res = orig_conn_data_methods->use_result(conn PROFILER_RESULT_FLAGS_CC);
+    profiler_pending *p;
+
+    if (res) {
+        p = profiler_result_move(conn, res, PROFILER_OWNER_RES);
+        if (p) {
+            p->fetch_start_ns = profiler_clock_mono_ns();
+        }
+    }
+
+    return res;
+}
+/* }}} */
+
+/* {{{ profiler_res_collect */
+static void profiler_res_collect(MYSQLND_RES *res, profiler_pending *p)
+{
+    profiler_pending_set_rows(p, orig_res_methods->num_rows(res),
+        profiler_pending_fetch_us(p), profiler_res_conn(res));
+}
+/* }}} */
+
+/* {{{ profiler_res_free_result_hook
+ * End of an unbuffered result read via use_result(). */
+static enum_func_status
+MYSQLND_METHOD(profiler_res, free_result)(
+    MYSQLND_RES *res,
+    PROFILER_BOOL_T implicit)
+{
+    profiler_pending *p = profiler_result_find(res);
+
+    if (p) {
+        profiler_res_collect(res, p);
+        profiler_result_finish(res);
+    }
+
+    return orig_res_methods->free_result(res, implicit);
+}
+/* }}} */
+
+/* {{{ profiler_conn_tx_enter
+ * Start of a transaction method on conn: open the span for BEGIN and
+ * let the query hook know which control statement it is about to see.
+ * Returns whether profiler_conn_tx_leave must follow. */
+static int profiler_conn_tx_enter(MYSQLND_CONN_DATA *conn, int event)
+{
+    if (PROFILER_G(tx_hook_event) != PROFILER_TX_NONE
+        || !PROFILER_G(enabled) || !profiler_job_is_any_active()) {
+        return 0;
+    }
+    profiler_tx_before(conn, event);
+    PROFILER_G(tx_hook_event) = event;
+    return 1;
+}
+/* }}} */
+
+/* {{{ profiler_conn_tx_leave */
+static void profiler_conn_tx_leave(MYSQLND_CONN_DATA *conn, int event,
+                                   enum_func_status result)
+{
+    PROFILER_G(tx_hook_event) = PROFILER_TX_NONE;
+    profiler_tx_after(conn, event, result == PASS);
+}
+/* }}} */
+
+/* {{{ profiler_conn_tx_begin_hook
+ * mysqli_begin_transaction(), PDO::beginTransaction(). Like the other
+ * transaction methods mysqlnd sends its SQL through conn::query(), so
+ * that statement's record belongs to the span. */
+static enum_func_status
+MYSQLND_METHOD(profiler_conn, tx_begin)(
+    MYSQLND_CONN_DATA *conn,
+    const unsigned int mode,
+    const char * const name)
+{
+    int tracked = profiler_conn_tx_enter(conn, PROFILER_TX_BEGIN);
+    enum_func_status result = orig_conn_data_methods->tx_begin(conn, mode, name);
+
+    if (tracked) {
+        profiler_conn_tx_leave(conn, PROFILER_TX_BEGIN, result);
+    }
+    return result;
+}
+/* }}} */
+
+/* {{{ profiler_conn_tx_commit_or_rollback_hook
+ * mysqli_commit(), mysqli_rollback(), PDO::commit(), PDO::rollBack() */
+static enum_func_status
+MYSQLND_METHOD(profiler_conn, tx_commit_or_rollback)(
+    MYSQLND_CONN_DATA *conn,
+    const PROFILER_BOOL_T commit,
+    const unsigned int flags,
+    const char * const name)
+{
+    int event = commit ? PROFILER_TX_COMMIT : PROFILER_TX_ROLLBACK;
+    int tracked = profiler_conn_tx_enter(conn, event);
+    enum_func_status result = orig_conn_data_methods->tx_commit_or_rollback(conn, commit,
+        flags, name);
+
+    if (tracked) {
+        profiler_conn_tx_leave(conn, event, result);
+    }
+    return result;
+}
+/* }}} */
+
+/* {{{ profiler_conn_set_autocommit_hook
+ * mysqli_autocommit(), PDO::ATTR_AUTOCOMMIT */
+static enum_func_status
+MYSQLND_METHOD(profiler_conn, set_autocommit)(
+    MYSQLND_CONN_DATA *conn,
+    unsigned int mode)
+{
+    int event = mode ? PROFILER_TX_AUTOCOMMIT_ON : PROFILER_TX_AUTOCOMMIT_OFF;
+    int tracked = profiler_conn_tx_enter(conn, event);
+    enum_func_status result = orig_conn_data_methods->set_autocommit(conn, mode);
+
+    if (tracked) {
+        profiler_conn_tx_leave(conn, event, result);
+    }
+    return result;
+}
+/* }}} */
+
+#if PROFILER_MYSQLND_CONN_ACCESS_SAFE
+
+/* {{{ profiler_conn_log_event
+ * Write a lifecycle event of conn. host overrides the connection's
+ * scheme (NULL = use it, e.g. after a failed connect it is not set). */
+static void profiler_conn_log_event(MYSQLND_CONN_DATA *conn, const char *event,
+                                    enum_func_status result, const profiler_timer *timer,
+                                    const char *db, size_t db_len,
+                                    const char *host, size_t host_len)
+{
+    profiler_conn_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.event = event;
+    ev.conn_id = profiler_conn_id(conn);
+    if (conn->scheme.s && conn->scheme.l) {
+        ev.host = conn->scheme.s;
+        ev.host_len = conn->scheme.l;
+    } else if (host) {
+        ev.host = host;
+        ev.host_len = host_len;
+    }
+    ev.db = db;
+    ev.db_len = db_len;
+    ev.thread_id = conn->thread_id;
+    ev.persistent = conn->persistent ? 1 : 0;
+    ev.status = result == PASS ? "ok" : "err";
+    ev.timer = timer;
+    profiler_log_conn(&ev);
+}
+/* }}} */
+
+/* {{{ profiler_conn_connect_hook
+ * Connect latency per host. A persistent connection only gets here when
+ * no idle one was left to reuse, so persistent connects are misses. */
+static enum_func_status
+MYSQLND_METHOD(profiler_conn, connect)(
+    MYSQLND_CONN_DATA *conn,
+    MYSQLND_CSTRING hostname,
+    MYSQLND_CSTRING username,
+    MYSQLND_CSTRING password,
+    MYSQLND_CSTRING database,
+    unsigned int port,
+    MYSQLND_CSTRING socket_or_pipe,
+    unsigned int mysql_flags)
+{
+    enum_func_status result;
+    profiler_timer timer;
+
+    profiler_timer_start(&timer);
+    result = orig_conn_data_methods->connect(conn, hostname, username, password, database,
+        port, socket_or_pipe, mysql_flags);
+    profiler_timer_stop(&timer);
+
+    if (PROFILER_G(enabled) && profiler_job_is_any_active()) {
+        char host[320];
+        int host_len;
+
+        /* What mysqlnd would have connected to, for a failed connect */
+        if (!hostname.s || !hostname.l || strcmp(hostname.s, "localhost") == 0) {
+            host_len = socket_or_pipe.s && socket_or_pipe.l
+                ? snprintf(host, sizeof(host), "unix://%.*s", (int)socket_or_pipe.l, socket_or_pipe.s)
+                : snprintf(host, sizeof(host), "unix:///tmp/mysql.sock");
+        } else {
+            host_len = snprintf(host, sizeof(host), "tcp://%.*s:%u", (int)hostname.l, hostname.s,
+                port ? port : 3306);
+        }
+        if (host_len < 0 || (size_t)host_len >= sizeof(host)) {
+            host_len = host_len < 0 ? 0 : (int)sizeof(host) - 1;
+        }
+
+        profiler_conn_log_event(conn, "connect", result, &timer,
+            database.s && database.l ? database.s : NULL, database.l, host, (size_t)host_len);
+    }
+    return result;
+}
+/* }}} */
+
+/* {{{ profiler_conn_change_user_hook
+ * mysqli_change_user(): the server resets the session, rolling back an
+ * open transaction. */
+static enum_func_status
+MYSQLND_METHOD(profiler_conn, change_user)(
+    MYSQLND_CONN_DATA * const conn,
+    const char *user,
+    const char *passwd,
+    const char *db,
+    PROFILER_BOOL_T silent,
+    size_t passwd_len)
+{
+    enum_func_status result;
+    profiler_timer timer;
+
+    profiler_timer_start(&timer);
+    result = orig_conn_data_methods->change_user(conn, user, passwd, db, silent, passwd_len);
+    profiler_timer_stop(&timer);
+
+    if (PROFILER_G(enabled) && profiler_job_is_any_active()) {
+        profiler_conn_log_event(conn, "change_user", result, &timer,
+            db && *db ? db : NULL, db ? strlen(db) : 0, NULL, 0);
+        if (result == PASS) {
+            profiler_tx_conn_closed(conn);
+        }
+    }
+    return result;
+}
+/* }}} */
+
+/* {{{ profiler_conn_select_db_hook
+ * mysqli_select_db(): sent as COM_INIT_DB, not as a query. */
+static enum_func_status
+MYSQLND_METHOD(profiler_conn, select_db)(
+    MYSQLND_CONN_DATA * const conn,
+    const char * const db,
+    const size_t db_len)
+{
+    enum_func_status result;
+    profiler_timer timer;
+
+    profiler_timer_start(&timer);
+    result = orig_conn_data_methods->select_db(conn, db, db_len);
+    profiler_timer_stop(&timer);
+
+    if (PROFILER_G(enabled) && profiler_job_is_any_active()) {
+        profiler_conn_log_event(conn, "select_db", result, &timer, db, db_len, NULL, 0);
+    }
+    return result;
+}
+/* }}} */
+
+/* {{{ profiler_conn_send_close_hook
+ * Explicit close, reconnect, or the connection object going away. Only
+ * connections that already have an id are reported; the id is dropped
+ * so that a reconnect on the same object counts as a new connection. */
+static enum_func_status
+MYSQLND_METHOD(profiler_conn, send_close)(
+    MYSQLND_CONN_DATA * const conn)
+{
+    void **slot = mysqlnd_plugin_get_plugin_connection_data_data(conn, profiler_plugin_id);
+    enum_func_status result;
+    profiler_timer timer;
+
+    profiler_timer_start(&timer);
+    result = orig_conn_data_methods->send_close(conn);
+    profiler_timer_stop(&timer);
+
+    if (slot && *slot) {
+        if (PROFILER_G(enabled) && profiler_job_is_any_active()) {
+            profiler_conn_log_event(conn, "close", result, &timer, NULL, 0, NULL, 0);
+            profiler_tx_conn_closed(conn);
+        }
+        *slot = NULL;
+    }
+    return result;
+}
+/* }}} */
+
+#endif /* PROFILER_MYSQLND_CONN_ACCESS_SAFE */
+
+/* {{{ profiler_pending_collect
+ * Request shutdown: statements and unbuffered results are still alive
+ * (their free/dtor hooks would have removed the record), connections
+ * may not be, so only the former are asked for metrics. */
+static void profiler_pending_collect(const void *owner, profiler_pending *p)
+{
+    switch (p->owner_type) {
+        case PROFILER_OWNER_STMT:
+            profiler_stmt_collect((const MYSQLND_STMT *)owner, p);
+            break;
+        case PROFILER_OWNER_RES:
+            profiler_res_collect((MYSQLND_RES *)owner, p);
+            break;
+        default:
+            break;
+    }
+}
+/* }}} */
+
 #endif /* PHP_VERSION_ID >= 70000 */
 
+/* {{{ mariadb_profiler_mysqlnd_plugin_request_shutdown
+ * Write records still waiting for their result set, then the spans of
+ * transactions left open. */
+void mariadb_profiler_mysqlnd_plugin_request_shutdown(void)
+{
+#if PHP_VERSION_ID >= 70000
+    profiler_result_request_shutdown(profiler_pending_collect);
+    profiler_tx_request_shutdown();
+    PROFILER_G(tx_hook_event) = PROFILER_TX_NONE;
+    if (PROFILER_G(stmt_long_data)) {
+        zend_hash_destroy(PROFILER_G(stmt_long_data));
+        FREE_HASHTABLE(PROFILER_G(stmt_long_data));
+        PROFILER_G(stmt_long_data) = NULL;
+    }
+#endif
+}
+/* }}} */
+
 /* {{{ mariadb_profiler_mysqlnd_plugin_register */
 void mariadb_profiler_mysqlnd_plugin_register(void)
 {
     PROFILER_CONN_METHODS_T *conn_data_methods;
     struct st_mysqlnd_stmt_methods *stmt_methods;
+#if PHP_VERSION_ID >= 70000
+    struct st_mysqlnd_res_methods *res_methods;
+#endif
 
     /* Register as a mysqlnd plugin */
     profiler_plugin_id = mysqlnd_plugin_register();
@@ -448,8 +1340,41 @@ void mariadb_profiler_mysqlnd_plugin_register(void)
     stmt_methods->prepare = MYSQLND_METHOD(profiler_stmt, prepare);
 
 #if PHP_VERSION_ID >= 70000
-    stmt_methods->execute = MYSQLND_METHOD(profiler_stmt, execute);
-    stmt_methods->dtor    = MYSQLND_METHOD(profiler_stmt, dtor);
+    stmt_methods->execute      = MYSQLND_METHOD(profiler_stmt, execute);
+    stmt_methods->dtor         = MYSQLND_METHOD(profiler_stmt, dtor);
+    stmt_methods->store_result = MYSQLND_METHOD(profiler_stmt, store_result);
+    stmt_methods->use_result   = MYSQLND_METHOD(profiler_stmt, use_result);
+    stmt_methods->free_result  = MYSQLND_METHOD(profiler_stmt, free_result);
+    stmt_methods->send_long_data = MYSQLND_METHOD(profiler_stmt, send_long_data);
+
+    /* Result-set methods (rows, bytes and fetch time per query) */
+    conn_data_methods->store_result = MYSQLND_METHOD(profiler_conn, store_result);
+    conn_data_methods->use_result   = MYSQLND_METHOD(profiler_conn, use_result);
+
+    /* Transaction spans */
+    conn_data_methods->tx_begin              = MYSQLND_METHOD(profiler_conn, tx_begin);
+    conn_data_methods->tx_commit_or_rollback = MYSQLND_METHOD(profiler_conn, tx_commit_or_rollback);
+    conn_data_methods->set_autocommit        = MYSQLND_METHOD(profiler_conn, set_autocommit);
+
+#if PROFILER_MYSQLND_CONN_ACCESS_SAFE
+    /* Connection lifecycle */
+    conn_data_methods->connect     = MYSQLND_METHOD(profiler_conn, connect);
+    conn_data_methods->change_user = MYSQLND_METHOD(profiler_conn, change_user);
+    conn_data_methods->select_db   = MYSQLND_METHOD(profiler_conn, select_db);
+    conn_data_methods->send_close  = MYSQLND_METHOD(profiler_conn, send_close);
+#endif
+
+    /* Every MYSQLND_RES copies this table when it is created */
+    res_methods = mysqlnd_result_get_methods();
+
+    if (!orig_res_methods) {
+        orig_res_methods = (struct st_mysqlnd_res_methods *)
+            pemalloc(sizeof(struct st_mysqlnd_res_methods), 1);
+        memcpy(orig_res_methods, res_methods,
+            sizeof(struct st_mysqlnd_res_methods));
+    }
+
+    res_methods->free_result = MYSQLND_METHOD(profiler_res, free_result);
 #endif
 }
 /* }}} */
@@ -0,0 +1,73 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Query Record                                |
+  +----------------------------------------------------------------------+
+  | Everything known about one logged statement (or connection event),   |
+  | handed to the log writers in a single struct.                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_RECORD_H
+#define PROFILER_RECORD_H
+
+/* Which optional result metrics a record carries */
+#define PROFILER_RECORD_ROWS      0x01 /* rows, fetch_us */
+#define PROFILER_RECORD_BYTES     0x02 /* bytes */
+#define PROFILER_RECORD_AFFECTED  0x04 /* affected, insert_id */
+#define PROFILER_RECORD_FP        0x08 /* fp */
+#define PROFILER_RECORD_STACK     0x10 /* trace is written as stack_id */
+#define PROFILER_RECORD_TMPL      0x20 /* query is written as tmpl_id */
+
+struct _profiler_trace;
+
+typedef struct _profiler_record {
+    const char           *query;
+    size_t                query_len;
+    const char           *params_json; /* JSON array or NULL */
+    const char           *status;      /* "ok" / "err", NULL = "ok" */
+    const profiler_timer *timer;       /* NULL = now, no duration */
+    const char           *tag;         /* context tag at query time or NULL */
+    const struct _profiler_trace *trace; /* call stack or NULL */
+    uint64_t              fp;          /* digest of the normalized statement */
+    uint64_t              stack_id;    /* profiler_trace_id() of trace */
+    uint64_t              tmpl_id;     /* profiler_tmpl id of query, 0 = not interned */
+    uint64_t              tx_id;       /* transaction span (profiler_tx.h), 0 = none */
+    uint64_t              conn_id;     /* connection that ran it, 0 = unknown */
+    uint64_t              req_id;      /* request summary (profiler_request.h), 0 = none */
+    /* Result metrics, valid according to flags */
+    unsigned int          flags;
+    uint64_t              rows;        /* rows returned to PHP */
+    uint64_t              fetch_us;    /* time spent transferring the result */
+    uint64_t              bytes;       /* bytes received for query + result */
+    uint64_t              affected;    /* affected rows (DML) */
+    uint64_t              insert_id;   /* last insert id, 0 = none */
+} profiler_record;
+
+/* A connect, change_user, select_db or close on a connection */
+typedef struct _profiler_conn_event {
+    const char           *event;       /* "connect", "change_user", "select_db", "close" */
+    uint64_t              conn_id;
+    const char           *host;        /* "tcp://host:port" / "unix:///path", NULL = unknown */
+    size_t                host_len;
+    const char           *db;          /* schema selected, NULL = none */
+    size_t                db_len;
+    uint64_t              thread_id;   /* server-side connection id, 0 = unknown */
+    int                   persistent;
+    const char           *status;      /* "ok" / "err" */
+    const profiler_timer *timer;
+} profiler_conn_event;
+
+/* A query budget limit the request went over (profiler_budget.c) */
+typedef struct _profiler_budget_event {
+    const char           *limit;       /* "queries", "db_time_us", "repeats" */
+    uint64_t              max;
+    uint64_t              value;       /* statements, us or runs so far */
+    const char           *query;       /* statement that went over */
+    size_t                query_len;
+    uint64_t              fp;          /* its shape, 0 = not computed ("repeats" only) */
+    const char           *tag;         /* context tag at that time or NULL */
+    const profiler_timer *timer;       /* that statement's run, NULL = unknown */
+    double                ts;
+} profiler_budget_event;
+
+#endif /* PROFILER_RECORD_H */
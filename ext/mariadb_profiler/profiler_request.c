@@ -0,0 +1,128 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Request Summary                             |
+  +----------------------------------------------------------------------+
+  | Per-request totals kept by the mysqlnd hooks while a job captures    |
+  | the request, so DB time can be ranked per endpoint without putting   |
+  | requests back together from query timestamps.                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "SAPI.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_request.h"
+#include "profiler_json.h"
+
+/* {{{ profiler_request_init */
+void profiler_request_init(void)
+{
+    profiler_request *req;
+    TSRMLS_FETCH();
+
+    req = &PROFILER_G(request);
+    memset(req, 0, sizeof(*req));
+    req->start_ts = profiler_clock_wall();
+    req->start_ns = profiler_clock_mono_ns();
+}
+/* }}} */
+
+/* {{{ profiler_request_id */
+uint64_t profiler_request_id(void)
+{
+    TSRMLS_FETCH();
+
+    if (!PROFILER_G(request).id) {
+        PROFILER_G(request).id = ((uint64_t)profiler_getpid() << 32)
+            | (uint64_t)++PROFILER_G(request_seq);
+    }
+    return PROFILER_G(request).id;
+}
+/* }}} */
+
+/* {{{ profiler_request_tag
+ * Add the current context tag to the request's distinct tags. */
+static void profiler_request_tag(profiler_request *req)
+{
+    const char *tag = profiler_tag_current();
+    int i;
+
+    if (!tag) {
+        return;
+    }
+    /* Most statements run under the tag of the one before */
+    for (i = req->tag_count - 1; i >= 0; i--) {
+        if (strcmp(req->tags[i], tag) == 0) {
+            return;
+        }
+    }
+    if (req->tag_count < PROFILER_REQUEST_MAX_TAGS) {
+        req->tags[req->tag_count++] = estrdup(tag);
+    }
+}
+/* }}} */
+
+/* {{{ profiler_request_statement */
+void profiler_request_statement(int ok, const profiler_timer *timer)
+{
+    profiler_request *req;
+    TSRMLS_FETCH();
+
+    req = &PROFILER_G(request);
+    req->queries++;
+    if (!ok) {
+        req->errors++;
+    }
+    if (timer) {
+        req->sum_us += timer->dur_us;
+        if (timer->dur_us > req->max_us) {
+            req->max_us = timer->dur_us;
+        }
+    }
+    profiler_request_tag(req);
+}
+/* }}} */
+
+/* {{{ profiler_request_append_tags_json */
+void profiler_request_append_tags_json(profiler_buf *out, const profiler_request *req)
+{
+    int i;
+
+    profiler_buf_appendc(out, '[');
+    for (i = 0; i < req->tag_count; i++) {
+        if (i) {
+            profiler_buf_appendc(out, ',');
+        }
+        profiler_buf_append_json_quoted(out, req->tags[i], strlen(req->tags[i]));
+    }
+    profiler_buf_appendc(out, ']');
+}
+/* }}} */
+
+/* {{{ profiler_request_shutdown */
+void profiler_request_shutdown(void)
+{
+    profiler_request *req;
+    int job_count;
+    int i;
+    TSRMLS_FETCH();
+
+    req = &PROFILER_G(request);
+    if (profiler_job_get_active_list(&job_count) && job_count > 0) {
+        profiler_request_id();
+        req->dur_us = (profiler_clock_mono_ns() - req->start_ns) / 1000;
+        req->pid = (long)profiler_getpid();
+        req->method = SG(request_info).request_method;
+        profiler_log_request(req);
+    }
+
+    for (i = 0; i < req->tag_count; i++) {
+        efree(req->tags[i]);
+    }
+    req->tag_count = 0;
+}
+/* }}} */
@@ -0,0 +1,48 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Request Summary Header                      |
+  +----------------------------------------------------------------------+
+  | Statement count, DB time, errors and tags of one captured request.   |
+  | Query records carry the request id ("rq"); one {"type":"req"}        |
+  | summary is written when the request ends.                            |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_REQUEST_H
+#define PROFILER_REQUEST_H
+
+/* Distinct context tags listed in a request summary */
+#define PROFILER_REQUEST_MAX_TAGS 32
+
+typedef struct _profiler_request {
+    uint64_t    id;         /* pid in the high half, per-process sequence below; 0 = none yet */
+    double      start_ts;   /* wall clock at RINIT */
+    uint64_t    start_ns;   /* monotonic clock at RINIT */
+    uint64_t    dur_us;     /* RINIT to the summary */
+    long        pid;
+    const char *method;     /* HTTP method, NULL under CLI */
+    uint64_t    queries;    /* statements run while the request was captured */
+    uint64_t    errors;
+    uint64_t    sum_us;     /* their total time */
+    uint64_t    max_us;
+    char       *tags[PROFILER_REQUEST_MAX_TAGS]; /* distinct tags, first seen first */
+    int         tag_count;
+} profiler_request;
+
+/* Start the request's clock and counters (RINIT) */
+void     profiler_request_init(void);
+
+/* This request's id, assigned on first use */
+uint64_t profiler_request_id(void);
+
+/* Count one statement that has run while a job captures the request */
+void     profiler_request_statement(int ok, const profiler_timer *timer);
+
+/* Append req's tags as a JSON array of strings */
+void     profiler_request_append_tags_json(profiler_buf *out, const profiler_request *req);
+
+/* Write the summary to the capturing jobs and free the tags (RSHUTDOWN,
+ * before the sinks are flushed) */
+void     profiler_request_shutdown(void);
+
+#endif /* PROFILER_REQUEST_H */
@@ -0,0 +1,206 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Result Tracking                             |
+  +----------------------------------------------------------------------+
+  | A statement that returns a result set is not logged when the query   |
+  | call returns: its record is parked under the connection, result or   |
+  | statement pointer until the mysqlnd plugin sees the result stored or |
+  | freed and fills in the result metrics. Records still pending at      |
+  | request shutdown are written with whatever is known by then.         |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_result.h"
+#include "profiler_fingerprint.h"
+#include "profiler_trace.h"
+#include "profiler_tmpl.h"
+
+#if PHP_VERSION_ID >= 70000
+
+/* {{{ profiler_result_free */
+static void profiler_result_free(profiler_pending *p)
+{
+    if (!p->rec.tmpl_id) {
+        efree((char *)p->rec.query); /* templates live in the dictionary */
+    }
+    if (p->rec.params_json) {
+        efree((char *)p->rec.params_json);
+    }
+    if (p->rec.tag) {
+        efree((char *)p->rec.tag);
+    }
+    profiler_trace_free((profiler_trace *)p->rec.trace);
+    efree(p);
+}
+/* }}} */
+
+/* {{{ profiler_result_request_init */
+void profiler_result_request_init(void)
+{
+    ALLOC_HASHTABLE(PROFILER_G(pending_results));
+    /* No destructor: entries are moved between keys, freed explicitly */
+    zend_hash_init(PROFILER_G(pending_results), 8, NULL, NULL, 0);
+}
+/* }}} */
+
+/* {{{ profiler_result_request_shutdown
+ * Write out every record still waiting for its result. */
+void profiler_result_request_shutdown(profiler_result_collect_func collect)
+{
+    HashTable *ht = PROFILER_G(pending_results);
+    zend_ulong owner;
+    profiler_pending *p;
+
+    if (!ht) {
+        return;
+    }
+
+    /* Detach first: hooks fired from here must not touch the table */
+    PROFILER_G(pending_results) = NULL;
+
+    ZEND_HASH_FOREACH_NUM_KEY_PTR(ht, owner, p) {
+        if (collect) {
+            collect((const void *)(uintptr_t)owner, p);
+        }
+        profiler_log_record(&p->rec);
+        profiler_result_free(p);
+    } ZEND_HASH_FOREACH_END();
+
+    zend_hash_destroy(ht);
+    FREE_HASHTABLE(ht);
+}
+/* }}} */
+
+/* {{{ profiler_result_begin */
+profiler_pending *profiler_result_begin(const void *owner, int owner_type,
+                                        const char *query, size_t query_len,
+                                        const profiler_tmpl *tmpl,
+                                        const char *params_json,
+                                        const char *status,
+                                        const profiler_timer *timer)
+{
+    profiler_pending *p;
+    profiler_record probe;
+    const char *tag;
+    const profiler_trace *trace;
+    int job_count;
+    int verdict;
+
+    if (!PROFILER_G(pending_results)
+        || !profiler_job_get_active_list(&job_count) || job_count == 0) {
+        return NULL;
+    }
+
+    /* The previous statement on this owner never reported a result */
+    profiler_result_finish(owner);
+
+    /* Judged on execution time: the trace has to be taken here or never */
+    verdict = profiler_log_slow_verdict(timer);
+    if (verdict == PROFILER_LOG_DROP) {
+        return NULL;
+    }
+
+    /* No job's filter wants it: skip the copies and the trace */
+    tag = profiler_tag_current();
+    memset(&probe, 0, sizeof(probe));
+    probe.query = tmpl ? tmpl->query : query;
+    probe.query_len = tmpl ? tmpl->query_len : query_len;
+    probe.status = status;
+    probe.timer = timer;
+    probe.tag = tag;
+    if (!profiler_log_wanted(&probe)) {
+        return NULL;
+    }
+
+    p = (profiler_pending *)ecalloc(1, sizeof(profiler_pending));
+    p->owner_type = owner_type;
+
+    if (tmpl) {
+        /* Copied and fingerprinted once per process, not per execute */
+        p->rec.query = tmpl->query;
+        p->rec.query_len = tmpl->query_len;
+        p->rec.fp = tmpl->fp;
+        p->rec.tmpl_id = tmpl->id;
+    } else {
+        p->rec.query = estrndup(query, query_len);
+        p->rec.query_len = query_len;
+        p->rec.fp = profiler_fingerprint(query, query_len, NULL);
+    }
+    p->rec.params_json = params_json ? estrdup(params_json) : NULL;
+    p->rec.status = status; /* static string */
+    p->rec.flags = PROFILER_RECORD_FP;
+    if (timer) {
+        p->timer = *timer;
+        p->rec.timer = &p->timer;
+    }
+
+    /* Tag and trace describe the call site, so capture them now; the
+     * trace is copied since the engine frames are gone by the time the
+     * record is written */
+    p->rec.tag = tag ? estrdup(tag) : NULL;
+    p->rec.req_id = profiler_request_id();
+    trace = verdict == PROFILER_LOG_FULL ? profiler_trace_capture() : NULL;
+    p->rec.trace = trace ? profiler_trace_copy(trace) : NULL;
+
+    zend_hash_index_update_ptr(PROFILER_G(pending_results),
+        (zend_ulong)(uintptr_t)owner, p);
+
+    return p;
+}
+/* }}} */
+
+/* {{{ profiler_result_find */
+profiler_pending *profiler_result_find(const void *owner)
+{
+    if (!PROFILER_G(pending_results)
+        || zend_hash_num_elements(PROFILER_G(pending_results)) == 0) {
+        return NULL;
+    }
+
+    return (profiler_pending *)zend_hash_index_find_ptr(
+        PROFILER_G(pending_results), (zend_ulong)(uintptr_t)owner);
+}
+/* }}} */
+
+/* {{{ profiler_result_move */
+profiler_pending *profiler_result_move(const void *from, const void *to, int owner_type)
+{
+    profiler_pending *p = profiler_result_find(from);
+
+    if (!p) {
+        return NULL;
+    }
+
+    zend_hash_index_del(PROFILER_G(pending_results), (zend_ulong)(uintptr_t)from);
+    profiler_result_finish(to);
+
+    p->owner_type = owner_type;
+    zend_hash_index_update_ptr(PROFILER_G(pending_results),
+        (zend_ulong)(uintptr_t)to, p);
+
+    return p;
+}
+/* }}} */
+
+/* {{{ profiler_result_finish */
+void profiler_result_finish(const void *owner)
+{
+    profiler_pending *p = profiler_result_find(owner);
+
+    if (!p) {
+        return;
+    }
+
+    zend_hash_index_del(PROFILER_G(pending_results), (zend_ulong)(uintptr_t)owner);
+    profiler_log_record(&p->rec);
+    profiler_result_free(p);
+}
+/* }}} */
+
+#endif /* PHP_VERSION_ID >= 70000 */
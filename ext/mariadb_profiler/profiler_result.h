@@ -0,0 +1,61 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Result Tracking Header                      |
+  +----------------------------------------------------------------------+
+  | Holds a query's record back until its result set has been consumed   |
+  | so rows, bytes and fetch time land on the same log line (PHP 7.0+).  |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_RESULT_H
+#define PROFILER_RESULT_H
+
+#if PHP_VERSION_ID >= 70000
+
+struct _profiler_tmpl;
+
+/* What the owner pointer of a pending record refers to */
+#define PROFILER_OWNER_CONN 1 /* MYSQLND_CONN_DATA: result not yet retrieved */
+#define PROFILER_OWNER_RES  2 /* MYSQLND_RES: unbuffered result being read */
+#define PROFILER_OWNER_STMT 3 /* MYSQLND_STMT: statement result */
+
+typedef struct _profiler_pending {
+    profiler_record rec;            /* strings point at owned copies */
+    profiler_timer  timer;          /* rec.timer points here */
+    int             owner_type;
+    uint64_t        rx_start;       /* connection bytes received before the query */
+    uint64_t        fetch_start_ns; /* monotonic time the result was handed out */
+} profiler_pending;
+
+/* Called for each record still pending at request shutdown so the
+ * plugin can read whatever metrics its live owner can still provide. */
+typedef void (*profiler_result_collect_func)(const void *owner, profiler_pending *p);
+
+void profiler_result_request_init(void);
+void profiler_result_request_shutdown(profiler_result_collect_func collect);
+
+/*
+ * Park a record under owner, capturing the current tag and trace now.
+ * The query text is copied unless tmpl (a prepared statement's
+ * interned template, may be NULL) supplies it.
+ * A record already pending under the same owner is written out first.
+ * Returns NULL when no job is active (nothing will be logged).
+ */
+profiler_pending *profiler_result_begin(const void *owner, int owner_type,
+                                        const char *query, size_t query_len,
+                                        const struct _profiler_tmpl *tmpl,
+                                        const char *params_json,
+                                        const char *status,
+                                        const profiler_timer *timer);
+
+profiler_pending *profiler_result_find(const void *owner);
+
+/* Re-key a pending record (e.g. connection -> unbuffered result). */
+profiler_pending *profiler_result_move(const void *from, const void *to, int owner_type);
+
+/* Write the pending record of owner (if any) and forget it. */
+void profiler_result_finish(const void *owner);
+
+#endif /* PHP_VERSION_ID >= 70000 */
+
+#endif /* PROFILER_RESULT_H */
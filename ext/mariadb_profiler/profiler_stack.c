@@ -0,0 +1,98 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Stack Interning                             |
+  +----------------------------------------------------------------------+
+  | Remembers which stack (and statement template) definitions this      |
+  | process has already written to which job log. Open-addressing set of |
+  | 64-bit keys, one per (job file, kind, id), in persistent memory.     |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_stack.h"
+#include "profiler_fingerprint.h"
+
+/* Power of two; the set is cleared once half full */
+#define PROFILER_STACK_SLOTS 8192
+
+/* {{{ profiler_stack_key
+ * Mix the job file and kind into the id. 0 marks a free slot. */
+static uint64_t profiler_stack_key(const char *job_key, const char *ext, int kind, uint64_t id)
+{
+    unsigned char k = (unsigned char)kind;
+    uint64_t h;
+
+    h = profiler_fnv1a(PROFILER_FNV_OFFSET, job_key, strlen(job_key));
+    h = profiler_fnv1a(h, "/", 1);
+    h = profiler_fnv1a(h, ext, strlen(ext));
+    h = profiler_fnv1a(h, &k, 1);
+
+    h ^= id;
+    return h ? h : 1;
+}
+/* }}} */
+
+/* {{{ profiler_stack_first_use */
+int profiler_stack_first_use(const char *job_key, const char *ext, int kind, uint64_t id)
+{
+    uint64_t key = profiler_stack_key(job_key, ext, kind, id);
+    uint64_t *slots;
+    size_t i;
+    TSRMLS_FETCH();
+
+    slots = PROFILER_G(stacks_sent);
+    if (!slots) {
+        slots = (uint64_t *)pecalloc(PROFILER_STACK_SLOTS, sizeof(uint64_t), 1);
+        PROFILER_G(stacks_sent) = slots;
+        PROFILER_G(stacks_sent_used) = 0;
+        PROFILER_G(stacks_gen) = PROFILER_G(registry_gen);
+    }
+
+    if (PROFILER_G(stacks_gen) != PROFILER_G(registry_gen)
+        || PROFILER_G(stacks_sent_used) >= PROFILER_STACK_SLOTS / 2) {
+        memset(slots, 0, PROFILER_STACK_SLOTS * sizeof(uint64_t));
+        PROFILER_G(stacks_sent_used) = 0;
+        PROFILER_G(stacks_gen) = PROFILER_G(registry_gen);
+    }
+
+    i = (size_t)(key ^ (key >> 32)) & (PROFILER_STACK_SLOTS - 1);
+    while (slots[i]) {
+        if (slots[i] == key) {
+            return 0;
+        }
+        i = (i + 1) & (PROFILER_STACK_SLOTS - 1);
+    }
+
+    slots[i] = key;
+    PROFILER_G(stacks_sent_used)++;
+    return 1;
+}
+/* }}} */
+
+/* {{{ profiler_stack_forget */
+void profiler_stack_forget(void)
+{
+    TSRMLS_FETCH();
+
+    if (PROFILER_G(stacks_sent) && PROFILER_G(stacks_sent_used)) {
+        memset(PROFILER_G(stacks_sent), 0, PROFILER_STACK_SLOTS * sizeof(uint64_t));
+        PROFILER_G(stacks_sent_used) = 0;
+    }
+}
+/* }}} */
+
+/* {{{ profiler_stack_shutdown */
+void profiler_stack_shutdown(zend_mariadb_profiler_globals *g)
+{
+    if (g->stacks_sent) {
+        pefree(g->stacks_sent, 1);
+        g->stacks_sent = NULL;
+    }
+    g->stacks_sent_used = 0;
+}
+/* }}} */
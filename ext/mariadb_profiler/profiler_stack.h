@@ -0,0 +1,33 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Stack Interning Header                      |
+  +----------------------------------------------------------------------+
+  | With mariadb_profiler.intern_stacks on, a backtrace is written to a  |
+  | job's log once as a {"type":"stack"} definition and query records    |
+  | refer to it by id ("st"). The id is a digest of the frames, so every |
+  | worker process derives the same id for the same stack and readers    |
+  | can merge definitions from all of them.                              |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_STACK_H
+#define PROFILER_STACK_H
+
+/*
+ * Whether definition id of kind (PROFILER_ENCODE_STACK, or _TMPL for
+ * statement templates) still has to be written to job_key's log file
+ * with extension ext; it counts as written from then on. The set is
+ * kept per process across requests and starts over when the job
+ * registry changes (a job key may be reused after purge) or it fills up.
+ */
+int  profiler_stack_first_use(const char *job_key, const char *ext, int kind, uint64_t id);
+
+/* Forget every definition written so far, after a flush lost them */
+void profiler_stack_forget(void);
+
+struct _zend_mariadb_profiler_globals;
+
+/* Release g's set (module/thread shutdown) */
+void profiler_stack_shutdown(struct _zend_mariadb_profiler_globals *g);
+
+#endif /* PROFILER_STACK_H */
@@ -0,0 +1,197 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - In-Request Stats                            |
+  +----------------------------------------------------------------------+
+  | Statement count, errors and DB time of the running request, in total |
+  | and per context tag. Kept by the mysqlnd hooks whether or not a job  |
+  | captures the request; nothing is written to the log.                 |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_stats.h"
+
+#if PHP_VERSION_ID >= 70000
+# define PROFILER_STATS_NEW_ARRAY(name) zval name##_zv; zval *name = &name##_zv
+#else
+# define PROFILER_STATS_NEW_ARRAY(name) zval *name; MAKE_STD_ZVAL(name)
+#endif
+
+/* {{{ profiler_stats_clear */
+static void profiler_stats_clear(profiler_stats *stats)
+{
+    int i;
+
+    for (i = 0; i < stats->tag_count; i++) {
+        efree(stats->tags[i].tag);
+    }
+    if (stats->tags) {
+        efree(stats->tags);
+    }
+    memset(stats, 0, sizeof(*stats));
+}
+/* }}} */
+
+/* {{{ profiler_stats_request_init */
+void profiler_stats_request_init(void)
+{
+    TSRMLS_FETCH();
+
+    memset(&PROFILER_G(stats), 0, sizeof(profiler_stats));
+    PROFILER_G(stats).since = profiler_clock_wall();
+}
+/* }}} */
+
+/* {{{ profiler_stats_request_shutdown */
+void profiler_stats_request_shutdown(void)
+{
+    TSRMLS_FETCH();
+
+    profiler_stats_clear(&PROFILER_G(stats));
+}
+/* }}} */
+
+/* {{{ profiler_stats_count */
+static void profiler_stats_count(profiler_stats_counts *c, int ok, const profiler_timer *timer)
+{
+    c->queries++;
+    if (!ok) {
+        c->errors++;
+    }
+    if (timer) {
+        c->sum_us += timer->dur_us;
+        if (timer->dur_us > c->max_us) {
+            c->max_us = timer->dur_us;
+        }
+    }
+}
+/* }}} */
+
+/* {{{ profiler_stats_tag_entry
+ * Entry of tag, added if there is room; NULL once the breakdown is full. */
+static profiler_stats_tag *profiler_stats_tag_entry(profiler_stats *stats, const char *tag)
+{
+    int i;
+
+    /* Most statements run under the tag of the one before */
+    if (stats->tag_count && strcmp(stats->tags[stats->tag_last].tag, tag) == 0) {
+        return &stats->tags[stats->tag_last];
+    }
+    for (i = 0; i < stats->tag_count; i++) {
+        if (strcmp(stats->tags[i].tag, tag) == 0) {
+            stats->tag_last = i;
+            return &stats->tags[i];
+        }
+    }
+    if (stats->tag_count >= PROFILER_STATS_MAX_TAGS) {
+        return NULL;
+    }
+    if (!stats->tags) {
+        stats->tags = (profiler_stats_tag *)emalloc(
+            PROFILER_STATS_MAX_TAGS * sizeof(profiler_stats_tag));
+    }
+    i = stats->tag_count++;
+    stats->tags[i].tag = estrdup(tag);
+    memset(&stats->tags[i].counts, 0, sizeof(profiler_stats_counts));
+    stats->tag_last = i;
+    return &stats->tags[i];
+}
+/* }}} */
+
+/* {{{ profiler_stats_statement */
+void profiler_stats_statement(int ok, const profiler_timer *timer)
+{
+    profiler_stats *stats;
+    profiler_stats_tag *entry;
+    const char *tag;
+    TSRMLS_FETCH();
+
+    /* Hooks run after RSHUTDOWN must not start a new breakdown */
+    if (!PROFILER_G(in_request)) {
+        return;
+    }
+    stats = &PROFILER_G(stats);
+    profiler_stats_count(&stats->total, ok, timer);
+
+    tag = profiler_tag_current();
+    if (tag && (entry = profiler_stats_tag_entry(stats, tag)) != NULL) {
+        profiler_stats_count(&entry->counts, ok, timer);
+    }
+}
+/* }}} */
+
+/* {{{ profiler_stats_add_counts */
+static void profiler_stats_add_counts(zval *arr, const profiler_stats_counts *c)
+{
+    add_assoc_long(arr, "queries", (zend_long)c->queries);
+    add_assoc_long(arr, "errors", (zend_long)c->errors);
+    add_assoc_long(arr, "db_time_us", (zend_long)c->sum_us);
+    add_assoc_long(arr, "max_us", (zend_long)c->max_us);
+}
+/* }}} */
+
+/* {{{ proto array|false mariadb_profiler_stats()
+ * Statements run by this request so far (since the last reset): count,
+ * failures, total and slowest time in microseconds, the wall clock the
+ * count started at, and the same counts per innermost context tag.
+ * Returns false if the profiler is disabled. */
+PHP_FUNCTION(mariadb_profiler_stats)
+{
+    const profiler_stats *stats;
+    int i;
+    TSRMLS_FETCH();
+
+#if PHP_VERSION_ID >= 70000
+    ZEND_PARSE_PARAMETERS_NONE();
+#endif
+
+    if (!PROFILER_G(enabled)) {
+        RETURN_FALSE;
+    }
+
+    stats = &PROFILER_G(stats);
+    array_init(return_value);
+    profiler_stats_add_counts(return_value, &stats->total);
+    add_assoc_double(return_value, "since", stats->since);
+    {
+        PROFILER_STATS_NEW_ARRAY(tags);
+
+        array_init(tags);
+        for (i = 0; i < stats->tag_count; i++) {
+            PROFILER_STATS_NEW_ARRAY(entry);
+
+            array_init(entry);
+            profiler_stats_add_counts(entry, &stats->tags[i].counts);
+            add_assoc_zval(tags, stats->tags[i].tag, entry);
+        }
+        add_assoc_zval(return_value, "tags", tags);
+    }
+}
+/* }}} */
+
+/* {{{ proto bool mariadb_profiler_reset_stats()
+ * Start this request's stats over, e.g. per unit of work in a worker
+ * that serves many of them in one request. Returns false if the
+ * profiler is disabled. */
+PHP_FUNCTION(mariadb_profiler_reset_stats)
+{
+    TSRMLS_FETCH();
+
+#if PHP_VERSION_ID >= 70000
+    ZEND_PARSE_PARAMETERS_NONE();
+#endif
+
+    if (!PROFILER_G(enabled)) {
+        RETURN_FALSE;
+    }
+
+    profiler_stats_clear(&PROFILER_G(stats));
+    PROFILER_G(stats).since = profiler_clock_wall();
+    RETURN_TRUE;
+}
+/* }}} */
@@ -0,0 +1,45 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - In-Request Stats Header                     |
+  +----------------------------------------------------------------------+
+  | Statement counters kept for every request, job or not, and read by   |
+  | the application with mariadb_profiler_stats().                       |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_STATS_H
+#define PROFILER_STATS_H
+
+/* Distinct context tags broken down per request */
+#define PROFILER_STATS_MAX_TAGS 64
+
+typedef struct _profiler_stats_counts {
+    uint64_t queries;
+    uint64_t errors;
+    uint64_t sum_us;        /* total statement time */
+    uint64_t max_us;        /* slowest statement */
+} profiler_stats_counts;
+
+typedef struct _profiler_stats_tag {
+    char                 *tag;
+    profiler_stats_counts counts;
+} profiler_stats_tag;
+
+typedef struct _profiler_stats {
+    double                since;     /* wall clock at RINIT or the last reset */
+    profiler_stats_counts total;
+    profiler_stats_tag   *tags;      /* innermost tag of each statement, NULL until needed */
+    int                   tag_count;
+    int                   tag_last;  /* entry hit by the previous tagged statement */
+} profiler_stats;
+
+/* Start counting from zero (RINIT) */
+void profiler_stats_request_init(void);
+
+/* Free the tag breakdown (RSHUTDOWN) */
+void profiler_stats_request_shutdown(void);
+
+/* Count one statement that has run, logged or not */
+void profiler_stats_statement(int ok, const profiler_timer *timer);
+
+#endif /* PROFILER_STATS_H */
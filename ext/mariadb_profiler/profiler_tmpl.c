@@ -0,0 +1,102 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Statement Template Dictionary               |
+  +----------------------------------------------------------------------+
+  | Open-addressing table of prepared statement templates keyed by a     |
+  | 64-bit digest of the text, in persistent memory. Each template is    |
+  | copied and fingerprinted once per process instead of at every        |
+  | prepare and execute.                                                 |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_tmpl.h"
+#include "profiler_fingerprint.h"
+
+/* Power of two; no new templates once half full or over the byte cap */
+#define PROFILER_TMPL_SLOTS     4096
+#define PROFILER_TMPL_MAX_BYTES (4 * 1024 * 1024)
+
+/* {{{ profiler_tmpl_digest
+ * FNV-1a of the template text. 0 marks a free slot. */
+static uint64_t profiler_tmpl_digest(const char *query, size_t query_len)
+{
+    uint64_t h = profiler_fnv1a(PROFILER_FNV_OFFSET, query, query_len);
+
+    return h ? h : 1;
+}
+/* }}} */
+
+/* {{{ profiler_tmpl_intern */
+const profiler_tmpl *profiler_tmpl_intern(const char *query, size_t query_len)
+{
+    uint64_t id = profiler_tmpl_digest(query, query_len);
+    profiler_tmpl *slots;
+    profiler_tmpl *t;
+    size_t i;
+    TSRMLS_FETCH();
+
+    slots = PROFILER_G(tmpls);
+    if (!slots) {
+        slots = (profiler_tmpl *)pecalloc(PROFILER_TMPL_SLOTS, sizeof(profiler_tmpl), 1);
+        PROFILER_G(tmpls) = slots;
+        PROFILER_G(tmpls_used) = 0;
+        PROFILER_G(tmpls_bytes) = 0;
+    }
+
+    i = (size_t)(id ^ (id >> 32)) & (PROFILER_TMPL_SLOTS - 1);
+    while (slots[i].id) {
+        if (slots[i].id == id) {
+            t = &slots[i];
+            if (t->query_len == query_len && memcmp(t->query, query, query_len) == 0) {
+                return t;
+            }
+            return NULL; /* another text with the same digest */
+        }
+        i = (i + 1) & (PROFILER_TMPL_SLOTS - 1);
+    }
+
+    if (PROFILER_G(tmpls_used) >= PROFILER_TMPL_SLOTS / 2
+        || PROFILER_G(tmpls_bytes) + query_len > PROFILER_TMPL_MAX_BYTES) {
+        return NULL;
+    }
+
+    t = &slots[i];
+    t->query = (char *)pemalloc(query_len + 1, 1);
+    memcpy(t->query, query, query_len);
+    t->query[query_len] = '\0';
+    t->query_len = query_len;
+    t->fp = profiler_fingerprint(query, query_len, NULL);
+    t->id = id;
+    PROFILER_G(tmpls_used)++;
+    PROFILER_G(tmpls_bytes) += query_len;
+
+    return t;
+}
+/* }}} */
+
+/* {{{ profiler_tmpl_shutdown */
+void profiler_tmpl_shutdown(zend_mariadb_profiler_globals *g)
+{
+    profiler_tmpl *slots = g->tmpls;
+    size_t i;
+
+    if (!slots) {
+        return;
+    }
+    for (i = 0; i < PROFILER_TMPL_SLOTS; i++) {
+        if (slots[i].id) {
+            pefree(slots[i].query, 1);
+        }
+    }
+    pefree(slots, 1);
+    g->tmpls = NULL;
+    g->tmpls_used = 0;
+    g->tmpls_bytes = 0;
+}
+/* }}} */
@@ -0,0 +1,35 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Statement Template Dictionary Header        |
+  +----------------------------------------------------------------------+
+  | Prepared statement templates are interned once per process. Each     |
+  | execute refers to its template, and with intern_statements on the    |
+  | text is written to a job's log once as a {"type":"stmt"} definition; |
+  | executes carry only its id ("sid"), expanded again by the readers.   |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_TMPL_H
+#define PROFILER_TMPL_H
+
+typedef struct _profiler_tmpl {
+    uint64_t  id;        /* digest of the text, the same in every process */
+    uint64_t  fp;        /* profiler_fingerprint() of the text */
+    size_t    query_len;
+    char     *query;     /* persistent, NUL-terminated */
+} profiler_tmpl;
+
+/*
+ * Template for query, added on first sight. Entries live until
+ * module/thread shutdown, so the pointer may be kept across requests.
+ * Returns NULL when the dictionary is full (or on a digest collision);
+ * the caller then keeps its own copy of the text as before.
+ */
+const profiler_tmpl *profiler_tmpl_intern(const char *query, size_t query_len);
+
+struct _zend_mariadb_profiler_globals;
+
+/* Release g's dictionary (module/thread shutdown) */
+void profiler_tmpl_shutdown(struct _zend_mariadb_profiler_globals *g);
+
+#endif /* PROFILER_TMPL_H */
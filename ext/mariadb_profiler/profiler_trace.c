@@ -2,8 +2,11 @@
   +----------------------------------------------------------------------+
   | MariaDB Query Profiler - Trace Capture Implementation                |
   +----------------------------------------------------------------------+
-  | Uses zend_fetch_debug_backtrace to capture the PHP call stack and    |
-  | format it as a JSON array for inclusion in query logs.               |
+  | Walks EG(current_execute_data) and reads function, class, file and   |
+  | line straight from the engine's frames into a reused frame array:    |
+  | no backtrace zvals, hash lookups or string copies. The log encoders  |
+  | format the frames (JSON or raw text).                                |
+  | PHP 5.x falls back to zend_fetch_debug_backtrace.                    |
   | Compatible with PHP 5.3 - 8.4+                                      |
   +----------------------------------------------------------------------+
 */
@@ -16,58 +19,77 @@
 #include "zend_builtin_functions.h"
 #include "php_mariadb_profiler.h"
 #include "profiler_trace.h"
-#include "profiler_log.h"
+#include "profiler_json.h"
+#include "profiler_fingerprint.h"
 
 #include <string.h>
 
-/* {{{ profiler_trace_append_frame
- * Append a single trace frame as JSON object to the buffer.
- * Returns the new position in the buffer (unchanged if buffer is full). */
-static int profiler_trace_append_frame(
-    char *buf, int pos, int buf_size,
-    const char *call, const char *file, long line, int is_first)
+/* {{{ profiler_trace_begin
+ * Reset the scratch trace, sizing its frame array on first use.
+ * trace_depth is PHP_INI_SYSTEM, so the array is kept for the life of
+ * the process (thread under ZTS). */
+static profiler_trace *profiler_trace_begin(int depth)
 {
-    char *escaped_call = NULL;
-    char *escaped_file = NULL;
-    int written;
+    profiler_trace *trace;
+    TSRMLS_FETCH();
 
-    if (call) {
-        escaped_call = profiler_log_escape_json_string(call, strlen(call));
-    }
-    if (file) {
-        escaped_file = profiler_log_escape_json_string(file, strlen(file));
+    trace = &PROFILER_G(trace);
+
+    if (trace->cap < depth) {
+        trace->frames = (profiler_frame *)perealloc(trace->frames,
+            depth * sizeof(profiler_frame), 1);
+        trace->cap = depth;
     }
+    trace->count = 0;
+    return trace;
+}
+/* }}} */
 
-    written = snprintf(buf + pos, buf_size - pos,
-        "%s{\"call\":\"%s\",\"file\":\"%s\",\"line\":%ld}",
-        is_first ? "" : ",",
-        escaped_call ? escaped_call : "",
-        escaped_file ? escaped_file : "",
-        line);
+#if PHP_VERSION_ID >= 70000
+/* ---- PHP 7.0+ implementation ---- */
 
-    if (escaped_call) efree(escaped_call);
-    if (escaped_file) efree(escaped_file);
+/* {{{ profiler_trace_caller
+ * The user code frame that made the call running in ex, or NULL when
+ * it was called from internal code (callbacks, magic methods).
+ * zend_call_function() may push a dummy frame without func in between. */
+static const zend_execute_data *profiler_trace_caller(const zend_execute_data *ex)
+{
+    const zend_execute_data *prev = ex->prev_execute_data;
 
-    if (written < 0 || pos + written >= buf_size - 1) {
-        return pos; /* buffer full, stop */
+    while (prev && !prev->func) {
+        prev = prev->prev_execute_data;
+    }
+    if (prev && ZEND_USER_CODE(prev->func->common.type) && prev->opline) {
+        return prev;
     }
-    return pos + written;
+    return NULL;
 }
 /* }}} */
 
-#if PHP_VERSION_ID >= 70000
-/* ---- PHP 7.0+ implementation ---- */
+/* {{{ profiler_trace_include_name
+ * Frame name for a file being included or eval'd, like debug_backtrace() */
+static const char *profiler_trace_include_name(const zend_op *opline)
+{
+    switch (opline->extended_value) {
+        case ZEND_EVAL:         return "eval";
+        case ZEND_INCLUDE:      return "include";
+        case ZEND_INCLUDE_ONCE: return "include_once";
+        case ZEND_REQUIRE:      return "require";
+        case ZEND_REQUIRE_ONCE: return "require_once";
+        default:                return NULL;
+    }
+}
+/* }}} */
 
-/* {{{ profiler_trace_capture_json */
-char *profiler_trace_capture_json(void)
+/* {{{ profiler_trace_capture
+ * Same frames as debug_backtrace(DEBUG_BACKTRACE_IGNORE_ARGS): each
+ * names the function called and the file/line it was called from. The
+ * main script's own frame has no caller and is not a frame. */
+const profiler_trace *profiler_trace_capture(void)
 {
-    zval trace;
-    zval *frame;
+    profiler_trace *trace;
+    const zend_execute_data *ex;
     int depth;
-    char buf[8192];
-    int pos = 0;
-    int is_first = 1;
-    char *result;
     TSRMLS_FETCH();
 
     depth = (int)PROFILER_G(trace_depth);
@@ -75,84 +97,92 @@ char *profiler_trace_capture_json(void)
         return NULL;
     }
 
-    PROFILER_FETCH_TRACE(&trace, 0, DEBUG_BACKTRACE_IGNORE_ARGS, depth);
-
-    if (Z_TYPE(trace) != IS_ARRAY) {
-        zval_ptr_dtor(&trace);
-        return NULL;
-    }
+    trace = profiler_trace_begin(depth);
 
-    pos += snprintf(buf + pos, sizeof(buf) - pos, "[");
+    for (ex = EG(current_execute_data); ex && trace->count < depth;
+         ex = ex->prev_execute_data) {
+        const zend_function *func = ex->func;
+        const zend_execute_data *caller;
+        profiler_frame *f;
 
-    ZEND_HASH_FOREACH_VAL(Z_ARRVAL(trace), frame) {
-        zval *zfile, *zline, *zfunc, *zclass, *ztype;
-        const char *file_str = "";
-        long line_val = 0;
-        char call_buf[512];
-        int prev_pos;
-
-        if (Z_TYPE_P(frame) != IS_ARRAY) continue;
-
-        zfile  = zend_hash_str_find(Z_ARRVAL_P(frame), "file", sizeof("file") - 1);
-        zline  = zend_hash_str_find(Z_ARRVAL_P(frame), "line", sizeof("line") - 1);
-        zfunc  = zend_hash_str_find(Z_ARRVAL_P(frame), "function", sizeof("function") - 1);
-        zclass = zend_hash_str_find(Z_ARRVAL_P(frame), "class", sizeof("class") - 1);
-        ztype  = zend_hash_str_find(Z_ARRVAL_P(frame), "type", sizeof("type") - 1);
-
-        if (zfile && Z_TYPE_P(zfile) == IS_STRING) {
-            file_str = Z_STRVAL_P(zfile);
+        if (!func) {
+            continue;
         }
-        if (zline && Z_TYPE_P(zline) == IS_LONG) {
-            line_val = Z_LVAL_P(zline);
-        }
-
-        /* Build "call" string: "Class->method" or "function" */
-        if (zclass && Z_TYPE_P(zclass) == IS_STRING
-            && ztype && Z_TYPE_P(ztype) == IS_STRING
-            && zfunc && Z_TYPE_P(zfunc) == IS_STRING) {
-            snprintf(call_buf, sizeof(call_buf), "%s%s%s",
-                Z_STRVAL_P(zclass), Z_STRVAL_P(ztype), Z_STRVAL_P(zfunc));
-        } else if (zfunc && Z_TYPE_P(zfunc) == IS_STRING) {
-            snprintf(call_buf, sizeof(call_buf), "%s", Z_STRVAL_P(zfunc));
+        caller = profiler_trace_caller(ex);
+        f = &trace->frames[trace->count];
+        memset(f, 0, sizeof(*f));
+
+        if (func->common.function_name) {
+            const zend_object *obj = PROFILER_EX_OBJ(ex);
+            const zend_class_entry *scope = func->common.scope
+                ? func->common.scope : (obj ? obj->ce : NULL);
+
+            f->func = ZSTR_VAL(func->common.function_name);
+            f->func_len = ZSTR_LEN(func->common.function_name);
+            if (scope) {
+                f->cls = ZSTR_VAL(scope->name);
+                f->cls_len = ZSTR_LEN(scope->name);
+                f->call_type = obj ? "->" : "::";
+            }
         } else {
-            snprintf(call_buf, sizeof(call_buf), "(unknown)");
+            /* Top-level code of an included or eval'd file */
+            if (!caller || caller->opline->opcode != ZEND_INCLUDE_OR_EVAL
+                || !(f->func = profiler_trace_include_name(caller->opline))) {
+                continue;
+            }
+            f->func_len = strlen(f->func);
         }
 
-        prev_pos = pos;
-        pos = profiler_trace_append_frame(buf, pos, sizeof(buf),
-            call_buf, file_str, line_val, is_first);
-        if (pos != prev_pos) {
-            is_first = 0;
+        if (caller) {
+            f->file = ZSTR_VAL(caller->func->op_array.filename);
+            f->file_len = ZSTR_LEN(caller->func->op_array.filename);
+            f->line = (long)caller->opline->lineno;
+        } else {
+            f->file = "";
         }
+        trace->count++;
+    }
 
-        /* Stop if buffer is nearly full */
-        if (pos >= (int)sizeof(buf) - 256) break;
-
-    } ZEND_HASH_FOREACH_END();
+    return trace;
+}
+/* }}} */
 
-    pos += snprintf(buf + pos, sizeof(buf) - pos, "]");
-    buf[sizeof(buf) - 1] = '\0';
+/* {{{ profiler_trace_request_shutdown */
+void profiler_trace_request_shutdown(void)
+{
+    TSRMLS_FETCH();
 
-    result = estrndup(buf, pos);
-    zval_ptr_dtor(&trace);
-    return result;
+    /* Frames only point into the engine; nothing request-bound to free */
+    PROFILER_G(trace).count = 0;
 }
 /* }}} */
 
 #else
 /* ---- PHP 5.x implementation ---- */
 
-/* {{{ profiler_trace_capture_json (PHP 5.x) */
-char *profiler_trace_capture_json(void)
+/* {{{ profiler_trace_str (PHP 5.x)
+ * String value of key in a frame array, or NULL. */
+static zval *profiler_trace_str(zval *frame, const char *key, size_t key_size)
 {
-    zval trace;
+    zval **zv = NULL;
+
+    if (zend_hash_find(Z_ARRVAL_P(frame), key, key_size, (void **)&zv) == SUCCESS
+        && Z_TYPE_PP(zv) == IS_STRING) {
+        return *zv;
+    }
+    return NULL;
+}
+/* }}} */
+
+/* {{{ profiler_trace_capture (PHP 5.x)
+ * The frames point into a debug_backtrace array that is kept until the
+ * next capture or the end of the request. */
+const profiler_trace *profiler_trace_capture(void)
+{
+    profiler_trace *trace;
     HashPosition hpos;
     zval **frame;
     int depth;
-    char buf[8192];
-    int pos = 0;
-    int is_first = 1;
-    char *result;
     TSRMLS_FETCH();
 
     depth = (int)PROFILER_G(trace_depth);
@@ -160,70 +190,211 @@ char *profiler_trace_capture_json(void)
         return NULL;
     }
 
-    INIT_ZVAL(trace);
-    PROFILER_FETCH_TRACE(&trace, 0, DEBUG_BACKTRACE_IGNORE_ARGS, depth);
+    profiler_trace_request_shutdown();
+    trace = profiler_trace_begin(depth);
+    INIT_ZVAL(trace->source);
+    PROFILER_FETCH_TRACE(&trace->source, 0, DEBUG_BACKTRACE_IGNORE_ARGS, depth);
 
-    if (Z_TYPE(trace) != IS_ARRAY) {
-        zval_dtor(&trace);
+    if (Z_TYPE(trace->source) != IS_ARRAY) {
+        profiler_trace_request_shutdown();
         return NULL;
     }
 
-    pos += snprintf(buf + pos, sizeof(buf) - pos, "[");
-
-    for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL(trace), &hpos);
-         zend_hash_get_current_data_ex(Z_ARRVAL(trace), (void **)&frame, &hpos) == SUCCESS;
-         zend_hash_move_forward_ex(Z_ARRVAL(trace), &hpos))
+    for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL(trace->source), &hpos);
+         zend_hash_get_current_data_ex(Z_ARRVAL(trace->source), (void **)&frame, &hpos) == SUCCESS;
+         zend_hash_move_forward_ex(Z_ARRVAL(trace->source), &hpos))
     {
-        zval **zfile = NULL, **zline = NULL, **zfunc = NULL, **zclass = NULL, **ztype = NULL;
-        const char *file_str = "";
-        long line_val = 0;
-        char call_buf[512];
-        int prev_pos;
+        profiler_frame *f;
+        zval **zline = NULL;
+        zval *zfile, *zfunc, *zclass, *ztype;
 
         if (Z_TYPE_PP(frame) != IS_ARRAY) continue;
+        if (trace->count >= depth) break;
+
+        f = &trace->frames[trace->count++];
+        memset(f, 0, sizeof(*f));
+        f->file = "";
 
-        zend_hash_find(Z_ARRVAL_PP(frame), "file", sizeof("file"), (void **)&zfile);
+        zfile  = profiler_trace_str(*frame, "file", sizeof("file"));
+        zfunc  = profiler_trace_str(*frame, "function", sizeof("function"));
+        zclass = profiler_trace_str(*frame, "class", sizeof("class"));
+        ztype  = profiler_trace_str(*frame, "type", sizeof("type"));
         zend_hash_find(Z_ARRVAL_PP(frame), "line", sizeof("line"), (void **)&zline);
-        zend_hash_find(Z_ARRVAL_PP(frame), "function", sizeof("function"), (void **)&zfunc);
-        zend_hash_find(Z_ARRVAL_PP(frame), "class", sizeof("class"), (void **)&zclass);
-        zend_hash_find(Z_ARRVAL_PP(frame), "type", sizeof("type"), (void **)&ztype);
 
-        if (zfile && Z_TYPE_PP(zfile) == IS_STRING) {
-            file_str = Z_STRVAL_PP(zfile);
+        if (zfile) {
+            f->file = Z_STRVAL_P(zfile);
+            f->file_len = Z_STRLEN_P(zfile);
         }
         if (zline && Z_TYPE_PP(zline) == IS_LONG) {
-            line_val = Z_LVAL_PP(zline);
+            f->line = Z_LVAL_PP(zline);
         }
-
-        /* Build "call" string */
-        if (zclass && Z_TYPE_PP(zclass) == IS_STRING
-            && ztype && Z_TYPE_PP(ztype) == IS_STRING
-            && zfunc && Z_TYPE_PP(zfunc) == IS_STRING) {
-            snprintf(call_buf, sizeof(call_buf), "%s%s%s",
-                Z_STRVAL_PP(zclass), Z_STRVAL_PP(ztype), Z_STRVAL_PP(zfunc));
-        } else if (zfunc && Z_TYPE_PP(zfunc) == IS_STRING) {
-            snprintf(call_buf, sizeof(call_buf), "%s", Z_STRVAL_PP(zfunc));
-        } else {
-            snprintf(call_buf, sizeof(call_buf), "(unknown)");
+        if (zfunc) {
+            f->func = Z_STRVAL_P(zfunc);
+            f->func_len = Z_STRLEN_P(zfunc);
+            if (zclass && ztype) {
+                f->cls = Z_STRVAL_P(zclass);
+                f->cls_len = Z_STRLEN_P(zclass);
+                f->call_type = Z_STRVAL_P(ztype)[0] == '-' ? "->" : "::";
+            }
         }
+    }
+
+    return trace;
+}
+/* }}} */
+
+/* {{{ profiler_trace_request_shutdown (PHP 5.x) */
+void profiler_trace_request_shutdown(void)
+{
+    profiler_trace *trace;
+    TSRMLS_FETCH();
+
+    trace = &PROFILER_G(trace);
+    if (Z_TYPE(trace->source) == IS_ARRAY) {
+        zval_dtor(&trace->source);
+        INIT_ZVAL(trace->source);
+    }
+    trace->count = 0;
+}
+/* }}} */
+
+#endif /* PHP_VERSION_ID >= 70000 */
+
+/* {{{ profiler_trace_shutdown */
+void profiler_trace_shutdown(zend_mariadb_profiler_globals *g)
+{
+    profiler_trace *trace = &g->trace;
 
-        prev_pos = pos;
-        pos = profiler_trace_append_frame(buf, pos, sizeof(buf),
-            call_buf, file_str, line_val, is_first);
-        if (pos != prev_pos) {
-            is_first = 0;
+    if (trace->frames) {
+        pefree(trace->frames, 1);
+        trace->frames = NULL;
+    }
+    trace->cap = 0;
+    trace->count = 0;
+}
+/* }}} */
+
+/* {{{ profiler_trace_copy */
+profiler_trace *profiler_trace_copy(const profiler_trace *trace)
+{
+    size_t size = sizeof(profiler_trace) + trace->count * sizeof(profiler_frame);
+    profiler_trace *copy;
+    char *p;
+    int i;
+
+    for (i = 0; i < trace->count; i++) {
+        size += trace->frames[i].cls_len + trace->frames[i].func_len
+            + trace->frames[i].file_len;
+    }
+
+    copy = (profiler_trace *)emalloc(size);
+    memset(copy, 0, sizeof(profiler_trace));
+    copy->frames = (profiler_frame *)(copy + 1);
+    copy->count = copy->cap = trace->count;
+    p = (char *)(copy->frames + trace->count);
+
+    for (i = 0; i < trace->count; i++) {
+        const profiler_frame *src = &trace->frames[i];
+        profiler_frame *dst = &copy->frames[i];
+
+        *dst = *src;
+        if (src->cls) {
+            memcpy(p, src->cls, src->cls_len);
+            dst->cls = p;
+            p += src->cls_len;
+        }
+        if (src->func) {
+            memcpy(p, src->func, src->func_len);
+            dst->func = p;
+            p += src->func_len;
         }
+        memcpy(p, src->file, src->file_len);
+        dst->file = p;
+        p += src->file_len;
+    }
 
-        if (pos >= (int)sizeof(buf) - 256) break;
+    return copy;
+}
+/* }}} */
+
+/* {{{ profiler_trace_free */
+void profiler_trace_free(profiler_trace *copy)
+{
+    if (copy) {
+        efree(copy);
     }
+}
+/* }}} */
+
+/* {{{ profiler_trace_id
+ * FNV-1a per frame over class, call type, function, file and line;
+ * the frame hashes are folded in order. */
+uint64_t profiler_trace_id(const profiler_trace *trace)
+{
+    uint64_t id = PROFILER_FNV_OFFSET;
+    int i;
 
-    pos += snprintf(buf + pos, sizeof(buf) - pos, "]");
-    buf[sizeof(buf) - 1] = '\0';
+    for (i = 0; i < trace->count; i++) {
+        const profiler_frame *f = &trace->frames[i];
+        uint64_t h = PROFILER_FNV_OFFSET;
+        char line[24];
+
+        if (f->cls) {
+            h = profiler_fnv1a(h, f->cls, f->cls_len);
+            h = profiler_fnv1a(h, f->call_type, 2);
+        }
+        if (f->func) {
+            h = profiler_fnv1a(h, f->func, f->func_len);
+        }
+        h = profiler_fnv1a(h, "\0", 1);
+        h = profiler_fnv1a(h, f->file, f->file_len);
+        h = profiler_fnv1a(h, line, (size_t)snprintf(line, sizeof(line), ":%ld", f->line));
 
-    result = estrndup(buf, pos);
-    zval_dtor(&trace);
-    return result;
+        id = (id ^ h) * PROFILER_FNV_PRIME;
+        id ^= id >> 29;
+    }
+    return id;
 }
 /* }}} */
 
-#endif /* PHP_VERSION_ID >= 70000 */
+/* {{{ profiler_trace_append_call */
+void profiler_trace_append_call(profiler_buf *out, const profiler_frame *frame)
+{
+    if (!frame->func) {
+        profiler_buf_append(out, "(unknown)", sizeof("(unknown)") - 1);
+        return;
+    }
+    if (frame->cls) {
+        profiler_buf_append(out, frame->cls, frame->cls_len);
+        profiler_buf_appends(out, frame->call_type);
+    }
+    profiler_buf_append(out, frame->func, frame->func_len);
+}
+/* }}} */
+
+/* {{{ profiler_trace_append_json */
+void profiler_trace_append_json(profiler_buf *out, const profiler_trace *trace)
+{
+    int i;
+
+    profiler_buf_appendc(out, '[');
+    for (i = 0; i < trace->count; i++) {
+        const profiler_frame *f = &trace->frames[i];
+
+        profiler_buf_appends(out, i ? ",{\"call\":\"" : "{\"call\":\"");
+        if (f->cls) {
+            profiler_buf_append_json(out, f->cls, f->cls_len);
+            profiler_buf_append_json(out, f->call_type, strlen(f->call_type));
+        }
+        if (f->func) {
+            profiler_buf_append_json(out, f->func, f->func_len);
+        } else {
+            profiler_buf_append(out, "(unknown)", sizeof("(unknown)") - 1);
+        }
+        profiler_buf_appends(out, "\",\"file\":");
+        profiler_buf_append_json_quoted(out, f->file, f->file_len);
+        profiler_buf_appendf(out, ",\"line\":%ld}", f->line);
+    }
+    profiler_buf_appendc(out, ']');
+}
+/* }}} */
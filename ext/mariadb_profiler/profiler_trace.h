@@ -9,15 +9,62 @@
 #ifndef PROFILER_TRACE_H
 #define PROFILER_TRACE_H
 
+#include "profiler_buf.h"
+
+/* One stack frame. Strings are not NUL-terminated: they point at the
+ * engine's function, class and file names and use the _len fields. */
+typedef struct _profiler_frame {
+    const char *cls;       /* NULL for plain functions */
+    size_t      cls_len;
+    const char *call_type; /* "->" or "::", valid when cls is set */
+    const char *func;      /* NULL when the frame has no function */
+    size_t      func_len;
+    const char *file;      /* "" when unknown */
+    size_t      file_len;
+    long        line;
+} profiler_frame;
+
+typedef struct _profiler_trace {
+    profiler_frame *frames;
+    int             count;
+    int             cap;
+#if PHP_VERSION_ID < 70000
+    zval            source; /* backtrace array the frame strings live in */
+#endif
+} profiler_trace;
+
 /*
- * Capture the current PHP backtrace and return it as a JSON array string.
+ * Capture the current PHP call stack (up to trace_depth frames).
  *
- * Returns NULL if trace_depth is 0 (disabled) or capture fails.
- * Caller must efree() the returned string.
- *
- * Output format:
+ * Returns NULL if trace_depth is 0 (disabled) or capture fails. The
+ * result is scratch space reused by the next capture and its strings
+ * point into engine memory, so a record that outlives the current
+ * hook has to keep a profiler_trace_copy() instead.
+ */
+const profiler_trace *profiler_trace_capture(void);
+
+/* Self-contained copy in a single emalloc block; profiler_trace_free() it */
+profiler_trace *profiler_trace_copy(const profiler_trace *trace);
+void profiler_trace_free(profiler_trace *copy);
+
+struct _zend_mariadb_profiler_globals;
+
+/* Release request-bound capture state / the frame array of g */
+void profiler_trace_request_shutdown(void);
+void profiler_trace_shutdown(struct _zend_mariadb_profiler_globals *g);
+
+/* Digest of the frames' (call, file, line): the stack id used for
+ * interning (profiler_stack.h). Equal stacks give equal ids in every
+ * process. */
+uint64_t profiler_trace_id(const profiler_trace *trace);
+
+/* "ClassName->method", "function" or "(unknown)" */
+void profiler_trace_append_call(profiler_buf *out, const profiler_frame *frame);
+
+/*
+ * Append the trace as a JSON array:
  *   [{"call":"ClassName->method","file":"/path/to/file.php","line":42}, ...]
  */
-char *profiler_trace_capture_json(void);
+void profiler_trace_append_json(profiler_buf *out, const profiler_trace *trace);
 
 #endif /* PROFILER_TRACE_H */
@@ -0,0 +1,82 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Request Trigger                             |
+  +----------------------------------------------------------------------+
+  | Reads the trigger value from the request's superglobals. Only called |
+  | from RINIT while some active job declares a trigger, so $_SERVER is  |
+  | not materialized for requests that have nothing to match.            |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_trigger.h"
+
+/* {{{ profiler_trigger_lookup
+ * String value of name in superglobal track (TRACK_VARS_*), or NULL. */
+static const char *profiler_trigger_lookup(int track, const char *name, size_t name_len)
+{
+#if PHP_VERSION_ID >= 70000
+    zval *arr = &PG(http_globals)[track];
+    zval *v;
+
+    if (Z_TYPE_P(arr) != IS_ARRAY) {
+        return NULL;
+    }
+    v = zend_hash_str_find(Z_ARRVAL_P(arr), name, name_len);
+    return v && Z_TYPE_P(v) == IS_STRING ? Z_STRVAL_P(v) : NULL;
+#else
+    zval *arr;
+    zval **v;
+    TSRMLS_FETCH();
+
+    arr = PG(http_globals)[track];
+    if (!arr || Z_TYPE_P(arr) != IS_ARRAY
+        || zend_hash_find(Z_ARRVAL_P(arr), name, name_len + 1, (void **)&v) != SUCCESS) {
+        return NULL;
+    }
+    return Z_TYPE_PP(v) == IS_STRING ? Z_STRVAL_PP(v) : NULL;
+#endif
+}
+/* }}} */
+
+/* {{{ profiler_trigger_request_value */
+char *profiler_trigger_request_value(void)
+{
+    const char *value;
+    TSRMLS_FETCH();
+
+    /* $_SERVER is a JIT auto global: build it now, RINIT runs before
+     * any script could have touched it */
+#if PHP_VERSION_ID >= 70000
+    zend_is_auto_global_str(ZEND_STRL("_SERVER"));
+#else
+    zend_is_auto_global("_SERVER", sizeof("_SERVER") - 1 TSRMLS_CC);
+#endif
+
+    value = profiler_trigger_lookup(TRACK_VARS_SERVER, ZEND_STRL(PROFILER_TRIGGER_HEADER));
+    if (!value) {
+        value = profiler_trigger_lookup(TRACK_VARS_COOKIE, ZEND_STRL(PROFILER_TRIGGER_NAME));
+    }
+    if (!value) {
+        value = profiler_trigger_lookup(TRACK_VARS_GET, ZEND_STRL(PROFILER_TRIGGER_NAME));
+    }
+    if (!value) {
+        /* CLI: $_SERVER holds the environment */
+        value = profiler_trigger_lookup(TRACK_VARS_SERVER, ZEND_STRL(PROFILER_TRIGGER_NAME));
+    }
+
+    return value ? estrdup(value) : NULL;
+}
+/* }}} */
+
+/* {{{ profiler_trigger_match */
+int profiler_trigger_match(const char *token, const char *value)
+{
+    return value && *token && strcmp(token, value) == 0;
+}
+/* }}} */
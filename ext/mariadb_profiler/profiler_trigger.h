@@ -0,0 +1,25 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Request Trigger Header                      |
+  +----------------------------------------------------------------------+
+  | A job with a "trigger" token only captures requests that carry the   |
+  | token: an X-MariaDB-Profiler header, a MARIADB_PROFILER cookie or    |
+  | query parameter, or a MARIADB_PROFILER environment variable (CLI).   |
+  | Looked up once in RINIT, so other requests never enter the hooks.    |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_TRIGGER_H
+#define PROFILER_TRIGGER_H
+
+#define PROFILER_TRIGGER_NAME   "MARIADB_PROFILER"        /* cookie, GET, env */
+#define PROFILER_TRIGGER_HEADER "HTTP_X_MARIADB_PROFILER" /* $_SERVER key of the header */
+
+/* The trigger value the current request carries (header, cookie, query
+ * parameter, then environment), or NULL. Caller must efree(). */
+char *profiler_trigger_request_value(void);
+
+/* Whether a request carrying value (NULL = none) fires a job's token */
+int profiler_trigger_match(const char *token, const char *value);
+
+#endif /* PROFILER_TRIGGER_H */
@@ -0,0 +1,359 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Transaction Spans                           |
+  +----------------------------------------------------------------------+
+  | Per-request table of connections and their open transaction. Spans   |
+  | follow what the server does: BEGIN inside a transaction commits it,  |
+  | autocommit=0 starts one at the next statement and autocommit=1       |
+  | commits it. Spans still open at request end are written as "open".   |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_tx.h"
+
+/* {{{ profiler_tx_skip
+ * Skip whitespace and comments. */
+static const char *profiler_tx_skip(const char *p, const char *end)
+{
+    while (p < end) {
+        if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+            p++;
+        } else if (*p == '/' && p + 1 < end && p[1] == '*') {
+            p += 2;
+            while (p + 1 < end && !(p[0] == '*' && p[1] == '/')) {
+                p++;
+            }
+            p = p + 1 < end ? p + 2 : end;
+        } else if (*p == '#' || (*p == '-' && p + 2 < end && p[1] == '-'
+                                 && (p[2] == ' ' || p[2] == '\t'))) {
+            while (p < end && *p != '\n') {
+                p++;
+            }
+        } else {
+            break;
+        }
+    }
+    return p;
+}
+/* }}} */
+
+/* {{{ profiler_tx_word
+ * Whether the keyword at *p is word (lowercase; matched ignoring ASCII
+ * case, whole word only); if so, move *p past it and any following
+ * whitespace. */
+static int profiler_tx_word(const char **p, const char *end, const char *word)
+{
+    const char *q = *p;
+    unsigned char c;
+
+    for (; *word; word++, q++) {
+        if (q >= end || ((unsigned char)*q | 0x20) != (unsigned char)*word) {
+            return 0;
+        }
+    }
+    if (q < end) {
+        c = (unsigned char)*q;
+        if (((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || (c >= '0' && c <= '9')
+            || c == '_' || c == '$' || c >= 0x80) {
+            return 0;
+        }
+    }
+    *p = profiler_tx_skip(q, end);
+    return 1;
+}
+/* }}} */
+
+/* {{{ profiler_tx_classify_set
+ * SET [SESSION | LOCAL | @@[session. | local.]]autocommit = value */
+static int profiler_tx_classify_set(const char *p, const char *end)
+{
+    if (end - p >= 2 && p[0] == '@' && p[1] == '@') {
+        p += 2;
+        if (profiler_tx_word(&p, end, "session") || profiler_tx_word(&p, end, "local")) {
+            if (p >= end || *p != '.') {
+                return PROFILER_TX_NONE;
+            }
+            p++;
+        }
+    } else if (!profiler_tx_word(&p, end, "session")) {
+        profiler_tx_word(&p, end, "local");
+    }
+
+    if (!profiler_tx_word(&p, end, "autocommit")) {
+        return PROFILER_TX_NONE;
+    }
+    if (p < end && *p == ':') {
+        p++;
+    }
+    if (p >= end || *p != '=') {
+        return PROFILER_TX_NONE;
+    }
+    p = profiler_tx_skip(p + 1, end);
+
+    if (profiler_tx_word(&p, end, "1") || profiler_tx_word(&p, end, "on")
+        || profiler_tx_word(&p, end, "true")) {
+        return PROFILER_TX_AUTOCOMMIT_ON;
+    }
+    if (profiler_tx_word(&p, end, "0") || profiler_tx_word(&p, end, "off")
+        || profiler_tx_word(&p, end, "false")) {
+        return PROFILER_TX_AUTOCOMMIT_OFF;
+    }
+    return PROFILER_TX_NONE;
+}
+/* }}} */
+
+/* {{{ profiler_tx_classify */
+int profiler_tx_classify(const char *query, size_t query_len)
+{
+    const char *end = query + query_len;
+    const char *p = profiler_tx_skip(query, end);
+
+    if (profiler_tx_word(&p, end, "begin")) {
+        /* BEGIN NOT ATOMIC opens a compound statement, not a transaction */
+        return profiler_tx_word(&p, end, "not") ? PROFILER_TX_NONE : PROFILER_TX_BEGIN;
+    }
+    if (profiler_tx_word(&p, end, "start")) {
+        return profiler_tx_word(&p, end, "transaction") ? PROFILER_TX_BEGIN : PROFILER_TX_NONE;
+    }
+    if (profiler_tx_word(&p, end, "commit")) {
+        return PROFILER_TX_COMMIT;
+    }
+    if (profiler_tx_word(&p, end, "rollback")) {
+        profiler_tx_word(&p, end, "work");
+        /* ROLLBACK TO SAVEPOINT keeps the transaction open */
+        return profiler_tx_word(&p, end, "to") ? PROFILER_TX_NONE : PROFILER_TX_ROLLBACK;
+    }
+    if (profiler_tx_word(&p, end, "set")) {
+        return profiler_tx_classify_set(p, end);
+    }
+    return PROFILER_TX_NONE;
+}
+/* }}} */
+
+#if PHP_VERSION_ID >= 70000
+
+typedef struct _profiler_tx_conn {
+    profiler_tx tx;
+    int         open;
+    int         autocommit_off;
+} profiler_tx_conn;
+
+/* {{{ profiler_tx_conn_dtor */
+static void profiler_tx_conn_dtor(zval *zv)
+{
+    efree(Z_PTR_P(zv));
+}
+/* }}} */
+
+/* {{{ profiler_tx_conn_get
+ * conn's state, added when create is set (else NULL if unknown). */
+static profiler_tx_conn *profiler_tx_conn_get(const void *conn, int create)
+{
+    profiler_tx_conn *c;
+
+    if (!conn) {
+        return NULL;
+    }
+    if (PROFILER_G(tx_conns)) {
+        c = (profiler_tx_conn *)zend_hash_index_find_ptr(PROFILER_G(tx_conns),
+            (zend_ulong)(uintptr_t)conn);
+        if (c || !create) {
+            return c;
+        }
+    } else if (!create) {
+        return NULL;
+    } else {
+        ALLOC_HASHTABLE(PROFILER_G(tx_conns));
+        zend_hash_init(PROFILER_G(tx_conns), 4, NULL, profiler_tx_conn_dtor, 0);
+    }
+
+    c = (profiler_tx_conn *)ecalloc(1, sizeof(profiler_tx_conn));
+    zend_hash_index_update_ptr(PROFILER_G(tx_conns), (zend_ulong)(uintptr_t)conn, c);
+    return c;
+}
+/* }}} */
+
+/* {{{ profiler_tx_open
+ * Start a span at the beginning of timer's statement (NULL = now). */
+static void profiler_tx_open(profiler_tx_conn *c, const profiler_timer *timer)
+{
+    memset(&c->tx, 0, sizeof(c->tx));
+    c->tx.id = ((uint64_t)profiler_getpid() << 32) | (uint64_t)++PROFILER_G(tx_seq);
+    if (timer) {
+        c->tx.start_ts = timer->start_ts;
+        c->tx.start_ns = timer->start_ns;
+    } else {
+        c->tx.start_ts = profiler_clock_wall();
+        c->tx.start_ns = profiler_clock_mono_ns();
+    }
+    c->open = 1;
+}
+/* }}} */
+
+/* {{{ profiler_tx_close
+ * End the span now and write its summary. */
+static void profiler_tx_close(profiler_tx_conn *c, const char *end)
+{
+    c->tx.dur_us = (profiler_clock_mono_ns() - c->tx.start_ns) / 1000;
+    c->tx.end = end;
+    c->open = 0;
+    profiler_log_tx(&c->tx);
+}
+/* }}} */
+
+/* {{{ profiler_tx_before */
+void profiler_tx_before(const void *conn, int event)
+{
+    profiler_tx_conn *c;
+
+    if (event != PROFILER_TX_BEGIN || !(c = profiler_tx_conn_get(conn, 1))) {
+        return;
+    }
+    if (c->open) {
+        profiler_tx_close(c, "commit"); /* BEGIN commits the running transaction */
+    }
+    profiler_tx_open(c, NULL);
+}
+/* }}} */
+
+/* {{{ profiler_tx_after */
+void profiler_tx_after(const void *conn, int event, int ok)
+{
+    profiler_tx_conn *c;
+
+    if (!ok || event == PROFILER_TX_NONE) {
+        if (event == PROFILER_TX_BEGIN && (c = profiler_tx_conn_get(conn, 0)) != NULL) {
+            c->open = 0; /* nothing began: drop the span unwritten */
+        }
+        return;
+    }
+
+    c = profiler_tx_conn_get(conn, event == PROFILER_TX_AUTOCOMMIT_OFF);
+    if (!c) {
+        return;
+    }
+    switch (event) {
+        case PROFILER_TX_COMMIT:
+        case PROFILER_TX_ROLLBACK:
+            if (c->open) {
+                profiler_tx_close(c, event == PROFILER_TX_COMMIT ? "commit" : "rollback");
+            }
+            break;
+        case PROFILER_TX_AUTOCOMMIT_ON:
+            c->autocommit_off = 0;
+            if (c->open) {
+                profiler_tx_close(c, "commit");
+            }
+            break;
+        case PROFILER_TX_AUTOCOMMIT_OFF:
+            c->autocommit_off = 1;
+            break;
+    }
+}
+/* }}} */
+
+/* {{{ profiler_tx_statement */
+uint64_t profiler_tx_statement(const void *conn, int event, int ok,
+                               const profiler_timer *timer)
+{
+    profiler_tx_conn *c = profiler_tx_conn_get(conn, 0);
+
+    if (!c) {
+        return 0;
+    }
+    if (event == PROFILER_TX_NONE) {
+        if (!c->open && c->autocommit_off) {
+            profiler_tx_open(c, timer);
+        }
+        if (c->open) {
+            c->tx.statements++;
+            if (!ok) {
+                c->tx.errors++;
+            }
+        }
+    }
+    return c->open ? c->tx.id : 0;
+}
+/* }}} */
+
+/* {{{ profiler_tx_conn_closed */
+void profiler_tx_conn_closed(const void *conn)
+{
+    profiler_tx_conn *c = profiler_tx_conn_get(conn, 0);
+
+    if (!c) {
+        return;
+    }
+    if (c->open) {
+        profiler_tx_close(c, "close");
+    }
+    /* The address may be reused by the next connection */
+    zend_hash_index_del(PROFILER_G(tx_conns), (zend_ulong)(uintptr_t)conn);
+}
+/* }}} */
+
+/* {{{ profiler_tx_request_shutdown */
+void profiler_tx_request_shutdown(void)
+{
+    HashTable *ht = PROFILER_G(tx_conns);
+    profiler_tx_conn *c;
+
+    if (!ht) {
+        return;
+    }
+    PROFILER_G(tx_conns) = NULL;
+
+    ZEND_HASH_FOREACH_PTR(ht, c) {
+        if (c->open) {
+            profiler_tx_close(c, "open");
+        }
+    } ZEND_HASH_FOREACH_END();
+
+    zend_hash_destroy(ht);
+    FREE_HASHTABLE(ht);
+}
+/* }}} */
+
+#else /* PHP_VERSION_ID < 70000 */
+
+/* The transaction hooks need the PHP 7 mysqlnd method table */
+
+void profiler_tx_before(const void *conn, int event)
+{
+    (void)conn;
+    (void)event;
+}
+
+void profiler_tx_after(const void *conn, int event, int ok)
+{
+    (void)conn;
+    (void)event;
+    (void)ok;
+}
+
+uint64_t profiler_tx_statement(const void *conn, int event, int ok,
+                               const profiler_timer *timer)
+{
+    (void)conn;
+    (void)event;
+    (void)ok;
+    (void)timer;
+    return 0;
+}
+
+void profiler_tx_conn_closed(const void *conn)
+{
+    (void)conn;
+}
+
+void profiler_tx_request_shutdown(void)
+{
+}
+
+#endif /* PHP_VERSION_ID >= 70000 */
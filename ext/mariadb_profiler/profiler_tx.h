@@ -0,0 +1,60 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Transaction Spans Header                    |
+  +----------------------------------------------------------------------+
+  | Follows each connection from BEGIN (or the first statement with      |
+  | autocommit off) to COMMIT/ROLLBACK. Statements inside carry the      |
+  | span's id ("tx") and a {"type":"tx"} summary with duration,          |
+  | statement count and outcome is written when the span ends (PHP 7.0+) |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_TX_H
+#define PROFILER_TX_H
+
+/* Transaction control statements (profiler_tx_classify) */
+#define PROFILER_TX_NONE           0 /* any other statement */
+#define PROFILER_TX_BEGIN          1 /* BEGIN, START TRANSACTION */
+#define PROFILER_TX_COMMIT         2
+#define PROFILER_TX_ROLLBACK       3 /* not ROLLBACK TO SAVEPOINT */
+#define PROFILER_TX_AUTOCOMMIT_ON  4 /* SET autocommit=1 (commits an open span) */
+#define PROFILER_TX_AUTOCOMMIT_OFF 5 /* SET autocommit=0 */
+
+typedef struct _profiler_tx {
+    uint64_t    id;         /* pid in the high half, per-process sequence below */
+    double      start_ts;   /* wall clock at BEGIN */
+    uint64_t    start_ns;   /* monotonic clock at BEGIN */
+    uint64_t    dur_us;     /* BEGIN to the end of COMMIT/ROLLBACK */
+    uint64_t    statements; /* statements inside, control statements excluded */
+    uint64_t    errors;
+    const char *end;        /* "commit", "rollback", "close" (connection closed),
+                               "open" (request ended first) */
+} profiler_tx;
+
+/* Which control statement query is; comments and case are ignored */
+int  profiler_tx_classify(const char *query, size_t query_len);
+
+/*
+ * Around a control statement on conn (conn::query() text, or mysqlnd's
+ * tx_begin / tx_commit_or_rollback / set_autocommit). A span is opened
+ * before BEGIN so the BEGIN record belongs to it, and closed after a
+ * successful COMMIT/ROLLBACK so that record does too.
+ */
+void profiler_tx_before(const void *conn, int event);
+void profiler_tx_after(const void *conn, int event, int ok);
+
+/*
+ * Span id for a statement on conn (0 = none). A statement that is not
+ * a control statement (event NONE) is counted, and opens a span at the
+ * start of timer when autocommit is off and none is open.
+ */
+uint64_t profiler_tx_statement(const void *conn, int event, int ok,
+                               const profiler_timer *timer);
+
+/* conn was closed: the server rolled back what was open ("close") */
+void profiler_tx_conn_closed(const void *conn);
+
+/* End open spans as "open" and forget all connections (RSHUTDOWN) */
+void profiler_tx_request_shutdown(void);
+
+#endif /* PROFILER_TX_H */
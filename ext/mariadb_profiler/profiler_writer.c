@@ -0,0 +1,253 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Buffered Log Writer                         |
+  +----------------------------------------------------------------------+
+  | Keeps each job's log files open for the duration of a request and    |
+  | accumulates encoded records in memory. A buffer is written with one  |
+  | locked append when it reaches mariadb_profiler.buffer_size, when the |
+  | job list is refreshed, and at request shutdown. With async_writer on |
+  | the buffer goes to the background writer (profiler_async.c) instead. |
+  | With shard_logs on, each process writes <job>.shard-<pid><ext>       |
+  | (without flock unless ZTS threads share it); the readers merge the   |
+  | shards by timestamp. With collector_socket set, buffers are sent to  |
+  | the collector process.                                               |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_mariadb_profiler.h"
+#include "profiler_writer.h"
+#include "profiler_async.h"
+#include "profiler_collector.h"
+#include "profiler_stack.h"
+
+#ifndef PHP_WIN32
+# include <sys/file.h>
+#endif
+#include <fcntl.h>
+#include <errno.h>
+
+/* {{{ profiler_writer_open
+ * Open the sink's file for appending on first use. */
+static int profiler_writer_open(profiler_sink *sink)
+{
+    if (sink->fd >= 0) {
+        return SUCCESS;
+    }
+
+    sink->fd = profiler_open(sink->path,
+        O_WRONLY | O_APPEND | O_CREAT | PROFILER_O_BINARY, 0666);
+
+    return sink->fd >= 0 ? SUCCESS : FAILURE;
+}
+/* }}} */
+
+/* {{{ profiler_writer_use_lock */
+int profiler_writer_use_lock(void)
+{
+#ifdef ZTS
+    /* All threads of the process append to the same shard */
+    return 1;
+#else
+    TSRMLS_FETCH();
+
+    return !PROFILER_G(shard_logs);
+#endif
+}
+/* }}} */
+
+/* {{{ profiler_writer_append
+ * Append data to fd, retrying short writes. Shared files are locked;
+ * a per-process shard of an NTS build is written by one process only
+ * and O_APPEND already places each write() at the end. */
+void profiler_writer_append(int fd, const char *data, size_t len, int lock)
+{
+    if (lock) {
+        flock(fd, LOCK_EX);
+    }
+
+    while (len > 0) {
+        profiler_ssize_t n = profiler_write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+
+    if (lock) {
+        flock(fd, LOCK_UN);
+    }
+}
+/* }}} */
+
+/* {{{ profiler_writer_file_name
+ * The file name part of a sink path, which is what the collector
+ * receives (it owns the log directory). */
+static const char *profiler_writer_file_name(const char *path)
+{
+    const char *name = strrchr(path, '/');
+
+#ifdef PHP_WIN32
+    const char *bs = strrchr(path, '\\');
+    if (bs && (!name || bs > name)) {
+        name = bs;
+    }
+#endif
+    return name ? name + 1 : path;
+}
+/* }}} */
+
+/* {{{ profiler_writer_flush_sink
+ * Append the sink's buffer to its file, or send it to the collector
+ * when collector_socket is set, or hand it to the background writer
+ * when async_writer is on. The buffer is emptied even on
+ * failure so a broken log_dir cannot grow memory without bound. When
+ * it is lost that way, the stack and template definitions it may have
+ * held are forgotten so that their next use writes them again. */
+static void profiler_writer_flush_sink(profiler_sink *sink)
+{
+    int ret = FAILURE;
+    TSRMLS_FETCH();
+
+    if (sink->buf.len == 0) {
+        return;
+    }
+
+    if (PROFILER_G(collector_socket) && PROFILER_G(collector_socket)[0]) {
+        ret = profiler_collector_send(profiler_writer_file_name(sink->path),
+            sink->buf.data, sink->buf.len);
+    }
+
+    if (ret == FAILURE && PROFILER_G(async_writer)) {
+        ret = profiler_async_write(sink->path, sink->buf.data, sink->buf.len);
+    }
+
+    if (ret == FAILURE && profiler_writer_open(sink) == SUCCESS) {
+        profiler_writer_append(sink->fd, sink->buf.data, sink->buf.len,
+            profiler_writer_use_lock());
+        ret = SUCCESS;
+    }
+
+    if (ret != SUCCESS) {
+        profiler_stack_forget();
+    }
+    profiler_buf_reset(&sink->buf);
+}
+/* }}} */
+
+/* {{{ profiler_writer_request_init */
+void profiler_writer_request_init(void)
+{
+    TSRMLS_FETCH();
+
+    PROFILER_G(sinks) = NULL;
+    PROFILER_G(sink_count) = 0;
+    PROFILER_G(sink_capacity) = 0;
+    PROFILER_G(shard_pid) = PROFILER_G(shard_logs) ? (long)profiler_getpid() : 0;
+}
+/* }}} */
+
+/* {{{ profiler_writer_request_shutdown
+ * Flush and close every sink opened during this request. */
+void profiler_writer_request_shutdown(void)
+{
+    int i;
+    TSRMLS_FETCH();
+
+    for (i = 0; i < PROFILER_G(sink_count); i++) {
+        profiler_sink *sink = &PROFILER_G(sinks)[i];
+
+        profiler_writer_flush_sink(sink);
+        if (sink->fd >= 0) {
+            profiler_close(sink->fd);
+        }
+        profiler_buf_free(&sink->buf);
+        efree(sink->job_key);
+        efree(sink->path);
+    }
+
+    if (PROFILER_G(sinks)) {
+        efree(PROFILER_G(sinks));
+    }
+    PROFILER_G(sinks) = NULL;
+    PROFILER_G(sink_count) = 0;
+    PROFILER_G(sink_capacity) = 0;
+}
+/* }}} */
+
+/* {{{ profiler_writer_get_sink
+ * Linear lookup is fine here: at most two sinks per active job. The
+ * path is only built when a sink is created. */
+profiler_sink *profiler_writer_get_sink(const char *job_key, const char *ext)
+{
+    int i;
+    profiler_sink *sink;
+    TSRMLS_FETCH();
+
+    for (i = 0; i < PROFILER_G(sink_count); i++) {
+        sink = &PROFILER_G(sinks)[i];
+        if ((sink->ext == ext || strcmp(sink->ext, ext) == 0)
+            && strcmp(sink->job_key, job_key) == 0) {
+            return sink;
+        }
+    }
+
+    if (PROFILER_G(sink_count) >= PROFILER_G(sink_capacity)) {
+        int capacity = PROFILER_G(sink_capacity) ? PROFILER_G(sink_capacity) * 2 : 8;
+        PROFILER_G(sinks) = (profiler_sink *)erealloc(PROFILER_G(sinks),
+            capacity * sizeof(profiler_sink));
+        PROFILER_G(sink_capacity) = capacity;
+    }
+
+    sink = &PROFILER_G(sinks)[PROFILER_G(sink_count)++];
+    sink->job_key = estrdup(job_key);
+    sink->ext = ext;
+    if (PROFILER_G(shard_pid)) {
+        spprintf(&sink->path, 0, "%s/%s.shard-%ld%s", PROFILER_G(log_dir), job_key,
+            PROFILER_G(shard_pid), ext);
+    } else {
+        spprintf(&sink->path, 0, "%s/%s%s", PROFILER_G(log_dir), job_key, ext);
+    }
+    sink->fd = -1;
+    profiler_buf_init(&sink->buf);
+
+    return sink;
+}
+/* }}} */
+
+/* {{{ profiler_writer_commit */
+void profiler_writer_commit(profiler_sink *sink)
+{
+    TSRMLS_FETCH();
+
+    if (!sink) {
+        return;
+    }
+
+    /* buffer_size <= 0 means write-through (flush every record) */
+    if (PROFILER_G(buffer_size) <= 0
+        || sink->buf.len >= (size_t)PROFILER_G(buffer_size)) {
+        profiler_writer_flush_sink(sink);
+    }
+}
+/* }}} */
+
+/* {{{ profiler_writer_flush_all */
+void profiler_writer_flush_all(void)
+{
+    int i;
+    TSRMLS_FETCH();
+
+    for (i = 0; i < PROFILER_G(sink_count); i++) {
+        profiler_writer_flush_sink(&PROFILER_G(sinks)[i]);
+    }
+}
+/* }}} */
@@ -0,0 +1,52 @@
+/*
+  +----------------------------------------------------------------------+
+  | MariaDB Query Profiler - Buffered Log Writer Header                  |
+  +----------------------------------------------------------------------+
+  | Per-request output sinks: one per (job, file type), each with an     |
+  | in-memory buffer that is appended to disk in a single write.         |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef PROFILER_WRITER_H
+#define PROFILER_WRITER_H
+
+#include "profiler_buf.h"
+
+typedef struct _profiler_sink {
+    char         *job_key; /* own copy: the job list may be reloaded mid-request */
+    const char   *ext;     /* file extension, a static string of the encoder */
+    char         *path;    /* absolute path of the log file */
+    int           fd;      /* -1 until the first flush opens it */
+    profiler_buf  buf;     /* records not yet written */
+} profiler_sink;
+
+/* Request lifecycle (called from RINIT / RSHUTDOWN) */
+void profiler_writer_request_init(void);
+void profiler_writer_request_shutdown(void);
+
+/*
+ * Look up (or create) the sink of (job_key, ext), which writes to
+ * <log_dir>/<job_key><ext>, or <log_dir>/<job_key>.shard-<pid><ext>
+ * with mariadb_profiler.shard_logs (job keys may not contain ".shard-").
+ * Callers append one complete record to sink->buf and then call
+ * profiler_writer_commit(). The pointer is only valid until the next
+ * call to profiler_writer_get_sink() (the sink table may grow).
+ */
+profiler_sink *profiler_writer_get_sink(const char *job_key, const char *ext);
+
+/* Flush the sink if its buffer reached mariadb_profiler.buffer_size. */
+void profiler_writer_commit(profiler_sink *sink);
+
+/* Write out all pending buffers (file descriptors stay open). */
+void profiler_writer_flush_all(void);
+
+/* Whether appends must be locked: shared files, and under ZTS also the
+ * shards, which all threads of a process write. */
+int  profiler_writer_use_lock(void);
+
+/* Append data to an open log file, under an exclusive lock if lock is
+ * set (also used by the background writer thread, so no request state
+ * is touched). */
+void profiler_writer_append(int fd, const char *data, size_t len, int lock);
+
+#endif /* PROFILER_WRITER_H */
@@ -5,10 +5,33 @@ import kotlinx.serialization.Serializable
 
 @Serializable
 data class QueryEntry(
+    /** Set on non-query records (e.g. "agg" summaries); null on queries */
+    @SerialName("type")
+    val recordType: String? = null,
     @SerialName("q")
     val query: String = "",
     @SerialName("ts")
     val timestamp: Double = 0.0,
+    /** Execution time in microseconds (null in logs from older extensions) */
+    @SerialName("dur")
+    val duration: Long? = null,
+    /** Digest of the normalized statement: equal for queries of the same shape */
+    @SerialName("fp")
+    val fingerprint: String? = null,
+    /** Rows returned by a result set */
+    @SerialName("rows")
+    val rows: Long? = null,
+    /** Time spent transferring the result set, in microseconds */
+    @SerialName("fetch")
+    val fetchTime: Long? = null,
+    /** Bytes received from the server for the query and its result */
+    @SerialName("bytes")
+    val bytes: Long? = null,
+    /** Rows affected by a statement without result set */
+    @SerialName("affected")
+    val affectedRows: Long? = null,
+    @SerialName("insert_id")
+    val insertId: Long? = null,
     @SerialName("k")
     val jobKey: String = "",
     @SerialName("s")
@@ -18,8 +41,21 @@ data class QueryEntry(
     @SerialName("params")
     val params: List<String?> = emptyList(),
     @SerialName("trace")
-    val trace: List<BacktraceFrame> = emptyList()
+    val trace: List<BacktraceFrame> = emptyList(),
+    /** Interned trace: id of an earlier "stack" record, resolved by LogParserService */
+    @SerialName("st")
+    val stackRef: String? = null,
+    /** Interned statement template: id of an earlier "stmt" record, resolved by LogParserService */
+    @SerialName("sid")
+    val statementRef: String? = null,
+    /** Id defined by a "stack" or "stmt" record */
+    @SerialName("id")
+    val stackId: String? = null
 ) {
+    /** Whether this line is a query record rather than a typed record */
+    val isQuery: Boolean
+        get() = recordType == null
+
     /** Whether this query has bound parameters (prepared statement) */
     val hasParams: Boolean
         get() = params.isNotEmpty()
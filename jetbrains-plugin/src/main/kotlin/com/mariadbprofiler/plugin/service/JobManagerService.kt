@@ -129,9 +129,9 @@ class JobManagerService(private val project: Project) {
     }
 
     private fun countQueriesInJsonl(key: String): Int {
-        val file = File(getLogDirectory(), "$key.jsonl")
-        if (!file.exists()) return 0
-        return file.useLines { lines -> lines.count { it.isNotBlank() } }
+        return LogParserService.jobLogFiles(File(getLogDirectory(), "$key.jsonl").path).sumOf { file ->
+            file.useLines { lines -> lines.count { it.isNotBlank() } }
+        }
     }
 
     fun loadJobs(): List<JobInfo> {
@@ -3,11 +3,14 @@ package com.mariadbprofiler.plugin.service
 import com.intellij.openapi.components.Service
 import com.intellij.openapi.diagnostic.Logger
 import com.intellij.openapi.project.Project
+import com.mariadbprofiler.plugin.model.BacktraceFrame
 import com.mariadbprofiler.plugin.model.QueryEntry
 import kotlinx.serialization.json.Json
 import java.io.File
 import java.io.RandomAccessFile
 import java.nio.charset.StandardCharsets
+import java.util.PriorityQueue
+import java.util.concurrent.ConcurrentHashMap
 
 @Service(Service.Level.PROJECT)
 class LogParserService(private val project: Project) {
@@ -19,6 +22,43 @@ class LogParserService(private val project: Project) {
         isLenient = true
     }
 
+    /** Interned traces by stack id; kept so tailed chunks can refer to earlier definitions */
+    private val stacks = ConcurrentHashMap<String, List<BacktraceFrame>>()
+
+    /** Interned statement templates ("stmt" records) by id, kept for the same reason */
+    private val statements = ConcurrentHashMap<String, QueryEntry>()
+
+    /**
+     * Add a parsed line to entries if it is a query, resolving its
+     * interned trace and statement template. Typed records (aggregation
+     * summaries, stack and statement definitions) are not queries.
+     */
+    private fun accept(entry: QueryEntry, entries: MutableList<QueryEntry>) {
+        if (!entry.isQuery) {
+            if (entry.recordType == "stack" && entry.stackId != null) {
+                stacks[entry.stackId] = entry.trace
+            } else if (entry.recordType == "stmt" && entry.stackId != null) {
+                statements[entry.stackId] = entry
+            }
+            return
+        }
+        var resolved = entry
+        val ref = entry.stackRef
+        val trace = if (ref != null && entry.trace.isEmpty()) stacks[ref] else null
+        if (trace != null) {
+            resolved = resolved.copy(trace = trace, stackRef = null)
+        }
+        val stmt = entry.statementRef?.let { statements[it] }
+        if (stmt != null && entry.query.isEmpty()) {
+            resolved = resolved.copy(
+                query = stmt.query,
+                fingerprint = entry.fingerprint ?: stmt.fingerprint,
+                statementRef = null
+            )
+        }
+        entries.add(resolved)
+    }
+
     fun parseJsonlFile(filePath: String): List<QueryEntry> {
         val file = File(filePath)
         if (!file.exists() || !file.canRead()) {
@@ -32,7 +72,7 @@ class LogParserService(private val project: Project) {
                 val trimmed = line.trim()
                 if (trimmed.isNotEmpty()) {
                     try {
-                        entries.add(json.decodeFromString<QueryEntry>(trimmed))
+                        accept(json.decodeFromString<QueryEntry>(trimmed), entries)
                     } catch (e: Exception) {
                         log.debug("Failed to parse line $index in $filePath: ${e.message}")
                         parseErrors++
@@ -47,6 +87,27 @@ class LogParserService(private val project: Project) {
         return entries
     }
 
+    /** Parse a job log and its per-process shards into one timestamp-ordered list. */
+    fun parseJobLog(jsonlPath: String): Pair<List<QueryEntry>, Map<String, Long>> =
+        parseJobLogFromOffsets(jsonlPath, emptyMap())
+
+    /**
+     * Read what was appended to a job log and its shards since the given
+     * offsets (missing files start at 0); new entries are merged by timestamp.
+     */
+    fun parseJobLogFromOffsets(
+        jsonlPath: String,
+        offsets: Map<String, Long>
+    ): Pair<List<QueryEntry>, Map<String, Long>> {
+        val newOffsets = offsets.toMutableMap()
+        val streams = jobLogFiles(jsonlPath).map { file ->
+            val (entries, newOffset) = parseJsonlFileFromOffset(file.path, offsets[file.path] ?: 0L)
+            newOffsets[file.path] = newOffset
+            entries
+        }
+        return Pair(mergeByTimestamp(streams), newOffsets)
+    }
+
     /**
      * Read JSONL entries starting from byte offset.
      * Returns (entries, newOffset) where newOffset is the file size at read time.
@@ -72,7 +133,7 @@ class LogParserService(private val project: Project) {
                 val trimmed = line.trim()
                 if (trimmed.isNotEmpty()) {
                     try {
-                        entries.add(json.decodeFromString<QueryEntry>(trimmed))
+                        accept(json.decodeFromString<QueryEntry>(trimmed), entries)
                     } catch (e: Exception) {
                         log.debug("Failed to parse incremental line: ${e.message}")
                     }
@@ -129,4 +190,46 @@ class LogParserService(private val project: Project) {
         }
         return Pair(lines, fileSize)
     }
+
+    companion object {
+        /**
+         * Files of a job log: `<key>.jsonl` and the per-process shards
+         * `<key>.shard-<pid>.jsonl` (mariadb_profiler.shard_logs), in pid order.
+         * Keys may not contain `.shard-`, so another job's files never match.
+         */
+        fun jobLogFiles(jsonlPath: String): List<File> {
+            val base = File(jsonlPath)
+            val prefix = base.name.removeSuffix(".jsonl") + ".shard-"
+            val shards = base.parentFile?.listFiles { f ->
+                f.name.startsWith(prefix) && f.name.endsWith(".jsonl") &&
+                    f.name.substring(prefix.length, f.name.length - ".jsonl".length).let { pid ->
+                        pid.isNotEmpty() && pid.all { it.isDigit() }
+                    }
+            }.orEmpty().sortedBy {
+                it.name.substring(prefix.length, it.name.length - ".jsonl".length).toLongOrNull() ?: Long.MAX_VALUE
+            }
+            return (if (base.exists()) listOf(base) else emptyList()) + shards
+        }
+
+        /**
+         * k-way merge of entry lists (each in write order) into one list
+         * ordered by timestamp. Ties go to the earlier list.
+         */
+        fun mergeByTimestamp(streams: List<List<QueryEntry>>): List<QueryEntry> {
+            val lists = streams.filter { it.isNotEmpty() }
+            if (lists.size <= 1) return lists.firstOrNull() ?: emptyList()
+
+            val heap = PriorityQueue<IntArray>(
+                compareBy<IntArray>({ lists[it[0]][it[1]].timestamp }, { it[0] })
+            )
+            lists.indices.forEach { heap.add(intArrayOf(it, 0)) }
+            val merged = ArrayList<QueryEntry>(lists.sumOf { it.size })
+            while (heap.isNotEmpty()) {
+                val (list, pos) = heap.poll().let { it[0] to it[1] }
+                merged.add(lists[list][pos])
+                if (pos + 1 < lists[list].size) heap.add(intArrayOf(list, pos + 1))
+            }
+            return merged
+        }
+    }
 }
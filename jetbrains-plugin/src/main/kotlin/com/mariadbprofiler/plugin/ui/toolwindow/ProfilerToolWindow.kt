@@ -43,7 +43,7 @@ class ProfilerToolWindow(private val project: Project) : JPanel(BorderLayout()),
     private val errorTabIndex: Int get() = 4 // Settings=3, Errors=4
 
     /** Byte offset into the current job's JSONL file for incremental reads */
-    private var jsonlOffset: Long = 0
+    private var jsonlOffsets: Map<String, Long> = emptyMap()
 
     private val errorChangeListener: () -> Unit = { updateErrorTabTitle() }
 
@@ -104,7 +104,7 @@ class ProfilerToolWindow(private val project: Project) : JPanel(BorderLayout()),
 
     private fun onJobSelected(job: JobInfo?) {
         currentJob = job
-        jsonlOffset = 0
+        jsonlOffsets = emptyMap()
         currentEntries.clear()
 
         if (job == null) {
@@ -121,10 +121,9 @@ class ProfilerToolWindow(private val project: Project) : JPanel(BorderLayout()),
             val jobManager = project.getService(JobManagerService::class.java)
             val jsonlPath = jobManager.getJsonlPath(job.key)
 
-            val entries = logParser.parseJsonlFile(jsonlPath)
+            val (entries, offsets) = logParser.parseJobLog(jsonlPath)
             currentEntries = entries.toMutableList()
-            val jsonlFile = java.io.File(jsonlPath)
-            jsonlOffset = if (jsonlFile.exists()) jsonlFile.length() else 0
+            jsonlOffsets = offsets
 
             queryLogPanel.setEntries(currentEntries)
             queryDetailPanel.showEntry(null)
@@ -224,10 +223,10 @@ class ProfilerToolWindow(private val project: Project) : JPanel(BorderLayout()),
             val jobManager = project.getService(JobManagerService::class.java)
             val jsonlPath = jobManager.getJsonlPath(job.key)
 
-            val (newEntries, newOffset) = logParser.parseJsonlFileFromOffset(jsonlPath, jsonlOffset)
+            val (newEntries, newOffsets) = logParser.parseJobLogFromOffsets(jsonlPath, jsonlOffsets)
             if (newEntries.isEmpty()) return
 
-            jsonlOffset = newOffset
+            jsonlOffsets = newOffsets
             currentEntries.addAll(newEntries)
 
             SwingUtilities.invokeLater {
@@ -3,6 +3,7 @@ package com.mariadbprofiler.plugin.model
 import kotlinx.serialization.json.Json
 import org.junit.Test
 import kotlin.test.assertEquals
+import kotlin.test.assertFalse
 import kotlin.test.assertNull
 import kotlin.test.assertTrue
 
@@ -275,6 +276,42 @@ class QueryEntryTest {
         assertEquals("UserController.php:42", entry.sourceFile)
     }
 
+    @Test
+    fun `parse stack definition and interned trace reference`() {
+        val stack = json.decodeFromString<QueryEntry>(
+            """{"type":"stack","k":"job1","id":"00000000000000c1","trace":[{"call":"Repo->find","file":"/app/Repo.php","line":42}]}"""
+        )
+        assertFalse(stack.isQuery)
+        assertEquals("00000000000000c1", stack.stackId)
+        assertEquals(42, stack.trace[0].line)
+
+        val query = json.decodeFromString<QueryEntry>(
+            """{"k":"job1","q":"SELECT 1","st":"00000000000000c1","ts":1705970401.0}"""
+        )
+        assertTrue(query.isQuery)
+        assertEquals("00000000000000c1", query.stackRef)
+        assertTrue(query.trace.isEmpty())
+    }
+
+    @Test
+    fun `parse statement definition and template reference`() {
+        val stmt = json.decodeFromString<QueryEntry>(
+            """{"type":"stmt","k":"job1","id":"00000000000000e1","q":"SELECT * FROM t WHERE id = ?","fp":"00000000000000f1"}"""
+        )
+        assertFalse(stmt.isQuery)
+        assertEquals("00000000000000e1", stmt.stackId)
+        assertEquals("SELECT * FROM t WHERE id = ?", stmt.query)
+        assertEquals("00000000000000f1", stmt.fingerprint)
+
+        val query = json.decodeFromString<QueryEntry>(
+            """{"k":"job1","sid":"00000000000000e1","params":["7"],"ts":1705970401.0}"""
+        )
+        assertTrue(query.isQuery)
+        assertEquals("00000000000000e1", query.statementRef)
+        assertEquals("", query.query)
+        assertEquals(listOf("7"), query.params)
+    }
+
     @Test
     fun `boundQuery replaces placeholders with params`() {
         val entry = QueryEntry(
@@ -389,6 +426,58 @@ class QueryEntryTest {
         assertNull(entry.status)
     }
 
+    // ---- duration field tests ----
+
+    @Test
+    fun `parse entry with duration`() {
+        val jsonStr = """{"k":"job1","q":"SELECT 1","ts":1705970401.0,"dur":1532}"""
+        val entry = json.decodeFromString<QueryEntry>(jsonStr)
+        assertEquals(1532L, entry.duration)
+    }
+
+    @Test
+    fun `parse entry without duration defaults to null`() {
+        val jsonStr = """{"k":"job1","q":"SELECT 1","ts":1705970401.0}"""
+        val entry = json.decodeFromString<QueryEntry>(jsonStr)
+        assertNull(entry.duration)
+    }
+
+    @Test
+    fun `parse entry with fingerprint`() {
+        val jsonStr = """{"k":"job1","q":"SELECT * FROM t WHERE id = 7","ts":1705970401.0,"fp":"9c3a51d0e8f27b46"}"""
+        val entry = json.decodeFromString<QueryEntry>(jsonStr)
+        assertEquals("9c3a51d0e8f27b46", entry.fingerprint)
+    }
+
+    @Test
+    fun `typed summary record is not a query`() {
+        val jsonStr = """{"type":"agg","k":"job1","fp":"00000000000000aa","q":"select ?","ep":"GET /","ts":1705970401.0,"n":3,"err":0}"""
+        val entry = json.decodeFromString<QueryEntry>(jsonStr)
+        assertEquals("agg", entry.recordType)
+        assertFalse(entry.isQuery)
+    }
+
+    // ---- result metrics tests ----
+
+    @Test
+    fun `parse entry with result set metrics`() {
+        val jsonStr = """{"k":"job1","q":"SELECT * FROM users","ts":1705970401.0,"rows":50000,"fetch":81234,"bytes":7340032}"""
+        val entry = json.decodeFromString<QueryEntry>(jsonStr)
+        assertEquals(50000L, entry.rows)
+        assertEquals(81234L, entry.fetchTime)
+        assertEquals(7340032L, entry.bytes)
+        assertNull(entry.affectedRows)
+    }
+
+    @Test
+    fun `parse entry with affected rows and insert id`() {
+        val jsonStr = """{"k":"job1","q":"INSERT INTO t VALUES (1)","ts":1705970401.0,"affected":1,"insert_id":42}"""
+        val entry = json.decodeFromString<QueryEntry>(jsonStr)
+        assertEquals(1L, entry.affectedRows)
+        assertEquals(42L, entry.insertId)
+        assertNull(entry.rows)
+    }
+
     // ---- hash comment tests ----
 
     @Test
@@ -114,4 +114,29 @@ class JsonParsingTest {
         assertTrue((byTable["posts"] ?: 0) > 0)
         assertTrue((byTable["logs"] ?: 0) > 0)
     }
+
+    @Test
+    fun `job log shards are listed in pid order and merged by timestamp`() {
+        val dir = java.nio.file.Files.createTempDirectory("profiler_shards").toFile()
+        try {
+            File(dir, "job1.shard-4101.jsonl").writeText(
+                """{"k":"job1","q":"SELECT 1","ts":100.0}""" + "\n" + """{"k":"job1","q":"SELECT 3","ts":102.0}""" + "\n"
+            )
+            File(dir, "job1.shard-987.jsonl").writeText("""{"k":"job1","q":"SELECT 2","ts":101.0}""" + "\n")
+            File(dir, "job10.jsonl").writeText("""{"k":"job10","q":"SELECT 9","ts":99.0}""" + "\n")
+            // A separate job whose key extends this one with a dotted number
+            File(dir, "job1.2.jsonl").writeText("""{"k":"job1.2","q":"SELECT 8","ts":98.0}""" + "\n")
+
+            val files = LogParserService.jobLogFiles(File(dir, "job1.jsonl").path)
+            assertEquals(listOf("job1.shard-987.jsonl", "job1.shard-4101.jsonl"), files.map { it.name })
+
+            val streams = files.map { file ->
+                file.readLines().filter { it.isNotBlank() }.map { json.decodeFromString<QueryEntry>(it) }
+            }
+            val merged = LogParserService.mergeByTimestamp(streams)
+            assertEquals(listOf("SELECT 1", "SELECT 2", "SELECT 3"), merged.map { it.query })
+        } finally {
+            dir.deleteRecursively()
+        }
+    }
 }
@@ -0,0 +1,113 @@
+#!/usr/bin/env php
+<?php
+
+/**
+ * Test suite for Collector (mariadb_profiler.collector_socket receiver)
+ */
+
+require_once __DIR__ . '/../vendor/autoload.php';
+
+use MariadbProfiler\Collector;
+
+$testDir = sys_get_temp_dir() . '/mariadb_profiler_collector_test_' . getmypid();
+$passed = 0;
+$failed = 0;
+
+function assert_true($name, $condition)
+{
+    global $passed, $failed;
+    if ($condition) {
+        echo "[PASS] {$name}\n";
+        $passed++;
+    } else {
+        echo "[FAIL] {$name}\n";
+        $failed++;
+    }
+}
+
+function cleanup($dir)
+{
+    if (!is_dir($dir)) {
+        return;
+    }
+    $files = glob($dir . '/*');
+    foreach ($files as $file) {
+        if (is_file($file)) {
+            unlink($file);
+        }
+    }
+    rmdir($dir);
+}
+
+echo "=== Collector Test Suite ===\n\n";
+
+cleanup($testDir);
+mkdir($testDir, 0777, true);
+$collector = new Collector($testDir);
+
+// Test: Default socket lives in the log directory
+assert_true('Default socket path', $collector->getSocketPath() === $testDir . '/collector.sock');
+
+// Test: Datagrams are appended to their file in arrival order
+$line1 = '{"k":"job-a","q":"SELECT 1","ts":1700000000.1}' . "\n";
+$line2 = '{"k":"job-a","q":"SELECT 2","ts":1700000000.2}' . "\n";
+assert_true('First datagram written', $collector->handleDatagram("job-a.jsonl\0" . $line1) === strlen($line1));
+assert_true('Second datagram written', $collector->handleDatagram("job-a.jsonl\0" . $line2) === strlen($line2));
+$collector->handleDatagram("job-a.raw.log\0[2023-11-14 22:13:20.100] [ok] SELECT 1\n");
+$collector->handleDatagram("job-a.shard-4101.bin\0\x01\x00");
+$collector->close();
+assert_true('JSONL file holds both buffers', file_get_contents($testDir . '/job-a.jsonl') === $line1 . $line2);
+assert_true('Raw log written', file_exists($testDir . '/job-a.raw.log'));
+assert_true('Binary shard written byte for byte', file_get_contents($testDir . '/job-a.shard-4101.bin') === "\x01\x00");
+
+// Test: Reopened after close and appended, not truncated
+$collector->handleDatagram("job-a.jsonl\0" . $line1);
+$collector->close();
+assert_true('Append after reopen', file_get_contents($testDir . '/job-a.jsonl') === $line1 . $line2 . $line1);
+
+// Test: Empty payload is accepted without creating a file
+assert_true('Empty payload', $collector->handleDatagram("job-b.jsonl\0") === 0);
+assert_true('Empty payload creates no file', !file_exists($testDir . '/job-b.jsonl'));
+
+// Test: Names outside the log directory or not job logs are rejected
+assert_true('Missing separator rejected', $collector->handleDatagram('job-a.jsonl') === false);
+assert_true('Path separator rejected', $collector->handleDatagram("../job-a.jsonl\0x") === false);
+assert_true('Subdirectory rejected', $collector->handleDatagram("sub/job-a.jsonl\0x") === false);
+assert_true('Dot file rejected', $collector->handleDatagram(".jsonl\0x") === false);
+assert_true('Job registry not writable', $collector->handleDatagram("jobs.json\0{}") === false);
+assert_true('Job registry file untouched', !file_exists($testDir . '/jobs.json'));
+assert_true('Raw log name accepted', Collector::isLogFileName('my-job.123.raw.log'));
+
+// Test: Tail output a subscriber's socket cannot take at once is kept and
+// flushed later, not cut mid-record
+$pair = stream_socket_pair(STREAM_PF_UNIX, STREAM_SOCK_STREAM, STREAM_IPPROTO_IP);
+stream_set_blocking($pair[0], false);
+stream_set_blocking($pair[1], false);
+$subscribers = new ReflectionProperty('MariadbProfiler\\Collector', 'subscribers');
+$subscribers->setAccessible(true);
+$subscribers->setValue($collector, [
+    (int)$pair[0] => ['conn' => $pair[0], 'file' => 'job-c.jsonl', 'line' => '', 'pending' => ''],
+]);
+$flush = new ReflectionMethod('MariadbProfiler\\Collector', 'flushSubscriber');
+$flush->setAccessible(true);
+$big = str_repeat('{"k":"job-c","q":"SELECT ' . str_repeat('x', 1000) . '"}' . "\n", 2048);
+$collector->handleDatagram("job-c.jsonl\0" . $big);
+$received = '';
+for ($i = 0; $i < 10000 && strlen($received) < strlen($big); $i++) {
+    while (($chunk = fread($pair[1], 65536)) !== false && $chunk !== '') {
+        $received .= $chunk;
+    }
+    $flush->invoke($collector, (int)$pair[0]);
+}
+$collector->close();
+assert_true('Tail subscriber receives every byte of a large buffer', $received === $big);
+assert_true('Tail subscriber kept after a short write', count($subscribers->getValue($collector)) === 1);
+fclose($pair[0]);
+fclose($pair[1]);
+$subscribers->setValue($collector, []);
+
+// Cleanup
+cleanup($testDir);
+
+echo "\n=== Results: {$passed} passed, {$failed} failed ===\n";
+exit($failed > 0 ? 1 : 0);
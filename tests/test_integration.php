@@ -107,9 +107,17 @@ file_put_contents($testDir . '/uuid2.jsonl', implode("\n", $queries2) . "\n");
 $r = run("{$base} job end uuid2");
 assert_test('End uuid2', str_contains_compat($r['output'], '[OK]') && str_contains_compat($r['output'], '1 queries'), $r['output']);
 
-// Start uuid3
-$r = run("{$base} job start uuid3");
+// Start uuid3 with request sampling
+$r = run("{$base} job start uuid3 --sample-rate=0.25");
 assert_test('Start uuid3', str_contains_compat($r['output'], '[OK]'), $r['output']);
+assert_test('Start uuid3 reports sample rate', str_contains_compat($r['output'], '25%'), $r['output']);
+$jobsData = json_decode(file_get_contents($testDir . '/jobs.json'), true);
+assert_test('uuid3 sample_rate stored in jobs.json',
+    isset($jobsData['active_jobs']['uuid3']['sample_rate']) && $jobsData['active_jobs']['uuid3']['sample_rate'] == 0.25,
+    json_encode(isset($jobsData['active_jobs']['uuid3']) ? $jobsData['active_jobs']['uuid3'] : null));
+
+$r = run("{$base} job start uuid-bad --sample-rate=2");
+assert_test('Out-of-range sample rate rejected', $r['code'] !== 0, $r['output']);
 
 // End uuid3 (no queries)
 $r = run("{$base} job end uuid3");
@@ -190,8 +198,8 @@ assert_test('Start tag-test', str_contains_compat($r['output'], '[OK]'), $r['out
 
 // Simulate JSONL with tags and traces (as if the C extension wrote them)
 $tagQueries = [
-    '{"k":"tag-test","q":"SELECT * FROM users WHERE id = 1","tag":"user_registration","trace":[{"call":"UserController->register","file":"/app/Http/Controllers/UserController.php","line":42}],"ts":1700000010.0}',
-    '{"k":"tag-test","q":"INSERT INTO email_queue (user_id, type) VALUES (1, \'welcome\')","tag":"send_email","trace":[{"call":"UserController->register","file":"/app/Http/Controllers/UserController.php","line":50},{"call":"Router->dispatch","file":"/app/routes.php","line":10}],"ts":1700000011.0}',
+    '{"k":"tag-test","q":"SELECT * FROM users WHERE id = 1","tag":"user_registration","trace":[{"call":"UserController->register","file":"/app/Http/Controllers/UserController.php","line":42}],"ts":1700000010.0,"dur":1532,"fp":"9c3a51d0e8f27b46","rows":1,"fetch":87,"bytes":412}',
+    '{"k":"tag-test","q":"INSERT INTO email_queue (user_id, type) VALUES (1, \'welcome\')","tag":"send_email","trace":[{"call":"UserController->register","file":"/app/Http/Controllers/UserController.php","line":50},{"call":"Router->dispatch","file":"/app/routes.php","line":10}],"ts":1700000011.0,"affected":1,"insert_id":17}',
     '{"k":"tag-test","q":"INSERT INTO audit_logs (action) VALUES (\'user_created\')","tag":"user_registration","trace":[{"call":"UserController->register","file":"/app/Http/Controllers/UserController.php","line":55}],"ts":1700000012.0}',
     '{"k":"tag-test","q":"SELECT COUNT(*) FROM users","ts":1700000013.0}',
     '{"k":"tag-test","q":"UPDATE users SET verified = 1 WHERE id = 1","tag":"user_registration","ts":1700000014.0}',
@@ -230,11 +238,35 @@ if (count($lines) >= 1) {
     assert_test('Line 1 has trace',
         is_array($line1) && isset($line1['trace']) && is_array($line1['trace']) && count($line1['trace']) > 0,
         json_encode(isset($line1['trace']) ? $line1['trace'] : null));
+    assert_test('Line 1 has duration',
+        is_array($line1) && isset($line1['dur']) && $line1['dur'] === 1532,
+        json_encode($line1));
+    assert_test('Line 1 has fingerprint',
+        is_array($line1) && isset($line1['fp']) && $line1['fp'] === '9c3a51d0e8f27b46',
+        json_encode($line1));
+    assert_test('Line 1 has result metrics',
+        is_array($line1) && isset($line1['rows'], $line1['fetch'], $line1['bytes'])
+            && $line1['rows'] === 1 && $line1['fetch'] === 87 && $line1['bytes'] === 412,
+        json_encode($line1));
+    assert_test('Line 1 (SELECT) has no affected field',
+        is_array($line1) && !isset($line1['affected']),
+        json_encode($line1));
     assert_test('Line 1 trace has call field',
         is_array($line1) && isset($line1['trace'][0]['call']) && $line1['trace'][0]['call'] === 'UserController->register',
         json_encode(isset($line1['trace'][0]) ? $line1['trace'][0] : null));
 }
 
+if (count($lines) >= 2) {
+    $line2 = json_decode($lines[1], true);
+    assert_test('Line 2 (INSERT) has affected rows and insert id',
+        is_array($line2) && isset($line2['affected'], $line2['insert_id'])
+            && $line2['affected'] === 1 && $line2['insert_id'] === 17,
+        json_encode($line2));
+    assert_test('Line 2 (INSERT) has no rows field',
+        is_array($line2) && !isset($line2['rows']),
+        json_encode($line2));
+}
+
 if (count($lines) >= 4) {
     $line4 = json_decode($lines[3], true);
     assert_test('Line 4 (untagged) has no tag field',
@@ -243,6 +275,9 @@ if (count($lines) >= 4) {
     assert_test('Line 4 (untagged) has no trace field',
         is_array($line4) && !isset($line4['trace']),
         json_encode($line4));
+    assert_test('Line 4 (no timing) has no dur field',
+        is_array($line4) && !isset($line4['dur']),
+        json_encode($line4));
 }
 
 // Test: --tag filter
@@ -279,6 +314,13 @@ if (file_exists($testDir . '/tag-test.parsed.json')) {
         assert_test('Export entry 1 has tag',
             isset($parsed[0]['tag']) && $parsed[0]['tag'] === 'user_registration',
             json_encode(isset($parsed[0]['tag']) ? $parsed[0]['tag'] : null));
+        assert_test('Export entry 1 has duration',
+            isset($parsed[0]['dur']) && $parsed[0]['dur'] === 1532,
+            json_encode(isset($parsed[0]['dur']) ? $parsed[0]['dur'] : null));
+        assert_test('Export entry 1 has rows and bytes',
+            isset($parsed[0]['rows'], $parsed[0]['bytes'])
+                && $parsed[0]['rows'] === 1 && $parsed[0]['bytes'] === 412,
+            json_encode($parsed[0]));
         assert_test('Export entry 1 has trace',
             isset($parsed[0]['trace']) && is_array($parsed[0]['trace']),
             json_encode(isset($parsed[0]['trace']) ? $parsed[0]['trace'] : null));
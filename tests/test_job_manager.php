@@ -53,15 +53,64 @@ assert_true('Start job test-001', $result === true);
 $active = $manager->listActiveJobs();
 assert_true('Job test-001 is active', isset($active['test-001']));
 
+// Test: Registry published with active count
+$registry = $manager->readRegistry();
+assert_true('Registry exists after start', $registry !== null);
+assert_true('Registry reports 1 active job', $registry !== null && $registry['active'] === 1);
+$generation = $registry !== null ? $registry['generation'] : 0;
+assert_true('Registry file is fixed size', filesize($testDir . '/jobs.gen') === JobManager::REGISTRY_SIZE);
+
 // Test: Start nested job
 $result = $manager->startJob('test-002');
 assert_true('Start nested job test-002', $result === true);
 
 $active = $manager->listActiveJobs();
 assert_true('Both jobs are active', count($active) === 2);
+$registry = $manager->readRegistry();
+assert_true('Registry generation bumped on start', $registry !== null && $registry['generation'] > $generation);
+assert_true('Registry reports 2 active jobs', $registry !== null && $registry['active'] === 2);
 $parent = isset($active['test-002']['parent']) ? $active['test-002']['parent'] : '';
 assert_true('test-002 parent is test-001', $parent === 'test-001');
 
+// Test: Sample rate is stored per job (and clamped to 0..1)
+$result = $manager->startJob('test-sampled', 0.01);
+assert_true('Start sampled job', $result === true);
+$active = $manager->listActiveJobs();
+assert_true('Sampled job has sample_rate', isset($active['test-sampled']['sample_rate']) && $active['test-sampled']['sample_rate'] === 0.01);
+assert_true('Unsampled job has no sample_rate', !isset($active['test-001']['sample_rate']));
+$manager->endJob('test-sampled');
+$manager->startJob('test-clamped', 5);
+$active = $manager->listActiveJobs();
+assert_true('Sample rate clamped to 1', isset($active['test-clamped']['sample_rate']) && $active['test-clamped']['sample_rate'] === 1.0);
+$manager->endJob('test-clamped');
+
+// Test: Capture filter is normalized and stored per job
+$manager->startJob('test-filtered', null, [
+    'tag' => 'checkout',
+    'verb' => 'select, update,SELECT',
+    'table' => '',
+    'min_us' => '1500',
+    'status' => 'ok',
+]);
+$active = $manager->listActiveJobs();
+$filter = isset($active['test-filtered']['filter']) ? $active['test-filtered']['filter'] : [];
+assert_true('Filter keeps tag prefix', isset($filter['tag']) && $filter['tag'] === 'checkout');
+assert_true('Filter verbs uppercased and deduplicated', isset($filter['verb']) && $filter['verb'] === ['SELECT', 'UPDATE']);
+assert_true('Filter min_us stored as integer', isset($filter['min_us']) && $filter['min_us'] === 1500);
+assert_true('Filter drops empty table and non-err status', !isset($filter['table']) && !isset($filter['status']));
+assert_true('Unfiltered job has no filter', !isset($active['test-001']['filter']));
+$manager->endJob('test-filtered');
+
+// Test: Trigger token is stored per job and validated
+assert_true('Trigger with invalid characters rejected', $manager->startJob('test-bad-trigger', null, [], 'a b"c') === false);
+$active = $manager->listActiveJobs();
+assert_true('Rejected trigger job not started', !isset($active['test-bad-trigger']));
+$manager->startJob('test-trigger', null, [], 'page-42.slow');
+$active = $manager->listActiveJobs();
+assert_true('Trigger job stores token', isset($active['test-trigger']['trigger']) && $active['test-trigger']['trigger'] === 'page-42.slow');
+assert_true('Untriggered job has no trigger', !isset($active['test-001']['trigger']));
+$manager->endJob('test-trigger');
+
 // Test: Cannot start duplicate job
 $result = $manager->startJob('test-001');
 assert_true('Duplicate job start fails', $result === false);
@@ -92,17 +141,285 @@ assert_true('Get queries returns 2 entries', count($queries) === 2);
 $firstQuery = isset($queries[0]['q']) ? $queries[0]['q'] : '';
 assert_true('First query correct', $firstQuery === 'SELECT id, name FROM users');
 
-// Test: End remaining job
-$manager->endJob('test-001');
+// Test: Aggregation summaries (typed records) next to a plain query line
+$jsonlFile = $testDir . '/test-001.jsonl';
+$entries = [
+    '{"k":"test-001","q":"SELECT 1","ts":1700000003.0}',
+    '{"type":"agg","k":"test-001","fp":"00000000000000aa","q":"select * from users where id = ?","ep":"GET /users","ts":1700000004.0,"n":3,"err":0,"sum":300,"min":50,"max":150,"hist":[0,0,0,0,0,2,0,1]}',
+    '{"type":"agg","k":"test-001","fp":"00000000000000aa","q":"select * from users where id = ?","ep":"GET /users","ts":1700000005.0,"n":2,"err":1,"sum":2000,"min":900,"max":1100,"hist":[0,0,0,0,0,0,0,0,0,1,1]}',
+    '{"type":"agg","k":"test-001","fp":"00000000000000bb","q":"select ?","ep":"GET /health","ts":1700000006.0,"n":1,"err":0,"sum":10,"min":10,"max":10,"hist":[0,0,0,1]}',
+];
+file_put_contents($jsonlFile, implode("\n", $entries) . "\n");
+
+$queries = $manager->getJobQueries('test-001');
+assert_true('Typed records are not returned as queries', count($queries) === 1);
+
+$aggs = $manager->getJobAggregates('test-001');
+assert_true('Summaries merged per fingerprint and endpoint', count($aggs) === 2);
+assert_true('Merged summary sorted first by total time', $aggs[0]['fp'] === '00000000000000aa');
+assert_true('Merged summary adds counts and sums',
+    $aggs[0]['n'] === 5 && $aggs[0]['err'] === 1 && $aggs[0]['sum'] === 2300);
+assert_true('Merged summary keeps min and max', $aggs[0]['min'] === 50 && $aggs[0]['max'] === 1100);
+assert_true('Merged histogram adds buckets',
+    $aggs[0]['hist'][5] === 2 && $aggs[0]['hist'][7] === 1 && $aggs[0]['hist'][9] === 1 && $aggs[0]['hist'][10] === 1);
+assert_true('Histogram p95 upper bound', JobManager::histogramPercentile($aggs[0]['hist'], 95) === 2048);
+
+// Test: End remaining job (query count includes aggregated queries)
+$count = $manager->endJob('test-001');
+assert_true('End job counts summary records by their n', $count === 7);
 $active = $manager->listActiveJobs();
 assert_true('No active jobs after ending all', count($active) === 0);
+$registry = $manager->readRegistry();
+assert_true('Registry reports 0 active jobs', $registry !== null && $registry['active'] === 0);
+
+// Test: Binary log format (bytes produced by the extension's encoder:
+// one query record and one aggregation summary)
+$manager->startJob('test-bin');
+file_put_contents($testDir . '/test-bin.bin', pack('H*',
+    '014e0a2053454c454354202a2046524f4d207573657273205748455245206964203d20312a0361706932055b2231225d22026f6b41467bf2e8d0513a9c1100009042fc54d94118fc0b48015057589c03'
+    . '023f41aa000000000000000a0873656c656374203f7206474554202f7811000000000000f83f78038001008801ac0290013298019601a201080000000000020001'
+));
+$queries = $manager->getJobQueries('test-bin');
+assert_true('Binary log: one query decoded', count($queries) === 1);
+$q = isset($queries[0]) ? $queries[0] : [];
+assert_true('Binary log: text fields decoded',
+    isset($q['k'], $q['q'], $q['tag'], $q['s'])
+        && $q['k'] === 'test-bin' && $q['q'] === 'SELECT * FROM users WHERE id = 1'
+        && $q['tag'] === 'api' && $q['s'] === 'ok');
+assert_true('Binary log: params decoded as JSON', isset($q['params']) && $q['params'] === ['1']);
+assert_true('Binary log: numeric fields decoded',
+    isset($q['dur'], $q['rows'], $q['fetch'], $q['bytes'])
+        && $q['dur'] === 1532 && $q['rows'] === 1 && $q['fetch'] === 87 && $q['bytes'] === 412);
+assert_true('Binary log: ts and fp decoded',
+    isset($q['ts'], $q['fp']) && abs($q['ts'] - 1700000010.25) < 0.000001 && $q['fp'] === '9c3a51d0e8f27b46');
+$aggs = $manager->getJobAggregates('test-bin');
+assert_true('Binary log: summary decoded',
+    count($aggs) === 1 && $aggs[0]['fp'] === '00000000000000aa' && $aggs[0]['ep'] === 'GET /x'
+        && $aggs[0]['n'] === 3 && $aggs[0]['sum'] === 300 && $aggs[0]['hist'] === [0, 0, 0, 0, 0, 2, 0, 1]);
+$count = $manager->endJob('test-bin');
+assert_true('Binary log: end job counts query and summary', $count === 4);
+
+// Test: Interned traces ("stack" definitions referenced by "st")
+$manager->startJob('test-st');
+$entries = [
+    '{"type":"stack","k":"test-st","id":"00000000000000c1","trace":[{"call":"UserRepo->find","file":"/app/UserRepo.php","line":42},{"call":"UserController->show","file":"/app/UserController.php","line":17}]}',
+    '{"k":"test-st","q":"SELECT * FROM users WHERE id = 1","st":"00000000000000c1","ts":1700000020.0}',
+    '{"k":"test-st","q":"SELECT * FROM users WHERE id = 2","st":"00000000000000c1","ts":1700000021.0}',
+    '{"k":"test-st","q":"SELECT 1","st":"00000000000000ff","ts":1700000022.0}',
+];
+file_put_contents($testDir . '/test-st.jsonl', implode("\n", $entries) . "\n");
+$queries = $manager->getJobQueries('test-st');
+assert_true('Stack definitions are not returned as queries', count($queries) === 3);
+assert_true('Stack reference resolved into trace',
+    isset($queries[0]['trace'][1]['call']) && $queries[0]['trace'][1]['call'] === 'UserController->show'
+        && !isset($queries[0]['st']));
+assert_true('Unknown stack reference left as is', !isset($queries[2]['trace']) && $queries[2]['st'] === '00000000000000ff');
+$callers = $manager->getCallerSummary('test-st');
+assert_true('Caller summary counts interned traces', isset($callers['UserRepo->find() UserRepo.php:42'])
+    && $callers['UserRepo->find() UserRepo.php:42'] === 2);
+$count = $manager->endJob('test-st');
+assert_true('End job does not count stack definitions', $count === 3);
+
+// Test: Interned trace in the binary format (stack record, then a query referencing it)
+$manager->startJob('test-stbin');
+file_put_contents($testDir . '/test-stbin.bin', pack('H*',
+    '034cb10188796a5b4c3d2e1f3a405b7b2263616c6c223a22557365725265706f2d3e66696e64222c2266696c65223a222f6170702f557365725265706f2e706870222c226c696e65223a34327d5d'
+    . '01140a0853454c4543542032a90188796a5b4c3d2e1f'
+));
+$records = $manager->getJobRecords('test-stbin');
+assert_true('Binary log: stack record decoded',
+    isset($records[0]['type'], $records[0]['id']) && $records[0]['type'] === 'stack'
+        && $records[0]['id'] === '1f2e3d4c5b6a7988');
+$queries = $manager->getJobQueries('test-stbin');
+assert_true('Binary log: stack reference resolved',
+    count($queries) === 1 && isset($queries[0]['trace'][0]['line']) && $queries[0]['trace'][0]['line'] === 42);
+$manager->endJob('test-stbin');
+
+// Test: Interned statement templates ("stmt" definitions referenced by "sid"),
+// JSONL and binary streams of the same job
+$manager->startJob('test-sid');
+file_put_contents($testDir . '/test-sid.jsonl', implode("\n", [
+    '{"type":"stmt","k":"test-sid","id":"00000000000000e1","q":"SELECT * FROM users WHERE id = ?","fp":"00000000000000f1"}',
+    '{"k":"test-sid","sid":"00000000000000e1","params":["1"],"s":"ok","ts":1700000040.1,"dur":100}',
+    '{"k":"test-sid","sid":"00000000000000e1","params":["2"],"s":"ok","ts":1700000040.2,"dur":90}',
+    '{"k":"test-sid","sid":"00000000000000ee","s":"ok","ts":1700000040.3}',
+]) . "\n");
+file_put_contents($testDir . '/test-sid.bin', pack('H*',
+    '0436b101e2000000000000000a21494e5345525420494e544f206c6f677320286d7367292056414c55455320283f2941f200000000000000'
+    . '0122b901e20000000000000032065b226869225d22026f6b110000204afc54d94118d201'
+));
+$queries = $manager->getJobQueries('test-sid');
+assert_true('Statement definitions are not returned as queries', count($queries) === 4);
+assert_true('Statement reference expanded into q and fp',
+    isset($queries[0]['q'], $queries[0]['fp']) && $queries[0]['q'] === 'SELECT * FROM users WHERE id = ?'
+        && $queries[0]['fp'] === '00000000000000f1' && !isset($queries[0]['sid'])
+        && array_keys($queries[0])[1] === 'q' && $queries[1]['params'] === ['2']);
+assert_true('Unknown statement reference left as is', !isset($queries[2]['q']) && $queries[2]['sid'] === '00000000000000ee');
+assert_true('Binary log: statement reference expanded',
+    isset($queries[3]['q']) && $queries[3]['q'] === 'INSERT INTO logs (msg) VALUES (?)'
+        && $queries[3]['fp'] === '00000000000000f2' && $queries[3]['params'] === ['hi'] && $queries[3]['dur'] === 210);
+$count = $manager->endJob('test-sid');
+assert_true('End job does not count statement definitions', $count === 4);
+
+// Test: Transaction spans ("tx" summaries, statements tagged with "tx"),
+// JSONL and binary streams of the same job
+$manager->startJob('test-tx');
+file_put_contents($testDir . '/test-tx.jsonl', implode("\n", [
+    '{"k":"test-tx","q":"BEGIN","tx":"00000fa100000001","s":"ok","ts":1700000050.0,"dur":50}',
+    '{"k":"test-tx","q":"INSERT INTO orders VALUES (1)","tx":"00000fa100000001","s":"ok","ts":1700000050.01,"dur":300}',
+    '{"k":"test-tx","q":"COMMIT","tx":"00000fa100000001","s":"ok","ts":1700000050.02,"dur":900}',
+    '{"type":"tx","k":"test-tx","id":"00000fa100000001","ep":"POST /order","ts":1700000050.0,"dur":1300,"n":1,"err":0,"end":"commit"}',
+    '{"type":"tx","k":"test-tx","id":"00000fa100000009","ep":"GET /cart","ts":1700000050.3,"dur":200,"n":2,"err":0,"end":"open"}',
+]) . "\n");
+file_put_contents($testDir . '/test-tx.bin', pack('H*',
+    '01360a1a5550444154452073746f636b20534554206e203d206e202d2031c10107000000a10f000022026f6b11cdcc8c4cfc54d94118a006'
+    . '0533b10107000000a10f0000720b504f5354202f6f72646572116666864cfc54d9411888277801800100ca0108726f6c6c6261636b'
+));
+$spans = $manager->getJobTransactions('test-tx');
+assert_true('Transactions: one per span, slowest first', array_map(function ($t) { return $t['id']; }, $spans)
+    === ['00000fa100000007', '00000fa100000001', '00000fa100000009']);
+assert_true('Binary log: transaction summary decoded', $spans[0]['type'] === 'tx' && $spans[0]['end'] === 'rollback'
+    && $spans[0]['ep'] === 'POST /order' && $spans[0]['dur'] === 5000 && $spans[0]['n'] === 1 && $spans[0]['err'] === 0
+    && array_keys($spans[0]) === ['type', 'k', 'id', 'ep', 'ts', 'dur', 'n', 'err', 'end']);
+assert_true('Transaction left open by the request', $spans[2]['end'] === 'open' && $spans[2]['n'] === 2);
+$queries = $manager->getJobQueries('test-tx');
+assert_true('Transaction summaries are not returned as queries', count($queries) === 4);
+assert_true('Binary log: statement carries its span id', $queries[3]['tx'] === '00000fa100000007'
+    && array_keys($queries[3])[2] === 'tx');
+$count = $manager->endJob('test-tx');
+assert_true('End job does not count transaction summaries', $count === 4);
+
+// Test: Connection events ("conn" records) and queries attributed by "cn",
+// JSONL and binary streams of the same job
+$manager->startJob('test-conn');
+file_put_contents($testDir . '/test-conn.jsonl', implode("\n", [
+    '{"type":"conn","k":"test-conn","cn":"00000fa100000001","ev":"connect","host":"tcp://db-primary:3306","thread":41,"persistent":true,"s":"ok","ep":"GET /feed","ts":1700000060.0,"dur":9000}',
+    '{"k":"test-conn","q":"SELECT 1","cn":"00000fa100000001","s":"ok","ts":1700000060.1,"dur":200}',
+    '{"type":"conn","k":"test-conn","cn":"00000fa100000002","ev":"connect","host":"tcp://db-primary:3306","s":"err","ep":"GET /feed","ts":1700000060.2,"dur":1000}',
+    '{"type":"conn","k":"test-conn","cn":"00000fa100000001","ev":"select_db","host":"tcp://db-primary:3306","db":"app","thread":41,"persistent":true,"s":"ok","ep":"GET /feed","ts":1700000060.3,"dur":50}',
+    '{"type":"conn","k":"test-conn","cn":"00000fa100000001","ev":"close","host":"tcp://db-primary:3306","thread":41,"persistent":true,"s":"ok","ep":"GET /feed","ts":1700000060.4,"dur":10}',
+    '{"k":"test-conn","q":"SELECT 3","cn":"00000fa1000000ff","s":"ok","ts":1700000060.7,"dur":100}',
+]) . "\n");
+file_put_contents($testDir . '/test-conn.bin', pack('H*',
+    '064dd10103000000a10f0000da0107636f6e6e656374e201157463703a2f2f64622d7265706c6963613a33333036f0014df8010122026f6b'
+    . '7209474554202f66656564110000204ffc54d94118a01f01240a0853454c4543542032d10103000000a10f000022026f6b116666264ffc54d941189601'
+));
+$records = $manager->getJobRecords('test-conn');
+assert_true('Binary log: connection event decoded', $records[5]['type'] === 'conn' && $records[5]['ev'] === 'connect'
+    && $records[5]['host'] === 'tcp://db-replica:3306' && $records[5]['thread'] === 77 && $records[5]['persistent'] === true
+    && $records[5]['cn'] === '00000fa100000003' && $records[5]['dur'] === 4000
+    && array_keys($records[5]) === ['type', 'k', 'cn', 'ev', 'host', 'thread', 'persistent', 's', 'ep', 'ts', 'dur']);
+$hosts = $manager->getJobConnections('test-conn');
+assert_true('Connections: one entry per host, most connect time first',
+    array_map(function ($h) { return $h['host']; }, $hosts) === ['tcp://db-primary:3306', 'tcp://db-replica:3306', '']);
+assert_true('Connections: connects, persistent misses and failures counted',
+    $hosts[0]['connects'] === 2 && $hosts[0]['persistent'] === 1 && $hosts[0]['failed'] === 1
+        && $hosts[0]['connect_us'] === 10000 && $hosts[0]['max_us'] === 9000
+        && $hosts[0]['closes'] === 1 && $hosts[0]['select_db'] === 1);
+assert_true('Connections: queries attributed to their host by "cn"',
+    $hosts[0]['queries'] === 1 && $hosts[0]['query_us'] === 200 && $hosts[1]['queries'] === 1 && $hosts[1]['query_us'] === 150
+        && $hosts[2]['queries'] === 1 && $hosts[2]['connects'] === 0);
+$count = $manager->endJob('test-conn');
+assert_true('End job does not count connection events', $count === 3);
+
+// Test: Query budget violations ("budget" records, budget_action=log)
+$manager->startJob('test-budget');
+file_put_contents($testDir . '/test-budget.jsonl', implode("\n", [
+    '{"k":"test-budget","q":"SELECT 1","s":"ok","ts":1700000070.1,"dur":100}',
+    '{"type":"budget","k":"test-budget","limit":"queries","max":20,"n":21,"q":"SELECT 1","tag":"cart","ep":"GET /cart","ts":1700000070.2}',
+]) . "\n");
+file_put_contents($testDir . '/test-budget.bin', pack('H*',
+    '07548202077265706561747398010a780b0a2053454c454354202a2046524f4d206974656d73205748455245206964203d203f4190ef7856cd'
+    . 'ab34122a04636172747209474554202f63617274110000a051fc54d941'
+));
+$violations = $manager->getJobBudgetViolations('test-budget');
+assert_true('Budget violations in time order', array_map(function ($v) { return $v['limit']; }, $violations)
+    === ['queries', 'repeats']);
+assert_true('Binary log: budget violation decoded', $violations[1]['type'] === 'budget' && $violations[1]['max'] === 10
+    && $violations[1]['n'] === 11 && $violations[1]['fp'] === '1234abcd5678ef90' && $violations[1]['ep'] === 'GET /cart'
+    && array_keys($violations[1]) === ['type', 'k', 'limit', 'max', 'n', 'q', 'fp', 'tag', 'ep', 'ts']);
+$count = $manager->endJob('test-budget');
+assert_true('End job does not count budget violations', $count === 1);
+
+// Test: Per-request summaries ("req" records) ranked by endpoint
+$manager->startJob('test-req');
+file_put_contents($testDir . '/test-req.jsonl', implode("\n", [
+    '{"k":"test-req","q":"SELECT * FROM carts","rq":"00000fa100000001","s":"ok","ts":1700000080.1,"dur":800}',
+    '{"type":"req","k":"test-req","id":"00000fa100000001","ep":"GET /cart","method":"GET","pid":4001,"ts":1700000080.0,"dur":9000,"n":5,"err":0,"sum":3000,"max":800}',
+    '{"type":"req","k":"test-req","id":"00000fa100000003","ep":"POST /order","method":"POST","pid":4001,"ts":1700000081.0,"dur":40000,"n":3,"err":0,"sum":20000,"max":15000,"tags":["checkout"]}',
+]) . "\n");
+file_put_contents($testDir . '/test-req.bin', pack('H*',
+    '084eb10102000000a10f00007209474554202f636172748a02034745549002a11f1100002054fc54d94118a09603780c8001018801a846'
+    . '9801a01f9a02125b2263617274222c2270726963696e67225d'
+));
+$endpoints = $manager->getJobEndpoints('test-req');
+assert_true('Endpoints ranked by DB time', array_map(function ($e) { return $e['ep']; }, $endpoints)
+    === ['POST /order', 'GET /cart']);
+assert_true('Endpoint totals over its requests', $endpoints[1]['requests'] === 2 && $endpoints[1]['queries'] === 17
+    && $endpoints[1]['db_us'] === 12000 && $endpoints[1]['max_us'] === 4000 && $endpoints[1]['err'] === 1
+    && $endpoints[1]['worst_id'] === '00000fa100000002');
+$req = array_values(array_filter($manager->getJobRecords('test-req'), function ($r) {
+    return isset($r['id']) && $r['id'] === '00000fa100000002';
+}));
+assert_true('Binary log: request summary decoded', count($req) === 1 && $req[0]['type'] === 'req'
+    && $req[0]['method'] === 'GET' && $req[0]['pid'] === 4001 && $req[0]['tags'] === ['cart', 'pricing']
+    && array_keys($req[0]) === ['type', 'k', 'id', 'ep', 'method', 'pid', 'ts', 'dur', 'n', 'err', 'sum', 'max', 'tags']);
+$count = $manager->endJob('test-req');
+assert_true('End job does not count request summaries', $count === 1);
+
+// Test: Per-process shards (mariadb_profiler.shard_logs) merged by timestamp
+$manager->startJob('test-shard');
+file_put_contents($testDir . '/test-shard.shard-4101.jsonl', implode("\n", [
+    '{"k":"test-shard","q":"SELECT 1","ts":1700000030.1}',
+    '{"type":"stack","k":"test-shard","id":"00000000000000d1","trace":[{"call":"a","file":"/a.php","line":1}]}',
+    '{"k":"test-shard","q":"SELECT 3","st":"00000000000000d1","ts":1700000030.3}',
+]) . "\n");
+file_put_contents($testDir . '/test-shard.shard-987.jsonl', implode("\n", [
+    '{"k":"test-shard","q":"SELECT 2","ts":1700000030.2}',
+    '{"k":"test-shard","q":"SELECT 4","ts":1700000030.4}',
+]) . "\n");
+file_put_contents($testDir . '/test-shard.shard-4101.raw.log',
+    "[2023-11-14 22:13:50.100] [ok] SELECT 1\n[2023-11-14 22:13:50.300] [ok] SELECT 3\n  <- a() /a.php:1\n");
+file_put_contents($testDir . '/test-shard.shard-987.raw.log', "[2023-11-14 22:13:50.200] [ok] SELECT 2\n");
+assert_true('Shards listed in pid order', array_map('basename', $manager->getJobLogFiles('test-shard', '.jsonl'))
+    === ['test-shard.shard-987.jsonl', 'test-shard.shard-4101.jsonl']);
+$queries = $manager->getJobQueries('test-shard');
+assert_true('Shards merged into one timestamp-ordered stream',
+    array_map(function ($q) { return $q['q']; }, $queries) === ['SELECT 1', 'SELECT 2', 'SELECT 3', 'SELECT 4']);
+assert_true('Stack reference resolved across merge', isset($queries[2]['trace'][0]['call']) && $queries[2]['trace'][0]['call'] === 'a');
+assert_true('Raw log shards merged entry by entry', $manager->getRawLog('test-shard') ===
+    "[2023-11-14 22:13:50.100] [ok] SELECT 1\n[2023-11-14 22:13:50.200] [ok] SELECT 2\n"
+    . "[2023-11-14 22:13:50.300] [ok] SELECT 3\n  <- a() /a.php:1\n");
+$count = $manager->endJob('test-shard');
+assert_true('End job counts queries in all shards', $count === 4);
 
 // Test: Purge
 $purged = $manager->purgeCompleted();
-assert_true('Purge returns count', $purged === 2);
+assert_true('Purge returns count', $purged === 15);
+assert_true('Purge removes shards', !file_exists($testDir . '/test-shard.shard-987.jsonl')
+    && !file_exists($testDir . '/test-shard.shard-4101.raw.log'));
+assert_true('Purge removes binary log', !file_exists($testDir . '/test-bin.bin'));
 $completed = $manager->listCompletedJobs();
 assert_true('No completed jobs after purge', count($completed) === 0);
 
+// Test: A key extended with a dotted number is another job, not a shard
+assert_true('Key with shard marker rejected', $manager->startJob('v1.shard-2') === false);
+$manager->startJob('v1');
+$manager->startJob('v1.2');
+file_put_contents($testDir . '/v1.jsonl', '{"k":"v1","q":"SELECT 1","ts":1700000090.1}' . "\n");
+file_put_contents($testDir . '/v1.shard-77.jsonl', '{"k":"v1","q":"SELECT 2","ts":1700000090.2}' . "\n");
+file_put_contents($testDir . '/v1.2.jsonl', '{"k":"v1.2","q":"SELECT 3","ts":1700000090.3}' . "\n");
+file_put_contents($testDir . '/v1.2.raw.log', "[2023-11-14 22:14:50.300] [ok] SELECT 3\n");
+assert_true('Other job\'s logs not taken for shards', array_map('basename', $manager->getJobLogFiles('v1', '.jsonl'))
+    === ['v1.jsonl', 'v1.shard-77.jsonl'] && $manager->getRawLog('v1') === null);
+assert_true('End job counts only its own files', $manager->endJob('v1') === 2);
+assert_true('Purge removes only completed job', $manager->purgeCompleted() === 1
+    && !file_exists($testDir . '/v1.shard-77.jsonl'));
+assert_true('Active job\'s logs survive purge of the other', file_exists($testDir . '/v1.2.jsonl')
+    && file_exists($testDir . '/v1.2.raw.log'));
+$manager->endJob('v1.2');
+$manager->purgeCompleted();
+
 // Cleanup
 cleanup($testDir);
 
@@ -12,7 +12,7 @@ export class LiveTailManager implements vscode.Disposable {
 
   private isActive = false;
   private currentJobKey: string | null = null;
-  private jsonlOffset = 0;
+  private jsonlOffsets = new Map<string, number>();
 
   constructor(
     outputChannel: vscode.OutputChannel,
@@ -31,7 +31,7 @@ export class LiveTailManager implements vscode.Disposable {
 
     this.currentJobKey = jobKey;
     this.isActive = true;
-    this.jsonlOffset = 0;
+    this.jsonlOffsets = new Map();
 
     vscode.commands.executeCommand('setContext', 'mariadbProfiler.liveTailActive', true);
 
@@ -45,12 +45,12 @@ export class LiveTailManager implements vscode.Disposable {
     // Initial load
     this.readNewEntries(jsonlPath);
 
-    // Watch for changes
+    // Watch for changes (in the job log and its per-process shards)
     this.fileWatcher.watchFile(jsonlPath, () => {
       if (this.isActive) {
         this.readNewEntries(jsonlPath);
       }
-    });
+    }, () => this.logParser.jobLogFiles(jsonlPath));
   }
 
   stop(): void {
@@ -61,7 +61,7 @@ export class LiveTailManager implements vscode.Disposable {
 
     this.isActive = false;
     this.currentJobKey = null;
-    this.jsonlOffset = 0;
+    this.jsonlOffsets = new Map();
 
     vscode.commands.executeCommand('setContext', 'mariadbProfiler.liveTailActive', false);
   }
@@ -79,8 +79,8 @@ export class LiveTailManager implements vscode.Disposable {
   }
 
   private readNewEntries(jsonlPath: string): void {
-    const result = this.logParser.parseJsonlFileFromOffset(jsonlPath, this.jsonlOffset);
-    this.jsonlOffset = result.newOffset;
+    const result = this.logParser.parseJobLogFromOffsets(jsonlPath, this.jsonlOffsets);
+    this.jsonlOffsets = result.offsets;
 
     for (const entry of result.entries) {
       const qtype = getQueryType(entry);
@@ -1,4 +1,3 @@
-import * as fs from 'fs';
 import * as vscode from 'vscode';
 import { LogParserService } from './service/LogParserService';
 import { JobManagerService } from './service/JobManagerService';
@@ -73,7 +72,7 @@ export function activate(context: vscode.ExtensionContext): void {
 
   // --- State ---
   let selectedJobKey: string | null = null;
-  let jsonlOffset = 0;
+  let jsonlOffsets = new Map<string, number>();
   let refreshTimer: ReturnType<typeof setInterval> | undefined;
 
   // --- Helper: Refresh jobs list ---
@@ -85,7 +84,7 @@ export function activate(context: vscode.ExtensionContext): void {
   // --- Helper: Load queries for a job ---
   function loadJobQueries(jobKey: string): void {
     const jsonlPath = jobManager.getJsonlPath(jobKey);
-    const entries = logParser.parseJsonlFile(jsonlPath);
+    const { entries, offsets } = logParser.parseJobLog(jsonlPath);
 
     // Resolve frames
     for (let i = 0; i < entries.length; i++) {
@@ -96,11 +95,7 @@ export function activate(context: vscode.ExtensionContext): void {
     }
 
     queryTreeProvider.loadEntries(entries);
-    try {
-      jsonlOffset = entries.length > 0 ? fs.statSync(jsonlPath).size : 0;
-    } catch {
-      jsonlOffset = 0;
-    }
+    jsonlOffsets = offsets;
 
     // Update statistics
     const stats = statisticsService.computeStats(entries);
@@ -115,7 +110,7 @@ export function activate(context: vscode.ExtensionContext): void {
     if (!selectedJobKey) { return; }
 
     const jsonlPath = jobManager.getJsonlPath(selectedJobKey);
-    const result = logParser.parseJsonlFileFromOffset(jsonlPath, jsonlOffset);
+    const result = logParser.parseJobLogFromOffsets(jsonlPath, jsonlOffsets);
 
     if (result.entries.length > 0) {
       // Resolve frames for new entries
@@ -128,7 +123,7 @@ export function activate(context: vscode.ExtensionContext): void {
       }
 
       queryTreeProvider.appendEntries(result.entries);
-      jsonlOffset = result.newOffset;
+      jsonlOffsets = result.offsets;
 
       // Recompute statistics
       const allEntries = queryTreeProvider.getEntries();
@@ -7,19 +7,48 @@ export interface BacktraceFrame {
 }
 
 export interface RawQueryEntry {
+  /** Set on non-query records (e.g. "agg" summaries); absent on queries */
+  type?: string;
   k: string;
-  q: string;
+  /** Absent on queries that refer to a statement template ("sid") */
+  q?: string;
   ts: number;
+  dur?: number;
+  fp?: string;
+  rows?: number;
+  fetch?: number;
+  bytes?: number;
+  affected?: number;
+  insert_id?: number;
   tag?: string;
   s?: string;
   params?: (string | null)[];
   trace?: BacktraceFrame[];
+  /** Interned trace: id of an earlier "stack" record (queries only) */
+  st?: string;
+  /** Interned statement template: id of an earlier "stmt" record (queries only) */
+  sid?: string;
+  /** Stack or statement id defined by a "stack" / "stmt" record */
+  id?: string;
 }
 
 export interface QueryEntry {
   jobKey: string;
   query: string;
   timestamp: number;
+  /** Execution time in microseconds (absent in logs from older extensions) */
+  duration?: number;
+  /** Digest of the normalized statement: equal for queries of the same shape */
+  fingerprint?: string;
+  /** Rows returned by a result set */
+  rows?: number;
+  /** Time spent transferring the result set, in microseconds */
+  fetchTime?: number;
+  /** Bytes received from the server for the query and its result */
+  bytes?: number;
+  /** Rows affected by a statement without result set */
+  affectedRows?: number;
+  insertId?: number;
   tag?: string;
   status?: string;
   params?: (string | null)[];
@@ -31,8 +60,15 @@ export type QueryType = 'SELECT' | 'INSERT' | 'UPDATE' | 'DELETE' | 'OTHER';
 export function fromRaw(raw: RawQueryEntry): QueryEntry {
   return {
     jobKey: raw.k,
-    query: raw.q,
+    query: raw.q ?? '',
     timestamp: raw.ts,
+    duration: raw.dur,
+    fingerprint: raw.fp,
+    rows: raw.rows,
+    fetchTime: raw.fetch,
+    bytes: raw.bytes,
+    affectedRows: raw.affected,
+    insertId: raw.insert_id,
     tag: raw.tag,
     status: raw.s,
     params: raw.params,
@@ -3,6 +3,8 @@ import * as vscode from 'vscode';
 
 interface WatchEntry {
   callback: () => void;
+  /** Files whose combined size/mtime is watched instead of the key path */
+  files?: () => string[];
   lastSize: number;
   lastMtime: number;
 }
@@ -16,12 +18,15 @@ export class FileWatcherService implements vscode.Disposable {
     this.timer = setInterval(() => this.poll(), this.pollIntervalMs);
   }
 
-  watchFile(filePath: string, onChange: () => void): void {
-    this.watchers.set(filePath, {
-      callback: onChange,
-      lastSize: this.getFileSize(filePath),
-      lastMtime: this.getFileMtime(filePath),
-    });
+  /**
+   * Call onChange when filePath changes. With files, the set of files it
+   * returns is watched as a whole under the filePath key (e.g. a job log
+   * and its per-process shards, which may appear while watching).
+   */
+  watchFile(filePath: string, onChange: () => void, files?: () => string[]): void {
+    const entry: WatchEntry = { callback: onChange, files, lastSize: 0, lastMtime: 0 };
+    [entry.lastSize, entry.lastMtime] = this.stat(filePath, entry);
+    this.watchers.set(filePath, entry);
   }
 
   unwatchFile(filePath: string): void {
@@ -38,8 +43,7 @@ export class FileWatcherService implements vscode.Disposable {
 
   private poll(): void {
     for (const [filePath, entry] of this.watchers) {
-      const size = this.getFileSize(filePath);
-      const mtime = this.getFileMtime(filePath);
+      const [size, mtime] = this.stat(filePath, entry);
 
       if (size !== entry.lastSize || mtime !== entry.lastMtime) {
         entry.lastSize = size;
@@ -53,6 +57,19 @@ export class FileWatcherService implements vscode.Disposable {
     }
   }
 
+  private stat(filePath: string, entry: WatchEntry): [number, number] {
+    if (!entry.files) {
+      return [this.getFileSize(filePath), this.getFileMtime(filePath)];
+    }
+    let size = 0;
+    let mtime = -1;
+    for (const file of entry.files()) {
+      size += Math.max(this.getFileSize(file), 0);
+      mtime = Math.max(mtime, this.getFileMtime(file));
+    }
+    return [size, mtime];
+  }
+
   private getFileSize(filePath: string): number {
     try {
       return fs.statSync(filePath).size;
@@ -1,9 +1,14 @@
 import * as fs from 'fs';
+import * as path from 'path';
 import * as vscode from 'vscode';
-import { QueryEntry, RawQueryEntry, fromRaw } from '../model/QueryEntry';
+import { BacktraceFrame, QueryEntry, RawQueryEntry, fromRaw } from '../model/QueryEntry';
 
 export class LogParserService {
   private errorChannel: vscode.OutputChannel;
+  /** Interned traces by stack id; kept so tailed chunks can refer to earlier definitions */
+  private stacks = new Map<string, BacktraceFrame[]>();
+  /** Interned statement templates by id, kept for the same reason */
+  private statements = new Map<string, { q: string; fp?: string }>();
 
   constructor(errorChannel: vscode.OutputChannel) {
     this.errorChannel = errorChannel;
@@ -16,6 +21,58 @@ export class LogParserService {
     return this.parseJsonlContent(content);
   }
 
+  /**
+   * Files of a job log: `<key>.jsonl` and the per-process shards
+   * `<key>.shard-<pid>.jsonl` (mariadb_profiler.shard_logs), in pid order.
+   * Keys may not contain `.shard-`, so another job's files never match.
+   */
+  jobLogFiles(jsonlPath: string): string[] {
+    const dir = path.dirname(jsonlPath);
+    const base = path.basename(jsonlPath, '.jsonl');
+    const files = fs.existsSync(jsonlPath) ? [jsonlPath] : [];
+    let names: string[];
+    try {
+      names = fs.readdirSync(dir);
+    } catch {
+      return files;
+    }
+
+    const shards: { file: string; pid: number }[] = [];
+    const prefix = base + '.shard-';
+    for (const name of names) {
+      if (!name.startsWith(prefix) || !name.endsWith('.jsonl')) { continue; }
+      const pid = name.slice(prefix.length, -'.jsonl'.length);
+      if (/^\d+$/.test(pid)) {
+        shards.push({ file: path.join(dir, name), pid: Number(pid) });
+      }
+    }
+    shards.sort((a, b) => a.pid - b.pid);
+    return files.concat(shards.map(s => s.file));
+  }
+
+  /** Parse a job log and its shards into one timestamp-ordered list. */
+  parseJobLog(jsonlPath: string): { entries: QueryEntry[]; offsets: Map<string, number> } {
+    return this.parseJobLogFromOffsets(jsonlPath, new Map());
+  }
+
+  /**
+   * Read what was appended to a job log and its shards since the given
+   * offsets (missing files start at 0); new entries are merged by timestamp.
+   */
+  parseJobLogFromOffsets(
+    jsonlPath: string,
+    offsets: Map<string, number>,
+  ): { entries: QueryEntry[]; offsets: Map<string, number> } {
+    const newOffsets = new Map(offsets);
+    const streams: QueryEntry[][] = [];
+    for (const file of this.jobLogFiles(jsonlPath)) {
+      const result = this.parseJsonlFileFromOffset(file, offsets.get(file) ?? 0);
+      newOffsets.set(file, result.newOffset);
+      streams.push(result.entries);
+    }
+    return { entries: mergeByTimestamp(streams), offsets: newOffsets };
+  }
+
   parseJsonlFileFromOffset(filePath: string, offset: number): { entries: QueryEntry[]; newOffset: number } {
     let fd: number;
     try {
@@ -83,6 +140,23 @@ export class LogParserService {
 
       try {
         const raw: RawQueryEntry = JSON.parse(trimmed);
+        // Typed records (aggregation summaries, stack and statement definitions) are not queries
+        if (raw.type) {
+          if (raw.type === 'stack' && raw.id && raw.trace) {
+            this.stacks.set(raw.id, raw.trace);
+          } else if (raw.type === 'stmt' && raw.id && raw.q !== undefined) {
+            this.statements.set(raw.id, { q: raw.q, fp: raw.fp });
+          }
+          continue;
+        }
+        if (raw.st && !raw.trace) {
+          raw.trace = this.stacks.get(raw.st);
+        }
+        if (raw.sid && raw.q === undefined) {
+          const stmt = this.statements.get(raw.sid);
+          raw.q = stmt?.q;
+          raw.fp = raw.fp ?? stmt?.fp;
+        }
         entries.push(fromRaw(raw));
       } catch (e) {
         this.errorChannel.appendLine(`[LogParser] Failed to parse line: ${trimmed.substring(0, 100)}`);
@@ -92,3 +166,59 @@ export class LogParserService {
     return entries;
   }
 }
+
+/**
+ * k-way merge of entry lists (each in write order) into one list ordered
+ * by timestamp. Ties go to the earlier list.
+ */
+export function mergeByTimestamp(streams: QueryEntry[][]): QueryEntry[] {
+  const lists = streams.filter(s => s.length > 0);
+  if (lists.length <= 1) { return lists[0] ?? []; }
+
+  // Binary min-heap of [list index, position]
+  const heap: [number, number][] = [];
+  const less = (a: [number, number], b: [number, number]): boolean => {
+    const ta = lists[a[0]][a[1]].timestamp;
+    const tb = lists[b[0]][b[1]].timestamp;
+    return ta !== tb ? ta < tb : a[0] < b[0];
+  };
+  const push = (item: [number, number]): void => {
+    let i = heap.push(item) - 1;
+    while (i > 0) {
+      const parent = (i - 1) >> 1;
+      if (!less(heap[i], heap[parent])) { break; }
+      [heap[i], heap[parent]] = [heap[parent], heap[i]];
+      i = parent;
+    }
+  };
+  const pop = (): [number, number] => {
+    const top = heap[0];
+    const last = heap.pop()!;
+    if (heap.length > 0) {
+      heap[0] = last;
+      let i = 0;
+      for (;;) {
+        const l = 2 * i + 1;
+        const r = l + 1;
+        let min = i;
+        if (l < heap.length && less(heap[l], heap[min])) { min = l; }
+        if (r < heap.length && less(heap[r], heap[min])) { min = r; }
+        if (min === i) { break; }
+        [heap[i], heap[min]] = [heap[min], heap[i]];
+        i = min;
+      }
+    }
+    return top;
+  };
+
+  lists.forEach((_, i) => push([i, 0]));
+  const merged: QueryEntry[] = [];
+  while (heap.length > 0) {
+    const [list, pos] = pop();
+    merged.push(lists[list][pos]);
+    if (pos + 1 < lists[list].length) {
+      push([list, pos + 1]);
+    }
+  }
+  return merged;
+}
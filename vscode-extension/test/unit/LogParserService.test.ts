@@ -71,6 +71,51 @@ describe('LogParserService', () => {
       expect(entries).toHaveLength(2);
     });
 
+    it('should skip typed records', () => {
+      const filePath = path.join(tmpDir, 'test.jsonl');
+      const lines = [
+        '{"k":"job1","q":"SELECT 1","ts":100}',
+        '{"type":"agg","k":"job1","fp":"00000000000000aa","q":"select ?","ep":"GET /","ts":100,"n":3,"err":0}',
+      ];
+      fs.writeFileSync(filePath, lines.join('\n'));
+
+      const entries = service.parseJsonlFile(filePath);
+      expect(entries).toHaveLength(1);
+      expect(entries[0].query).toBe('SELECT 1');
+    });
+
+    it('should resolve interned traces from stack records', () => {
+      const filePath = path.join(tmpDir, 'test.jsonl');
+      const lines = [
+        '{"type":"stack","k":"job1","id":"00000000000000c1","trace":[{"call":"Repo->find","file":"/app/Repo.php","line":42}]}',
+        '{"k":"job1","q":"SELECT 1","st":"00000000000000c1","ts":100}',
+        '{"k":"job1","q":"SELECT 2","st":"00000000000000ff","ts":101}',
+      ];
+      fs.writeFileSync(filePath, lines.join('\n'));
+
+      const entries = service.parseJsonlFile(filePath);
+      expect(entries).toHaveLength(2);
+      expect(entries[0].trace).toEqual([{ call: 'Repo->find', file: '/app/Repo.php', line: 42 }]);
+      expect(entries[1].trace).toBeUndefined();
+    });
+
+    it('should expand statement templates from stmt records', () => {
+      const filePath = path.join(tmpDir, 'test.jsonl');
+      const lines = [
+        '{"type":"stmt","k":"job1","id":"00000000000000e1","q":"SELECT * FROM t WHERE id = ?","fp":"00000000000000f1"}',
+        '{"k":"job1","sid":"00000000000000e1","params":["7"],"ts":100}',
+        '{"k":"job1","sid":"00000000000000ee","ts":101}',
+      ];
+      fs.writeFileSync(filePath, lines.join('\n'));
+
+      const entries = service.parseJsonlFile(filePath);
+      expect(entries).toHaveLength(2);
+      expect(entries[0].query).toBe('SELECT * FROM t WHERE id = ?');
+      expect(entries[0].fingerprint).toBe('00000000000000f1');
+      expect(entries[0].params).toEqual(['7']);
+      expect(entries[1].query).toBe('');
+    });
+
     it('should return empty for non-existent file', () => {
       const entries = service.parseJsonlFile('/nonexistent/file.jsonl');
       expect(entries).toEqual([]);
@@ -112,6 +157,20 @@ describe('LogParserService', () => {
       expect(result2.entries[0].query).toBe('SELECT 2');
     });
 
+    it('should resolve stacks defined in an earlier chunk', () => {
+      const filePath = path.join(tmpDir, 'test.jsonl');
+      const line1 = '{"type":"stack","k":"job1","id":"00000000000000c1","trace":[{"call":"main","file":"/app/index.php","line":3}]}\n';
+      const line2 = '{"k":"job1","q":"SELECT 1","st":"00000000000000c1","ts":100}\n';
+      fs.writeFileSync(filePath, line1);
+
+      const result1 = service.parseJsonlFileFromOffset(filePath, 0);
+      expect(result1.entries).toHaveLength(0);
+
+      fs.appendFileSync(filePath, line2);
+      const result2 = service.parseJsonlFileFromOffset(filePath, result1.newOffset);
+      expect(result2.entries[0].trace?.[0].call).toBe('main');
+    });
+
     it('should return empty when no new data', () => {
       const filePath = path.join(tmpDir, 'test.jsonl');
       fs.writeFileSync(filePath, '{"k":"j","q":"SELECT 1","ts":0}\n');
@@ -161,4 +220,32 @@ describe('LogParserService', () => {
       expect(r2.content).toBe('line 2\n');
     });
   });
+
+  describe('parseJobLog', () => {
+    it('should merge per-process shards by timestamp', () => {
+      const jsonlPath = path.join(tmpDir, 'job1.jsonl');
+      fs.writeFileSync(path.join(tmpDir, 'job1.shard-4101.jsonl'),
+        '{"k":"job1","q":"SELECT 1","ts":100}\n{"k":"job1","q":"SELECT 3","ts":102}\n');
+      fs.writeFileSync(path.join(tmpDir, 'job1.shard-987.jsonl'), '{"k":"job1","q":"SELECT 2","ts":101}\n');
+      fs.writeFileSync(path.join(tmpDir, 'job10.jsonl'), '{"k":"job10","q":"SELECT 9","ts":99}\n');
+      // A separate job whose key extends this one with a dotted number
+      fs.writeFileSync(path.join(tmpDir, 'job1.2.jsonl'), '{"k":"job1.2","q":"SELECT 8","ts":98}\n');
+
+      expect(service.jobLogFiles(jsonlPath).map(f => path.basename(f)))
+        .toEqual(['job1.shard-987.jsonl', 'job1.shard-4101.jsonl']);
+      const { entries } = service.parseJobLog(jsonlPath);
+      expect(entries.map(e => e.query)).toEqual(['SELECT 1', 'SELECT 2', 'SELECT 3']);
+    });
+
+    it('should read new entries from every shard', () => {
+      const jsonlPath = path.join(tmpDir, 'job1.jsonl');
+      fs.writeFileSync(jsonlPath, '{"k":"job1","q":"SELECT 1","ts":100}\n');
+      const first = service.parseJobLog(jsonlPath);
+
+      fs.appendFileSync(jsonlPath, '{"k":"job1","q":"SELECT 3","ts":102}\n');
+      fs.writeFileSync(path.join(tmpDir, 'job1.shard-55.jsonl'), '{"k":"job1","q":"SELECT 2","ts":101}\n');
+      const next = service.parseJobLogFromOffsets(jsonlPath, first.offsets);
+      expect(next.entries.map(e => e.query)).toEqual(['SELECT 2', 'SELECT 3']);
+    });
+  });
 });
@@ -17,6 +17,7 @@ describe('fromRaw', () => {
       k: 'job1',
       q: 'SELECT * FROM users',
       ts: 1705970401.123,
+      dur: 1532,
       tag: 'api',
       s: 'ok',
       params: ['42'],
@@ -28,6 +29,7 @@ describe('fromRaw', () => {
     expect(entry.jobKey).toBe('job1');
     expect(entry.query).toBe('SELECT * FROM users');
     expect(entry.timestamp).toBe(1705970401.123);
+    expect(entry.duration).toBe(1532);
     expect(entry.tag).toBe('api');
     expect(entry.status).toBe('ok');
     expect(entry.params).toEqual(['42']);
@@ -46,6 +48,34 @@ describe('fromRaw', () => {
     expect(entry.params).toBeUndefined();
     expect(entry.trace).toBeUndefined();
   });
+
+  it('should map result set metrics', () => {
+    const raw: RawQueryEntry = {
+      k: 'j', q: 'SELECT * FROM users', ts: 0, rows: 50000, fetch: 81234, bytes: 7340032,
+    };
+    const entry = fromRaw(raw);
+
+    expect(entry.rows).toBe(50000);
+    expect(entry.fetchTime).toBe(81234);
+    expect(entry.bytes).toBe(7340032);
+    expect(entry.affectedRows).toBeUndefined();
+  });
+
+  it('should map fingerprint', () => {
+    const raw: RawQueryEntry = { k: 'j', q: 'SELECT * FROM users WHERE id = 1', ts: 0, fp: '9c3a51d0e8f27b46' };
+    const entry = fromRaw(raw);
+
+    expect(entry.fingerprint).toBe('9c3a51d0e8f27b46');
+  });
+
+  it('should map affected rows and insert id', () => {
+    const raw: RawQueryEntry = { k: 'j', q: 'INSERT INTO t VALUES (1)', ts: 0, affected: 1, insert_id: 42 };
+    const entry = fromRaw(raw);
+
+    expect(entry.affectedRows).toBe(1);
+    expect(entry.insertId).toBe(42);
+    expect(entry.rows).toBeUndefined();
+  });
 });
 
 describe('getQueryType', () => {